@@ -0,0 +1,92 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        Benchmark.h
+ * Description:  Minimal timing harness for the benchmark executable
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Benchmark {
+struct Case {
+  const char *name;
+  void (*function)(void);
+};
+
+inline std::vector<Case> &GetCases(void) {
+  static std::vector<Case> cases;
+  return cases;
+}
+
+struct Registrar {
+  Registrar(const char *name, void (*function)(void)) {
+    GetCases().push_back(Case{name, function});
+  }
+};
+
+/*
+ * Keep the compiler from dropping a computed value
+ * */
+template <typename T>
+inline void DoNotOptimize(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline void ClobberMemory(void) { asm volatile("" : : : "memory"); }
+
+/*
+ * Time iterations of the function, repeating until at least
+ * kMinimumTime has elapsed. Returns nanoseconds per iteration.
+ * */
+inline double Measure(const std::function<void(void)> &function,
+                      std::size_t iterations = 1024) {
+  using Clock = std::chrono::steady_clock;
+  static const constexpr auto kMinimumTime = std::chrono::milliseconds(200);
+  for (std::size_t i = 0; i < iterations / 16 + 1; i++) {
+    function();
+  }
+  while (true) {
+    const auto start = Clock::now();
+    for (std::size_t i = 0; i < iterations; i++) {
+      function();
+    }
+    const auto elapsed = Clock::now() - start;
+    if (elapsed >= kMinimumTime) {
+      const auto ns =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+      return static_cast<double>(ns) / static_cast<double>(iterations);
+    }
+    iterations *= 2;
+  }
+}
+
+inline void Report(const std::string &name, double ns_per_iteration,
+                   std::size_t bytes_per_iteration = 0) {
+  if (bytes_per_iteration != 0) {
+    const double mb_per_s =
+        static_cast<double>(bytes_per_iteration) * 1e3 / ns_per_iteration;
+    printf("%-48s %12.1f ns %12.1f MB/s\n", name.c_str(), ns_per_iteration,
+           mb_per_s);
+  } else {
+    printf("%-48s %12.1f ns\n", name.c_str(), ns_per_iteration);
+  }
+}
+}  //  namespace Benchmark
+
+#define BENCHMARK_CONCAT_INNER(a, b) a##b
+#define BENCHMARK_CONCAT(a, b) BENCHMARK_CONCAT_INNER(a, b)
+#define BENCHMARK_CASE(name)                                   \
+  static void name(void);                                      \
+  static const Benchmark::Registrar BENCHMARK_CONCAT(          \
+      benchmark_registrar_, name){#name, &name};               \
+  static void name(void)
@@ -0,0 +1,95 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        bench_BitFieldDataStore.cpp
+ * Description:  Packing coils a word at a time against a loop per bit
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <ArrayView/ArrayView.h>
+#include <Modbus/BitControl.h>
+#include <Modbus/DataStores/BitFieldDataStore.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "Benchmark.h"
+
+namespace {
+using Store = Modbus::BitFieldDataStore<4096>;
+
+//  What a controller without word access has to do
+void GetBitsLoop(const Store &store, const std::size_t address,
+                 const std::size_t bit_count, uint8_t *data) {
+  for (std::size_t byte = 0; byte < (bit_count + 7) / 8; byte++) {
+    data[byte] = 0;
+  }
+  for (std::size_t bit = 0; bit < bit_count; bit++) {
+    if (store.GetBit(address + bit)) {
+      data[bit / 8] = static_cast<uint8_t>(data[bit / 8] | (1u << (bit % 8)));
+    }
+  }
+}
+
+void SetBitsLoop(Store *store, const std::size_t address,
+                 const std::size_t bit_count, const uint8_t *data) {
+  for (std::size_t bit = 0; bit < bit_count; bit++) {
+    store->SetBit(address + bit, (data[bit / 8] >> (bit % 8)) & 1u);
+  }
+}
+}  // namespace
+
+BENCHMARK_CASE(BitFieldDataStore_ReadCoils) {
+  Store store;
+  for (std::size_t i = 0; i < store.size(); i++) {
+    store.SetBit(i, (i * 37) % 7 < 3);
+  }
+  std::array<uint8_t, 256> data{};
+  //  Start off a word boundary so every word is put together from two
+  const std::size_t address = 13;
+  for (std::size_t bit_count :
+       {std::size_t{16}, std::size_t{128}, std::size_t{2000}}) {
+    const std::string size = std::to_string(bit_count) + " coils ";
+    const std::size_t bytes = Modbus::BitCommand::GetByteCount(bit_count);
+    const double loop = Benchmark::Measure([&]() {
+      GetBitsLoop(store, address, bit_count, data.data());
+      Benchmark::ClobberMemory();
+    });
+    Benchmark::Report(size + "get, bit loop", loop, bytes);
+    const double words = Benchmark::Measure([&]() {
+      ArrayView<uint8_t> view{data.size(), data.data()};
+      store.GetBits(address, bit_count, &view);
+      Benchmark::ClobberMemory();
+    });
+    Benchmark::Report(size + "get, words", words, bytes);
+  }
+}
+
+BENCHMARK_CASE(BitFieldDataStore_WriteCoils) {
+  Store store;
+  std::array<uint8_t, 256> data{};
+  for (std::size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<uint8_t>(i * 131 + 7);
+  }
+  const std::size_t address = 13;
+  for (std::size_t bit_count :
+       {std::size_t{16}, std::size_t{128}, std::size_t{1968}}) {
+    const std::string size = std::to_string(bit_count) + " coils ";
+    const std::size_t bytes = Modbus::BitCommand::GetByteCount(bit_count);
+    const double loop = Benchmark::Measure([&]() {
+      SetBitsLoop(&store, address, bit_count, data.data());
+      Benchmark::ClobberMemory();
+    });
+    Benchmark::Report(size + "set, bit loop", loop, bytes);
+    const double words = Benchmark::Measure([&]() {
+      store.SetBits(address, bit_count,
+                    ArrayView<const uint8_t>{data.size(), data.data()});
+      Benchmark::ClobberMemory();
+    });
+    Benchmark::Report(size + "set, words", words, bytes);
+  }
+}
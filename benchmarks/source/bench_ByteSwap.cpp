@@ -0,0 +1,105 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        bench_ByteSwap.cpp
+ * Description:  Register byte swap backends over read and write sizes
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <ArrayView/ArrayView.h>
+#include <Modbus/ByteSwap.h>
+#include <Modbus/DataStores/RegisterDataStore.h>
+#include <Utilities/TypeConversion.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "Benchmark.h"
+
+namespace {
+const char *GetBackendName(const Modbus::ByteSwapBackend backend) {
+  switch (backend) {
+    case Modbus::ByteSwapBackend::kScalar:
+      return "scalar";
+    case Modbus::ByteSwapBackend::kSsse3:
+      return "ssse3";
+    case Modbus::ByteSwapBackend::kAvx2:
+      return "avx2";
+    case Modbus::ByteSwapBackend::kNeon:
+      return "neon";
+    default:
+      break;
+  }
+  return "unknown";
+}
+
+static const constexpr std::size_t kMaxRegisters = 125;
+}  // namespace
+
+BENCHMARK_CASE(ByteSwap_Backends) {
+  std::array<uint16_t, kMaxRegisters> registers{};
+  for (std::size_t i = 0; i < registers.size(); i++) {
+    registers[i] = static_cast<uint16_t>(i * 131 + 7);
+  }
+  std::array<uint8_t, kMaxRegisters * sizeof(uint16_t)> bytes{};
+  printf("Startup backend: %s\n",
+         GetBackendName(Modbus::GetByteSwapBackend()));
+  for (std::size_t count : {1, 8, 16, 64, 123, 125}) {
+    const std::string size = std::to_string(count) + " registers ";
+    //  The per byte loop the store used before
+    ArrayView<uint8_t> view{bytes.size(), bytes.data()};
+    const double reference = Benchmark::Measure([&]() {
+      for (std::size_t i = 0; i < count; i++) {
+        view[2 * i] = Utilities::GetByte(registers[i], 1);
+        view[2 * i + 1] = Utilities::GetByte(registers[i], 0);
+      }
+      Benchmark::ClobberMemory();
+    });
+    Benchmark::Report(size + "GetByte loop", reference, 2 * count);
+
+    for (auto backend :
+         {Modbus::ByteSwapBackend::kScalar, Modbus::ByteSwapBackend::kSsse3,
+          Modbus::ByteSwapBackend::kAvx2, Modbus::ByteSwapBackend::kNeon}) {
+      if (!Modbus::ByteSwapBackendAvailable(backend)) {
+        continue;
+      }
+      const auto to_bytes = Modbus::GetRegistersToBytesFunction(backend);
+      const double read = Benchmark::Measure([&]() {
+        to_bytes(registers.data(), bytes.data(), count);
+        Benchmark::ClobberMemory();
+      });
+      Benchmark::Report(size + "read " + GetBackendName(backend), read,
+                        2 * count);
+      const auto to_registers = Modbus::GetBytesToRegistersFunction(backend);
+      const double write = Benchmark::Measure([&]() {
+        to_registers(bytes.data(), registers.data(), count);
+        Benchmark::ClobberMemory();
+      });
+      Benchmark::Report(size + "write " + GetBackendName(backend), write,
+                        2 * count);
+    }
+  }
+}
+
+//  Function 3 and 16 sized copies through the store
+BENCHMARK_CASE(ByteSwap_RegisterDataStore) {
+  std::array<uint16_t, kMaxRegisters> registers{};
+  Modbus::RegisterDataStore store{registers.data(), registers.size()};
+  std::array<uint8_t, kMaxRegisters * sizeof(uint16_t)> bytes{};
+  ArrayView<uint8_t> view{bytes.size(), bytes.data()};
+  const double read = Benchmark::Measure([&]() {
+    store.GetRegisters(0, kMaxRegisters, &view);
+    Benchmark::ClobberMemory();
+  });
+  Benchmark::Report("GetRegisters 125", read, bytes.size());
+  const ArrayView<const uint8_t> input{bytes.size(), bytes.data()};
+  const double write = Benchmark::Measure([&]() {
+    store.SetRegisters(0, kMaxRegisters, input);
+    Benchmark::ClobberMemory();
+  });
+  Benchmark::Report("SetRegisters 125", write, bytes.size());
+}
@@ -0,0 +1,68 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        bench_Crc.cpp
+ * Description:  CRC16 backends over Modbus frame sizes
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <Modbus/Crc.h>
+#include <Utilities/Crc.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "Benchmark.h"
+
+namespace {
+const char *GetBackendName(const Modbus::Crc16Backend backend) {
+  switch (backend) {
+    case Modbus::Crc16Backend::kBitwise:
+      return "bitwise";
+    case Modbus::Crc16Backend::kTable:
+      return "table";
+    case Modbus::Crc16Backend::kSliceBy8:
+      return "slice-by-8";
+    case Modbus::Crc16Backend::kClmul:
+      return "pclmul";
+    default:
+      break;
+  }
+  return "unknown";
+}
+}  // namespace
+
+BENCHMARK_CASE(Crc16_Backends) {
+  std::array<uint8_t, 256> data{};
+  for (std::size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<uint8_t>(i * 131 + 7);
+  }
+  printf("Startup backend: %s\n", GetBackendName(Modbus::GetCrc16Backend()));
+  for (std::size_t length : {8, 16, 32, 64, 128, 256}) {
+    const std::string size = std::to_string(length) + " bytes ";
+    const double reference = Benchmark::Measure([&]() {
+      Benchmark::DoNotOptimize(Utilities::crc16(data.data(), length));
+      Benchmark::ClobberMemory();
+    });
+    Benchmark::Report(size + "Utilities::crc16", reference, length);
+
+    for (auto backend :
+         {Modbus::Crc16Backend::kBitwise, Modbus::Crc16Backend::kTable,
+          Modbus::Crc16Backend::kSliceBy8, Modbus::Crc16Backend::kClmul}) {
+      if (!Modbus::Crc16BackendAvailable(backend)) {
+        continue;
+      }
+      const auto update = Modbus::GetCrc16Function(backend);
+      const double ns = Benchmark::Measure([&]() {
+        Benchmark::DoNotOptimize(
+            update(Modbus::kCrc16Initial, data.data(), length));
+        Benchmark::ClobberMemory();
+      });
+      Benchmark::Report(size + GetBackendName(backend), ns, length);
+    }
+  }
+}
@@ -0,0 +1,84 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        bench_NotifyingRegisterDataStore.cpp
+ * Description:  Write turnaround against the number of subscriptions
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <ArrayView/ArrayView.h>
+#include <Modbus/DataStores/NotifyingRegisterDataStore.h>
+#include <Modbus/DataStores/RegisterDataStore.h>
+#include <Modbus/Modbus.h>
+#include <Modbus/ModbusRtu/ModbusRtuSlave.h>
+#include <Modbus/RegisterControl.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "Benchmark.h"
+#include "Crc.h"
+
+namespace {
+static const constexpr uint8_t kSlaveAddress = 0x0f;
+static const constexpr std::size_t kRegisterCount = 8192;
+using Store = Modbus::NotifyingRegisterDataStore<64>;
+
+/*
+ * Function 16 of 16 registers at address 0 through RunCommand, the part of
+ * the turnaround the write callbacks add to. after runs in each iteration.
+ * */
+template <typename TStore, typename TFunction>
+double TimeWrite(TStore *store, TFunction &&after) {
+  using Controller = Modbus::HoldingRegisterController<TStore>;
+  Controller controller{store};
+  Modbus::ProtocolRtuSlave<Controller> slave{&crc16, kSlaveAddress,
+                                             controller};
+  std::array<uint8_t, 256> frame_data{};
+  Modbus::Frame frame{kSlaveAddress, Modbus::Function::kNone, 0,
+                      ArrayView<uint8_t>{frame_data.size(), frame_data.data()}};
+  const std::array<uint16_t, 16> values{};
+  Modbus::WriteMultipleHoldingRegistersCommand::FillFrame(
+      0, values.size(), ArrayView<const uint16_t>{values.size(), values.data()},
+      &frame);
+  return Benchmark::Measure([&]() {
+    Benchmark::DoNotOptimize(slave.RunCommand(frame));
+    after();
+    Benchmark::ClobberMemory();
+  });
+}
+}  // namespace
+
+BENCHMARK_CASE(NotifyingRegisterDataStore_Write) {
+  std::array<uint16_t, kRegisterCount> registers{};
+  Modbus::RegisterDataStore plain{registers.data(), registers.size()};
+  Benchmark::Report("RegisterDataStore", TimeWrite(&plain, [] {}));
+
+  for (std::size_t subscriptions : {0, 1, 16, 64}) {
+    //  Ranges elsewhere in the map, skipped through the page masks
+    Store store{registers.data(), registers.size()};
+    for (std::size_t i = 0; i < subscriptions; i++) {
+      store.Subscribe(1024 + i * 100, 50);
+    }
+    Benchmark::Report(
+        std::to_string(subscriptions) + " subscriptions elsewhere",
+        TimeWrite(&store, [] {}));
+  }
+
+  //  One subscriber on the written range, drained before the queue fills so
+  //  each write is queued rather than counted as an overflow
+  Store store{registers.data(), registers.size()};
+  const int id = store.Subscribe(0, 16);
+  std::size_t writes = 0;
+  Benchmark::Report("1 subscription on the range",
+                    TimeWrite(&store, [&] {
+                      if (++writes == 32) {
+                        store.TakeWrites(id, [](std::size_t, std::size_t) {});
+                        writes = 0;
+                      }
+                    }));
+}
@@ -0,0 +1,177 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        bench_PollScheduler.cpp
+ * Description:  Bus time of polling every field of the tests/modbus_map.csv
+ *               layout one read per field against coalesced reads
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <ArrayView/ArrayView.h>
+#include <Modbus/MappedRegisterDataStore.h>
+#include <Modbus/Modbus.h>
+#include <Modbus/ModbusRtu/ModbusRtuMaster.h>
+#include <Modbus/ModbusRtu/ModbusRtuSlave.h>
+#include <Modbus/ModbusRtu/PollScheduler.h>
+#include <Modbus/RegisterControl.h>
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "Benchmark.h"
+#include "Crc.h"
+#include "TestHoldingRegisterMappedDataStore.h"
+#include "TestInputRegisterMappedDataStore.h"
+
+namespace {
+using HoldingWrapper = ModbusBasic_holding_register::Wrapper;
+using InputWrapper = ModbusBasic_input_register::Wrapper;
+using HoldingStore = Modbus::MappedRegisterDataStore<HoldingWrapper>;
+using InputStore = Modbus::MappedRegisterDataStore<InputWrapper>;
+using HoldingController = Modbus::HoldingRegisterController<HoldingStore>;
+using InputController = Modbus::InputRegisterController<InputStore>;
+using Slave = Modbus::ProtocolRtuSlave<HoldingController, InputController>;
+
+struct BenchSlave : public Slave {
+  using Slave::Slave;
+  void ProcessBytes(const ArrayView<const uint8_t> &data) {
+    slave_.ProcessBytes(data);
+  }
+};
+
+static const constexpr uint8_t kSlaveAddress = 0x05;
+static const constexpr std::size_t kBitsPerCharacter = 11;
+static const constexpr std::size_t kReadRequestLength = 8;
+static const constexpr std::size_t kReadResponseOverhead = 5;
+
+/*
+ * Request and response on the wire plus the t3.5 gap after each
+ * */
+double TransactionTime_us(const std::size_t register_count, const int baud) {
+  const double character_us = 1e6 * kBitsPerCharacter / baud;
+  const double frame_delay_us = baud > 19200 ? 1750.0 : 3.5 * character_us;
+  const std::size_t characters = kReadRequestLength + kReadResponseOverhead +
+                                 register_count * sizeof(uint16_t);
+  return static_cast<double>(characters) * character_us + 2 * frame_delay_us;
+}
+
+struct PollBench {
+  ModbusBasic_holding_register::holding_register slave_holding_data{};
+  HoldingWrapper slave_holding_map{&slave_holding_data};
+  HoldingStore slave_holding_store{&slave_holding_map};
+  HoldingController holding{&slave_holding_store};
+  ModbusBasic_input_register::input_register slave_input_data{};
+  InputWrapper slave_input_map{&slave_input_data};
+  InputStore slave_input_store{&slave_input_map};
+  InputController input{&slave_input_store};
+  BenchSlave slave{&crc16, kSlaveAddress, holding, input};
+
+  ModbusBasic_holding_register::holding_register holding_data{};
+  HoldingWrapper holding_map{&holding_data};
+  HoldingStore holding_store{&holding_map};
+  ModbusBasic_input_register::input_register input_data{};
+  InputWrapper input_map{&input_data};
+  InputStore input_store{&input_map};
+
+  Modbus::ProtocolRtuMaster master{&crc16, Modbus::MasterTiming{0, 1000, 0}};
+  Modbus::PollScheduler<HoldingStore, 32> holding_scheduler;
+  Modbus::PollScheduler<InputStore, 32> input_scheduler;
+  uint32_t now_us = 0;
+
+  template <typename TWrapper, typename TScheduler, typename TStore>
+  static void AddFields(const Modbus::AddressSpace space,
+                        TScheduler *scheduler, TStore *store) {
+    for (std::size_t i = 0; i < TWrapper::offsets_.size(); i++) {
+      const std::size_t address = TWrapper::offsets_[i];
+      const std::size_t count = TWrapper::end_points_[i] - address + 1;
+      scheduler->AddRange(
+          Modbus::PollRange{kSlaveAddress, space,
+                            static_cast<uint16_t>(address),
+                            static_cast<uint16_t>(count), 1000},
+          store);
+    }
+  }
+
+  explicit PollBench(const uint16_t gap_threshold)
+      : holding_scheduler{{gap_threshold, 125}},
+        input_scheduler{{gap_threshold, 125}} {
+    AddFields<HoldingWrapper>(Modbus::AddressSpace::kHoldingRegister,
+                              &holding_scheduler, &holding_store);
+    AddFields<InputWrapper>(Modbus::AddressSpace::kInputRegister,
+                            &input_scheduler, &input_store);
+  }
+
+  void Transact(void) {
+    const auto tx = master.GetTxData();
+    master.RequestSent(now_us);
+    slave.Reset();
+    slave.ProcessBytes(tx);
+    slave.ProcessMessage();
+    const auto &response = slave.GetResponse();
+    master.ProcessBytes(
+        ArrayView<const uint8_t>{response.GetLength(), response.data()},
+        now_us);
+  }
+
+  /*
+   * One full poll of every field, returns the bus time for the baud rate
+   * */
+  double Cycle(const int baud) {
+    double bus_us = 0;
+    now_us += 1000;
+    while (true) {
+      if (holding_scheduler.Run(&master, now_us) ||
+          input_scheduler.Run(&master, now_us)) {
+        bus_us += TransactionTime_us(
+            Modbus::ReadMultipleRegistersCommandBase::ReadRegisterCount(
+                master.GetRequest().data_array),
+            baud);
+        Transact();
+      } else if (!master.IsBusy()) {
+        break;
+      }
+    }
+    return bus_us;
+  }
+};
+
+template <typename TWrapper>
+double FieldByFieldTime_us(const int baud) {
+  double bus_us = 0;
+  for (std::size_t i = 0; i < TWrapper::offsets_.size(); i++) {
+    bus_us += TransactionTime_us(
+        TWrapper::end_points_[i] - TWrapper::offsets_[i] + 1, baud);
+  }
+  return bus_us;
+}
+}  // namespace
+
+BENCHMARK_CASE(PollScheduler_BusTime) {
+  const std::size_t fields =
+      HoldingWrapper::offsets_.size() + InputWrapper::offsets_.size();
+  for (const int baud : {9600, 19200, 115200}) {
+    const double field_by_field = FieldByFieldTime_us<HoldingWrapper>(baud) +
+                                  FieldByFieldTime_us<InputWrapper>(baud);
+    PollBench bench{8};
+    const double coalesced = bench.Cycle(baud);
+    const auto &holding = bench.holding_scheduler.GetStatistics();
+    const auto &input = bench.input_scheduler.GetStatistics();
+    printf("%6d baud  %2zu reads %8.1f ms  ->  %2zu reads %8.1f ms  "
+           "saved %4.1f%%\n",
+           baud, fields, field_by_field / 1e3,
+           holding.requests + input.requests, coalesced / 1e3,
+           100.0 * (field_by_field - coalesced) / field_by_field);
+  }
+
+  PollBench bench{8};
+  const double ns = Benchmark::Measure([&]() {
+    Benchmark::DoNotOptimize(bench.Cycle(19200));
+    Benchmark::ClobberMemory();
+  });
+  Benchmark::Report("Scheduler cycle, 36 fields, master and slave", ns);
+}
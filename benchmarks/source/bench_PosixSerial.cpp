@@ -0,0 +1,128 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        bench_PosixSerial.cpp
+ * Description:  Syscalls and time to move data through UartController,
+ *               per byte against block transfers, over a pseudo terminal
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <PosixSerial.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+
+#include "Benchmark.h"
+
+namespace {
+static const constexpr std::size_t kBlockSize = 256;
+
+struct PseudoTerminal {
+  int master = -1;
+  const char *slave_name = nullptr;
+  PseudoTerminal(void) {
+    master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (master >= 0 && grantpt(master) == 0 && unlockpt(master) == 0) {
+      slave_name = ptsname(master);
+    }
+  }
+  ~PseudoTerminal(void) {
+    if (master >= 0) {
+      close(master);
+    }
+  }
+  void Drain(void) const {
+    std::array<uint8_t, 1024> data;
+    while (read(master, data.data(), data.size()) > 0) {
+    }
+  }
+};
+
+struct Counts {
+  std::size_t syscalls = 0;
+  std::size_t bytes = 0;
+};
+
+void ReportCounts(const char *name, const double ns, const Counts &counts) {
+  Benchmark::Report(name, ns, kBlockSize);
+  printf("%-48s %12.2f syscalls per %zu bytes\n", name,
+         static_cast<double>(counts.syscalls) /
+             static_cast<double>(counts.bytes) * kBlockSize,
+         kBlockSize);
+}
+}  // namespace
+
+BENCHMARK_CASE(PosixSerial_Syscalls) {
+  PseudoTerminal pty;
+  if (pty.slave_name == nullptr) {
+    printf("No pseudo terminal available\n");
+    return;
+  }
+  UartController uart{pty.slave_name, B115200};
+  std::array<uint8_t, kBlockSize> block{};
+  for (std::size_t i = 0; i < block.size(); i++) {
+    block[i] = static_cast<uint8_t>(i);
+  }
+  std::array<uint8_t, kBlockSize> out{};
+
+  //  Receive, the master end plays the bus
+  Counts per_byte_rx{};
+  const double per_byte_rx_ns = Benchmark::Measure([&]() {
+    write(pty.master, block.data(), block.size());
+    uint8_t data = 0;
+    std::size_t received = 0;
+    while (received < block.size()) {
+      per_byte_rx.syscalls++;
+      if (uart.getByte(data) == 1) {
+        received++;
+      }
+    }
+    per_byte_rx.syscalls++;  //  The read that finds the port empty
+    per_byte_rx.bytes += received;
+  });
+  ReportCounts("rx read per byte", per_byte_rx_ns, per_byte_rx);
+
+  uart.ResetStatistics();
+  const double block_rx_ns = Benchmark::Measure([&]() {
+    write(pty.master, block.data(), block.size());
+    std::size_t received = 0;
+    while (received < block.size()) {
+      received += uart.ReadIntoRxBuff();
+    }
+    uart.read(out.data(), received);
+  });
+  ReportCounts("rx ReadIntoRxBuff", block_rx_ns,
+               Counts{uart.GetStatistics().read_calls,
+                      uart.GetStatistics().bytes_read});
+
+  //  Transmit
+  Counts per_byte_tx{};
+  const double per_byte_tx_ns = Benchmark::Measure([&]() {
+    for (const auto pt : block) {
+      uart.sendByte(pt);
+    }
+    per_byte_tx.syscalls += block.size();
+    per_byte_tx.bytes += block.size();
+    pty.Drain();
+  });
+  ReportCounts("tx write per byte", per_byte_tx_ns, per_byte_tx);
+
+  uart.ResetStatistics();
+  const double block_tx_ns = Benchmark::Measure([&]() {
+    uart.write(block.data(), block.size());
+    while (uart.TxPending()) {
+      uart.SendTxBuff();
+      pty.Drain();
+    }
+  });
+  ReportCounts("tx SendTxBuff", block_tx_ns,
+               Counts{uart.GetStatistics().write_calls,
+                      uart.GetStatistics().bytes_written});
+}
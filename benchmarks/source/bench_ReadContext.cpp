@@ -0,0 +1,97 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        bench_ReadContext.cpp
+ * Description:  Per-byte vs block ingestion of frames by ReadContext
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <ArrayView/ArrayView.h>
+#include <Modbus/Modbus.h>
+#include <Modbus/ModbusRtu/ModbusRtuProtocol.h>
+#include <Modbus/RegisterControl.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include "Benchmark.h"
+#include "Crc.h"
+
+namespace {
+struct FrameBuffer {
+  std::array<uint8_t, 256> data{};
+  std::size_t length = 0;
+};
+
+FrameBuffer MakeWriteMultipleFrame(const uint16_t register_count) {
+  std::array<uint8_t, 256> command_data{};
+  std::array<uint16_t, 125> registers{};
+  for (uint16_t i = 0; i < registers.size(); i++) {
+    registers[i] = static_cast<uint16_t>(i * 0x0101);
+  }
+  Modbus::Frame packet{
+      ArrayView<uint8_t>{command_data.size(), command_data.data()}};
+  packet.address = 0x0f;
+  Modbus::WriteMultipleHoldingRegistersCommand::FillFrame(
+      0, register_count,
+      ArrayView<const uint16_t>{register_count, registers.data()}, &packet);
+
+  FrameBuffer buffer;
+  buffer.length = Modbus::GetRequiredPacketSize(packet);
+  ArrayView<uint8_t> frame{buffer.length, buffer.data.data()};
+  Modbus::ProtocolRtu{&crc16}.Frame(packet, &frame);
+  return buffer;
+}
+
+FrameBuffer MakeReadFrame(void) {
+  std::array<uint8_t, 256> command_data{};
+  Modbus::Frame packet{
+      ArrayView<uint8_t>{command_data.size(), command_data.data()}};
+  packet.address = 0x0f;
+  Modbus::ReadMultipleHoldingRegistersCommand::FillFrame(0, 125, &packet);
+
+  FrameBuffer buffer;
+  buffer.length = Modbus::GetRequiredPacketSize(packet);
+  ArrayView<uint8_t> frame{buffer.length, buffer.data.data()};
+  Modbus::ProtocolRtu{&crc16}.Frame(packet, &frame);
+  return buffer;
+}
+
+void RunComparison(const std::string &name, const FrameBuffer &buffer) {
+  std::array<uint8_t, 256> frame_data{};
+  Modbus::Frame frame{ArrayView<uint8_t>{frame_data.size(), frame_data.data()}};
+  Modbus::ReadContext ctx;
+
+  const double bytewise = Benchmark::Measure([&]() {
+    ctx.Reset();
+    frame.data_length = 0;
+    for (std::size_t i = 0; i < buffer.length; i++) {
+      ctx.ProcessCharacter(&frame, buffer.data[i]);
+    }
+    Benchmark::DoNotOptimize(ctx.PacketReceived());
+    Benchmark::ClobberMemory();
+  });
+  Benchmark::Report(name + " ProcessCharacter", bytewise, buffer.length);
+
+  const double block = Benchmark::Measure([&]() {
+    ctx.Reset();
+    frame.data_length = 0;
+    const auto result = ctx.ProcessBytes(
+        &frame, ArrayView<const uint8_t>{buffer.length, buffer.data.data()});
+    Benchmark::DoNotOptimize(result);
+    Benchmark::ClobberMemory();
+  });
+  Benchmark::Report(name + " ProcessBytes", block, buffer.length);
+  printf("%-48s %12.2fx\n", (name + " speedup").c_str(), bytewise / block);
+}
+}  // namespace
+
+BENCHMARK_CASE(ReadContext_ProcessBytes) {
+  RunComparison("FC3 request (8 bytes)", MakeReadFrame());
+  RunComparison("FC16 16 registers", MakeWriteMultipleFrame(16));
+  RunComparison("FC16 123 registers", MakeWriteMultipleFrame(123));
+}
@@ -0,0 +1,113 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        bench_RtuSlave.cpp
+ * Description:  Whole slave transactions, request bytes in to framed
+ *               response out
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <ArrayView/ArrayView.h>
+#include <Modbus/DataStores/RegisterDataStore.h>
+#include <Modbus/Modbus.h>
+#include <Modbus/ModbusRtu/ModbusRtuSlave.h>
+#include <Modbus/RegisterControl.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "Benchmark.h"
+#include "Crc.h"
+
+namespace {
+using HoldingController =
+    Modbus::HoldingRegisterController<Modbus::RegisterDataStore>;
+using InputController =
+    Modbus::InputRegisterController<Modbus::RegisterDataStore>;
+using Slave = Modbus::ProtocolRtuSlave<HoldingController, InputController>;
+
+//  Exposes ProcessBytes which the slave keeps on its protocol member
+struct BenchSlave : public Slave {
+  using Slave::Slave;
+  void ProcessBytes(const ArrayView<const uint8_t> &data) {
+    slave_.ProcessBytes(data);
+  }
+};
+
+struct SlaveBench {
+  static const constexpr uint8_t kSlaveAddress = 0x0f;
+  std::array<uint16_t, 256> registers{};
+  Modbus::RegisterDataStore holding_map{registers.data(), registers.size()};
+  HoldingController holding{&holding_map};
+  Modbus::RegisterDataStore input_map{registers.data(), registers.size()};
+  InputController input{&input_map};
+  BenchSlave slave{&crc16, kSlaveAddress, holding, input};
+
+  std::array<uint8_t, 256> request{};
+  std::size_t request_length = 0;
+
+  explicit SlaveBench(const uint16_t register_count) {
+    std::array<uint8_t, 256> command_data{};
+    Modbus::Frame packet{
+        ArrayView<uint8_t>{command_data.size(), command_data.data()}};
+    packet.address = kSlaveAddress;
+    Modbus::ReadMultipleHoldingRegistersCommand::FillFrame(0, register_count,
+                                                           &packet);
+    request_length = Modbus::GetRequiredPacketSize(packet);
+    ArrayView<uint8_t> frame{request_length, request.data()};
+    Modbus::ProtocolRtu{&crc16}.Frame(packet, &frame);
+  }
+
+  std::size_t Transaction(void) {
+    slave.ProcessBytes(
+        ArrayView<const uint8_t>{request_length, request.data()});
+    slave.ProcessMessage();
+    const std::size_t length = slave.GetResponse().GetLength();
+    Benchmark::DoNotOptimize(slave.GetResponse().data()[length - 1]);
+    slave.Reset();
+    return length;
+  }
+};
+
+}  // namespace
+
+/*
+ * The response encoded in the slave's own buffer and copied to a transmit
+ * array, as a sender had to before SetTxBuffer, against it encoded straight
+ * into the transmit array
+ * */
+BENCHMARK_CASE(RtuSlave_Transaction) {
+  for (const uint16_t register_count : {1, 16, 125}) {
+    SlaveBench bench{register_count};
+    std::array<uint8_t, 256> tx_data{};
+    std::size_t response_length = bench.Transaction();
+    const double copied = Benchmark::Measure([&]() {
+      bench.slave.ProcessBytes(ArrayView<const uint8_t>{
+          bench.request_length, bench.request.data()});
+      bench.slave.ProcessMessage();
+      const auto &response = bench.slave.GetResponse();
+      std::memcpy(tx_data.data(), response.data(), response.GetLength());
+      Benchmark::DoNotOptimize(tx_data[response.GetLength() - 1]);
+      bench.slave.Reset();
+      Benchmark::ClobberMemory();
+    });
+    Benchmark::Report("FC3 " + std::to_string(register_count) +
+                          " registers copied to tx",
+                      copied, response_length);
+
+    bench.slave.SetTxBuffer(ArrayView<uint8_t>{tx_data.size(), tx_data.data()});
+    response_length = bench.Transaction();
+    const double tx_buffer = Benchmark::Measure([&]() {
+      Benchmark::DoNotOptimize(bench.Transaction());
+      Benchmark::ClobberMemory();
+    });
+    Benchmark::Report(
+        "FC3 " + std::to_string(register_count) + " registers tx buffer",
+        tx_buffer, response_length);
+  }
+}
@@ -0,0 +1,104 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        bench_SeqlockRegisterDataStore.cpp
+ * Description:  Function 4 reads of the seqlock store against the plain
+ *               store, alone and with an application thread writing
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <ArrayView/ArrayView.h>
+#include <Modbus/DataStores/RegisterDataStore.h>
+#include <Modbus/DataStores/SeqlockRegisterDataStore.h>
+#include <Modbus/Modbus.h>
+#include <Modbus/ModbusRtu/ModbusRtuSlave.h>
+#include <Modbus/RegisterControl.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "Benchmark.h"
+#include "Crc.h"
+
+namespace {
+static const constexpr uint8_t kSlaveAddress = 0x0f;
+static const constexpr std::size_t kRegisterCount = 1024;
+static const constexpr uint16_t kReadCount = 125;
+using Store = Modbus::SeqlockRegisterDataStore<kRegisterCount>;
+
+/*
+ * Function 4 of 125 registers at address 0 through RunCommand
+ * */
+template <typename TStore>
+double TimeRead(TStore *store) {
+  using Controller = Modbus::InputRegisterController<TStore>;
+  Controller controller{store};
+  Modbus::ProtocolRtuSlave<Controller> slave{&crc16, kSlaveAddress,
+                                             controller};
+  std::array<uint8_t, 256> frame_data{};
+  Modbus::Frame frame{kSlaveAddress, Modbus::Function::kNone, 0,
+                      ArrayView<uint8_t>{frame_data.size(), frame_data.data()}};
+  Modbus::ReadInputRegistersCommand::FillFrame(0, kReadCount, &frame);
+  return Benchmark::Measure([&]() {
+    Benchmark::DoNotOptimize(slave.RunCommand(frame));
+    Benchmark::ClobberMemory();
+  });
+}
+
+/*
+ * TimeRead while another thread publishes a 64 bit value at address as
+ * fast as it can
+ * */
+template <typename TStore, typename TWrite>
+double TimeReadWhileWriting(TStore *store, const std::size_t address,
+                            TWrite &&write) {
+  std::atomic<bool> done{false};
+  std::thread writer([&] {
+    std::array<uint16_t, 4> values{};
+    while (!done.load(std::memory_order_relaxed)) {
+      values[3]++;
+      write(store, address, values);
+    }
+  });
+  const double ns = TimeRead(store);
+  done.store(true, std::memory_order_relaxed);
+  writer.join();
+  return ns;
+}
+
+void WritePlain(Modbus::RegisterDataStore *store, const std::size_t address,
+                const std::array<uint16_t, 4> &values) {
+  for (std::size_t i = 0; i < values.size(); i++) {
+    store->SetRegister(address + i, values[i]);
+  }
+}
+
+void WriteSeqlock(Store *store, const std::size_t address,
+                  const std::array<uint16_t, 4> &values) {
+  store->Write(address, values.size(), values.data());
+}
+}  // namespace
+
+BENCHMARK_CASE(SeqlockRegisterDataStore_Read) {
+  std::array<uint16_t, kRegisterCount> registers{};
+  Modbus::RegisterDataStore plain{registers.data(), registers.size()};
+  Store store{registers.data(), registers.size()};
+  Benchmark::Report("RegisterDataStore", TimeRead(&plain));
+  Benchmark::Report("SeqlockRegisterDataStore", TimeRead(&store));
+
+  //  A writer outside the range read only shares the cache, inside it the
+  //  plain store serves torn values and the seqlock store copies again
+  Benchmark::Report("RegisterDataStore, writer elsewhere",
+                    TimeReadWhileWriting(&plain, 512, WritePlain));
+  Benchmark::Report("SeqlockRegisterDataStore, writer elsewhere",
+                    TimeReadWhileWriting(&store, 512, WriteSeqlock));
+  Benchmark::Report("RegisterDataStore, writer in range",
+                    TimeReadWhileWriting(&plain, 62, WritePlain));
+  Benchmark::Report("SeqlockRegisterDataStore, writer in range",
+                    TimeReadWhileWriting(&store, 62, WriteSeqlock));
+}
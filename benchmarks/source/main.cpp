@@ -0,0 +1,22 @@
+/*
+ * Copyright 2020 Electrooptical Innovations
+ * main.cpp
+ *
+ * Runs every registered benchmark, or those whose name contains argv[1]
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#include "Benchmark.h"
+
+int main(int argc, char* argv[]) {
+  const char* filter = argc > 1 ? argv[1] : "";
+  for (const auto& pt : Benchmark::GetCases()) {
+    if (strstr(pt.name, filter) != nullptr) {
+      printf("\n%s\n", pt.name);
+      pt.function();
+    }
+  }
+  return 0;
+}
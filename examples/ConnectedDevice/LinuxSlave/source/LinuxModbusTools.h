@@ -1,5 +1,6 @@
 #pragma once
 
+#include <Modbus/Crc.h>
 #include <Modbus/DataCommand.h>
 #include <Modbus/Modbus.h>
 #include <Modbus/RegisterControl.h>
@@ -18,7 +19,7 @@ inline int64_t GetMicroSecondsSince(const timeval &first,
 
 inline uint16_t crc16(const ArrayView<uint8_t> &array, std::size_t length) {
   assert(length <= array.size());
-  return Utilities::crc16(array.data(), length);
+  return Modbus::CalculateCrc16(array, length);
 }
 
 inline timeval GetTimeStamp(void) {
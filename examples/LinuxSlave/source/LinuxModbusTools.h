@@ -16,11 +16,6 @@ inline int64_t GetMicroSecondsSince(const timeval &first,
          (second.tv_usec - first.tv_usec);
 }
 
-inline uint16_t crc16(const ArrayView<uint8_t> &array, std::size_t length) {
-  assert(length <= array.size());
-  return Utilities::crc16(array.data(), length);
-}
-
 inline timeval GetTimeStamp(void) {
   timeval tv;
   gettimeofday(&tv, NULL);
@@ -10,68 +10,80 @@
  */
 
 #pragma once
-#include <Modbus/../../examples/posix/PosixSerial.h>
+#include <Modbus/../../examples/posix/PosixRtuPort.h>
 #include <Modbus/BitControl.h>
-#include <Modbus/DataStore.h>
+#include <Modbus/DataStores/BitFieldDataStore.h>
+#include <Modbus/DataStores/RegisterDataStore.h>
+#include <Modbus/DeviceIdentification.h>
+#include <Modbus/Diagnostics.h>
 #include <Modbus/Modbus.h>
 #include <Modbus/ModbusRtu/ModbusRtuSlave.h>
 #include <Modbus/RegisterControl.h>
 #include <Utilities/TypeConversion.h>
+#include <sys/epoll.h>
 #include <sys/time.h>
+#include <unistd.h>
 
+#include <array>
 #include <cassert>
 #include <cstdint>
 #include <vector>
 
 #include "LinuxModbusTools.h"
 
-inline const constexpr std::size_t kCoilCount = 125;
 inline const constexpr std::size_t kRegisterCount = 1024;
+inline const constexpr std::size_t kCoilCount = 2048;
 using CoilController =
     Modbus::CoilController<Modbus::BitFieldDataStore<kCoilCount>>;
-using HoldingRegisterController = Modbus::HoldingRegisterController<
-    Modbus::RegisterDataStore<kRegisterCount>>;
 using DiscreteInputController =
     Modbus::DiscreteInputController<Modbus::BitFieldDataStore<kCoilCount>>;
+using HoldingRegisterController =
+    Modbus::HoldingRegisterController<Modbus::RegisterDataStore>;
 using InputRegisterController =
-    Modbus::InputRegisterController<Modbus::RegisterDataStore<kRegisterCount>>;
+    Modbus::InputRegisterController<Modbus::RegisterDataStore>;
+using DeviceIdentificationController =
+    Modbus::DeviceIdentificationController<Modbus::DeviceIdentification<>>;
 using SlaveBase =
     Modbus::ProtocolRtuSlave<CoilController, HoldingRegisterController,
-                             DiscreteInputController, InputRegisterController>;
+                             DiscreteInputController, InputRegisterController,
+                             DeviceIdentificationController,
+                             Modbus::DiagnosticsController>;
 
-class LinuxSlave : public SlaveBase {
+class LinuxSlave : public PosixRtuPort<SlaveBase> {
  public:
-  //  Modbus::BitFieldDataStore<kCoilCount> coil_data_store;
-  CoilController coils_;
+  Modbus::BitFieldDataStore<kCoilCount> coil_data_store{};
+  CoilController coils_{&coil_data_store};
 
-  Modbus::RegisterDataStore<kRegisterCount> holding_register_data_store;
-  HoldingRegisterController hregs_{&holding_register_data_store};
+  Modbus::BitFieldDataStore<kCoilCount> discrete_input_data_store{};
+  DiscreteInputController dins_{&discrete_input_data_store};
 
-  DiscreteInputController dins_;
+  std::array<uint16_t, kRegisterCount> holding_registers_{};
+  Modbus::RegisterDataStore holding_register_data_store{
+      holding_registers_.data(), holding_registers_.size()};
+  HoldingRegisterController hregs_{&holding_register_data_store};
 
-  Modbus::RegisterDataStore<kRegisterCount> input_register_data_store;
+  std::array<uint16_t, kRegisterCount> input_registers_{};
+  Modbus::RegisterDataStore input_register_data_store{
+      input_registers_.data(), input_registers_.size()};
   InputRegisterController inregs_{&input_register_data_store};
 
+  Modbus::DeviceIdentification<> identification_{};
+  DeviceIdentificationController device_id_{&identification_};
+
+  Modbus::CommDiagnostics diagnostics_data_{};
+  Modbus::DiagnosticsController diagnostics_controller_{&diagnostics_data_};
+
   static const constexpr uint8_t kSlaveAddress = 0x03;
 
   static const constexpr int kBaudRateHz = 9600;
-  static const constexpr speed_t kBaudRate = B9600;
-  static const constexpr int kCharacterClocks = 8 + 1;
+  static const constexpr int64_t kFrameDelay_us =
+      GetFrameDelay_us(kBaudRateHz);
 
-  const char *const device_name;  // = "/tmp/ttyp0";
   timeval last_character_time_ = GetTimeStamp();
-  static const constexpr int64_t kFrameDelay_us =
-      (1e6 * (kCharacterClocks * 3.5)) / (static_cast<double>(kBaudRateHz));
-  UartController iodev_;
-  int byte_counter_ = 0;
-
-  timeval GetTimeStamp(void) {
-    timeval tv;
-    gettimeofday(&tv, NULL);
-    return tv;
-  }
+  int epoll_fd_ = -1;
+  bool watch_writable_ = false;
 
-  void ProcessPacket(void) {
+  void OnFrame(void) override {
     ProcessMessage();
 
     const auto &frame = GetFrameIn();
@@ -88,9 +100,9 @@ class LinuxSlave : public SlaveBase {
     }
 #endif
     if (GetResponseValid()) {
-      iodev_.write(GetResponse().data(), GetResponse().GetLength());
+      SendResponse();
       printf("Response: [");
-      const auto response = GetResponse();
+      const auto &response = GetResponse();
       std::size_t cnt = 0;
       for (auto pt : response) {
         cnt++;
@@ -99,6 +111,7 @@ class LinuxSlave : public SlaveBase {
       printf("]\n");
       assert(cnt == response.GetLength());
     }
+    ResponseSent();
     Reset();
   }
 
@@ -109,28 +122,103 @@ class LinuxSlave : public SlaveBase {
     return character_timeout;
   }
 
+  //  The port is watched for writable only while tx bytes are queued
+  void WatchWritable(const bool on) {
+    if (on == watch_writable_) {
+      return;
+    }
+    epoll_event event{};
+    event.events = on ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.fd = GetPortFileDescriptor();
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, event.data.fd, &event);
+    watch_writable_ = on;
+  }
+
+  void SetupReactor(void) {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = GetPortFileDescriptor();
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event.data.fd, &event);
+    event.data.fd = GetTimerFileDescriptor();
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event.data.fd, &event);
+  }
+
  public:
+  /*
+   * Event driven alternative to Run. Sleeps in epoll_wait until the port
+   * has data, can take queued tx bytes or the frame timer fires, so an idle
+   * bus costs no CPU. The timer is restarted on every received block and
+   * drops a partial frame once the line has been quiet for t3.5.
+   * */
+  void RunReactor(const int timeout_ms = -1) {
+    std::array<epoll_event, 2> events{};
+    const int count = epoll_wait(epoll_fd_, events.data(),
+                                 static_cast<int>(events.size()), timeout_ms);
+    for (int i = 0; i < count; i++) {
+      const auto &event = events[static_cast<std::size_t>(i)];
+      if (event.data.fd == GetTimerFileDescriptor()) {
+        OnTimer();
+        continue;
+      }
+      if (event.events & EPOLLOUT) {
+        OnWritable();
+      }
+      if (event.events & EPOLLIN) {
+        OnReadable();
+      }
+    }
+    WatchWritable(TxPending());
+  }
+
   void Run(void) {
-    // sleep(0.005);
     iodev_.SendTxBuff();
     iodev_.ReadIntoRxBuff();
 
     if (slave_.ctx_.PacketReceived()) {
-      //  check slave address
-      ProcessPacket();
+      OnFrame();
     }
-    if (!iodev_.rxEmpty()) {
+    if (rx_start_ == rx_end_ && !iodev_.rxEmpty()) {
       last_character_time_ = GetTimeStamp();
-      uint8_t data = 0;
-      iodev_.read(&data, 1);
-      slave_.ProcessCharacter(data);
+    }
+    if (FillChunk()) {
+      //  Bytes past the end of a frame are held until it has been handled
+      ParseChunk();
     } else if (RxCharacterTimeout(GetTimeStamp())) {
       Reset();
     }
   }
 
   explicit LinuxSlave(const char *const port)
-      : SlaveBase{&crc16, kSlaveAddress, coils_, hregs_, dins_, inregs_},
-        device_name{port},
-        iodev_{port, kBaudRate} {}
+      : PosixRtuPort<SlaveBase>{port,
+                                kBaudRateHz,
+                                &crc16,
+                                kSlaveAddress,
+                                coils_,
+                                hregs_,
+                                dins_,
+                                inregs_,
+                                device_id_,
+                                diagnostics_controller_} {
+    SetDiagnostics(&diagnostics_data_);
+    using Modbus::DeviceObjectId;
+    identification_.AddObject(DeviceObjectId::kVendorName,
+                              "Electrooptical Innovations");
+    identification_.AddObject(DeviceObjectId::kProductCode, "ModbusBasic");
+    identification_.AddObject(DeviceObjectId::kMajorMinorRevision, "1.0.1");
+    identification_.AddObject(DeviceObjectId::kProductName, "LinuxSlave");
+    identification_.Build(kSlaveAddress);
+    SetupReactor();
+  }
+
+  ~LinuxSlave(void) { close(epoll_fd_); }
+
+  //  The prebuilt identification frames carry the address, build them again
+  void SetAddress(const uint8_t slave_address) {
+    PosixRtuPort<SlaveBase>::SetAddress(slave_address);
+    identification_.Build(slave_address);
+  }
+
+  LinuxSlave(const LinuxSlave &) = delete;
+  LinuxSlave &operator=(const LinuxSlave &) = delete;
 };
@@ -9,6 +9,8 @@ int main(int argc, char* argv[]) {
     printf("Requires device port as argument, exiting\n");
     return 1;
   }
+  //  Polling loop instead of blocking on the port
+  const bool poll = argc > 3 && strcmp(argv[3], "poll") == 0;
   if (argc > 2) {
     address = atoi(argv[2]);
     printf("Address: %d\n", address);
@@ -25,8 +27,12 @@ int main(int argc, char* argv[]) {
   fflush(stdout);
   while (true) {
     loops++;
-    slave.Run();
-    sleep(0.05);
+    if (poll) {
+      slave.Run();
+      sleep(0.05);
+    } else {
+      slave.RunReactor();
+    }
 #if 0
     if (loops%(1<<10) == 0) {
       printf("[");
@@ -0,0 +1,126 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        PortWorker.h
+ * Description:  Worker thread serving a shard of the serial ports from one
+ *               epoll set
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#pragma once
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "SerialPortSlave.h"
+
+class PortWorker {
+  static const constexpr int kMaxEvents = 64;
+  static const constexpr int kStopCheck_ms = 200;
+
+  std::vector<SerialPortSlave *> ports_;
+  //  Whether each port is also watched for EPOLLOUT
+  std::vector<bool> watch_writable_;
+  const int core_;
+  int epoll_fd_ = -1;
+  std::thread thread_;
+  const std::atomic<bool> &running_;
+
+  //  Event data is the port index shifted up, the low bit marks the timer
+  void Watch(const int fd, const uint64_t data) {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = data;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+  }
+
+  //  A port is watched for writable only while it has tx bytes queued
+  void UpdateWritable(const std::size_t index) {
+    SerialPortSlave *port = ports_[index];
+    if (port->TxPending() == watch_writable_[index]) {
+      return;
+    }
+    watch_writable_[index] = port->TxPending();
+    epoll_event event{};
+    event.events = watch_writable_[index] ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.u64 = index << 1;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, port->GetPortFileDescriptor(), &event);
+  }
+
+  void Pin(void) {
+    if (core_ < 0) {
+      return;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(static_cast<std::size_t>(core_), &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+      printf("Unable to pin worker to core %d\n", core_);
+    }
+  }
+
+  void Run(void) {
+    Pin();
+    std::array<epoll_event, kMaxEvents> events{};
+    while (running_.load(std::memory_order_relaxed)) {
+      const int count =
+          epoll_wait(epoll_fd_, events.data(), kMaxEvents, kStopCheck_ms);
+      for (int i = 0; i < count; i++) {
+        const auto &event = events[static_cast<std::size_t>(i)];
+        const std::size_t index = event.data.u64 >> 1;
+        SerialPortSlave *port = ports_[index];
+        if (event.data.u64 & 1) {
+          port->OnTimer();
+          continue;
+        }
+        if (event.events & EPOLLOUT) {
+          port->OnWritable();
+        }
+        if (event.events & EPOLLIN) {
+          port->OnReadable();
+        }
+        UpdateWritable(index);
+      }
+    }
+  }
+
+ public:
+  void Add(SerialPortSlave *port) {
+    const uint64_t index = ports_.size();
+    ports_.push_back(port);
+    watch_writable_.push_back(false);
+    Watch(port->GetPortFileDescriptor(), index << 1);
+    Watch(port->GetTimerFileDescriptor(), (index << 1) | 1);
+  }
+
+  std::size_t GetPortCount(void) const { return ports_.size(); }
+
+  void Start(void) { thread_ = std::thread{&PortWorker::Run, this}; }
+  void Join(void) {
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  //  core < 0 leaves the thread unpinned
+  PortWorker(const int core, const std::atomic<bool> &running)
+      : core_{core}, epoll_fd_{epoll_create1(EPOLL_CLOEXEC)}, running_{running} {}
+  ~PortWorker(void) {
+    Join();
+    close(epoll_fd_);
+  }
+
+  PortWorker(const PortWorker &) = delete;
+  PortWorker &operator=(const PortWorker &) = delete;
+};
@@ -0,0 +1,62 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        SerialPortSlave.h
+ * Description:  One rtu slave on one serial line, driven by its owner's
+ *               epoll set
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#pragma once
+#include <Modbus/../../examples/posix/PosixRtuPort.h>
+#include <Modbus/DataStores/RegisterDataStore.h>
+#include <Modbus/Modbus.h>
+#include <Modbus/ModbusRtu/ModbusRtuSlave.h>
+#include <Modbus/RegisterControl.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+inline const constexpr std::size_t kRegisterCount = 1024;
+using HoldingRegisterController =
+    Modbus::HoldingRegisterController<Modbus::RegisterDataStore>;
+using InputRegisterController =
+    Modbus::InputRegisterController<Modbus::RegisterDataStore>;
+using SlaveBase = Modbus::ProtocolRtuSlave<HoldingRegisterController,
+                                           InputRegisterController>;
+
+class SerialPortSlave : public PosixRtuPort<SlaveBase> {
+  std::array<uint16_t, kRegisterCount> holding_registers_{};
+  Modbus::RegisterDataStore holding_register_data_store_{
+      holding_registers_.data(), holding_registers_.size()};
+  HoldingRegisterController hregs_{&holding_register_data_store_};
+
+  std::array<uint16_t, kRegisterCount> input_registers_{};
+  Modbus::RegisterDataStore input_register_data_store_{
+      input_registers_.data(), input_registers_.size()};
+  InputRegisterController inregs_{&input_register_data_store_};
+
+  std::size_t frames_ = 0;
+
+  void OnFrame(void) override {
+    frames_++;
+    PosixRtuPort<SlaveBase>::OnFrame();
+  }
+
+ public:
+  std::size_t GetFrameCount(void) const { return frames_; }
+  HoldingRegisterController &GetHoldingRegisters(void) { return hregs_; }
+  InputRegisterController &GetInputRegisters(void) { return inregs_; }
+
+  SerialPortSlave(const std::string &device_name, const uint8_t address,
+                  const int baud_rate_hz)
+      : PosixRtuPort<SlaveBase>{device_name, baud_rate_hz, &crc16, address,
+                                hregs_,      inregs_} {}
+
+  SerialPortSlave(const SerialPortSlave &) = delete;
+  SerialPortSlave &operator=(const SerialPortSlave &) = delete;
+};
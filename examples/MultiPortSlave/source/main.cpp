@@ -0,0 +1,85 @@
+/*
+ * Serves many serial lines from one process
+ *
+ *   modbus_multiport_slave <workers> <device[:address[:baud]]>...
+ *
+ * Ports are dealt round robin to the workers, worker n is pinned to core n
+ * modulo the number of cores.
+ */
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "PortWorker.h"
+#include "SerialPortSlave.h"
+
+static std::atomic<bool> running{true};
+
+static void Stop(int) { running.store(false); }
+
+struct PortSetting {
+  std::string device;
+  uint8_t address = 1;
+  int baud_rate_hz = 9600;
+};
+
+static PortSetting ParsePort(const std::string &argument) {
+  PortSetting setting{};
+  const std::size_t first = argument.find(':');
+  setting.device = argument.substr(0, first);
+  if (first != std::string::npos) {
+    const std::size_t second = argument.find(':', first + 1);
+    setting.address = static_cast<uint8_t>(
+        atoi(argument.substr(first + 1, second - first - 1).c_str()));
+    if (second != std::string::npos) {
+      setting.baud_rate_hz = atoi(argument.substr(second + 1).c_str());
+    }
+  }
+  return setting;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    printf("Usage: %s <workers> <device[:address[:baud]]>...\n", argv[0]);
+    return 1;
+  }
+  const std::size_t worker_count =
+      static_cast<std::size_t>(std::max(1, atoi(argv[1])));
+  const int cores = static_cast<int>(std::thread::hardware_concurrency());
+
+  std::vector<std::unique_ptr<SerialPortSlave>> ports;
+  for (int i = 2; i < argc; i++) {
+    const PortSetting setting = ParsePort(argv[i]);
+    ports.push_back(std::make_unique<SerialPortSlave>(
+        setting.device, setting.address, setting.baud_rate_hz));
+    printf("%s address %d at %d baud\n", setting.device.c_str(),
+           setting.address, setting.baud_rate_hz);
+  }
+
+  std::vector<std::unique_ptr<PortWorker>> workers;
+  for (std::size_t i = 0; i < worker_count; i++) {
+    const int core = cores > 0 ? static_cast<int>(i) % cores : -1;
+    workers.push_back(std::make_unique<PortWorker>(core, running));
+  }
+  for (std::size_t i = 0; i < ports.size(); i++) {
+    workers[i % workers.size()]->Add(ports[i].get());
+  }
+
+  signal(SIGINT, Stop);
+  signal(SIGTERM, Stop);
+  for (auto &worker : workers) {
+    worker->Start();
+  }
+  for (auto &worker : workers) {
+    worker->Join();
+  }
+  for (const auto &port : ports) {
+    printf("%s %zu frames\n", port->GetDeviceName().c_str(),
+           port->GetFrameCount());
+  }
+  return 0;
+}
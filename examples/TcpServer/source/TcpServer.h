@@ -0,0 +1,267 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        TcpServer.h
+ * Description:  epoll based Modbus/TCP server
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ *
+ * One thread, one epoll set. Connections come from a pool allocated at
+ * startup, each holds its own parse state and transmit buffer so serving a
+ * request does not allocate. A connection with an unsent response is not
+ * read from again until the response has gone out.
+ */
+
+#pragma once
+#include <Modbus/DataStores/RegisterDataStore.h>
+#include <Modbus/Modbus.h>
+#include <Modbus/ModbusTcp/ModbusTcpSlave.h>
+#include <Modbus/RegisterControl.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+inline const constexpr std::size_t kRegisterCount = 1024;
+using HoldingRegisterController =
+    Modbus::HoldingRegisterController<Modbus::RegisterDataStore>;
+using InputRegisterController =
+    Modbus::InputRegisterController<Modbus::RegisterDataStore>;
+using TcpSlave = Modbus::ProtocolTcpSlave<HoldingRegisterController,
+                                          InputRegisterController>;
+
+struct TcpConnection {
+  int fd = -1;
+  Modbus::TcpSlaveSession session;
+  std::array<uint8_t, 1024> rx_data{};
+  std::size_t rx_start = 0;
+  std::size_t rx_end = 0;
+  std::size_t tx_sent = 0;  //  Bytes of the current response already sent
+  bool writing = false;     //  Waiting on EPOLLOUT
+
+  void Open(const int socket) {
+    fd = socket;
+    rx_start = rx_end = tx_sent = 0;
+    writing = false;
+    session.Reset();
+  }
+};
+
+class TcpServer {
+  static const constexpr uint32_t kListenIndex = UINT32_MAX;
+  static const constexpr int kMaxEvents = 256;
+
+  std::array<uint16_t, kRegisterCount> holding_registers_{};
+  Modbus::RegisterDataStore holding_register_data_store_{
+      holding_registers_.data(), holding_registers_.size()};
+  HoldingRegisterController hregs_{&holding_register_data_store_};
+
+  std::array<uint16_t, kRegisterCount> input_registers_{};
+  Modbus::RegisterDataStore input_register_data_store_{
+      input_registers_.data(), input_registers_.size()};
+  InputRegisterController inregs_{&input_register_data_store_};
+
+  TcpSlave slave_;
+  std::vector<TcpConnection> connections_;
+  std::vector<uint32_t> free_connections_;
+  int listen_fd_ = -1;
+  int epoll_fd_ = -1;
+
+  static bool SetNonBlocking(const int fd) {
+    const int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+  }
+
+  void Watch(const int fd, const uint32_t index, const uint32_t events,
+             const int operation) {
+    epoll_event event{};
+    event.events = events;
+    event.data.u32 = index;
+    epoll_ctl(epoll_fd_, operation, fd, &event);
+  }
+
+  void Close(const uint32_t index) {
+    TcpConnection &connection = connections_[index];
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, connection.fd, nullptr);
+    close(connection.fd);
+    connection.fd = -1;
+    free_connections_.push_back(index);
+  }
+
+  void Accept(void) {
+    while (true) {
+      const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK);
+      if (fd < 0) {
+        return;  //  EAGAIN, everything pending has been accepted
+      }
+      if (free_connections_.empty()) {
+        close(fd);
+        continue;
+      }
+      const int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      const uint32_t index = free_connections_.back();
+      free_connections_.pop_back();
+      connections_[index].Open(fd);
+      Watch(fd, index, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_ADD);
+    }
+  }
+
+  /*
+   * Send what is left of the current response. Returns false if the socket
+   * is full and the rest has to wait for EPOLLOUT.
+   * */
+  bool Flush(TcpConnection *connection) {
+    const auto tx = connection->session.GetTxData();
+    while (connection->tx_sent < tx.size()) {
+      const ssize_t cnt =
+          send(connection->fd, tx.data() + connection->tx_sent,
+               tx.size() - connection->tx_sent, MSG_NOSIGNAL);
+      if (cnt > 0) {
+        connection->tx_sent += static_cast<std::size_t>(cnt);
+      } else if (cnt < 0 && errno == EINTR) {
+        continue;
+      } else {
+        return false;
+      }
+    }
+    connection->tx_sent = 0;
+    connection->session.Reset();
+    return true;
+  }
+
+  /*
+   * Run every complete request in the receive buffer. Returns false if the
+   * connection has to be closed.
+   * */
+  bool Serve(const uint32_t index) {
+    TcpConnection &connection = connections_[index];
+    while (connection.rx_start < connection.rx_end) {
+      const auto result =
+          connection.session.ProcessBytes(ArrayView<const uint8_t>{
+              connection.rx_end - connection.rx_start,
+              &connection.rx_data[connection.rx_start]});
+      connection.rx_start += result.bytes_used;
+      if (connection.session.HasError()) {
+        return false;
+      }
+      if (!result.packet_received) {
+        break;
+      }
+      slave_.ProcessMessage(&connection.session);
+      const bool sent = Flush(&connection);
+      slave_.ResponseSent();
+      if (!sent) {
+        connection.writing = true;
+        Watch(connection.fd, index, EPOLLOUT | EPOLLRDHUP, EPOLL_CTL_MOD);
+        return true;
+      }
+    }
+    connection.rx_start = connection.rx_end = 0;
+    return true;
+  }
+
+  void OnReadable(const uint32_t index) {
+    TcpConnection &connection = connections_[index];
+    const ssize_t cnt =
+        recv(connection.fd, &connection.rx_data[connection.rx_end],
+             connection.rx_data.size() - connection.rx_end, 0);
+    if (cnt == 0 || (cnt < 0 && errno != EAGAIN && errno != EINTR)) {
+      Close(index);
+      return;
+    }
+    if (cnt > 0) {
+      connection.rx_end += static_cast<std::size_t>(cnt);
+    }
+    if (!Serve(index)) {
+      Close(index);
+    }
+  }
+
+  void OnWritable(const uint32_t index) {
+    TcpConnection &connection = connections_[index];
+    if (!Flush(&connection)) {
+      return;
+    }
+    connection.writing = false;
+    Watch(connection.fd, index, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_MOD);
+    //  Requests that arrived while the response was blocked
+    if (!Serve(index)) {
+      Close(index);
+    }
+  }
+
+ public:
+  TcpServer(const uint16_t port, const std::size_t max_connections,
+            const uint8_t unit_id)
+      : slave_{unit_id, hregs_, inregs_},
+        connections_(max_connections),
+        free_connections_(max_connections) {
+    for (std::size_t i = 0; i < max_connections; i++) {
+      free_connections_[i] = static_cast<uint32_t>(max_connections - 1 - i);
+    }
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    const int one = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&address),
+             sizeof(address)) != 0 ||
+        listen(listen_fd_, SOMAXCONN) != 0) {
+      printf("Unable to listen on port %d: %s\n", port, strerror(errno));
+    }
+    epoll_fd_ = epoll_create1(0);
+    Watch(listen_fd_, kListenIndex, EPOLLIN, EPOLL_CTL_ADD);
+  }
+
+  ~TcpServer(void) {
+    for (auto &connection : connections_) {
+      if (connection.fd >= 0) {
+        close(connection.fd);
+      }
+    }
+    close(epoll_fd_);
+    close(listen_fd_);
+  }
+
+  TcpServer(const TcpServer &) = delete;
+  TcpServer &operator=(const TcpServer &) = delete;
+
+  HoldingRegisterController &GetHoldingRegisters(void) { return hregs_; }
+  InputRegisterController &GetInputRegisters(void) { return inregs_; }
+
+  void Run(const int timeout_ms = -1) {
+    std::array<epoll_event, kMaxEvents> events{};
+    const int count =
+        epoll_wait(epoll_fd_, events.data(), kMaxEvents, timeout_ms);
+    for (int i = 0; i < count; i++) {
+      const epoll_event &event = events[static_cast<std::size_t>(i)];
+      const uint32_t index = event.data.u32;
+      if (index == kListenIndex) {
+        Accept();
+      } else if (event.events & (EPOLLERR | EPOLLHUP)) {
+        Close(index);
+      } else if (connections_[index].writing) {
+        if (event.events & EPOLLOUT) {
+          OnWritable(index);
+        }
+      } else if (event.events & (EPOLLIN | EPOLLRDHUP)) {
+        OnReadable(index);
+      }
+    }
+  }
+};
@@ -0,0 +1,27 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "TcpServer.h"
+int main(int argc, char* argv[]) {
+  uint16_t port = 502;
+  std::size_t max_connections = 4096;
+  uint8_t unit_id = 1;
+  if (argc > 1) {
+    port = static_cast<uint16_t>(atoi(argv[1]));
+  }
+  if (argc > 2) {
+    max_connections = static_cast<std::size_t>(atoi(argv[2]));
+  }
+  if (argc > 3) {
+    unit_id = static_cast<uint8_t>(atoi(argv[3]));
+  }
+  printf("Port: %d, connections: %zu, unit id: %d\n", port, max_connections,
+         unit_id);
+  fflush(stdout);
+
+  TcpServer server{port, max_connections, unit_id};
+  while (true) {
+    server.Run();
+  }
+  return 0;
+}
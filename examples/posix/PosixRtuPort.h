@@ -0,0 +1,203 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        PosixRtuPort.h
+ * Description:  Rtu slave on a posix serial port, the receive, transmit and
+ *               frame timing shared by the Linux examples
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ *
+ * PosixRtuPort wraps a ProtocolRtuSlave with its UartController and frame
+ * timer. The owner waits on the port and timer descriptors in its own epoll
+ * set and calls OnReadable, OnWritable and OnTimer as they fire. Responses
+ * never block, what the port does not take is queued and goes out on
+ * OnWritable, so the owner watches for EPOLLOUT while TxPending.
+ */
+
+#pragma once
+#include <Modbus/../../examples/posix/PosixSerial.h>
+#include <Modbus/Crc.h>
+#include <Modbus/ModbusRtu/ModbusRtuSlave.h>
+#include <sys/timerfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+inline uint16_t crc16(const ArrayView<uint8_t> &array, std::size_t length) {
+  assert(length <= array.size());
+  return Modbus::CalculateCrc16(array, length);
+}
+
+/*
+ * t3.5 in microseconds. A character is 11 bits (start, 8 data, parity or a
+ * second stop bit, stop), above 19200 baud the spec fixes it at 1750 us.
+ * */
+inline constexpr int64_t GetFrameDelay_us(const int baud_rate_hz) {
+  const int64_t kCharacterBits = 11;
+  if (baud_rate_hz > 19200) {
+    return 1750;
+  }
+  return (1000000 * kCharacterBits * 7) / (2 * baud_rate_hz);
+}
+
+inline speed_t GetSpeed(const int baud_rate_hz) {
+  switch (baud_rate_hz) {
+    case 1200:
+      return B1200;
+    case 2400:
+      return B2400;
+    case 4800:
+      return B4800;
+    case 19200:
+      return B19200;
+    case 38400:
+      return B38400;
+    case 57600:
+      return B57600;
+    case 115200:
+      return B115200;
+    case 9600:
+    default:
+      return B9600;
+  }
+}
+
+/*
+ * One shot timerfd used to drop a frame once the line has been quiet for
+ * t3.5
+ * */
+class FrameTimer {
+  int fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+ public:
+  int GetFileDescriptor(void) const { return fd_; }
+
+  //  Arm the timer for delay_us from now, zero disarms it
+  void Set(const int64_t delay_us) {
+    itimerspec timer{};
+    timer.it_value.tv_sec = static_cast<time_t>(delay_us / 1000000);
+    timer.it_value.tv_nsec = static_cast<long>((delay_us % 1000000) * 1000);
+    timerfd_settime(fd_, 0, &timer, nullptr);
+  }
+
+  //  Clears the expiry, false if the timer had not fired
+  bool Acknowledge(void) {
+    uint64_t expirations = 0;
+    return read(fd_, &expirations, sizeof(expirations)) > 0;
+  }
+
+  FrameTimer(void) {}
+  ~FrameTimer(void) { close(fd_); }
+  FrameTimer(const FrameTimer &) = delete;
+  FrameTimer &operator=(const FrameTimer &) = delete;
+};
+
+template <typename TSlave>
+class PosixRtuPort : public TSlave {
+ protected:
+  const std::string device_name_;
+  const int64_t frame_delay_us_;
+  UartController iodev_;
+  FrameTimer frame_timer_{};
+  std::array<uint8_t, 256> tx_data_{};
+  std::array<uint8_t, 256> rx_chunk_{};
+  std::size_t rx_start_ = 0;
+  std::size_t rx_end_ = 0;
+
+  bool FrameInProgress(void) const {
+    return this->slave_.ctx_.GetState() != Modbus::PacketState::kAddress;
+  }
+
+  //  The response was encoded in tx_data_, send it from there
+  void SendResponse(void) {
+    if (this->GetResponseValid()) {
+      iodev_.WriteDirect(this->GetResponse().data(),
+                         this->GetResponse().GetLength());
+    }
+  }
+
+  //  Called for every complete frame, answers it and readies the next
+  virtual void OnFrame(void) {
+    this->ProcessMessage();
+    SendResponse();
+    this->ResponseSent();
+    this->Reset();
+  }
+
+  /*
+   * Take the next block from the rx ring once the last one has been parsed,
+   * false when there is nothing left
+   * */
+  bool FillChunk(void) {
+    if (rx_start_ == rx_end_) {
+      rx_start_ = 0;
+      rx_end_ = iodev_.ReadBlock(rx_chunk_.data(), rx_chunk_.size());
+    }
+    return rx_start_ < rx_end_;
+  }
+
+  //  Parse the current block up to the end of a frame
+  bool ParseChunk(void) {
+    const auto result = this->slave_.ProcessBytes(ArrayView<const uint8_t>{
+        rx_end_ - rx_start_, &rx_chunk_[rx_start_]});
+    rx_start_ += result.bytes_used;
+    return result.packet_received;
+  }
+
+ public:
+  int GetPortFileDescriptor(void) const { return iodev_.GetFileDescriptor(); }
+  int GetTimerFileDescriptor(void) const {
+    return frame_timer_.GetFileDescriptor();
+  }
+  const std::string &GetDeviceName(void) const { return device_name_; }
+  bool TxPending(void) const { return iodev_.TxPending(); }
+
+  /*
+   * Parse and answer everything the port has, then restart the frame timer
+   * if a frame is still coming in
+   * */
+  void OnReadable(void) {
+    iodev_.ReadIntoRxBuff();
+    while (FillChunk()) {
+      if (ParseChunk()) {
+        OnFrame();
+      }
+    }
+    frame_timer_.Set(FrameInProgress() ? frame_delay_us_ : 0);
+  }
+
+  //  Send what an earlier response left queued
+  void OnWritable(void) { iodev_.SendTxBuff(); }
+
+  //  The line went quiet part way through a frame, drop it
+  void OnTimer(void) {
+    if (frame_timer_.Acknowledge() && FrameInProgress()) {
+      this->Reset();
+    }
+  }
+
+  /*
+   * slave_arguments are passed on to TSlave, the handlers they refer to may
+   * be members of the derived class as only references are kept
+   * */
+  template <typename... TArgs>
+  PosixRtuPort(const std::string &device_name, const int baud_rate_hz,
+               TArgs &&... slave_arguments)
+      : TSlave{std::forward<TArgs>(slave_arguments)...},
+        device_name_{device_name},
+        frame_delay_us_{GetFrameDelay_us(baud_rate_hz)},
+        iodev_{device_name_.c_str(), GetSpeed(baud_rate_hz)} {
+    this->SetTxBuffer(ArrayView<uint8_t>{tx_data_.size(), tx_data_.data()});
+  }
+  virtual ~PosixRtuPort(void) {}
+
+  PosixRtuPort(const PosixRtuPort &) = delete;
+  PosixRtuPort &operator=(const PosixRtuPort &) = delete;
+};
@@ -18,6 +18,8 @@
 #include <termios.h>  // POSIX terminal control definitions
 #include <unistd.h>   // UNIX standard function definitions
 
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <cerrno>  // Error number definitions
 #include <cstdint>
@@ -64,37 +66,149 @@ int SetupSerial(const char *device, const speed_t baudrate = B9600) {
   return connection;
 }
 
+/*
+ * Counts of the read/write calls made on the port
+ * */
+struct UartStatistics {
+  std::size_t read_calls = 0;
+  std::size_t write_calls = 0;
+  std::size_t bytes_read = 0;
+  std::size_t bytes_written = 0;
+};
+
+/*
+ * Data moves between the port and the ring buffers in blocks, one read
+ * fills as much of the rx ring as is free and one write sends everything
+ * queued in the tx ring. The ring buffers do not expose their storage so
+ * blocks go through a staging array.
+ * */
 class UartController : public IODevice {
+  static const constexpr std::size_t kBufferSize = 1024;
   const char *const device_name_;
   const speed_t baudrate_;
   int connection_ = 0;
-  RingBuffer<uint8_t, 1024> rxbuff_;
-  RingBuffer<uint8_t, 1024> txbuff_;
+  RingBuffer<uint8_t, kBufferSize> rxbuff_;
+  RingBuffer<uint8_t, kBufferSize> txbuff_;
+  //  Bytes taken from txbuff_ that the port has not accepted yet
+  std::array<uint8_t, kBufferSize> tx_stage_{};
+  std::size_t tx_stage_start_ = 0;
+  std::size_t tx_stage_end_ = 0;
+  UartStatistics statistics_{};
+
+  ssize_t ReadPort(uint8_t *data, const std::size_t length) {
+    statistics_.read_calls++;
+    const ssize_t cnt = ::read(connection_, data, length);
+    if (cnt > 0) {
+      statistics_.bytes_read += static_cast<std::size_t>(cnt);
+    }
+    return cnt;
+  }
+
+  ssize_t WritePort(const uint8_t *data, const std::size_t length) {
+    statistics_.write_calls++;
+    const ssize_t cnt = ::write(connection_, data, length);
+    if (cnt > 0) {
+      statistics_.bytes_written += static_cast<std::size_t>(cnt);
+    }
+    return cnt;
+  }
 
  public:
   virtual void Setup(void) {
     connection_ = SetupSerial(device_name_, baudrate_);
   }
+  int GetFileDescriptor(void) const { return connection_; }
+  const UartStatistics &GetStatistics(void) const { return statistics_; }
+  void ResetStatistics(void) { statistics_ = UartStatistics{}; }
+
   void sendByte(const uint8_t data) const { ::write(connection_, &data, 1); }
   int getByte(uint8_t &data) const { return ::read(connection_, &data, 1); }
+
+  bool TxPending(void) const {
+    return tx_stage_start_ < tx_stage_end_ || !txbuff_.isEmpty();
+  }
+
+  /*
+   * Send as much of the tx ring as the port takes. Whatever is left stays
+   * staged for the next call.
+   * */
   virtual uint32_t SendTxBuff(void) {
-    int cnt = 0;
-    while (!txbuff_.isEmpty()) {
-      cnt++;
-      uint8_t data = 0;
-      txbuff_.pop(data);
-      sendByte(data);
+    uint32_t cnt = 0;
+    while (true) {
+      if (tx_stage_start_ == tx_stage_end_) {
+        const std::size_t queued =
+            std::min<std::size_t>(txbuff_.GetCount(), tx_stage_.size());
+        if (queued == 0) {
+          break;
+        }
+        txbuff_.pop(tx_stage_.data(), queued);
+        tx_stage_start_ = 0;
+        tx_stage_end_ = queued;
+      }
+      const ssize_t written = WritePort(&tx_stage_[tx_stage_start_],
+                                        tx_stage_end_ - tx_stage_start_);
+      if (written <= 0) {
+        break;  //  Port is full, try again on the next call
+      }
+      tx_stage_start_ += static_cast<std::size_t>(written);
+      cnt += static_cast<uint32_t>(written);
     }
     return cnt;
   }
 
+  /*
+   * Writes a block straight to the port without going through the tx ring.
+   * It never waits, whatever the port does not take now is queued in the tx
+   * ring behind anything already there and sent by SendTxBuff once the port
+   * is writable. Returns the bytes written now.
+   * */
+  uint32_t WriteDirect(const uint8_t *data, const std::size_t length) {
+    SendTxBuff();
+    std::size_t written = 0;
+    while (!TxPending() && written < length) {
+      const ssize_t cnt = WritePort(data + written, length - written);
+      if (cnt > 0) {
+        written += static_cast<std::size_t>(cnt);
+      } else if (cnt == 0 || errno != EINTR) {
+        break;
+      }
+    }
+    if (written < length) {
+      txbuff_.insert(data + written, length - written);
+    }
+    return static_cast<uint32_t>(written);
+  }
+
+  /*
+   * Take up to length bytes from the rx ring in one call, returns the count
+   * */
+  std::size_t ReadBlock(uint8_t *data, const std::size_t length) {
+    const std::size_t count = std::min<std::size_t>(rxbuff_.GetCount(), length);
+    rxbuff_.pop(data, count);
+    return count;
+  }
+
+  /*
+   * Read into the free space of the rx ring. A short read means the driver
+   * has nothing more so the loop stops without the extra empty read.
+   * */
   virtual uint32_t ReadIntoRxBuff(void) {
-    uint8_t data = 0;
-    int cnt = 0;
-    while (getByte(data) == 1) {
-      cnt++;
-      rxbuff_.insert(data);
-      data = 0;
+    std::array<uint8_t, kBufferSize> chunk;
+    uint32_t cnt = 0;
+    while (true) {
+      const std::size_t space = rxbuff_.size() - rxbuff_.GetCount();
+      if (space == 0) {
+        break;
+      }
+      const ssize_t received = ReadPort(chunk.data(), space);
+      if (received <= 0) {
+        break;
+      }
+      rxbuff_.insert(chunk.data(), static_cast<std::size_t>(received));
+      cnt += static_cast<uint32_t>(received);
+      if (static_cast<std::size_t>(received) < space) {
+        break;
+      }
     }
     return cnt;
   }
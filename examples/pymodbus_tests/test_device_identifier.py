@@ -24,7 +24,7 @@ crc = Crc(
 )
 
 function = 0x2B
-frame = [slave_address, function, 0x0F, 0x01, 0x00]
+frame = [slave_address, function, 0x0E, 0x01, 0x00]  # MEI 14, basic, from object 0
 
 crc_calc = crc.bit_by_bit(frame)
 frame.append(crc_calc & 0xFF)
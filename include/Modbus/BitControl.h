@@ -0,0 +1,457 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        BitControl.h
+ * Description:  Default data controller for the bit functions
+ *               (coils & discrete inputs)
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ *
+ * Target Processor: Any, Linux system
+ * ----------------------------------------------------------------------
+ */
+
+#pragma once
+#include <Modbus/DataCommand.h>
+#include <Modbus/Modbus.h>
+
+#include <algorithm>
+#include <array>
+
+namespace Modbus {
+class BitCommand : public DataCommand {
+ public:
+  static constexpr std::size_t GetByteCount(const std::size_t bit_count) {
+    return (bit_count + 7) / 8;
+  }
+};
+
+class ReadBitsCommandBase : public BitCommand {
+ public:
+  //  Most bits a single read may ask for, 250 data bytes
+  static const constexpr uint16_t kMaxBitCount = 2000;
+  struct CommandPacket {
+    static const constexpr std::size_t kBitCount =
+        DataCommand::CommandPacket::kDataAddressEnd + 1;
+    static const constexpr std::size_t kPacketSize =
+        kBitCount + sizeof(uint16_t);
+  };
+  struct ResponsePacket {
+    static const constexpr std::size_t kNumberOfBytes =
+        Command::ResponsePacket::kHeaderEnd + 1;
+    static const constexpr std::size_t kHeaderSize = kNumberOfBytes + 1;
+  };
+  static uint16_t ReadBitCount(const ArrayView<uint8_t> &data_array) {
+    return Utilities::Make_MSB_uint16_tFromU8Array(ArrayView<const uint8_t>{
+        sizeof(uint16_t), &data_array[CommandPacket::kBitCount]});
+  }
+  static uint8_t ReadResponseByteCount(const ArrayView<uint8_t> &data_array) {
+    return data_array[ResponsePacket::kNumberOfBytes];
+  }
+
+ protected:
+  static void FillResponseHeaderBase(const uint8_t slave_address,
+                                     const std::size_t bit_count,
+                                     Response *response, Function function) {
+    response->operator[](DataCommand::ResponsePacket::kSlaveAddress) =
+        slave_address;
+    response->operator[](DataCommand::ResponsePacket::kFunction) =
+        static_cast<uint8_t>(function);
+    const std::size_t number_of_data_bytes = GetByteCount(bit_count);
+    response->operator[](ResponsePacket::kNumberOfBytes) =
+        static_cast<uint8_t>(number_of_data_bytes);
+    response->SetLength(ResponsePacket::kHeaderSize + number_of_data_bytes);
+  }
+  static int32_t FillFrameBase(const uint16_t address,
+                               const uint16_t bit_count, Frame *frame,
+                               Function function) {
+    assert(frame->data_array.size() >= CommandPacket::kPacketSize);
+    frame->function = function;
+    frame->data_array[DataCommand::CommandPacket::kDataAddressStart] =
+        Utilities::GetByte(address, 1);
+    frame->data_array[DataCommand::CommandPacket::kDataAddressStart + 1] =
+        Utilities::GetByte(address, 0);
+    frame->data_array[CommandPacket::kBitCount] =
+        Utilities::GetByte(bit_count, 1);
+    frame->data_array[CommandPacket::kBitCount + 1] =
+        Utilities::GetByte(bit_count, 0);
+    frame->data_length = CommandPacket::kPacketSize;
+    return 0;
+  }
+};
+
+class ReadCoilsCommand : public ReadBitsCommandBase {
+ public:
+  static const constexpr Function kFunction = Function::kReadCoils;
+  static int32_t FillFrame(const uint16_t address, const uint16_t bit_count,
+                           Frame *frame) {
+    return FillFrameBase(address, bit_count, frame, kFunction);
+  }
+  static void FillResponseHeader(const uint8_t slave_address,
+                                 const std::size_t bit_count,
+                                 Response *response) {
+    FillResponseHeaderBase(slave_address, bit_count, response, kFunction);
+  }
+};
+
+class ReadDiscreteInputsCommand : public ReadBitsCommandBase {
+ public:
+  static const constexpr Function kFunction = Function::kReadDiscreteInputs;
+  static int32_t FillFrame(const uint16_t address, const uint16_t bit_count,
+                           Frame *frame) {
+    return FillFrameBase(address, bit_count, frame, kFunction);
+  }
+  static void FillResponseHeader(const uint8_t slave_address,
+                                 const std::size_t bit_count,
+                                 Response *response) {
+    FillResponseHeaderBase(slave_address, bit_count, response, kFunction);
+  }
+};
+
+/*
+ * Function 5, the value is 0xff00 for on and 0x0000 for off, anything else is
+ * an illegal data value. The response is an echo of the command.
+ * */
+class WriteSingleCoilCommand : public BitCommand {
+ public:
+  static const constexpr auto kFunction = Function::kWriteSingleCoil;
+  static const constexpr uint16_t kOn = 0xff00;
+  static const constexpr uint16_t kOff = 0x0000;
+  struct CommandPacket {
+    static const constexpr std::size_t kValueStart =
+        DataCommand::CommandPacket::kDataAddressEnd + 1;
+    static const constexpr std::size_t kPacketSize =
+        kValueStart + sizeof(uint16_t);
+  };
+  struct ResponsePacket {
+    static const constexpr std::size_t kDataAddress =
+        DataCommand::ResponsePacket::kHeaderEnd + 1;
+    static const constexpr std::size_t kValueStart =
+        kDataAddress + sizeof(uint16_t);
+    static const constexpr std::size_t kPacketSize =
+        kValueStart + sizeof(uint16_t);
+  };
+  static uint16_t ReadSetting(const ArrayView<uint8_t> &data_array) {
+    return Utilities::Make_MSB_uint16_tFromU8Array(ArrayView<const uint8_t>{
+        sizeof(uint16_t), &data_array[CommandPacket::kValueStart]});
+  }
+  static void FillResponseHeader(const uint8_t slave_address,
+                                 const uint16_t address, const uint16_t value,
+                                 Response *response) {
+    response->operator[](DataCommand::ResponsePacket::kSlaveAddress) =
+        slave_address;
+    response->operator[](DataCommand::ResponsePacket::kFunction) =
+        static_cast<uint8_t>(kFunction);
+    response->operator[](ResponsePacket::kDataAddress) =
+        Utilities::GetByte(address, 1);
+    response->operator[](ResponsePacket::kDataAddress + 1) =
+        Utilities::GetByte(address, 0);
+    response->operator[](ResponsePacket::kValueStart) =
+        Utilities::GetByte(value, 1);
+    response->operator[](ResponsePacket::kValueStart + 1) =
+        Utilities::GetByte(value, 0);
+    response->SetLength(ResponsePacket::kPacketSize);
+  }
+  static int32_t FillFrame(const uint16_t address, const bool value,
+                           Frame *frame) {
+    assert(frame->data_array.size() >= CommandPacket::kPacketSize);
+    const uint16_t setting = value ? kOn : kOff;
+    frame->function = kFunction;
+    frame->data_array[DataCommand::CommandPacket::kDataAddressStart] =
+        Utilities::GetByte(address, 1);
+    frame->data_array[DataCommand::CommandPacket::kDataAddressStart + 1] =
+        Utilities::GetByte(address, 0);
+    frame->data_array[CommandPacket::kValueStart] =
+        Utilities::GetByte(setting, 1);
+    frame->data_array[CommandPacket::kValueStart + 1] =
+        Utilities::GetByte(setting, 0);
+    frame->data_length = CommandPacket::kPacketSize;
+    return 0;
+  }
+};
+
+class WriteMultipleCoilsCommand : public BitCommand {
+ public:
+  static const constexpr auto kFunction = Function::kWriteMultipleCoils;
+  //  Most bits a single write may carry, 246 data bytes
+  static const constexpr uint16_t kMaxBitCount = 1968;
+  struct CommandPacket {
+    static const constexpr std::size_t kBitCount =
+        DataCommand::CommandPacket::kDataAddressEnd + 1;
+    static const constexpr std::size_t kNumberOfDataBytes =
+        kBitCount + sizeof(uint16_t);
+    static const constexpr std::size_t kValueStart = kNumberOfDataBytes + 1;
+    static const constexpr std::size_t kHeaderSize = kValueStart;
+  };
+  struct ResponsePacket {
+    static const constexpr std::size_t kDataAddress =
+        DataCommand::ResponsePacket::kHeaderEnd + 1;
+    static const constexpr std::size_t kBitCount =
+        kDataAddress + sizeof(uint16_t);
+    static const constexpr std::size_t kPacketSize =
+        kBitCount + sizeof(uint16_t);
+  };
+  static uint16_t ReadBitCount(const ArrayView<uint8_t> &data_array) {
+    return Utilities::Make_MSB_uint16_tFromU8Array(ArrayView<const uint8_t>{
+        sizeof(uint16_t), &data_array[CommandPacket::kBitCount]});
+  }
+  static std::size_t ReadDataByteCount(const ArrayView<uint8_t> &data_array) {
+    return data_array[CommandPacket::kNumberOfDataBytes];
+  }
+  static void FillResponseHeader(const uint8_t slave_address,
+                                 const uint16_t address,
+                                 const uint16_t bit_count, Response *response) {
+    response->operator[](DataCommand::ResponsePacket::kSlaveAddress) =
+        slave_address;
+    response->operator[](DataCommand::ResponsePacket::kFunction) =
+        static_cast<uint8_t>(kFunction);
+    response->operator[](ResponsePacket::kDataAddress) =
+        Utilities::GetByte(address, 1);
+    response->operator[](ResponsePacket::kDataAddress + 1) =
+        Utilities::GetByte(address, 0);
+    response->operator[](ResponsePacket::kBitCount) =
+        Utilities::GetByte(bit_count, 1);
+    response->operator[](ResponsePacket::kBitCount + 1) =
+        Utilities::GetByte(bit_count, 0);
+    response->SetLength(ResponsePacket::kPacketSize);
+  }
+  /*
+   * data holds the bits packed in Modbus order, GetByteCount(bit_count) bytes
+   * */
+  static int32_t FillFrame(const uint16_t address, const uint16_t bit_count,
+                           const ArrayView<const uint8_t> &data,
+                           Frame *frame) {
+    const std::size_t number_of_data_bytes = GetByteCount(bit_count);
+    const std::size_t frame_size =
+        CommandPacket::kHeaderSize + number_of_data_bytes;
+    assert(frame->data_array.size() >= frame_size);
+    assert(data.size() >= number_of_data_bytes);
+
+    frame->function = kFunction;
+    frame->data_array[DataCommand::CommandPacket::kDataAddressStart] =
+        Utilities::GetByte(address, 1);
+    frame->data_array[DataCommand::CommandPacket::kDataAddressStart + 1] =
+        Utilities::GetByte(address, 0);
+    frame->data_array[CommandPacket::kBitCount] =
+        Utilities::GetByte(bit_count, 1);
+    frame->data_array[CommandPacket::kBitCount + 1] =
+        Utilities::GetByte(bit_count, 0);
+    frame->data_array[CommandPacket::kNumberOfDataBytes] =
+        static_cast<uint8_t>(number_of_data_bytes);
+    std::copy(data.begin(), data.begin() + number_of_data_bytes,
+              &frame->data_array[CommandPacket::kValueStart]);
+    frame->data_length = frame_size;
+    return 0;
+  }
+};
+
+static_assert(GetFunctionDescriptor(Function::kReadCoils).meta_length ==
+              ReadBitsCommandBase::CommandPacket::kPacketSize);
+static_assert(GetFunctionDescriptor(Function::kWriteSingleCoil).meta_length +
+                  GetFunctionDescriptor(Function::kWriteSingleCoil)
+                      .data_length ==
+              WriteSingleCoilCommand::CommandPacket::kPacketSize);
+static_assert(GetFunctionDescriptor(Function::kWriteMultipleCoils)
+                  .meta_length ==
+              WriteMultipleCoilsCommand::CommandPacket::kValueStart);
+
+/*
+ * Bits are copied between the data store and the frame a word at a time by
+ * the store's GetBits and SetBits, see BitFieldDataStore.h
+ * */
+template <typename T>
+class CoilController {
+  T *bit_data_;
+
+ public:
+  static const constexpr std::array<Function, 3> kFunctions{
+      Function::kReadCoils,
+      Function::kWriteSingleCoil,
+      Function::kWriteMultipleCoils,
+  };
+
+ private:
+  Exception ValidateReadCoils(const ArrayView<uint8_t> &data_array) const {
+    const std::size_t address = ReadCoilsCommand::ReadAddressStart(data_array);
+    const std::size_t bit_count = ReadCoilsCommand::ReadBitCount(data_array);
+    if (bit_count == 0 || bit_count > ReadCoilsCommand::kMaxBitCount) {
+      return Exception::kIllegalDataValue;
+    } else if (!ReadLocationValid(address, bit_count)) {
+      return Exception::kIllegalDataAddress;
+    }
+    return Exception::kAck;
+  }
+  Exception ValidateWriteSingleCoil(
+      const ArrayView<uint8_t> &data_array) const {
+    const std::size_t address = DataCommand::ReadAddressStart(data_array);
+    const uint16_t setting = WriteSingleCoilCommand::ReadSetting(data_array);
+    if (setting != WriteSingleCoilCommand::kOn &&
+        setting != WriteSingleCoilCommand::kOff) {
+      return Exception::kIllegalDataValue;
+    } else if (!WriteLocationValid(address, 1)) {
+      return Exception::kIllegalDataAddress;
+    }
+    return Exception::kAck;
+  }
+  Exception ValidateWriteMultipleCoils(
+      const ArrayView<uint8_t> &data_array) const {
+    const std::size_t address = DataCommand::ReadAddressStart(data_array);
+    const std::size_t bit_count =
+        WriteMultipleCoilsCommand::ReadBitCount(data_array);
+    if (bit_count == 0 || bit_count > WriteMultipleCoilsCommand::kMaxBitCount ||
+        BitCommand::GetByteCount(bit_count) !=
+            WriteMultipleCoilsCommand::ReadDataByteCount(data_array)) {
+      return Exception::kIllegalDataValue;
+    } else if (!WriteLocationValid(address, bit_count)) {
+      return Exception::kIllegalDataAddress;
+    }
+    return Exception::kAck;
+  }
+
+ public:
+  explicit CoilController(T *bit_data) : bit_data_{bit_data} {}
+  T *GetDataStore(void) { return bit_data_; }
+  bool WriteLocationValid(std::size_t address, std::size_t count) const {
+    return bit_data_->WriteLocationValid(address, count);
+  }
+  bool ReadLocationValid(std::size_t address, std::size_t count) const {
+    return bit_data_->ReadLocationValid(address, count);
+  }
+  bool ReadBit(uint16_t address) const { return bit_data_->GetBit(address); }
+  void WriteBit(uint16_t address, bool value) {
+    bit_data_->SetBit(address, value);
+  }
+
+  int32_t ReadFrame(const Frame &frame, Response *response) {
+    if (frame.function == Function::kReadCoils) {
+      return RunReadCoils(frame, response);
+    } else if (frame.function == Function::kWriteSingleCoil) {
+      return RunWriteSingleCoil(frame, response);
+    } else if (frame.function == Function::kWriteMultipleCoils) {
+      return RunWriteMultipleCoils(frame, response);
+    } else {
+      assert(0);
+    }
+    return -1;
+  }
+
+  int32_t RunReadCoils(const Frame &frame, Response *response) {
+    const uint16_t address =
+        ReadCoilsCommand::ReadAddressStart(frame.data_array);
+    const uint16_t bit_count = ReadCoilsCommand::ReadBitCount(frame.data_array);
+    ReadCoilsCommand::FillResponseHeader(frame.address, bit_count, response);
+    auto response_data = ArrayView<uint8_t>{
+        BitCommand::GetByteCount(bit_count),
+        &response->data()[ReadCoilsCommand::ResponsePacket::kHeaderSize]};
+    bit_data_->GetBits(address, bit_count, &response_data);
+    return 0;
+  }
+
+  int32_t RunWriteSingleCoil(const Frame &frame, Response *response) {
+    const uint16_t address = DataCommand::ReadAddressStart(frame.data_array);
+    const uint16_t setting =
+        WriteSingleCoilCommand::ReadSetting(frame.data_array);
+    const bool value = setting == WriteSingleCoilCommand::kOn;
+    WriteBit(address, value);
+    bit_data_->set_bit_callback(address, value);
+    WriteSingleCoilCommand::FillResponseHeader(frame.address, address, setting,
+                                               response);
+    return 0;
+  }
+
+  int32_t RunWriteMultipleCoils(const Frame &frame, Response *response) {
+    const uint16_t address = DataCommand::ReadAddressStart(frame.data_array);
+    const uint16_t bit_count =
+        WriteMultipleCoilsCommand::ReadBitCount(frame.data_array);
+    const std::size_t value_start =
+        WriteMultipleCoilsCommand::CommandPacket::kValueStart;
+    const ArrayView<const uint8_t> data_view{
+        BitCommand::GetByteCount(bit_count), &frame.data_array[value_start]};
+    bit_data_->SetBits(address, bit_count, data_view);
+    bit_data_->set_bits_callback(address, bit_count, data_view);
+    WriteMultipleCoilsCommand::FillResponseHeader(frame.address, address,
+                                                  bit_count, response);
+    return 0;
+  }
+
+  Exception ValidateFrame(const Frame &frame) const {
+    Exception exception = Exception::kIllegalFunction;
+    if (frame.function == Function::kReadCoils) {
+      exception = ValidateReadCoils(frame.data_array);
+    } else if (frame.function == Function::kWriteSingleCoil) {
+      exception = ValidateWriteSingleCoil(frame.data_array);
+    } else if (frame.function == Function::kWriteMultipleCoils) {
+      exception = ValidateWriteMultipleCoils(frame.data_array);
+    } else {
+      assert(0);
+    }
+    return exception;
+  }
+};
+
+template <typename T>
+class DiscreteInputController {
+  T *bit_data_;
+
+ public:
+  static const constexpr std::array<Function, 1> kFunctions{
+      Function::kReadDiscreteInputs,
+  };
+
+ private:
+  Exception ValidateReadDiscreteInputs(
+      const ArrayView<uint8_t> &data_array) const {
+    const std::size_t address =
+        ReadDiscreteInputsCommand::ReadAddressStart(data_array);
+    const std::size_t bit_count =
+        ReadDiscreteInputsCommand::ReadBitCount(data_array);
+    if (bit_count == 0 || bit_count > ReadDiscreteInputsCommand::kMaxBitCount) {
+      return Exception::kIllegalDataValue;
+    } else if (!ReadLocationValid(address, bit_count)) {
+      return Exception::kIllegalDataAddress;
+    }
+    return Exception::kAck;
+  }
+
+ public:
+  explicit DiscreteInputController(T *bit_data) : bit_data_{bit_data} {}
+  T *GetDataStore(void) { return bit_data_; }
+  bool ReadLocationValid(std::size_t address, std::size_t count) const {
+    return bit_data_->ReadLocationValid(address, count);
+  }
+  bool ReadBit(uint16_t address) const { return bit_data_->GetBit(address); }
+  void WriteBit(uint16_t address, bool value) {
+    bit_data_->SetBit(address, value);
+  }
+
+  int32_t ReadFrame(const Frame &frame, Response *response) {
+    if (frame.function != Function::kReadDiscreteInputs) {
+      return -1;
+    }
+    return RunReadDiscreteInputs(frame, response);
+  }
+
+  int32_t RunReadDiscreteInputs(const Frame &frame, Response *response) {
+    const uint16_t address =
+        ReadDiscreteInputsCommand::ReadAddressStart(frame.data_array);
+    const uint16_t bit_count =
+        ReadDiscreteInputsCommand::ReadBitCount(frame.data_array);
+    ReadDiscreteInputsCommand::FillResponseHeader(frame.address, bit_count,
+                                                  response);
+    auto response_data = ArrayView<uint8_t>{
+        BitCommand::GetByteCount(bit_count),
+        &response
+             ->data()[ReadDiscreteInputsCommand::ResponsePacket::kHeaderSize]};
+    bit_data_->GetBits(address, bit_count, &response_data);
+    return 0;
+  }
+
+  Exception ValidateFrame(const Frame &frame) const {
+    if (frame.function != Function::kReadDiscreteInputs) {
+      return Exception::kIllegalFunction;
+    }
+    return ValidateReadDiscreteInputs(frame.data_array);
+  }
+};
+}  //  namespace Modbus
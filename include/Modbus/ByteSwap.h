@@ -0,0 +1,273 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        ByteSwap.h
+ * Description:  Bulk conversion between host registers and big endian
+ *               register bytes with scalar, SSSE3, AVX2 and NEON backends
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ *
+ * The backend is picked once at startup, AVX2 or SSSE3 when the CPU has it,
+ * NEON when the compiler targets it and scalar otherwise. Define
+ * MODBUS_BYTESWAP_BACKEND as one of the ByteSwapBackend names (kScalar,
+ * kSsse3, kAvx2, kNeon) to fix it at compile time instead.
+ *
+ * The kernels are plain loads and stores with no synchronisation. Calling
+ * them on registers another thread writes at the same time is a data race,
+ * stores shared between threads use the sequence counts of
+ * SeqlockRegisterDataStore instead.
+ */
+
+#pragma once
+#ifndef MODBUS_BYTESWAP_H_
+#define MODBUS_BYTESWAP_H_
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define MODBUS_BYTESWAP_BIG_ENDIAN_HOST 1
+#else
+#define MODBUS_BYTESWAP_BIG_ENDIAN_HOST 0
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__)) &&   \
+    !defined(MODBUS_BYTESWAP_NO_SIMD)
+#define MODBUS_BYTESWAP_HAS_X86 1
+#include <immintrin.h>
+#else
+#define MODBUS_BYTESWAP_HAS_X86 0
+#endif
+
+#if defined(__ARM_NEON) && !MODBUS_BYTESWAP_BIG_ENDIAN_HOST && \
+    !defined(MODBUS_BYTESWAP_NO_SIMD)
+#define MODBUS_BYTESWAP_HAS_NEON 1
+#include <arm_neon.h>
+#else
+#define MODBUS_BYTESWAP_HAS_NEON 0
+#endif
+
+namespace Modbus {
+enum class ByteSwapBackend { kScalar, kSsse3, kAvx2, kNeon };
+
+using RegistersToBytesFunction = void (*)(const uint16_t *, uint8_t *,
+                                          std::size_t);
+using BytesToRegistersFunction = void (*)(const uint8_t *, uint16_t *,
+                                          std::size_t);
+
+inline void RegistersToBytesScalar(const uint16_t *registers, uint8_t *bytes,
+                                   const std::size_t count) {
+  for (std::size_t i = 0; i < count; i++) {
+    const uint16_t value = __atomic_load_n(&registers[i], __ATOMIC_RELAXED);
+    bytes[2 * i] = static_cast<uint8_t>(value >> 8);
+    bytes[2 * i + 1] = static_cast<uint8_t>(value & 0xff);
+  }
+}
+
+inline void BytesToRegistersScalar(const uint8_t *bytes, uint16_t *registers,
+                                   const std::size_t count) {
+  for (std::size_t i = 0; i < count; i++) {
+    const uint16_t value =
+        static_cast<uint16_t>((bytes[2 * i] << 8) | bytes[2 * i + 1]);
+    __atomic_store_n(&registers[i], value, __ATOMIC_RELAXED);
+  }
+}
+
+#if MODBUS_BYTESWAP_HAS_X86
+/*
+ * pshufb with each byte pair reversed, 8 registers per 16 byte block
+ * */
+__attribute__((target("ssse3"))) inline void RegistersToBytesSsse3(
+    const uint16_t *registers, uint8_t *bytes, const std::size_t count) {
+  const __m128i swap =
+      _mm_set_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(&registers[i]));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(&bytes[2 * i]),
+                     _mm_shuffle_epi8(block, swap));
+  }
+  RegistersToBytesScalar(&registers[i], &bytes[2 * i], count - i);
+}
+
+__attribute__((target("ssse3"))) inline void BytesToRegistersSsse3(
+    const uint8_t *bytes, uint16_t *registers, const std::size_t count) {
+  const __m128i swap =
+      _mm_set_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(&bytes[2 * i]));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(&registers[i]),
+                     _mm_shuffle_epi8(block, swap));
+  }
+  BytesToRegistersScalar(&bytes[2 * i], &registers[i], count - i);
+}
+
+/*
+ * vpshufb shuffles within each 128 bit lane so the same pattern is repeated,
+ * 16 registers per block with the remainder handled by SSSE3
+ * */
+__attribute__((target("avx2"))) inline void RegistersToBytesAvx2(
+    const uint16_t *registers, uint8_t *bytes, const std::size_t count) {
+  const __m256i swap = _mm256_set_epi8(
+      14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1, 14, 15, 12, 13,
+      10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+  std::size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&registers[i]));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(&bytes[2 * i]),
+                        _mm256_shuffle_epi8(block, swap));
+  }
+  RegistersToBytesSsse3(&registers[i], &bytes[2 * i], count - i);
+}
+
+__attribute__((target("avx2"))) inline void BytesToRegistersAvx2(
+    const uint8_t *bytes, uint16_t *registers, const std::size_t count) {
+  const __m256i swap = _mm256_set_epi8(
+      14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1, 14, 15, 12, 13,
+      10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+  std::size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    const __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&bytes[2 * i]));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(&registers[i]),
+                        _mm256_shuffle_epi8(block, swap));
+  }
+  BytesToRegistersSsse3(&bytes[2 * i], &registers[i], count - i);
+}
+#endif
+
+#if MODBUS_BYTESWAP_HAS_NEON
+inline void RegistersToBytesNeon(const uint16_t *registers, uint8_t *bytes,
+                                 const std::size_t count) {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const uint8x16_t block =
+        vld1q_u8(reinterpret_cast<const uint8_t *>(&registers[i]));
+    vst1q_u8(&bytes[2 * i], vrev16q_u8(block));
+  }
+  RegistersToBytesScalar(&registers[i], &bytes[2 * i], count - i);
+}
+
+inline void BytesToRegistersNeon(const uint8_t *bytes, uint16_t *registers,
+                                 const std::size_t count) {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const uint8x16_t block = vld1q_u8(&bytes[2 * i]);
+    vst1q_u16(&registers[i], vreinterpretq_u16_u8(vrev16q_u8(block)));
+  }
+  BytesToRegistersScalar(&bytes[2 * i], &registers[i], count - i);
+}
+#endif
+
+inline bool ByteSwapBackendAvailable(const ByteSwapBackend backend) {
+  switch (backend) {
+    case ByteSwapBackend::kSsse3:
+#if MODBUS_BYTESWAP_HAS_X86
+      return __builtin_cpu_supports("ssse3");
+#else
+      return false;
+#endif
+    case ByteSwapBackend::kAvx2:
+#if MODBUS_BYTESWAP_HAS_X86
+      return __builtin_cpu_supports("avx2");
+#else
+      return false;
+#endif
+    case ByteSwapBackend::kNeon:
+      return MODBUS_BYTESWAP_HAS_NEON;
+    case ByteSwapBackend::kScalar:
+    default:
+      return true;
+  }
+}
+
+/*
+ * Unavailable backends fall back to scalar
+ * */
+inline RegistersToBytesFunction GetRegistersToBytesFunction(
+    const ByteSwapBackend backend) {
+  if (!ByteSwapBackendAvailable(backend)) {
+    return &RegistersToBytesScalar;
+  }
+  switch (backend) {
+#if MODBUS_BYTESWAP_HAS_X86
+    case ByteSwapBackend::kSsse3:
+      return &RegistersToBytesSsse3;
+    case ByteSwapBackend::kAvx2:
+      return &RegistersToBytesAvx2;
+#endif
+#if MODBUS_BYTESWAP_HAS_NEON
+    case ByteSwapBackend::kNeon:
+      return &RegistersToBytesNeon;
+#endif
+    default:
+      return &RegistersToBytesScalar;
+  }
+}
+
+inline BytesToRegistersFunction GetBytesToRegistersFunction(
+    const ByteSwapBackend backend) {
+  if (!ByteSwapBackendAvailable(backend)) {
+    return &BytesToRegistersScalar;
+  }
+  switch (backend) {
+#if MODBUS_BYTESWAP_HAS_X86
+    case ByteSwapBackend::kSsse3:
+      return &BytesToRegistersSsse3;
+    case ByteSwapBackend::kAvx2:
+      return &BytesToRegistersAvx2;
+#endif
+#if MODBUS_BYTESWAP_HAS_NEON
+    case ByteSwapBackend::kNeon:
+      return &BytesToRegistersNeon;
+#endif
+    default:
+      return &BytesToRegistersScalar;
+  }
+}
+
+inline ByteSwapBackend GetByteSwapBackend(void) {
+#if defined(MODBUS_BYTESWAP_BACKEND)
+  return ByteSwapBackend::MODBUS_BYTESWAP_BACKEND;
+#elif MODBUS_BYTESWAP_BIG_ENDIAN_HOST
+  return ByteSwapBackend::kScalar;
+#else
+  for (auto backend : {ByteSwapBackend::kAvx2, ByteSwapBackend::kSsse3,
+                       ByteSwapBackend::kNeon}) {
+    if (ByteSwapBackendAvailable(backend)) {
+      return backend;
+    }
+  }
+  return ByteSwapBackend::kScalar;
+#endif
+}
+
+/*
+ * Registers to the big endian bytes of a response
+ * */
+inline void RegistersToBytes(const uint16_t *registers, uint8_t *bytes,
+                             const std::size_t count) {
+  static const RegistersToBytesFunction convert =
+      GetRegistersToBytesFunction(GetByteSwapBackend());
+  convert(registers, bytes, count);
+}
+
+/*
+ * Big endian bytes of a request to registers
+ * */
+inline void BytesToRegisters(const uint8_t *bytes, uint16_t *registers,
+                             const std::size_t count) {
+  static const BytesToRegistersFunction convert =
+      GetBytesToRegistersFunction(GetByteSwapBackend());
+  convert(bytes, registers, count);
+}
+}  //  namespace Modbus
+
+#endif  //  MODBUS_BYTESWAP_H_
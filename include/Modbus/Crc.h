@@ -0,0 +1,255 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        Crc.h
+ * Description:  Modbus CRC16 engine with table, slice-by-8 and carry-less
+ *               multiply backends
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ *
+ * The backend is picked once at startup, PCLMUL when the CPU has it and
+ * slice-by-8 otherwise. Define MODBUS_CRC16_BACKEND as one of the
+ * Crc16Backend names (kBitwise, kTable, kSliceBy8, kClmul) to fix it at
+ * compile time instead.
+ */
+
+#pragma once
+#ifndef MODBUS_CRC_H_
+#define MODBUS_CRC_H_
+#include <ArrayView/ArrayView.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__)) &&   \
+    !defined(MODBUS_CRC16_NO_CLMUL)
+#define MODBUS_CRC16_HAS_CLMUL 1
+#include <immintrin.h>
+#else
+#define MODBUS_CRC16_HAS_CLMUL 0
+#endif
+
+namespace Modbus {
+static const constexpr uint16_t kCrc16Initial = 0xffff;
+static const constexpr uint16_t kCrc16Polynomial = 0xa001;  //  0x8005 reflected
+
+enum class Crc16Backend { kBitwise, kTable, kSliceBy8, kClmul };
+
+inline constexpr uint16_t Crc16UpdateBitwise(uint16_t crc, const uint8_t byte) {
+  crc = static_cast<uint16_t>(crc ^ byte);
+  for (int bit = 0; bit < 8; bit++) {
+    crc = (crc & 0x0001) != 0
+              ? static_cast<uint16_t>((crc >> 1) ^ kCrc16Polynomial)
+              : static_cast<uint16_t>(crc >> 1);
+  }
+  return crc;
+}
+
+/*
+ * Table k holds the CRC of a byte followed by k zero bytes, table 0 is the
+ * usual byte table.
+ * */
+using Crc16Tables = std::array<std::array<uint16_t, 256>, 8>;
+inline constexpr Crc16Tables MakeCrc16Tables(void) {
+  Crc16Tables tables{};
+  for (std::size_t i = 0; i < 256; i++) {
+    tables[0][i] = Crc16UpdateBitwise(0, static_cast<uint8_t>(i));
+  }
+  for (std::size_t k = 1; k < tables.size(); k++) {
+    for (std::size_t i = 0; i < 256; i++) {
+      const uint16_t previous = tables[k - 1][i];
+      tables[k][i] = static_cast<uint16_t>((previous >> 8) ^
+                                           tables[0][previous & 0xff]);
+    }
+  }
+  return tables;
+}
+
+inline constexpr Crc16Tables kCrc16Tables = MakeCrc16Tables();
+
+inline constexpr uint16_t Crc16Update(const uint16_t crc, const uint8_t byte) {
+  return static_cast<uint16_t>((crc >> 8) ^
+                               kCrc16Tables[0][(crc ^ byte) & 0xff]);
+}
+
+inline uint16_t Crc16UpdateBitwise(uint16_t crc, const uint8_t *data,
+                                   const std::size_t length) {
+  for (std::size_t i = 0; i < length; i++) {
+    crc = Crc16UpdateBitwise(crc, data[i]);
+  }
+  return crc;
+}
+
+inline uint16_t Crc16UpdateTable(uint16_t crc, const uint8_t *data,
+                                 const std::size_t length) {
+  for (std::size_t i = 0; i < length; i++) {
+    crc = Crc16Update(crc, data[i]);
+  }
+  return crc;
+}
+
+inline uint16_t Crc16UpdateSliceBy8(uint16_t crc, const uint8_t *data,
+                                    std::size_t length) {
+  const auto &t = kCrc16Tables;
+  while (length >= 8) {
+    const uint8_t b0 = static_cast<uint8_t>(data[0] ^ (crc & 0xff));
+    const uint8_t b1 = static_cast<uint8_t>(data[1] ^ (crc >> 8));
+    crc = static_cast<uint16_t>(t[7][b0] ^ t[6][b1] ^ t[5][data[2]] ^
+                                t[4][data[3]] ^ t[3][data[4]] ^ t[2][data[5]] ^
+                                t[1][data[6]] ^ t[0][data[7]]);
+    data += 8;
+    length -= 8;
+  }
+  return Crc16UpdateTable(crc, data, length);
+}
+
+/*
+ * x^n mod P in the reflected bit order used by the folding below, placed in
+ * the top 16 bits of a 64 bit word.
+ * */
+inline constexpr uint64_t MakeCrc16FoldConstant(const std::size_t n) {
+  uint32_t remainder = 1;
+  for (std::size_t i = 0; i < n; i++) {
+    remainder <<= 1;
+    if ((remainder & 0x10000) != 0) {
+      remainder ^= 0x18005;
+    }
+  }
+  uint64_t reflected = 0;
+  for (std::size_t bit = 0; bit < 16; bit++) {
+    if ((remainder >> bit) & 1) {
+      reflected |= uint64_t{1} << (63 - bit);
+    }
+  }
+  return reflected;
+}
+
+#if MODBUS_CRC16_HAS_CLMUL
+/*
+ * Folds the buffer 16 bytes at a time with carry-less multiplies until a
+ * single 16 byte block is left, that block and the tail go through the
+ * tables. The incoming CRC is folded into the first two bytes.
+ *
+ * With the bytes loaded little endian, bit b of the 128 bit state is the
+ * coefficient of x^(127 - b). The low half H and high half L are replaced by
+ * H * x^192 + L * x^128 mod P, which is congruent and small enough to add
+ * the next block onto. Multiplying reflected operands shifts the product by
+ * one bit so the constants are x^191 and x^127.
+ * */
+__attribute__((target("pclmul,sse2"))) inline uint16_t Crc16UpdateClmul(
+    uint16_t crc, const uint8_t *data, std::size_t length) {
+  static const constexpr std::size_t kBlockSize = 16;
+  if (length < 2 * kBlockSize) {
+    return Crc16UpdateSliceBy8(crc, data, length);
+  }
+  static const constexpr uint64_t kFoldHigh = MakeCrc16FoldConstant(191);
+  static const constexpr uint64_t kFoldLow = MakeCrc16FoldConstant(127);
+  const __m128i constants = _mm_set_epi64x(static_cast<int64_t>(kFoldLow),
+                                           static_cast<int64_t>(kFoldHigh));
+  __m128i state = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+  state = _mm_xor_si128(state, _mm_cvtsi32_si128(crc));
+  data += kBlockSize;
+  length -= kBlockSize;
+
+  while (length >= kBlockSize) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+    const __m128i high = _mm_clmulepi64_si128(state, constants, 0x00);
+    const __m128i low = _mm_clmulepi64_si128(state, constants, 0x11);
+    state = _mm_xor_si128(_mm_xor_si128(high, low), block);
+    data += kBlockSize;
+    length -= kBlockSize;
+  }
+
+  std::array<uint8_t, kBlockSize> folded{};
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(folded.data()), state);
+  crc = Crc16UpdateSliceBy8(0, folded.data(), folded.size());
+  return Crc16UpdateSliceBy8(crc, data, length);
+}
+#endif
+
+inline bool Crc16BackendAvailable(const Crc16Backend backend) {
+  if (backend == Crc16Backend::kClmul) {
+#if MODBUS_CRC16_HAS_CLMUL
+    return __builtin_cpu_supports("pclmul");
+#else
+    return false;
+#endif
+  }
+  return true;
+}
+
+using Crc16UpdateFunction = uint16_t (*)(uint16_t, const uint8_t *,
+                                         std::size_t);
+
+inline Crc16UpdateFunction GetCrc16Function(const Crc16Backend backend) {
+  switch (backend) {
+    case Crc16Backend::kBitwise:
+      return &Crc16UpdateBitwise;
+    case Crc16Backend::kTable:
+      return &Crc16UpdateTable;
+    case Crc16Backend::kClmul:
+#if MODBUS_CRC16_HAS_CLMUL
+      if (Crc16BackendAvailable(backend)) {
+        return &Crc16UpdateClmul;
+      }
+#endif
+      return &Crc16UpdateSliceBy8;
+    case Crc16Backend::kSliceBy8:
+    default:
+      return &Crc16UpdateSliceBy8;
+  }
+}
+
+inline Crc16Backend GetCrc16Backend(void) {
+#if defined(MODBUS_CRC16_BACKEND)
+  return Crc16Backend::MODBUS_CRC16_BACKEND;
+#else
+  return Crc16BackendAvailable(Crc16Backend::kClmul) ? Crc16Backend::kClmul
+                                                     : Crc16Backend::kSliceBy8;
+#endif
+}
+
+inline uint16_t Crc16Update(const uint16_t crc, const uint8_t *data,
+                            const std::size_t length) {
+  static const Crc16UpdateFunction update = GetCrc16Function(GetCrc16Backend());
+  return update(crc, data, length);
+}
+
+/*
+ * Matches the Crc16 hook of ProtocolRtu, the result is in transmit order
+ * with the low byte of the CRC in the upper byte.
+ * */
+inline uint16_t CalculateCrc16(const ArrayView<uint8_t> &array,
+                               const std::size_t length) {
+  const uint16_t crc = Crc16Update(kCrc16Initial, array.data(), length);
+  return static_cast<uint16_t>((crc << 8) | (crc >> 8));
+}
+
+/*
+ * CRC of a frame kept up to date as bytes are received. The CRC goes out
+ * low byte first so running it over a complete frame, CRC included, leaves
+ * zero.
+ * */
+class RunningCrc16 {
+  uint16_t crc_ = kCrc16Initial;
+
+ public:
+  void Reset(void) { crc_ = kCrc16Initial; }
+  void Update(const uint8_t byte) { crc_ = Crc16Update(crc_, byte); }
+  void Update(const uint8_t *data, const std::size_t length) {
+    crc_ = Crc16Update(crc_, data, length);
+  }
+  uint16_t GetValue(void) const { return crc_; }
+  uint8_t GetLowByte(void) const { return static_cast<uint8_t>(crc_ & 0xff); }
+  uint8_t GetHighByte(void) const { return static_cast<uint8_t>(crc_ >> 8); }
+  bool ResidueIsValid(void) const { return crc_ == 0; }
+};
+}  //  namespace Modbus
+
+#endif  //  MODBUS_CRC_H_
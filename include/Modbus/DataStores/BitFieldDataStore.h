@@ -0,0 +1,146 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        BitFieldDataStore.h
+ * Description:  Bit packed store for coils and discrete inputs
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ *
+ * Bits are kept in 64 bit words, bit n in bit n % 64 of word n / 64. Modbus
+ * packs bits the same way, the first bit in the least significant bit of
+ * the first byte, so a run of bits on the wire is the little endian image of
+ * a run of bits in the store shifted by the start address. Reads and writes
+ * move up to 64 bits at a time with one or two shifts instead of a loop per
+ * bit.
+ */
+
+#pragma once
+#ifndef MODBUS_BITFIELDDATASTORE_H_
+#define MODBUS_BITFIELDDATASTORE_H_
+#include <ArrayView/ArrayView.h>
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+
+#include "Modbus/DataStores/DataStore.h"
+
+namespace Modbus {
+template <std::size_t kBitCount>
+class BitFieldDataStore : public DataStore {
+  static const constexpr std::size_t kWordBits = 64;
+  static const constexpr std::size_t kWordCount =
+      (kBitCount + kWordBits - 1) / kWordBits;
+  std::array<uint64_t, kWordCount> words_{};
+
+  static constexpr uint64_t GetMask(const std::size_t bit_count) {
+    return bit_count >= kWordBits ? ~uint64_t{0}
+                                  : (uint64_t{1} << bit_count) - 1;
+  }
+
+  /*
+   * The bit_count <= 64 bits from bit on, in the low bits of the result
+   * */
+  uint64_t Extract(const std::size_t bit, const std::size_t bit_count) const {
+    const std::size_t word = bit / kWordBits;
+    const std::size_t shift = bit % kWordBits;
+    uint64_t value = words_[word] >> shift;
+    if (shift != 0 && shift + bit_count > kWordBits) {
+      value |= words_[word + 1] << (kWordBits - shift);
+    }
+    return value & GetMask(bit_count);
+  }
+
+  void Deposit(const std::size_t bit, const std::size_t bit_count,
+               const uint64_t value) {
+    const std::size_t word = bit / kWordBits;
+    const std::size_t shift = bit % kWordBits;
+    const uint64_t mask = GetMask(bit_count);
+    words_[word] =
+        (words_[word] & ~(mask << shift)) | ((value & mask) << shift);
+    if (shift != 0 && shift + bit_count > kWordBits) {
+      const std::size_t spill = kWordBits - shift;
+      words_[word + 1] =
+          (words_[word + 1] & ~(mask >> spill)) | ((value & mask) >> spill);
+    }
+  }
+
+  static std::size_t GetIndex(const std::size_t address) {
+    return address - GetAddressStart();
+  }
+
+ public:
+  static constexpr std::size_t size(void) { return kBitCount; }
+  static constexpr std::size_t GetSize(void) { return kBitCount; }
+  bool ReadLocationValid(std::size_t address, std::size_t count) const {
+    return count > 0 && GetIndex(address) + count <= kBitCount;
+  }
+  bool WriteLocationValid(std::size_t address, std::size_t count) const {
+    return ReadLocationValid(address, count);
+  }
+
+  bool GetBit(const std::size_t address) const {
+    const std::size_t index = GetIndex(address);
+    assert(index < kBitCount);
+    return (words_[index / kWordBits] >> (index % kWordBits)) & 1u;
+  }
+  void SetBit(const std::size_t address, const bool value) {
+    const std::size_t index = GetIndex(address);
+    assert(index < kBitCount);
+    const uint64_t bit = uint64_t{1} << (index % kWordBits);
+    uint64_t &word = words_[index / kWordBits];
+    word = value ? (word | bit) : (word & ~bit);
+  }
+
+  /*
+   * Pack bit_count bits starting at address into data_view in Modbus order.
+   * The unused high bits of the last byte are zero.
+   * */
+  void GetBits(const std::size_t address, const std::size_t bit_count,
+               ArrayView<uint8_t> *data_view) const {
+    assert(ReadLocationValid(address, bit_count));
+    const std::size_t start = GetIndex(address);
+    uint8_t *const data = data_view->data();
+    for (std::size_t done = 0; done < bit_count; done += kWordBits) {
+      const std::size_t chunk_bits =
+          bit_count - done < kWordBits ? bit_count - done : kWordBits;
+      const uint64_t value = Extract(start + done, chunk_bits);
+      const std::size_t chunk_bytes = (chunk_bits + kByteSize - 1) / kByteSize;
+      uint8_t *const out = &data[done / kByteSize];
+      for (std::size_t byte = 0; byte < chunk_bytes; byte++) {
+        out[byte] = static_cast<uint8_t>(value >> (byte * kByteSize));
+      }
+    }
+  }
+
+  /*
+   * Unpack bit_count bits in Modbus order from data_view into the store
+   * starting at address
+   * */
+  void SetBits(const std::size_t address, const std::size_t bit_count,
+               const ArrayView<const uint8_t> &data_view) {
+    assert(WriteLocationValid(address, bit_count));
+    const std::size_t start = GetIndex(address);
+    const uint8_t *const data = data_view.data();
+    for (std::size_t done = 0; done < bit_count; done += kWordBits) {
+      const std::size_t chunk_bits =
+          bit_count - done < kWordBits ? bit_count - done : kWordBits;
+      const std::size_t chunk_bytes = (chunk_bits + kByteSize - 1) / kByteSize;
+      const uint8_t *const in = &data[done / kByteSize];
+      uint64_t value = 0;
+      for (std::size_t byte = 0; byte < chunk_bytes; byte++) {
+        value |= static_cast<uint64_t>(in[byte]) << (byte * kByteSize);
+      }
+      Deposit(start + done, chunk_bits, value);
+    }
+  }
+
+  void set_bit_callback(std::size_t, bool) {}
+  void set_bits_callback(std::size_t, std::size_t,
+                         const ArrayView<const uint8_t> &) {}
+};
+}  //  namespace Modbus
+
+#endif  //  MODBUS_BITFIELDDATASTORE_H_
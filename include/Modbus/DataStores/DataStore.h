@@ -13,6 +13,8 @@
 #ifndef MODBUS_DATASTORE_H_
 #define MODBUS_DATASTORE_H_
 #include <cstdint>
+#include <type_traits>
+#include <utility>
 using size_t = std::size_t;
 
 namespace Modbus {
@@ -25,6 +27,16 @@ class DataStore {
   static constexpr std::size_t GetAddressStart(void) { return kAddressStart; }
 };
 
+/*
+ * Stores that hold work back until the response has been sent, such as the
+ * wakes of NotifyingRegisterDataStore, have Publish(void)
+ * */
+template <typename T, typename = void>
+struct HasPublish : std::false_type {};
+template <typename T>
+struct HasPublish<T, std::void_t<decltype(std::declval<T &>().Publish())>>
+    : std::true_type {};
+
 }  // namespace Modbus
 
 #endif  // MODBUS_DATASTORE_H_
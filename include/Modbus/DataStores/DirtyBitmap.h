@@ -0,0 +1,169 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        DirtyBitmap.h
+ * Description:  Hierarchical bitmap of changed registers
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ *
+ * Bit n of the leaf words is register n. Bit n of the summary words is set
+ * when leaf word n may be non zero, bit n of the top word when summary word
+ * n may be. Checking for any change reads the top word, a walk only visits
+ * the leaf words that changed.
+ *
+ * One thread marks, typically the protocol thread, and another takes. A
+ * mark sets the leaf then the summary then the top bit. A take clears the
+ * top then the summary bit before exchanging the word below, so a bit set
+ * during a take is either taken or left with its summary bits set. A summary
+ * bit may be left over a leaf word that is already zero, the next take
+ * clears it.
+ */
+
+#pragma once
+#ifndef MODBUS_DIRTYBITMAP_H_
+#define MODBUS_DIRTYBITMAP_H_
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+namespace Modbus {
+template <std::size_t kBitCount>
+class DirtyBitmap {
+  static const constexpr std::size_t kWordBits = 64;
+  static const constexpr std::size_t kLeafCount =
+      (kBitCount + kWordBits - 1) / kWordBits;
+  static const constexpr std::size_t kSummaryCount =
+      (kLeafCount + kWordBits - 1) / kWordBits;
+  static_assert(kBitCount > 0, "Empty bitmap");
+  static_assert(kSummaryCount <= kWordBits,
+                "More bits than one top word can summarize");
+
+  std::array<std::atomic<uint64_t>, kLeafCount> leaves_{};
+  std::array<std::atomic<uint64_t>, kSummaryCount> summary_{};
+  std::atomic<uint64_t> top_{0};
+
+  static constexpr uint64_t GetBit(const std::size_t bit) {
+    return uint64_t{1} << (bit % kWordBits);
+  }
+
+  //  bit_count bits from shift, bit_count + shift <= 64
+  static constexpr uint64_t GetMask(const std::size_t shift,
+                                    const std::size_t bit_count) {
+    return (bit_count >= kWordBits ? ~uint64_t{0}
+                                   : (uint64_t{1} << bit_count) - 1)
+           << shift;
+  }
+
+  void MarkWord(const std::size_t leaf, const uint64_t bits) {
+    leaves_[leaf].fetch_or(bits, std::memory_order_release);
+    summary_[leaf / kWordBits].fetch_or(GetBit(leaf),
+                                        std::memory_order_release);
+    top_.fetch_or(GetBit(leaf / kWordBits), std::memory_order_release);
+  }
+
+  /*
+   * Runs of set bits in word as (first bit, count), lowest first
+   * */
+  template <typename TFunction>
+  static void ForEachRun(uint64_t word, const std::size_t base,
+                         TFunction&& function) {
+    while (word != 0) {
+      const std::size_t start =
+          static_cast<std::size_t>(__builtin_ctzll(word));
+      const uint64_t rest = ~(word >> start);
+      const std::size_t count =
+          rest == 0 ? kWordBits - start
+                    : static_cast<std::size_t>(__builtin_ctzll(rest));
+      function(base + start, count);
+      word &= ~GetMask(start, count);
+    }
+  }
+
+ public:
+  static constexpr std::size_t size(void) { return kBitCount; }
+
+  void Mark(const std::size_t bit) {
+    assert(bit < kBitCount);
+    MarkWord(bit / kWordBits, GetBit(bit));
+  }
+
+  //  One atomic or per leaf word touched
+  void Mark(const std::size_t first, const std::size_t count) {
+    assert(first + count <= kBitCount);
+    std::size_t bit = first;
+    const std::size_t end = first + count;
+    while (bit < end) {
+      const std::size_t shift = bit % kWordBits;
+      const std::size_t run =
+          end - bit < kWordBits - shift ? end - bit : kWordBits - shift;
+      MarkWord(bit / kWordBits, GetMask(shift, run));
+      bit += run;
+    }
+  }
+
+  bool IsMarked(const std::size_t bit) const {
+    assert(bit < kBitCount);
+    return (leaves_[bit / kWordBits].load(std::memory_order_acquire) &
+            GetBit(bit)) != 0;
+  }
+
+  //  Single load, may report a change that a take in progress is clearing
+  bool Any(void) const { return top_.load(std::memory_order_acquire) != 0; }
+
+  /*
+   * Clears the marked bits and calls function(first, count) for each run of
+   * them, runs that continue across words are joined. Returns the number of
+   * bits taken.
+   * */
+  template <typename TFunction>
+  std::size_t Take(TFunction&& function) {
+    std::size_t taken = 0;
+    std::size_t run_start = 0;
+    std::size_t run_count = 0;
+    const auto add_run = [&](const std::size_t start, const std::size_t count) {
+      taken += count;
+      if (run_count != 0 && run_start + run_count == start) {
+        run_count += count;
+        return;
+      }
+      if (run_count != 0) {
+        function(run_start, run_count);
+      }
+      run_start = start;
+      run_count = count;
+    };
+
+    uint64_t top = top_.exchange(0, std::memory_order_acq_rel);
+    while (top != 0) {
+      const std::size_t summary_index =
+          static_cast<std::size_t>(__builtin_ctzll(top));
+      top &= top - 1;
+      uint64_t summary =
+          summary_[summary_index].exchange(0, std::memory_order_acq_rel);
+      while (summary != 0) {
+        const std::size_t leaf = summary_index * kWordBits +
+                                 static_cast<std::size_t>(
+                                     __builtin_ctzll(summary));
+        summary &= summary - 1;
+        const uint64_t word =
+            leaves_[leaf].exchange(0, std::memory_order_acquire);
+        ForEachRun(word, leaf * kWordBits, add_run);
+      }
+    }
+    if (run_count != 0) {
+      function(run_start, run_count);
+    }
+    return taken;
+  }
+
+  void Clear(void) {
+    Take([](std::size_t, std::size_t) {});
+  }
+};
+}  //  namespace Modbus
+
+#endif  //  MODBUS_DIRTYBITMAP_H_
@@ -0,0 +1,113 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        FifoDataStore.h
+ * Description:  Register queue for function 24, filled from another thread
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ *
+ * A single producer, single consumer ring with the same insert/pop style as
+ * RingBuffer. RingBuffer keeps one element count that both sides change so
+ * it needs a lock when the sides run on different threads. Here the producer
+ * only writes the tail and the consumer only writes the head, each is
+ * published with a release store and read with an acquire load, so an
+ * acquisition thread or interrupt can push while the slave drains without
+ * either one waiting.
+ *
+ * A push to a full queue drops the value and counts an overflow, the oldest
+ * samples are kept because the consumer may be reading them.
+ */
+
+#pragma once
+#ifndef MODBUS_FIFODATASTORE_H_
+#define MODBUS_FIFODATASTORE_H_
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "Modbus/DataStores/DataStore.h"
+
+namespace Modbus {
+template <std::size_t kSize>
+class FifoDataStore : public DataStore {
+  static_assert(kSize > 0 && (kSize & (kSize - 1)) == 0,
+                "Queue size must be a power of two");
+  static const constexpr std::size_t kCacheLine = 64;
+
+  //  Indices run freely and are masked on access, head == tail is empty
+  alignas(kCacheLine) std::atomic<std::size_t> head_{0};
+  alignas(kCacheLine) std::atomic<std::size_t> tail_{0};
+  alignas(kCacheLine) std::atomic<uint32_t> overflows_{0};
+  std::array<uint16_t, kSize> data_{};
+
+ public:
+  static constexpr std::size_t size(void) { return kSize; }
+
+  /*
+   * Producer side. Returns false and counts an overflow when full.
+   * */
+  bool insert(const uint16_t value) {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == kSize) {
+      overflows_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    data_[tail & (kSize - 1)] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /*
+   * Producer side, pushes a block with one release. Returns the number
+   * queued, each value that did not fit counts as an overflow.
+   * */
+  std::size_t insert(const uint16_t *values, const std::size_t count) {
+    const std::size_t tail = tail_.load(std::memory_order_relaxed);
+    const std::size_t space =
+        kSize - (tail - head_.load(std::memory_order_acquire));
+    const std::size_t queued = count < space ? count : space;
+    for (std::size_t i = 0; i < queued; i++) {
+      data_[(tail + i) & (kSize - 1)] = values[i];
+    }
+    tail_.store(tail + queued, std::memory_order_release);
+    if (queued != count) {
+      overflows_.fetch_add(static_cast<uint32_t>(count - queued),
+                           std::memory_order_relaxed);
+    }
+    return queued;
+  }
+
+  /*
+   * Consumer side, takes up to count values. Returns the number taken.
+   * */
+  std::size_t pop(uint16_t *values, const std::size_t count) {
+    const std::size_t head = head_.load(std::memory_order_relaxed);
+    const std::size_t available = tail_.load(std::memory_order_acquire) - head;
+    const std::size_t taken = count < available ? count : available;
+    for (std::size_t i = 0; i < taken; i++) {
+      values[i] = data_[(head + i) & (kSize - 1)];
+    }
+    head_.store(head + taken, std::memory_order_release);
+    return taken;
+  }
+
+  //  Exact on the consumer side, a lower bound anywhere else
+  std::size_t GetCount(void) const {
+    return tail_.load(std::memory_order_acquire) -
+           head_.load(std::memory_order_acquire);
+  }
+  bool isEmpty(void) const { return GetCount() == 0; }
+
+  uint32_t GetOverflowCount(void) const {
+    return overflows_.load(std::memory_order_relaxed);
+  }
+  void ResetOverflowCount(void) {
+    overflows_.store(0, std::memory_order_relaxed);
+  }
+};
+}  //  namespace Modbus
+
+#endif  //  MODBUS_FIFODATASTORE_H_
@@ -0,0 +1,282 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        MmapFileStore.h
+ * Description:  File record store for functions 20 & 21 on mapped files
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ *
+ * Target Processor: Linux system
+ * ----------------------------------------------------------------------
+ *
+ * Each file on disk is mapped shared and holds its records in Modbus byte
+ * order, most significant byte first, so records move between the mapping
+ * and a frame with a single memcpy and no conversion.
+ *
+ * Modbus numbers records 0 to 9999 within a file. A disk file larger than
+ * that is served as a run of consecutive file numbers of kRecordsPerFile
+ * records each, a 400 kB log opened as file 1 is files 1 to 21.
+ *
+ * Writes only mark the touched bytes dirty. Sync() starts writeback of the
+ * dirty span of each file with one sync_file_range(SYNC_FILE_RANGE_WRITE),
+ * msync(MS_ASYNC) starts no I/O on Linux. It does not wait for the disk,
+ * FileRecordController calls it once per frame so a write of several
+ * sub-requests costs one call per file. Flush() waits for everything synced
+ * since the last flush to reach the disk, the owner calls it from a timer or
+ * once the response has gone out, never while a master is waiting.
+ */
+
+#pragma once
+#ifndef MODBUS_MMAPFILESTORE_H_
+#define MODBUS_MMAPFILESTORE_H_
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include "Modbus/DataStores/DataStore.h"
+
+namespace Modbus {
+template <std::size_t kMaxFiles>
+class MmapFileStore : public DataStore {
+ public:
+  static const constexpr std::size_t kRecordSize = sizeof(uint16_t);
+  static const constexpr std::size_t kRecordsPerFile = 10000;
+
+ private:
+  struct Mapping {
+    uint8_t *data = nullptr;
+    std::size_t size = 0;  //  bytes
+    int fd = -1;
+    uint16_t first_file = 0;
+    uint16_t file_count = 0;
+    std::size_t dirty_start = 0;
+    std::size_t dirty_end = 0;  //  empty when start == end
+    bool unflushed = false;     //  synced but not yet flushed
+  };
+  std::array<Mapping, kMaxFiles> mappings_{};
+  int sync_error_ = 0;
+
+  const Mapping *Find(const std::size_t file_number) const {
+    for (const auto &mapping : mappings_) {
+      if (mapping.data != nullptr && file_number >= mapping.first_file &&
+          file_number < mapping.first_file + mapping.file_count) {
+        return &mapping;
+      }
+    }
+    return nullptr;
+  }
+  Mapping *Find(const std::size_t file_number) {
+    return const_cast<Mapping *>(
+        static_cast<const MmapFileStore *>(this)->Find(file_number));
+  }
+  static std::size_t GetOffset(const Mapping &mapping,
+                               const std::size_t file_number,
+                               const std::size_t record_number) {
+    return ((file_number - mapping.first_file) * kRecordsPerFile +
+            record_number) *
+           kRecordSize;
+  }
+
+ public:
+  MmapFileStore(void) = default;
+  MmapFileStore(const MmapFileStore &) = delete;
+  MmapFileStore &operator=(const MmapFileStore &) = delete;
+  ~MmapFileStore(void) {
+    for (auto &mapping : mappings_) {
+      if (mapping.data != nullptr) {
+        Close(mapping.first_file);
+      }
+    }
+  }
+
+  /*
+   * Map the file at path as file_number onwards, holding record_count
+   * records. The file is created, or grown with zeros, to fit. Returns 0 or
+   * a negative errno.
+   * */
+  int Open(const uint16_t file_number, const char *path,
+           const std::size_t record_count) {
+    const std::size_t file_count =
+        (record_count + kRecordsPerFile - 1) / kRecordsPerFile;
+    if (file_number == 0 || record_count == 0 ||
+        file_number + file_count > 0x10000) {
+      return -EINVAL;
+    }
+    for (std::size_t file = file_number; file < file_number + file_count;
+         file++) {
+      if (Find(file) != nullptr) {
+        return -EEXIST;
+      }
+    }
+    Mapping *slot = nullptr;
+    for (auto &mapping : mappings_) {
+      if (mapping.data == nullptr) {
+        slot = &mapping;
+        break;
+      }
+    }
+    if (slot == nullptr) {
+      return -ENOMEM;
+    }
+
+    const std::size_t size = record_count * kRecordSize;
+    const int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      return -errno;
+    }
+    struct stat status {};
+    if (fstat(fd, &status) != 0 ||
+        (static_cast<std::size_t>(status.st_size) < size &&
+         ftruncate(fd, static_cast<off_t>(size)) != 0)) {
+      const int error = errno;
+      close(fd);
+      return -error;
+    }
+    void *const data =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      const int error = errno;
+      close(fd);
+      return -error;
+    }
+    *slot = Mapping{};
+    slot->data = static_cast<uint8_t *>(data);
+    slot->size = size;
+    slot->fd = fd;
+    slot->first_file = file_number;
+    slot->file_count = static_cast<uint16_t>(file_count);
+    return 0;
+  }
+
+  /*
+   * Flush and unmap the file opened as file_number
+   * */
+  void Close(const uint16_t file_number) {
+    Mapping *const mapping = Find(file_number);
+    if (mapping == nullptr) {
+      return;
+    }
+    if (mapping->dirty_start != mapping->dirty_end || mapping->unflushed) {
+      msync(mapping->data, mapping->size, MS_SYNC);
+    }
+    munmap(mapping->data, mapping->size);
+    close(mapping->fd);
+    *mapping = Mapping{};
+  }
+
+  bool RecordsValid(const std::size_t file_number,
+                    const std::size_t record_number,
+                    const std::size_t record_count) const {
+    const Mapping *const mapping = Find(file_number);
+    return mapping != nullptr && record_count > 0 &&
+           record_number + record_count <= kRecordsPerFile &&
+           GetOffset(*mapping, file_number, record_number) +
+                   record_count * kRecordSize <=
+               mapping->size;
+  }
+
+  /*
+   * The records in Modbus byte order, straight from the mapping
+   * */
+  const uint8_t *GetRecords(const std::size_t file_number,
+                            const std::size_t record_number) const {
+    const Mapping *const mapping = Find(file_number);
+    assert(mapping != nullptr);
+    return &mapping->data[GetOffset(*mapping, file_number, record_number)];
+  }
+
+  void ReadRecords(const std::size_t file_number,
+                   const std::size_t record_number,
+                   const std::size_t record_count, uint8_t *data) const {
+    assert(RecordsValid(file_number, record_number, record_count));
+    std::memcpy(data, GetRecords(file_number, record_number),
+                record_count * kRecordSize);
+  }
+
+  void WriteRecords(const std::size_t file_number,
+                    const std::size_t record_number,
+                    const std::size_t record_count, const uint8_t *data) {
+    assert(RecordsValid(file_number, record_number, record_count));
+    Mapping *const mapping = Find(file_number);
+    const std::size_t start = GetOffset(*mapping, file_number, record_number);
+    const std::size_t end = start + record_count * kRecordSize;
+    std::memcpy(&mapping->data[start], data, end - start);
+    if (mapping->dirty_start == mapping->dirty_end) {
+      mapping->dirty_start = start;
+      mapping->dirty_end = end;
+    } else {
+      mapping->dirty_start =
+          start < mapping->dirty_start ? start : mapping->dirty_start;
+      mapping->dirty_end = end > mapping->dirty_end ? end : mapping->dirty_end;
+    }
+  }
+
+  /*
+   * Start writeback of the dirty span of each file, returns without waiting
+   * for it. Returns 0 or the negative errno of the last failure, which is
+   * also kept for GetSyncError.
+   * */
+  int Sync(void) {
+    int result = 0;
+    for (auto &mapping : mappings_) {
+      if (mapping.dirty_start == mapping.dirty_end) {
+        continue;
+      }
+      //  The mapping starts at offset 0 of the file
+      if (sync_file_range(mapping.fd, static_cast<off_t>(mapping.dirty_start),
+                          static_cast<off_t>(mapping.dirty_end -
+                                             mapping.dirty_start),
+                          SYNC_FILE_RANGE_WRITE) != 0) {
+        result = -errno;
+        sync_error_ = result;
+      }
+      mapping.dirty_start = mapping.dirty_end = 0;
+      mapping.unflushed = true;
+    }
+    return result;
+  }
+
+  /*
+   * Sync and then wait until every file written since the last flush is on
+   * the disk. Blocks on the disk, so call it off the response path. Returns
+   * 0 or the negative errno of the last failure, a failed file is retried by
+   * the next flush.
+   * */
+  int Flush(void) {
+    int result = Sync();
+    for (auto &mapping : mappings_) {
+      if (!mapping.unflushed) {
+        continue;
+      }
+      if (msync(mapping.data, mapping.size, MS_SYNC) != 0) {
+        result = -errno;
+        sync_error_ = result;
+      } else {
+        mapping.unflushed = false;
+      }
+    }
+    return result;
+  }
+  bool IsFlushed(void) const {
+    for (const auto &mapping : mappings_) {
+      if (mapping.unflushed || mapping.dirty_start != mapping.dirty_end) {
+        return false;
+      }
+    }
+    return true;
+  }
+  int GetSyncError(void) const { return sync_error_; }
+
+  void set_records_callback(std::size_t, std::size_t, std::size_t) {}
+};
+}  //  namespace Modbus
+
+#endif  //  MODBUS_MMAPFILESTORE_H_
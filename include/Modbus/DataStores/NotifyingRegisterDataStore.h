@@ -0,0 +1,228 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        NotifyingRegisterDataStore.h
+ * Description:  Register store that wakes subscribers through an eventfd
+ *               when a master writes their range
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ *
+ * Target Processor: Linux system
+ * ----------------------------------------------------------------------
+ *
+ * Application threads subscribe to register ranges during setup. Each
+ * subscription has an eventfd to wait on with poll or epoll and a single
+ * producer, single consumer queue of the writes that touched its range.
+ *
+ * The write callbacks run on the protocol thread before the response is
+ * sent. They only queue the write for each overlapping subscription, found
+ * through a mask of subscriptions per 64 register page, so the cost does not
+ * grow with the number of subscriptions. Wakes are left to Publish, called
+ * once the response is on its way. Publish writes a subscription's eventfd
+ * only when its consumer has drained the queue since the last wake, so a
+ * burst of writes costs one wake per subscriber.
+ *
+ * A write that finds a full queue marks the subscription overflowed, its
+ * consumer is then given the whole range once.
+ */
+
+#pragma once
+#ifndef MODBUS_NOTIFYINGREGISTERDATASTORE_H_
+#define MODBUS_NOTIFYINGREGISTERDATASTORE_H_
+#include <ArrayView/ArrayView.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include "Modbus/DataStores/RegisterDataStore.h"
+
+namespace Modbus {
+struct RegisterWrite {
+  uint16_t address = 0;
+  uint16_t count = 0;
+};
+
+template <std::size_t kMaxSubscriptions = 16, std::size_t kQueueSize = 64>
+class NotifyingRegisterDataStore : public RegisterDataStore {
+  static_assert(kMaxSubscriptions > 0 && kMaxSubscriptions <= 64,
+                "Subscriptions are kept in a 64 bit mask");
+  static_assert(kQueueSize > 0 && (kQueueSize & (kQueueSize - 1)) == 0,
+                "Queue size must be a power of two");
+  static const constexpr std::size_t kCacheLine = 64;
+  static const constexpr std::size_t kPageBits = 6;
+  static const constexpr std::size_t kPageCount =
+      (std::size_t{1} << 16) >> kPageBits;
+
+  struct Subscription {
+    //  Written by the protocol thread
+    alignas(kCacheLine) std::atomic<std::size_t> tail{0};
+    std::atomic<bool> overflowed{false};
+    //  Written by the consumer
+    alignas(kCacheLine) std::atomic<std::size_t> head{0};
+    std::atomic<bool> armed{true};
+    std::array<RegisterWrite, kQueueSize> writes{};
+    std::size_t first = 0;  //  index
+    std::size_t count = 0;
+    int fd = -1;
+  };
+
+  std::array<Subscription, kMaxSubscriptions> subscriptions_{};
+  std::size_t subscription_count_ = 0;
+  std::array<uint64_t, kPageCount> page_masks_{};
+  uint64_t pending_ = 0;  //  Subscriptions queued to since Publish
+
+  void Queue(const std::size_t first, const std::size_t count) {
+    uint64_t candidates = 0;
+    for (std::size_t page = first >> kPageBits;
+         page <= (first + count - 1) >> kPageBits; page++) {
+      candidates |= page_masks_[page];
+    }
+    while (candidates != 0) {
+      const std::size_t id =
+          static_cast<std::size_t>(__builtin_ctzll(candidates));
+      candidates &= candidates - 1;
+      Subscription& subscription = subscriptions_[id];
+      if (first >= subscription.first + subscription.count ||
+          subscription.first >= first + count) {
+        continue;
+      }
+      const std::size_t tail =
+          subscription.tail.load(std::memory_order_relaxed);
+      if (tail - subscription.head.load(std::memory_order_acquire) ==
+          kQueueSize) {
+        subscription.overflowed.store(true, std::memory_order_release);
+      } else {
+        subscription.writes[tail & (kQueueSize - 1)] = RegisterWrite{
+            static_cast<uint16_t>(first + GetAddressStart()),
+            static_cast<uint16_t>(count)};
+        subscription.tail.store(tail + 1, std::memory_order_release);
+      }
+      pending_ |= uint64_t{1} << id;
+    }
+  }
+
+ public:
+  NotifyingRegisterDataStore(uint16_t* data, const size_t length)
+      : RegisterDataStore{data, length} {}
+  ~NotifyingRegisterDataStore(void) {
+    for (std::size_t i = 0; i < subscription_count_; i++) {
+      close(subscriptions_[i].fd);
+    }
+  }
+  NotifyingRegisterDataStore(const NotifyingRegisterDataStore&) = delete;
+  NotifyingRegisterDataStore& operator=(const NotifyingRegisterDataStore&) =
+      delete;
+
+  /*
+   * Setup only, not safe while the slave is serving. Returns the
+   * subscription id or -errno.
+   * */
+  int Subscribe(const std::size_t address, const std::size_t count) {
+    if (count == 0 || !ReadLocationValid(address, count)) {
+      return -EINVAL;
+    }
+    if (subscription_count_ == kMaxSubscriptions) {
+      return -ENOSPC;
+    }
+    const int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+      return -errno;
+    }
+    const std::size_t id = subscription_count_++;
+    Subscription& subscription = subscriptions_[id];
+    subscription.first = GetIndex(address);
+    subscription.count = count;
+    subscription.fd = fd;
+    for (std::size_t page = subscription.first >> kPageBits;
+         page <= (subscription.first + count - 1) >> kPageBits; page++) {
+      page_masks_[page] |= uint64_t{1} << id;
+    }
+    return static_cast<int>(id);
+  }
+
+  //  Readable when writes are waiting, for poll or epoll
+  int GetFileDescriptor(const int id) const {
+    assert(static_cast<std::size_t>(id) < subscription_count_);
+    return subscriptions_[static_cast<std::size_t>(id)].fd;
+  }
+
+  void set_register_callback(std::size_t address, uint16_t) {
+    Queue(GetIndex(address), 1);
+  }
+
+  void set_registers_callback(std::size_t address, std::size_t register_count,
+                              const ArrayView<const uint8_t>&) {
+    Queue(GetIndex(address), register_count);
+  }
+
+  /*
+   * Protocol thread, after the response has been sent. The slave's
+   * ResponseSent calls it through HoldingRegisterController. Wakes each
+   * subscription queued to whose consumer is waiting.
+   * */
+  void Publish(void) {
+    if (pending_ == 0) {
+      return;
+    }
+    //  Pairs with the fence in TakeWrites so a wake is never lost
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (pending_ != 0) {
+      const std::size_t id =
+          static_cast<std::size_t>(__builtin_ctzll(pending_));
+      pending_ &= pending_ - 1;
+      Subscription& subscription = subscriptions_[id];
+      if (subscription.armed.exchange(false, std::memory_order_acq_rel)) {
+        const uint64_t one = 1;
+        (void)!write(subscription.fd, &one, sizeof(one));
+      }
+    }
+  }
+
+  /*
+   * Consumer of subscription id. Calls function(address, count) for each
+   * queued write, clipped to the subscribed range, or once for the whole
+   * range after an overflow. Returns the number of calls.
+   * */
+  template <typename TFunction>
+  std::size_t TakeWrites(const int id, TFunction&& function) {
+    assert(static_cast<std::size_t>(id) < subscription_count_);
+    Subscription& subscription = subscriptions_[static_cast<std::size_t>(id)];
+    uint64_t wakes = 0;
+    (void)!read(subscription.fd, &wakes, sizeof(wakes));
+    subscription.armed.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    const std::size_t head = subscription.head.load(std::memory_order_relaxed);
+    const std::size_t tail = subscription.tail.load(std::memory_order_acquire);
+    const std::size_t start = subscription.first + GetAddressStart();
+    std::size_t calls = 0;
+    if (subscription.overflowed.exchange(false, std::memory_order_acquire)) {
+      function(start, subscription.count);
+      calls++;
+    } else {
+      for (std::size_t i = head; i != tail; i++) {
+        const RegisterWrite& queued = subscription.writes[i & (kQueueSize - 1)];
+        const std::size_t first =
+            queued.address > start ? queued.address : start;
+        const std::size_t end =
+            queued.address + queued.count < start + subscription.count
+                ? queued.address + queued.count
+                : start + subscription.count;
+        function(first, end - first);
+        calls++;
+      }
+    }
+    subscription.head.store(tail, std::memory_order_release);
+    return calls;
+  }
+};
+}  //  namespace Modbus
+
+#endif  //  MODBUS_NOTIFYINGREGISTERDATASTORE_H_
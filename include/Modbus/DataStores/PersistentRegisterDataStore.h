@@ -0,0 +1,313 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        PersistentRegisterDataStore.h
+ * Description:  Register store saved to a mapped file in the background
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ *
+ * Target Processor: Linux system
+ * ----------------------------------------------------------------------
+ *
+ * The registers are served from memory as in RegisterDataStore, a write
+ * only sets a flag. Flush copies the registers into one of two slots of a
+ * mapped file and msyncs it, the flusher thread does so at most once per
+ * interval however many writes were made.
+ *
+ * The file holds a header with a magic number, version and register count,
+ * then slots A and B. Each slot has a sequence number and a CRC16 over the
+ * sequence, count and registers, which are kept in Modbus byte order. Flush
+ * always writes the slot not holding the newest image, so a crash during a
+ * flush leaves the previous image intact. Open loads the valid slot with the
+ * highest sequence, a file with a different layout is started afresh and the
+ * registers keep the values they were constructed with.
+ *
+ * A flush copying while a multiple register write lands may save part of
+ * it, the write marks the store dirty again and the next flush saves the
+ * rest.
+ */
+
+#pragma once
+#ifndef MODBUS_PERSISTENTREGISTERDATASTORE_H_
+#define MODBUS_PERSISTENTREGISTERDATASTORE_H_
+#include <ArrayView/ArrayView.h>
+#include <Modbus/ByteSwap.h>
+#include <Modbus/Crc.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include "Modbus/DataStores/RegisterDataStore.h"
+
+namespace Modbus {
+class PersistentRegisterDataStore : public RegisterDataStore {
+ public:
+  static const constexpr uint32_t kMagic = 0x4d425253;  //  "MBRS"
+  static const constexpr uint16_t kVersion = 1;
+
+ private:
+  struct FileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t register_count;
+    uint32_t slot_size;
+  };
+  struct SlotHeader {
+    uint64_t sequence;
+    uint32_t register_count;
+    uint16_t crc;
+    uint16_t reserved;
+  };
+  static const constexpr std::size_t kSlotHeaderSize = 64;
+  static_assert(sizeof(SlotHeader) <= kSlotHeaderSize, "Slot header size");
+
+  uint8_t* map_ = nullptr;
+  std::size_t map_size_ = 0;
+  std::size_t slot_size_ = 0;
+  int fd_ = -1;
+  uint64_t sequence_ = 0;  //  Of the newest slot
+  std::size_t newest_slot_ = 1;
+  bool recovered_ = false;
+  std::atomic<bool> dirty_{false};
+  std::atomic<int> sync_error_{0};
+
+  std::mutex flush_mutex_;
+  std::mutex flusher_mutex_;
+  std::condition_variable flusher_wake_;
+  bool flusher_stop_ = false;
+  std::thread flusher_;
+
+  static std::size_t GetPageSize(void) {
+    static const std::size_t kPageSize =
+        static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    return kPageSize;
+  }
+  static std::size_t RoundToPage(const std::size_t size) {
+    return (size + GetPageSize() - 1) & ~(GetPageSize() - 1);
+  }
+
+  uint8_t* GetSlot(const std::size_t slot) const {
+    return &map_[GetPageSize() + slot * slot_size_];
+  }
+
+  uint16_t GetSlotCrc(const uint8_t* slot) const {
+    const std::size_t covered =
+        offsetof(SlotHeader, register_count) + sizeof(uint32_t);
+    const uint16_t crc = Crc16Update(kCrc16Initial, slot, covered);
+    return Crc16Update(crc, &slot[kSlotHeaderSize],
+                       GetSize() * sizeof(uint16_t));
+  }
+
+  bool SlotValid(const std::size_t slot, uint64_t* sequence) const {
+    SlotHeader header{};
+    std::memcpy(&header, GetSlot(slot), sizeof(header));
+    *sequence = header.sequence;
+    return header.sequence != 0 && header.register_count == GetSize() &&
+           header.crc == GetSlotCrc(GetSlot(slot));
+  }
+
+  //  Loads the newest valid slot, false when neither is valid
+  bool Recover(void) {
+    FileHeader header{};
+    std::memcpy(&header, map_, sizeof(header));
+    if (header.magic != kMagic || header.version != kVersion ||
+        header.register_count != GetSize() || header.slot_size != slot_size_) {
+      return false;
+    }
+    std::array<uint64_t, 2> sequences{};
+    std::array<bool, 2> valid{};
+    for (std::size_t slot = 0; slot < 2; slot++) {
+      valid[slot] = SlotValid(slot, &sequences[slot]);
+    }
+    if (!valid[0] && !valid[1]) {
+      return false;
+    }
+    newest_slot_ =
+        valid[0] && (!valid[1] || sequences[0] > sequences[1]) ? 0 : 1;
+    sequence_ = sequences[newest_slot_];
+    uint16_t* const registers = GetData();
+    BytesToRegisters(&GetSlot(newest_slot_)[kSlotHeaderSize], registers,
+                     GetSize());
+    return true;
+  }
+
+  int Initialize(void) {
+    std::memset(map_, 0, map_size_);
+    const FileHeader header{kMagic, kVersion, 0,
+                            static_cast<uint32_t>(GetSize()),
+                            static_cast<uint32_t>(slot_size_)};
+    std::memcpy(map_, &header, sizeof(header));
+    sequence_ = 0;
+    newest_slot_ = 1;
+    dirty_.store(true, std::memory_order_release);  //  Save the defaults
+    return msync(map_, map_size_, MS_SYNC) == 0 ? 0 : -errno;
+  }
+
+  void RunFlusher(const std::chrono::milliseconds interval) {
+    std::unique_lock<std::mutex> lock{flusher_mutex_};
+    while (!flusher_stop_) {
+      flusher_wake_.wait_for(lock, interval, [this] { return flusher_stop_; });
+      lock.unlock();
+      Flush();
+      lock.lock();
+    }
+  }
+
+ public:
+  PersistentRegisterDataStore(uint16_t* data, const size_t length)
+      : RegisterDataStore{data, length} {}
+  ~PersistentRegisterDataStore(void) { Close(); }
+  PersistentRegisterDataStore(const PersistentRegisterDataStore&) = delete;
+  PersistentRegisterDataStore& operator=(const PersistentRegisterDataStore&) =
+      delete;
+
+  /*
+   * Map the file at path, creating it if needed, and load the saved
+   * registers from it. Returns 0 or a negative errno, IsRecovered tells
+   * whether registers were loaded.
+   * */
+  int Open(const char* path) {
+    if (map_ != nullptr) {
+      return -EBUSY;
+    }
+    slot_size_ = RoundToPage(kSlotHeaderSize + GetSize() * sizeof(uint16_t));
+    map_size_ = GetPageSize() + 2 * slot_size_;
+    const int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      return -errno;
+    }
+    struct stat status {};
+    if (fstat(fd, &status) != 0 ||
+        (static_cast<std::size_t>(status.st_size) != map_size_ &&
+         ftruncate(fd, static_cast<off_t>(map_size_)) != 0)) {
+      const int error = errno;
+      close(fd);
+      return -error;
+    }
+    void* const map =
+        mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      const int error = errno;
+      close(fd);
+      return -error;
+    }
+    map_ = static_cast<uint8_t*>(map);
+    fd_ = fd;
+    recovered_ = Recover();
+    if (recovered_) {
+      return 0;
+    }
+    const int error = Initialize();
+    if (error != 0) {
+      munmap(map_, map_size_);
+      close(fd_);
+      map_ = nullptr;
+      fd_ = -1;
+    }
+    return error;
+  }
+
+  //  Stops the flusher, saves any unsaved writes and unmaps the file
+  void Close(void) {
+    StopFlusher();
+    if (map_ == nullptr) {
+      return;
+    }
+    Flush();
+    munmap(map_, map_size_);
+    close(fd_);
+    map_ = nullptr;
+    fd_ = -1;
+  }
+
+  bool IsRecovered(void) const { return recovered_; }
+  bool IsDirty(void) const { return dirty_.load(std::memory_order_acquire); }
+  uint64_t GetSequence(void) {
+    std::lock_guard<std::mutex> lock{flush_mutex_};
+    return sequence_;
+  }
+  int GetSyncError(void) const {
+    return sync_error_.load(std::memory_order_relaxed);
+  }
+
+  void set_register_callback(std::size_t, uint16_t) {
+    dirty_.store(true, std::memory_order_release);
+  }
+  void set_registers_callback(std::size_t, std::size_t,
+                              const ArrayView<const uint8_t>&) {
+    dirty_.store(true, std::memory_order_release);
+  }
+
+  /*
+   * Saves the registers to the older slot if written since the last flush.
+   * Returns 0 or the negative errno of a failed msync, the store is left
+   * dirty so the next flush retries.
+   * */
+  int Flush(void) {
+    std::lock_guard<std::mutex> lock{flush_mutex_};
+    if (map_ == nullptr || !dirty_.exchange(false, std::memory_order_acq_rel)) {
+      return 0;
+    }
+    const std::size_t slot = newest_slot_ ^ 1;
+    uint8_t* const target = GetSlot(slot);
+    //  The protocol thread may be writing, each register is loaded whole
+    uint8_t* bytes = &target[kSlotHeaderSize];
+    for (std::size_t i = 0; i < GetSize(); i++) {
+      const uint16_t value = GetRegister(GetAddressStart() + i);
+      *bytes++ = Utilities::GetByte(value, 1);
+      *bytes++ = Utilities::GetByte(value, 0);
+    }
+    SlotHeader header{sequence_ + 1, static_cast<uint32_t>(GetSize()), 0, 0};
+    std::memcpy(target, &header, sizeof(header));
+    header.crc = GetSlotCrc(target);
+    std::memcpy(target, &header, sizeof(header));
+    if (msync(target, slot_size_, MS_SYNC) != 0) {
+      const int error = -errno;
+      sync_error_.store(error, std::memory_order_relaxed);
+      dirty_.store(true, std::memory_order_release);
+      return error;
+    }
+    newest_slot_ = slot;
+    sequence_++;
+    return 0;
+  }
+
+  /*
+   * Flush from a background thread every interval
+   * */
+  void StartFlusher(const std::chrono::milliseconds interval) {
+    StopFlusher();
+    flusher_stop_ = false;
+    flusher_ = std::thread{&PersistentRegisterDataStore::RunFlusher, this,
+                           interval};
+  }
+
+  void StopFlusher(void) {
+    if (!flusher_.joinable()) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock{flusher_mutex_};
+      flusher_stop_ = true;
+    }
+    flusher_wake_.notify_all();
+    flusher_.join();
+  }
+};
+}  //  namespace Modbus
+
+#endif  //  MODBUS_PERSISTENTREGISTERDATASTORE_H_
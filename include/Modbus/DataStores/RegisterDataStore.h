@@ -1,4 +1,6 @@
+#pragma once
 #include <ArrayView/ArrayView.h>
+#include <Modbus/ByteSwap.h>
 #include <Utilities/CommonTypes.h>
 #include <Utilities/Crc.h>
 #include <Utilities/TypeConversion.h>
@@ -10,15 +12,20 @@
 #include <utility>  // pair
 
 #include "Modbus/DataStores/DataStore.h"
+#include "Modbus/DataStores/DirtyBitmap.h"
 
 namespace Modbus {
 class RegisterDataStore : public DataStore {
   std::pair<uint16_t*, size_t> data_store_;
 
  protected:
-  static std::size_t GetIndex(const uint16_t address) {
+  static std::size_t GetIndex(const std::size_t address) {
     return address - GetAddressStart();
   }
+  uint16_t* GetData(void) const { return data_store_.first; }
+  void SetData(uint16_t* data, const size_t length) {
+    data_store_ = {data, length};
+  }
 
  public:
   RegisterDataStore(uint16_t* data, const size_t length)
@@ -37,74 +44,103 @@ class RegisterDataStore : public DataStore {
   static constexpr std::size_t GetRegisterByteSize(void) {
     return sizeof(uint16_t);
   }
+  //  Single registers are loaded and stored with atomics so GetRegister,
+  //  SetRegister and MaskWriteRegister may run on different threads
   uint16_t GetRegister(const std::size_t address) const {
     const size_t index = GetIndex(address);
     assert(index < data_store_.second);
-    return data_store_.first[index];
+    return __atomic_load_n(&data_store_.first[index], __ATOMIC_RELAXED);
   }
 
+  //  Bulk copies go through the ByteSwap.h kernels, which are plain vector
+  //  loads and stores. Running them while another thread writes the same
+  //  registers is a data race, use SeqlockRegisterDataStore for that.
   void GetRegisters(const std::size_t address, const std::size_t register_count,
                     ArrayView<uint8_t>* data_view) {
-    const std::size_t num_data_bytes = register_count * sizeof(uint16_t);
-    std::size_t register_index = address;
-    for (std::size_t byte_number = 0; byte_number < num_data_bytes;) {
-      const uint16_t state = GetRegister(register_index++);
-      data_view->operator[](byte_number++) = Utilities::GetByte(state, 1);
-      data_view->operator[](byte_number++) = Utilities::GetByte(state, 0);
-    }
+    assert(data_view->size() >= register_count * sizeof(uint16_t));
+    assert(GetIndex(address) + register_count <= data_store_.second);
+    RegistersToBytes(&data_store_.first[GetIndex(address)], data_view->data(),
+                     register_count);
   }
 
-  //  void set_register_callback(std::size_t, uint16_t) {}
-  //  void set_registers_callback(std::size_t, std::size_t, const
-  //  ArrayView<const uint8_t>&) {}
+  void set_register_callback(std::size_t, uint16_t) {}
+  void set_registers_callback(std::size_t, std::size_t,
+                              const ArrayView<const uint8_t>&) {}
 
   void SetRegister(std::size_t address, uint16_t value) {
-    data_store_.first[GetIndex(address)] = value;
+    __atomic_store_n(&data_store_.first[GetIndex(address)], value,
+                     __ATOMIC_RELAXED);
+  }
+
+  /*
+   * Function 22, applied with a compare and swap so a write made between
+   * loading the register and storing the result is not lost. Returns the
+   * new value.
+   * */
+  uint16_t MaskWriteRegister(std::size_t address, uint16_t and_mask,
+                             uint16_t or_mask) {
+    uint16_t* const value = &data_store_.first[GetIndex(address)];
+    uint16_t current = __atomic_load_n(value, __ATOMIC_RELAXED);
+    uint16_t result = 0;
+    do {
+      result = static_cast<uint16_t>((current & and_mask) |
+                                     (or_mask & ~and_mask));
+    } while (!__atomic_compare_exchange_n(value, &current, result, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return result;
   }
 
   void SetRegisters(std::size_t address, std::size_t register_count,
                     const ArrayView<const uint8_t>& data_view) {
-    for (std::size_t index = 0; index < register_count; index++) {
-      const std::size_t byte_index = index * sizeof(uint16_t);
-      const ArrayView<const uint8_t> uint16_data_view{sizeof(uint16_t),
-                                                      &data_view[byte_index]};
-      const uint16_t value =
-          Utilities::Make_MSB_uint16_tFromU8Array(uint16_data_view);
-      SetRegister(address + index, value);
-    }
+    assert(data_view.size() >= register_count * sizeof(uint16_t));
+    assert(GetIndex(address) + register_count <= data_store_.second);
+    BytesToRegisters(data_view.data(), &data_store_.first[GetIndex(address)],
+                     register_count);
   }
 };
 
-inline bool is_true(const bool value) { return value; }
-
+/*
+ * Marks the registers written by functions 6, 16, 22 and 23 in a DirtyBitmap so
+ * the application can handle only what changed. Marking and taking may run
+ * on different threads.
+ * */
+template <std::size_t kRegisterCount>
 class UpdatingRegisterDataStore : public RegisterDataStore {
-  std::pair<bool*, size_t> flags_;
+  DirtyBitmap<kRegisterCount> flags_{};
 
  public:
-  UpdatingRegisterDataStore(uint16_t* data, const size_t length, bool* flags)
-      : RegisterDataStore{data, length}, flags_{flags, length} {}
+  UpdatingRegisterDataStore(uint16_t* data, const size_t length)
+      : RegisterDataStore{data, length} {
+    assert(length <= kRegisterCount);
+  }
 
   bool flag_set(const std::size_t address) const {
-    return flags_.first[std::min(address, flags_.second - 1)];
+    const std::size_t index = GetIndex(address);
+    return index < GetSize() && flags_.IsMarked(index);
   }
 
   void set_register_callback(std::size_t address, uint16_t) {
-    flags_.first[GetIndex(address)] = true;
+    flags_.Mark(GetIndex(address));
   }
 
   void set_registers_callback(std::size_t address, std::size_t register_count,
                               const ArrayView<const uint8_t>&) {
-    for (size_t i = 0; i < register_count; i++) {
-      flags_.first[GetIndex(address + i)] = true;
-    }
+    flags_.Mark(GetIndex(address), register_count);
   }
 
-  bool new_data_available() const {
-    return std::any_of(flags_.first, flags_.first + flags_.second - 1, is_true);
-  }
+  bool new_data_available() const { return flags_.Any(); }
+
+  void clear_new_data_flags() { flags_.Clear(); }
 
-  void clear_new_data_flags() {
-    std::fill(flags_.first, flags_.first + flags_.second - 1, false);
+  /*
+   * Clears the flags and calls function(address, register_count) for each
+   * run of changed registers. Returns the number of registers changed.
+   * */
+  template <typename TFunction>
+  std::size_t take_new_data(TFunction&& function) {
+    return flags_.Take([&](const std::size_t index, const std::size_t count) {
+      function(index + GetAddressStart(), count);
+    });
   }
 };
 }  //  namespace Modbus
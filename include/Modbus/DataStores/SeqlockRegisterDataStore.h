@@ -0,0 +1,252 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        SeqlockRegisterDataStore.h
+ * Description:  Register store that application threads update while the
+ *               protocol thread serves it, reads never see half an update
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ *
+ * Target Processor: Linux system
+ * ----------------------------------------------------------------------
+ *
+ * A value spread over several registers, a 64 bit count in four, is torn
+ * in a plain RegisterDataStore when function 3 or 4 reads it while another
+ * thread is part way through storing it. Here the registers are split into
+ * regions of kRegionSize, each with a sequence count that is odd while a
+ * write to the region is in progress.
+ *
+ * A writer takes the regions it covers in ascending order by making their
+ * counts odd with a compare and swap, so writers from several threads are
+ * serialized per region without a mutex and never deadlock. A reader notes
+ * the counts of the regions it covers, copies and copies again if any count
+ * was odd or has changed, so the whole range read is one snapshot. Reads
+ * take no lock and never block a writer, a reader only waits while a write
+ * to its range is in progress.
+ *
+ * Application threads publish values with Write and read them back with
+ * Read, writes from the master go through the same regions.
+ */
+
+#pragma once
+#ifndef MODBUS_SEQLOCKREGISTERDATASTORE_H_
+#define MODBUS_SEQLOCKREGISTERDATASTORE_H_
+#include <ArrayView/ArrayView.h>
+#include <sched.h>
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include "Modbus/DataStores/RegisterDataStore.h"
+
+namespace Modbus {
+//  Sequence count of one region, one per cache line so writers to
+//  neighbouring regions do not contend
+struct SeqlockSequence {
+  static const constexpr std::size_t kCacheLine = 64;
+  alignas(kCacheLine) uint32_t value = 0;
+};
+
+/*
+ * The seqlock over an array of region counts, shared by the stores here and
+ * SharedRegisterDataStore, whose counts are in shared memory
+ * */
+template <std::size_t kRegisterCount, std::size_t kRegionSize>
+struct SeqlockRegions {
+  static_assert(kRegisterCount > 0 && kRegionSize > 0, "Empty store");
+  static const constexpr std::size_t kRegionCount =
+      (kRegisterCount + kRegionSize - 1) / kRegionSize;
+
+  static std::size_t GetRegion(const std::size_t index) {
+    return index / kRegionSize;
+  }
+
+  //  Takes the regions of the registers at index in ascending order,
+  //  waiting out another writer holding one
+  static void BeginWrite(SeqlockSequence* sequences, const std::size_t index,
+                         const std::size_t count) {
+    for (std::size_t region = GetRegion(index);
+         region <= GetRegion(index + count - 1); region++) {
+      uint32_t* const sequence = &sequences[region].value;
+      uint32_t current = __atomic_load_n(sequence, __ATOMIC_RELAXED);
+      while ((current & 1) != 0 ||
+             !__atomic_compare_exchange_n(sequence, &current, current + 1,
+                                          true, __ATOMIC_ACQUIRE,
+                                          __ATOMIC_RELAXED)) {
+        if ((current & 1) != 0) {
+          sched_yield();
+          current = __atomic_load_n(sequence, __ATOMIC_RELAXED);
+        }
+      }
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+  }
+
+  static void EndWrite(SeqlockSequence* sequences, const std::size_t index,
+                       const std::size_t count) {
+    for (std::size_t region = GetRegion(index);
+         region <= GetRegion(index + count - 1); region++) {
+      __atomic_fetch_add(&sequences[region].value, 1, __ATOMIC_RELEASE);
+    }
+  }
+
+  /*
+   * Runs copy until no write to the regions of the registers at index
+   * overlapped it. Returns false once a region has stayed mid write for
+   * max_stalled_yields yields, as when its writer died during the write,
+   * 0 waits for ever.
+   * */
+  template <typename TCopy>
+  static bool ReadConsistent(const SeqlockSequence* sequences,
+                             const std::size_t index, const std::size_t count,
+                             TCopy&& copy,
+                             const std::size_t max_stalled_yields = 0) {
+    const std::size_t first = GetRegion(index);
+    const std::size_t last = GetRegion(index + count - 1);
+    std::array<uint32_t, kRegionCount> before{};
+    uint32_t stalled = 0;
+    std::size_t stalled_yields = 0;
+    while (true) {
+      uint32_t sequence = 0;
+      for (std::size_t region = first; region <= last && (sequence & 1) == 0;
+           region++) {
+        sequence = __atomic_load_n(&sequences[region].value, __ATOMIC_ACQUIRE);
+        before[region] = sequence;
+      }
+      if ((sequence & 1) != 0) {
+        if (sequence != stalled) {
+          stalled = sequence;
+          stalled_yields = 0;
+        } else if (++stalled_yields == max_stalled_yields) {
+          return false;
+        }
+        sched_yield();
+        continue;
+      }
+      copy();
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      bool stable = true;
+      for (std::size_t region = first; region <= last && stable; region++) {
+        stable = __atomic_load_n(&sequences[region].value,
+                                 __ATOMIC_RELAXED) == before[region];
+      }
+      if (stable) {
+        return true;
+      }
+    }
+  }
+};
+
+/*
+ * The store over region counts kept elsewhere, see SeqlockRegisterDataStore
+ * for one that holds its own
+ * */
+template <std::size_t kRegisterCount, std::size_t kRegionSize>
+class SeqlockRegisterDataStoreBase : public RegisterDataStore {
+ protected:
+  using Regions = SeqlockRegions<kRegisterCount, kRegionSize>;
+
+ private:
+  SeqlockSequence* sequences_;
+
+ protected:
+  SeqlockRegisterDataStoreBase(uint16_t* data, const size_t length,
+                               SeqlockSequence* sequences)
+      : RegisterDataStore{data, length}, sequences_{sequences} {
+    assert(length <= kRegisterCount);
+  }
+
+  void SetSequences(SeqlockSequence* sequences) { sequences_ = sequences; }
+
+  void BeginWrite(const std::size_t index, const std::size_t count) {
+    Regions::BeginWrite(sequences_, index, count);
+  }
+
+  void EndWrite(const std::size_t index, const std::size_t count) {
+    Regions::EndWrite(sequences_, index, count);
+  }
+
+  template <typename TCopy>
+  void ReadConsistent(const std::size_t index, const std::size_t count,
+                      TCopy&& copy) const {
+    Regions::ReadConsistent(sequences_, index, count, copy);
+  }
+
+ public:
+  /*
+   * Publish count registers from address as one update, a read of any of
+   * them sees all or none of it
+   * */
+  void Write(const std::size_t address, const std::size_t count,
+             const uint16_t* values) {
+    assert(ReadLocationValid(address, count));
+    const std::size_t index = GetIndex(address);
+    uint16_t* const data = GetData();
+    BeginWrite(index, count);
+    for (std::size_t i = 0; i < count; i++) {
+      __atomic_store_n(&data[index + i], values[i], __ATOMIC_RELAXED);
+    }
+    EndWrite(index, count);
+  }
+
+  //  Copies count registers from address as one snapshot
+  void Read(const std::size_t address, const std::size_t count,
+            uint16_t* values) const {
+    assert(ReadLocationValid(address, count));
+    const std::size_t index = GetIndex(address);
+    const uint16_t* const data = GetData();
+    ReadConsistent(index, count, [&] {
+      for (std::size_t i = 0; i < count; i++) {
+        values[i] = __atomic_load_n(&data[index + i], __ATOMIC_RELAXED);
+      }
+    });
+  }
+
+  void GetRegisters(const std::size_t address, const std::size_t register_count,
+                    ArrayView<uint8_t>* data_view) {
+    ReadConsistent(GetIndex(address), register_count, [&] {
+      RegisterDataStore::GetRegisters(address, register_count, data_view);
+    });
+  }
+
+  void SetRegister(std::size_t address, uint16_t value) {
+    BeginWrite(GetIndex(address), 1);
+    RegisterDataStore::SetRegister(address, value);
+    EndWrite(GetIndex(address), 1);
+  }
+
+  uint16_t MaskWriteRegister(std::size_t address, uint16_t and_mask,
+                             uint16_t or_mask) {
+    BeginWrite(GetIndex(address), 1);
+    const uint16_t value =
+        RegisterDataStore::MaskWriteRegister(address, and_mask, or_mask);
+    EndWrite(GetIndex(address), 1);
+    return value;
+  }
+
+  void SetRegisters(std::size_t address, std::size_t register_count,
+                    const ArrayView<const uint8_t>& data_view) {
+    BeginWrite(GetIndex(address), register_count);
+    RegisterDataStore::SetRegisters(address, register_count, data_view);
+    EndWrite(GetIndex(address), register_count);
+  }
+};
+
+template <std::size_t kRegisterCount, std::size_t kRegionSize = 64>
+class SeqlockRegisterDataStore
+    : public SeqlockRegisterDataStoreBase<kRegisterCount, kRegionSize> {
+  using Base = SeqlockRegisterDataStoreBase<kRegisterCount, kRegionSize>;
+  std::array<SeqlockSequence, Base::Regions::kRegionCount> sequences_{};
+
+ public:
+  SeqlockRegisterDataStore(uint16_t* data, const size_t length)
+      : Base{data, length, nullptr} {
+    Base::SetSequences(sequences_.data());
+  }
+};
+}  //  namespace Modbus
+
+#endif  //  MODBUS_SEQLOCKREGISTERDATASTORE_H_
@@ -0,0 +1,294 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        SharedRegisterDataStore.h
+ * Description:  Register store in POSIX shared memory that other local
+ *               processes map read only
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ *
+ * Target Processor: Linux system
+ * ----------------------------------------------------------------------
+ *
+ * The slave process creates the segment with SharedRegisterDataStore and
+ * serves it like a RegisterDataStore. Other processes open it with
+ * SharedRegisterReader and copy registers straight out of the mapping, no
+ * Modbus traffic is involved.
+ *
+ * The segment holds the region sequence counts of SeqlockRegisterDataStore
+ * next to the registers, so the slave serves it with the same seqlock and a
+ * reader in another process copies a range as one snapshot, it never sees
+ * half of a multiple register write. The generation count goes up after
+ * every write, a reader polling for changes only compares it.
+ *
+ * Only the creating process writes, readers never write to the segment.
+ * The creator holds a lock on the segment while it is open so a second
+ * Create of the same name is refused until the first store is closed or its
+ * process exits.
+ */
+
+#pragma once
+#ifndef MODBUS_SHAREDREGISTERDATASTORE_H_
+#define MODBUS_SHAREDREGISTERDATASTORE_H_
+#include <ArrayView/ArrayView.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include "Modbus/DataStores/SeqlockRegisterDataStore.h"
+
+namespace Modbus {
+/*
+ * Layout of the shared segment. Counts are accessed with the __atomic
+ * builtins as the registers are in RegisterDataStore.
+ * */
+template <std::size_t kRegisterCount, std::size_t kRegionSize>
+struct SharedRegisterImage {
+  static const constexpr uint32_t kMagic = 0x4d425348;  //  "MBSH"
+  static const constexpr uint16_t kVersion = 2;
+  using Regions = SeqlockRegions<kRegisterCount, kRegionSize>;
+  static const constexpr std::size_t kRegionCount = Regions::kRegionCount;
+
+  uint32_t magic;
+  uint16_t version;
+  uint16_t region_size;
+  uint32_t register_count;
+  uint32_t reserved;
+  uint64_t generation;
+  SeqlockSequence sequences[kRegionCount];
+  uint16_t registers[kRegisterCount];
+
+  bool LayoutValid(void) const {
+    return __atomic_load_n(&magic, __ATOMIC_ACQUIRE) == kMagic &&
+           version == kVersion && region_size == kRegionSize &&
+           register_count == kRegisterCount;
+  }
+};
+
+template <std::size_t kRegisterCount, std::size_t kRegionSize = 64>
+class SharedRegisterDataStore
+    : public SeqlockRegisterDataStoreBase<kRegisterCount, kRegionSize> {
+  using Base = SeqlockRegisterDataStoreBase<kRegisterCount, kRegionSize>;
+
+ public:
+  using Image = SharedRegisterImage<kRegisterCount, kRegionSize>;
+
+ private:
+  Image* image_ = nullptr;
+  int fd_ = -1;
+
+  void Published(void) {
+    __atomic_fetch_add(&image_->generation, 1, __ATOMIC_RELEASE);
+  }
+
+ public:
+  SharedRegisterDataStore(void) : Base{nullptr, 0, nullptr} {}
+  ~SharedRegisterDataStore(void) { Close(); }
+  SharedRegisterDataStore(const SharedRegisterDataStore&) = delete;
+  SharedRegisterDataStore& operator=(const SharedRegisterDataStore&) = delete;
+
+  /*
+   * Create or reopen the segment name ("/name"). The registers of a segment
+   * with the same layout are kept, so a restarted slave carries on where it
+   * stopped. Returns 0, -EWOULDBLOCK if another store has the segment open
+   * or a negative errno, until then every address is invalid.
+   * */
+  int Create(const char* name, const mode_t mode = 0644) {
+    if (image_ != nullptr) {
+      return -EBUSY;
+    }
+    const int fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, mode);
+    if (fd < 0) {
+      return -errno;
+    }
+    struct stat status {};
+    //  The lock goes with the descriptor, so also with a crashed slave
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0 || fstat(fd, &status) != 0 ||
+        (static_cast<std::size_t>(status.st_size) != sizeof(Image) &&
+         ftruncate(fd, static_cast<off_t>(sizeof(Image))) != 0)) {
+      const int error = errno;
+      close(fd);
+      return -error;
+    }
+    void* const map = mmap(nullptr, sizeof(Image), PROT_READ | PROT_WRITE,
+                           MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      const int error = errno;
+      close(fd);
+      return -error;
+    }
+    image_ = static_cast<Image*>(map);
+    fd_ = fd;
+    if (image_->LayoutValid()) {
+      //  A write cut short by a crash leaves its regions odd
+      for (auto& sequence : image_->sequences) {
+        if ((sequence.value & 1) != 0) {
+          __atomic_store_n(&sequence.value, sequence.value + 1,
+                           __ATOMIC_RELEASE);
+        }
+      }
+    } else {
+      __atomic_store_n(&image_->magic, 0, __ATOMIC_RELAXED);
+      image_->version = Image::kVersion;
+      image_->region_size = static_cast<uint16_t>(kRegionSize);
+      image_->register_count = static_cast<uint32_t>(kRegisterCount);
+      for (auto& sequence : image_->sequences) {
+        sequence.value = 0;
+      }
+      for (auto& value : image_->registers) {
+        value = 0;
+      }
+      __atomic_store_n(&image_->magic, Image::kMagic, __ATOMIC_RELEASE);
+    }
+    Base::SetSequences(image_->sequences);
+    Base::SetData(image_->registers, kRegisterCount);
+    return 0;
+  }
+
+  //  Unmaps the segment, it stays for readers until Unlink
+  void Close(void) {
+    if (image_ == nullptr) {
+      return;
+    }
+    Base::SetData(nullptr, 0);
+    Base::SetSequences(nullptr);
+    munmap(image_, sizeof(Image));
+    close(fd_);
+    image_ = nullptr;
+    fd_ = -1;
+  }
+
+  static int Unlink(const char* name) {
+    return shm_unlink(name) == 0 ? 0 : -errno;
+  }
+
+  uint64_t GetGeneration(void) const {
+    return __atomic_load_n(&image_->generation, __ATOMIC_ACQUIRE);
+  }
+
+  void Write(const std::size_t address, const std::size_t count,
+             const uint16_t* values) {
+    Base::Write(address, count, values);
+    Published();
+  }
+
+  void SetRegister(std::size_t address, uint16_t value) {
+    Base::SetRegister(address, value);
+    Published();
+  }
+
+  uint16_t MaskWriteRegister(std::size_t address, uint16_t and_mask,
+                             uint16_t or_mask) {
+    const uint16_t value = Base::MaskWriteRegister(address, and_mask, or_mask);
+    Published();
+    return value;
+  }
+
+  void SetRegisters(std::size_t address, std::size_t register_count,
+                    const ArrayView<const uint8_t>& data_view) {
+    Base::SetRegisters(address, register_count, data_view);
+    Published();
+  }
+};
+
+/*
+ * Read only view of a segment made by SharedRegisterDataStore with the same
+ * kRegisterCount and kRegionSize
+ * */
+template <std::size_t kRegisterCount, std::size_t kRegionSize = 64>
+class SharedRegisterReader {
+ public:
+  using Image = SharedRegisterImage<kRegisterCount, kRegionSize>;
+
+ private:
+  //  Yields while one write stays in progress before the writer is taken
+  //  for dead
+  static const constexpr std::size_t kMaxStalledYields = 1 << 12;
+  const Image* image_ = nullptr;
+
+ public:
+  SharedRegisterReader(void) = default;
+  ~SharedRegisterReader(void) { Close(); }
+  SharedRegisterReader(const SharedRegisterReader&) = delete;
+  SharedRegisterReader& operator=(const SharedRegisterReader&) = delete;
+
+  /*
+   * Map the segment name read only. Returns 0, -EPROTO if its layout does
+   * not match or a negative errno.
+   * */
+  int Open(const char* name) {
+    if (image_ != nullptr) {
+      return -EBUSY;
+    }
+    const int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0) {
+      return -errno;
+    }
+    struct stat status {};
+    if (fstat(fd, &status) != 0) {
+      const int error = errno;
+      close(fd);
+      return -error;
+    }
+    if (static_cast<std::size_t>(status.st_size) != sizeof(Image)) {
+      close(fd);
+      return -EPROTO;
+    }
+    void* const map =
+        mmap(nullptr, sizeof(Image), PROT_READ, MAP_SHARED, fd, 0);
+    const int error = errno;
+    close(fd);  //  The mapping holds the segment
+    if (map == MAP_FAILED) {
+      return -error;
+    }
+    image_ = static_cast<const Image*>(map);
+    if (!image_->LayoutValid()) {
+      Close();
+      return -EPROTO;
+    }
+    return 0;
+  }
+
+  void Close(void) {
+    if (image_ != nullptr) {
+      munmap(const_cast<Image*>(image_), sizeof(Image));
+      image_ = nullptr;
+    }
+  }
+
+  bool IsOpen(void) const { return image_ != nullptr; }
+
+  uint64_t GetGeneration(void) const {
+    return __atomic_load_n(&image_->generation, __ATOMIC_ACQUIRE);
+  }
+
+  /*
+   * Copies count registers from address as one snapshot. Returns false if
+   * a write to them stayed in progress, as when the writer died during it.
+   * */
+  bool Read(const std::size_t address, const std::size_t count,
+            uint16_t* values) const {
+    const std::size_t first = address - DataStore::GetAddressStart();
+    assert(first + count <= kRegisterCount);
+    return Image::Regions::ReadConsistent(
+        image_->sequences, first, count,
+        [&] {
+          for (std::size_t i = 0; i < count; i++) {
+            values[i] = __atomic_load_n(&image_->registers[first + i],
+                                        __ATOMIC_RELAXED);
+          }
+        },
+        kMaxStalledYields);
+  }
+};
+}  //  namespace Modbus
+
+#endif  //  MODBUS_SHAREDREGISTERDATASTORE_H_
@@ -0,0 +1,230 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        SparseRegisterDataStore.h
+ * Description:  Register store covering the whole address space with pages
+ *               allocated on first write
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ *
+ * The 65536 registers are split into 256 pages of 256. A register is found
+ * through the page table by the high byte of its address and within the page
+ * by the low byte. A page is allocated when it is first written, so a device
+ * using addresses 0, 1000, 30000 and 40000 holds four pages, 2 kB of
+ * registers plus the 2 kB table.
+ *
+ * With UnallocatedRead::kZero every address is valid and registers never
+ * written read as zero. With UnallocatedRead::kIllegalAddress reads of a page
+ * that is not allocated fail validation, so the master gets an illegal data
+ * address exception. Allocate the device's map at setup in that case.
+ *
+ * Pages are published with a compare and swap so any thread may write, and
+ * registers are loaded and stored whole as in RegisterDataStore.
+ */
+
+#pragma once
+#ifndef MODBUS_SPARSEREGISTERDATASTORE_H_
+#define MODBUS_SPARSEREGISTERDATASTORE_H_
+#include <ArrayView/ArrayView.h>
+#include <Modbus/ByteSwap.h>
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "Modbus/DataStores/DataStore.h"
+
+namespace Modbus {
+enum class UnallocatedRead { kZero, kIllegalAddress };
+
+class SparseRegisterDataStore : public DataStore {
+ public:
+  static const constexpr std::size_t kPageBits = 8;
+  static const constexpr std::size_t kPageSize = std::size_t{1} << kPageBits;
+  static const constexpr std::size_t kRegisterCount = std::size_t{1} << 16;
+  static const constexpr std::size_t kPageCount = kRegisterCount / kPageSize;
+
+ private:
+  std::array<std::atomic<uint16_t*>, kPageCount> pages_{};
+  std::atomic<std::size_t> page_count_{0};
+  UnallocatedRead unallocated_read_;
+
+  static std::size_t GetIndex(const std::size_t address) {
+    return address - GetAddressStart();
+  }
+
+  uint16_t* GetPage(const std::size_t page) const {
+    return pages_[page].load(std::memory_order_acquire);
+  }
+
+  uint16_t* GetOrAllocatePage(const std::size_t page) {
+    uint16_t* current = GetPage(page);
+    if (current != nullptr) {
+      return current;
+    }
+    uint16_t* const allocated = new uint16_t[kPageSize]();
+    if (pages_[page].compare_exchange_strong(current, allocated,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_acquire)) {
+      page_count_.fetch_add(1, std::memory_order_relaxed);
+      return allocated;
+    }
+    delete[] allocated;  //  Another thread allocated it first
+    return current;
+  }
+
+  /*
+   * Calls function(page, offset, index, run) for each page in the range,
+   * index counts registers from the start of the range
+   * */
+  template <typename TFunction>
+  static void ForEachPage(const std::size_t first, const std::size_t count,
+                          TFunction&& function) {
+    std::size_t index = 0;
+    while (index < count) {
+      const std::size_t register_index = first + index;
+      const std::size_t offset = register_index % kPageSize;
+      const std::size_t run = count - index < kPageSize - offset
+                                  ? count - index
+                                  : kPageSize - offset;
+      function(register_index / kPageSize, offset, index, run);
+      index += run;
+    }
+  }
+
+ public:
+  explicit SparseRegisterDataStore(
+      const UnallocatedRead unallocated_read = UnallocatedRead::kZero)
+      : unallocated_read_{unallocated_read} {}
+  ~SparseRegisterDataStore(void) {
+    for (auto& page : pages_) {
+      delete[] page.load(std::memory_order_relaxed);
+    }
+  }
+  SparseRegisterDataStore(const SparseRegisterDataStore&) = delete;
+  SparseRegisterDataStore& operator=(const SparseRegisterDataStore&) = delete;
+
+  //  Allocates the pages of a range so it reads as zero before it is written
+  void Allocate(const std::size_t address, const std::size_t count) {
+    assert(WriteLocationValid(address, count));
+    ForEachPage(GetIndex(address), count,
+                [this](std::size_t page, std::size_t, std::size_t,
+                       std::size_t) { GetOrAllocatePage(page); });
+  }
+
+  bool IsAllocated(const std::size_t address) const {
+    return IsAddressValid(address) &&
+           GetPage(GetIndex(address) / kPageSize) != nullptr;
+  }
+
+  std::size_t GetAllocatedPageCount(void) const {
+    return page_count_.load(std::memory_order_relaxed);
+  }
+
+  bool IsAddressValid(std::size_t address) const {
+    return address >= GetAddressStart() &&
+           address < GetAddressStart() + kRegisterCount;
+  }
+  bool WriteLocationValid(std::size_t address, std::size_t count) const {
+    return count != 0 && IsAddressValid(address) &&
+           IsAddressValid(address + count - 1);
+  }
+  bool ReadLocationValid(std::size_t address, std::size_t count) const {
+    if (!WriteLocationValid(address, count)) {
+      return false;
+    }
+    if (unallocated_read_ == UnallocatedRead::kZero) {
+      return true;
+    }
+    const std::size_t first = GetIndex(address) / kPageSize;
+    const std::size_t last = (GetIndex(address) + count - 1) / kPageSize;
+    for (std::size_t page = first; page <= last; page++) {
+      if (GetPage(page) == nullptr) {
+        return false;
+      }
+    }
+    return true;
+  }
+  std::size_t size(void) { return GetSize(); }
+  std::size_t GetSize(void) const { return kRegisterCount; }
+  static constexpr std::size_t GetRegisterByteSize(void) {
+    return sizeof(uint16_t);
+  }
+
+  uint16_t GetRegister(const std::size_t address) const {
+    const std::size_t index = GetIndex(address);
+    assert(index < kRegisterCount);
+    const uint16_t* const page = GetPage(index / kPageSize);
+    if (page == nullptr) {
+      return 0;
+    }
+    return __atomic_load_n(&page[index % kPageSize], __ATOMIC_RELAXED);
+  }
+
+  void GetRegisters(const std::size_t address, const std::size_t register_count,
+                    ArrayView<uint8_t>* data_view) const {
+    assert(data_view->size() >= register_count * sizeof(uint16_t));
+    assert(GetIndex(address) + register_count <= kRegisterCount);
+    uint8_t* const bytes = data_view->data();
+    ForEachPage(GetIndex(address), register_count,
+                [&](std::size_t page, std::size_t offset, std::size_t index,
+                    std::size_t run) {
+                  const uint16_t* const registers = GetPage(page);
+                  if (registers == nullptr) {
+                    std::memset(&bytes[2 * index], 0, 2 * run);
+                  } else {
+                    RegistersToBytes(&registers[offset], &bytes[2 * index],
+                                     run);
+                  }
+                });
+  }
+
+  void set_register_callback(std::size_t, uint16_t) {}
+  void set_registers_callback(std::size_t, std::size_t,
+                              const ArrayView<const uint8_t>&) {}
+
+  void SetRegister(std::size_t address, uint16_t value) {
+    const std::size_t index = GetIndex(address);
+    assert(index < kRegisterCount);
+    uint16_t* const page = GetOrAllocatePage(index / kPageSize);
+    __atomic_store_n(&page[index % kPageSize], value, __ATOMIC_RELAXED);
+  }
+
+  //  Function 22, as RegisterDataStore::MaskWriteRegister
+  uint16_t MaskWriteRegister(std::size_t address, uint16_t and_mask,
+                             uint16_t or_mask) {
+    const std::size_t index = GetIndex(address);
+    assert(index < kRegisterCount);
+    uint16_t* const value =
+        &GetOrAllocatePage(index / kPageSize)[index % kPageSize];
+    uint16_t current = __atomic_load_n(value, __ATOMIC_RELAXED);
+    uint16_t result = 0;
+    do {
+      result = static_cast<uint16_t>((current & and_mask) |
+                                     (or_mask & ~and_mask));
+    } while (!__atomic_compare_exchange_n(value, &current, result, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return result;
+  }
+
+  void SetRegisters(std::size_t address, std::size_t register_count,
+                    const ArrayView<const uint8_t>& data_view) {
+    assert(data_view.size() >= register_count * sizeof(uint16_t));
+    assert(GetIndex(address) + register_count <= kRegisterCount);
+    const uint8_t* const bytes = data_view.data();
+    ForEachPage(GetIndex(address), register_count,
+                [&](std::size_t page, std::size_t offset, std::size_t index,
+                    std::size_t run) {
+                  BytesToRegisters(&bytes[2 * index],
+                                   &GetOrAllocatePage(page)[offset], run);
+                });
+  }
+};
+}  //  namespace Modbus
+
+#endif  //  MODBUS_SPARSEREGISTERDATASTORE_H_
@@ -0,0 +1,426 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        DeviceIdentification.h
+ * Description:  Function 43 / MEI 14, read device identification
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ *
+ * Target Processor: Any, Linux system
+ * ----------------------------------------------------------------------
+ *
+ * The identity of a device does not change while it runs, so every response
+ * is encoded once by DeviceIdentification::Build, crc included, and a
+ * request is answered with one copy of a prebuilt frame. Only a stream read
+ * that starts part way through a response that did not fit in one frame is
+ * encoded per request, from the prebuilt object list.
+ */
+
+#pragma once
+#include <Modbus/Crc.h>
+#include <Modbus/Modbus.h>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+namespace Modbus {
+enum class DeviceObjectId : uint8_t {
+  kVendorName = 0x00,
+  kProductCode = 0x01,
+  kMajorMinorRevision = 0x02,
+  kVendorUrl = 0x03,
+  kProductName = 0x04,
+  kModelName = 0x05,
+  kUserApplicationName = 0x06,
+  kExtendedStart = 0x80,
+};
+
+enum class ReadDeviceIdCode : uint8_t {
+  kBasic = 1,     //  stream access, objects 0x00 to 0x02
+  kRegular = 2,   //  stream access, objects 0x00 to 0x7f
+  kExtended = 3,  //  stream access, objects 0x00 to 0xff
+  kSpecific = 4,  //  one object
+};
+
+class ReadDeviceIdentificationCommand : public Command {
+ public:
+  static const constexpr auto kFunction = Function::kReadDeviceIdentification;
+  static const constexpr uint8_t kMeiType = 0x0e;
+  static const constexpr uint8_t kMoreFollows = 0xff;
+  static const constexpr uint8_t kIndividualAccess = 0x80;
+  //  Most object bytes, id and length included, in one response
+  static const constexpr std::size_t kMaxObjectBytes = 246;
+  struct CommandPacket {
+    static const constexpr std::size_t kMeiType = 0;
+    static const constexpr std::size_t kReadDeviceIdCode = kMeiType + 1;
+    static const constexpr std::size_t kObjectId = kReadDeviceIdCode + 1;
+    static const constexpr std::size_t kPacketSize = kObjectId + 1;
+  };
+  struct ResponsePacket {
+    static const constexpr std::size_t kMeiType =
+        Command::ResponsePacket::kHeaderEnd + 1;
+    static const constexpr std::size_t kReadDeviceIdCode = kMeiType + 1;
+    static const constexpr std::size_t kConformityLevel = kReadDeviceIdCode + 1;
+    static const constexpr std::size_t kMoreFollows = kConformityLevel + 1;
+    static const constexpr std::size_t kNextObjectId = kMoreFollows + 1;
+    static const constexpr std::size_t kNumberOfObjects = kNextObjectId + 1;
+    static const constexpr std::size_t kObjectStart = kNumberOfObjects + 1;
+  };
+  static uint8_t ReadMeiType(const ArrayView<uint8_t> &data_array) {
+    return data_array[CommandPacket::kMeiType];
+  }
+  static uint8_t ReadDeviceIdCodeValue(const ArrayView<uint8_t> &data_array) {
+    return data_array[CommandPacket::kReadDeviceIdCode];
+  }
+  static uint8_t ReadObjectId(const ArrayView<uint8_t> &data_array) {
+    return data_array[CommandPacket::kObjectId];
+  }
+  static constexpr uint8_t GetLastObjectId(const ReadDeviceIdCode code) {
+    return code == ReadDeviceIdCode::kBasic     ? 0x02
+           : code == ReadDeviceIdCode::kRegular ? 0x7f
+                                                : 0xff;
+  }
+  static int32_t FillFrame(const ReadDeviceIdCode code, const uint8_t object_id,
+                           Frame *frame) {
+    assert(frame->data_array.size() >= CommandPacket::kPacketSize);
+    frame->function = kFunction;
+    frame->data_array[CommandPacket::kMeiType] = kMeiType;
+    frame->data_array[CommandPacket::kReadDeviceIdCode] =
+        static_cast<uint8_t>(code);
+    frame->data_array[CommandPacket::kObjectId] = object_id;
+    frame->data_length = CommandPacket::kPacketSize;
+    return 0;
+  }
+};
+
+static_assert(
+    GetFunctionDescriptor(Function::kReadDeviceIdentification).meta_length +
+        GetFunctionDescriptor(Function::kReadDeviceIdentification)
+            .data_length ==
+    ReadDeviceIdentificationCommand::CommandPacket::kPacketSize);
+
+/*
+ * Holds up to kMaxObjects objects and the frames built from them in
+ * kFrameBytes bytes. Add the objects, basic ones 0 to 2 are required, then
+ * Build once with the slave address before serving requests.
+ * */
+template <std::size_t kMaxObjects = 16, std::size_t kFrameBytes = 2048>
+class DeviceIdentification {
+  using Command = ReadDeviceIdentificationCommand;
+  static const constexpr std::size_t kObjectBytes =
+      kMaxObjects * (2 + Command::kMaxObjectBytes);
+
+  struct Object {
+    uint8_t id;
+    std::size_t offset;  //  of the encoded id, length, value in objects_
+    std::size_t size;
+  };
+  struct PrebuiltFrame {
+    ReadDeviceIdCode code;
+    uint8_t object_id;
+    std::size_t offset;  //  in frames_
+    std::size_t length;  //  without the crc
+  };
+
+  std::array<Object, kMaxObjects> objects_{};
+  std::size_t object_count_ = 0;
+  std::array<uint8_t, kObjectBytes> object_data_{};
+  std::size_t object_data_length_ = 0;
+
+  std::array<PrebuiltFrame, 4 * kMaxObjects> prebuilt_{};
+  std::size_t prebuilt_count_ = 0;
+  std::array<uint8_t, kFrameBytes> frames_{};
+  std::size_t frames_length_ = 0;
+  uint8_t slave_address_ = 0;
+  uint8_t conformity_level_ = 0;
+  bool built_ = false;
+
+  /*
+   * next_object_id is zero when no more objects follow
+   * */
+  void FillHeader(const uint8_t slave_address, const ReadDeviceIdCode code,
+                  const uint8_t next_object_id, const std::size_t count,
+                  uint8_t *response) const {
+    response[Modbus::Command::ResponsePacket::kSlaveAddress] = slave_address;
+    response[Modbus::Command::ResponsePacket::kFunction] =
+        static_cast<uint8_t>(Command::kFunction);
+    response[Command::ResponsePacket::kMeiType] = Command::kMeiType;
+    response[Command::ResponsePacket::kReadDeviceIdCode] =
+        static_cast<uint8_t>(code);
+    response[Command::ResponsePacket::kConformityLevel] = conformity_level_;
+    response[Command::ResponsePacket::kMoreFollows] =
+        next_object_id != 0 ? Command::kMoreFollows : 0;
+    response[Command::ResponsePacket::kNextObjectId] = next_object_id;
+    response[Command::ResponsePacket::kNumberOfObjects] =
+        static_cast<uint8_t>(count);
+  }
+
+  std::size_t CountObjects(const ReadDeviceIdCode code) const {
+    std::size_t count = 0;
+    while (count < object_count_ &&
+           objects_[count].id <= Command::GetLastObjectId(code)) {
+      count++;
+    }
+    return count;
+  }
+
+ public:
+  /*
+   * Returns false if the object is a duplicate, too long or there is no
+   * room left. Objects may be added in any order.
+   * */
+  bool AddObject(const uint8_t id, const uint8_t *value,
+                 const std::size_t length) {
+    const std::size_t size = 2 + length;
+    if (built_ || object_count_ == kMaxObjects ||
+        size > Command::kMaxObjectBytes ||
+        object_data_length_ + size > object_data_.size()) {
+      return false;
+    }
+    std::size_t index = 0;
+    while (index < object_count_ && objects_[index].id < id) {
+      index++;
+    }
+    if (index < object_count_ && objects_[index].id == id) {
+      return false;
+    }
+    //  Keep objects_ sorted by id, the encoded data follows the same order
+    const std::size_t offset = index < object_count_ ? objects_[index].offset
+                                                     : object_data_length_;
+    uint8_t *const data = object_data_.data();
+    std::copy_backward(data + offset, data + object_data_length_,
+                       data + object_data_length_ + size);
+    object_data_[offset] = id;
+    object_data_[offset + 1] = static_cast<uint8_t>(length);
+    std::memcpy(&object_data_[offset + 2], value, length);
+    object_data_length_ += size;
+    for (std::size_t i = object_count_; i > index; i--) {
+      objects_[i] = objects_[i - 1];
+      objects_[i].offset += size;
+    }
+    objects_[index] = Object{id, offset, size};
+    object_count_++;
+    return true;
+  }
+  bool AddObject(const DeviceObjectId id, const char *value) {
+    return AddObject(static_cast<uint8_t>(id),
+                     reinterpret_cast<const uint8_t *>(value),
+                     std::strlen(value));
+  }
+
+  /*
+   * Encodes the objects for a stream read of code starting at object index
+   * first into response, as many as fit. Returns the response length
+   * without the crc.
+   * */
+  std::size_t EncodeStream(const uint8_t slave_address,
+                           const ReadDeviceIdCode code, const std::size_t first,
+                           uint8_t *response) const {
+    const std::size_t count = CountObjects(code);
+    std::size_t last = first;
+    std::size_t bytes = 0;
+    while (last < count &&
+           bytes + objects_[last].size <= Command::kMaxObjectBytes) {
+      bytes += objects_[last].size;
+      last++;
+    }
+    const bool more_follows = last < count;
+    FillHeader(slave_address, code, more_follows ? objects_[last].id : 0,
+               last - first, response);
+    if (bytes > 0) {
+      std::memcpy(&response[Command::ResponsePacket::kObjectStart],
+                  &object_data_[objects_[first].offset], bytes);
+    }
+    return Command::ResponsePacket::kObjectStart + bytes;
+  }
+
+  /*
+   * Encodes every stream response reached by following more follows from
+   * the first object, and every single object response, with its crc.
+   * Returns false if the basic objects are missing or the frames do not
+   * fit in kFrameBytes.
+   * */
+  bool Build(const uint8_t slave_address) {
+    built_ = false;
+    prebuilt_count_ = 0;
+    frames_length_ = 0;
+    slave_address_ = slave_address;
+    if (CountObjects(ReadDeviceIdCode::kBasic) != 3) {
+      return false;
+    }
+    const bool extended = objects_[object_count_ - 1].id >=
+                          static_cast<uint8_t>(DeviceObjectId::kExtendedStart);
+    const bool regular = CountObjects(ReadDeviceIdCode::kRegular) > 3;
+    conformity_level_ = static_cast<uint8_t>(
+        Command::kIndividualAccess | (extended ? 3 : regular ? 2 : 1));
+
+    std::array<uint8_t, 256> frame{};
+    auto add_frame = [&](const ReadDeviceIdCode code, const uint8_t object_id,
+                         const std::size_t length) {
+      if (frames_length_ + length + sizeof(uint16_t) > frames_.size()) {
+        return false;
+      }
+      RunningCrc16 crc{};
+      crc.Update(frame.data(), length);
+      frame[length] = crc.GetLowByte();
+      frame[length + 1] = crc.GetHighByte();
+      std::memcpy(&frames_[frames_length_], frame.data(),
+                  length + sizeof(uint16_t));
+      prebuilt_[prebuilt_count_++] =
+          PrebuiltFrame{code, object_id, frames_length_, length};
+      frames_length_ += length + sizeof(uint16_t);
+      return true;
+    };
+
+    for (const auto code :
+         {ReadDeviceIdCode::kBasic, ReadDeviceIdCode::kRegular,
+          ReadDeviceIdCode::kExtended}) {
+      const std::size_t count = CountObjects(code);
+      for (std::size_t first = 0; first < count;) {
+        const std::size_t length =
+            EncodeStream(slave_address, code, first, frame.data());
+        if (!add_frame(code, objects_[first].id, length)) {
+          return false;
+        }
+        first += frame[Command::ResponsePacket::kNumberOfObjects];
+      }
+    }
+    for (std::size_t i = 0; i < object_count_; i++) {
+      const Object &object = objects_[i];
+      FillHeader(slave_address, ReadDeviceIdCode::kSpecific, 0, 1,
+                 frame.data());
+      const std::size_t length =
+          Command::ResponsePacket::kObjectStart + object.size;
+      std::memcpy(&frame[Command::ResponsePacket::kObjectStart],
+                  &object_data_[object.offset], object.size);
+      if (!add_frame(ReadDeviceIdCode::kSpecific, object.id, length)) {
+        return false;
+      }
+    }
+    built_ = true;
+    return true;
+  }
+
+  bool IsBuilt(void) const { return built_; }
+  uint8_t GetSlaveAddress(void) const { return slave_address_; }
+  uint8_t GetConformityLevel(void) const { return conformity_level_; }
+
+  //  Index of the object with id, object_count_ if there is none
+  std::size_t FindObject(const uint8_t id) const {
+    for (std::size_t i = 0; i < object_count_; i++) {
+      if (objects_[i].id == id) {
+        return i;
+      }
+    }
+    return object_count_;
+  }
+  bool HasObject(const uint8_t id) const {
+    return FindObject(id) != object_count_;
+  }
+
+  /*
+   * The prebuilt frame, crc included, answering code at object_id, or
+   * nullptr if that response is not prebuilt. length is set without the crc.
+   * */
+  const uint8_t *GetFrame(const ReadDeviceIdCode code, const uint8_t object_id,
+                          std::size_t *length) const {
+    for (std::size_t i = 0; i < prebuilt_count_; i++) {
+      const PrebuiltFrame &prebuilt = prebuilt_[i];
+      if (prebuilt.code == code && prebuilt.object_id == object_id) {
+        *length = prebuilt.length;
+        return &frames_[prebuilt.offset];
+      }
+    }
+    return nullptr;
+  }
+
+  /*
+   * The object index a stream read of code asked for object_id starts at.
+   * An id outside the code's range or not present restarts at the first.
+   * */
+  std::size_t GetStreamStart(const ReadDeviceIdCode code,
+                             const uint8_t object_id) const {
+    const std::size_t index = FindObject(object_id);
+    return index < CountObjects(code) ? index : 0;
+  }
+  uint8_t GetObjectId(const std::size_t index) const {
+    return objects_[index].id;
+  }
+};
+
+/*
+ * Serves function 43 with MEI type 14 from a built DeviceIdentification
+ * */
+template <typename T>
+class DeviceIdentificationController {
+  using Command = ReadDeviceIdentificationCommand;
+  const T *identification_;
+
+ public:
+  static const constexpr std::array<Function, 1> kFunctions{
+      Function::kReadDeviceIdentification,
+  };
+
+  explicit DeviceIdentificationController(const T *identification)
+      : identification_{identification} {}
+  const T *GetDataStore(void) const { return identification_; }
+
+  int32_t ReadFrame(const Frame &frame, Response *response) {
+    if (frame.function != Function::kReadDeviceIdentification) {
+      return -1;
+    }
+    return RunReadDeviceIdentification(frame, response);
+  }
+
+  int32_t RunReadDeviceIdentification(const Frame &frame, Response *response) {
+    const auto code = static_cast<ReadDeviceIdCode>(
+        Command::ReadDeviceIdCodeValue(frame.data_array));
+    uint8_t object_id = Command::ReadObjectId(frame.data_array);
+    std::size_t start = 0;
+    if (code != ReadDeviceIdCode::kSpecific) {
+      start = identification_->GetStreamStart(code, object_id);
+      object_id = identification_->GetObjectId(start);
+    }
+    std::size_t length = 0;
+    const uint8_t *const prebuilt =
+        identification_->GetFrame(code, object_id, &length);
+    if (prebuilt != nullptr) {
+      assert(response->size() >= length);
+      //  A TCP response has no room for the crc after a full size object
+      const bool crc_valid =
+          frame.address == identification_->GetSlaveAddress() &&
+          response->size() >= length + sizeof(uint16_t);
+      std::memcpy(response->data(), prebuilt,
+                  crc_valid ? length + sizeof(uint16_t) : length);
+      response->SetLength(length);
+      response->SetCrcWritten(crc_valid);
+    } else {
+      response->SetLength(identification_->EncodeStream(
+          frame.address, code, start, response->data()));
+    }
+    return 0;
+  }
+
+  Exception ValidateFrame(const Frame &frame) const {
+    if (frame.function != Function::kReadDeviceIdentification ||
+        Command::ReadMeiType(frame.data_array) != Command::kMeiType ||
+        !identification_->IsBuilt()) {
+      return Exception::kIllegalFunction;
+    }
+    const uint8_t code = Command::ReadDeviceIdCodeValue(frame.data_array);
+    if (code < static_cast<uint8_t>(ReadDeviceIdCode::kBasic) ||
+        code > static_cast<uint8_t>(ReadDeviceIdCode::kSpecific)) {
+      return Exception::kIllegalDataValue;
+    }
+    if (code == static_cast<uint8_t>(ReadDeviceIdCode::kSpecific) &&
+        !identification_->HasObject(Command::ReadObjectId(frame.data_array))) {
+      return Exception::kIllegalDataAddress;
+    }
+    return Exception::kAck;
+  }
+};
+}  //  namespace Modbus
@@ -0,0 +1,490 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        Diagnostics.h
+ * Description:  Serial line diagnostics, functions 8, 11 and 12
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ *
+ * Target Processor: Any, Linux system
+ * ----------------------------------------------------------------------
+ *
+ * CommDiagnostics holds the counters and event log of the serial line
+ * specification. ProtocolRtuSlave records into it once it is given one with
+ * SetDiagnostics, DiagnosticsController serves it to a master. The protocol
+ * thread is the only writer. Counters are relaxed atomic increments and the
+ * event log is a ring with an atomic write count, so the application may
+ * read either from another thread without a lock.
+ */
+
+#pragma once
+#include <Modbus/Modbus.h>
+#include <Utilities/TypeConversion.h>
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+namespace Modbus {
+enum class DiagnosticCounter : uint8_t {
+  kBusMessage = 0,         //  Every frame seen on the line
+  kBusCommunicationError,  //  Frames with a bad crc
+  kSlaveExceptionError,    //  Exception responses sent
+  kSlaveMessage,           //  Frames addressed to this slave or broadcast
+  kSlaveNoResponse,        //  Frames to this slave that were not answered
+  kSlaveNak,
+  kSlaveBusy,
+  kBusCharacterOverrun,  //  Frames dropped for overrunning the buffer
+  kCount,
+};
+
+enum class DiagnosticSubFunction : uint16_t {
+  kReturnQueryData = 0x00,
+  kRestartCommunicationsOption = 0x01,
+  kReturnDiagnosticRegister = 0x02,
+  kForceListenOnlyMode = 0x04,
+  kClearCountersAndDiagnosticRegister = 0x0a,
+  kReturnBusMessageCount = 0x0b,
+  kReturnBusCommunicationErrorCount = 0x0c,
+  kReturnBusExceptionErrorCount = 0x0d,
+  kReturnSlaveMessageCount = 0x0e,
+  kReturnSlaveNoResponseCount = 0x0f,
+  kReturnSlaveNakCount = 0x10,
+  kReturnSlaveBusyCount = 0x11,
+  kReturnBusCharacterOverrunCount = 0x12,
+  kClearOverrunCounterAndFlag = 0x14,
+};
+
+//  Counters are returned by sub-functions 0x0b to 0x12 in the same order
+static_assert(
+    static_cast<uint16_t>(DiagnosticSubFunction::kReturnBusMessageCount) +
+        static_cast<uint16_t>(DiagnosticCounter::kCount) - 1 ==
+    static_cast<uint16_t>(
+        DiagnosticSubFunction::kReturnBusCharacterOverrunCount));
+
+/*
+ * Event bytes as defined for function 12
+ * */
+struct CommEvent {
+  static const constexpr uint8_t kReceive = 0x80;
+  static const constexpr uint8_t kReceiveCommunicationError = 0x02;
+  static const constexpr uint8_t kReceiveCharacterOverrun = 0x10;
+  static const constexpr uint8_t kReceiveListenOnly = 0x20;
+  static const constexpr uint8_t kReceiveBroadcast = 0x40;
+
+  static const constexpr uint8_t kSend = 0x40;
+  static const constexpr uint8_t kSendReadException = 0x01;
+  static const constexpr uint8_t kSendAbortException = 0x02;
+  static const constexpr uint8_t kSendBusyException = 0x04;
+  static const constexpr uint8_t kSendNakException = 0x08;
+  static const constexpr uint8_t kSendListenOnly = 0x20;
+
+  static const constexpr uint8_t kEnteredListenOnly = 0x04;
+  static const constexpr uint8_t kCommunicationRestart = 0x00;
+
+  static constexpr uint8_t MakeSendEvent(const Exception exception) {
+    switch (exception) {
+      case Exception::kIllegalFunction:
+      case Exception::kIllegalDataAddress:
+      case Exception::kIllegalDataValue:
+        return kSend | kSendReadException;
+      case Exception::kSlaveDeviceFailure:
+        return kSend | kSendAbortException;
+      case Exception::kAck:
+      case Exception::kSlaveDeviceBusy:
+        return kSend | kSendBusyException;
+      case Exception::kNak:
+        return kSend | kSendNakException;
+      default:
+        return kSend;
+    }
+  }
+};
+
+/*
+ * Fixed size ring of the most recent events. Push is called from one thread,
+ * Copy may be called from any.
+ * */
+template <std::size_t kSize = 64>
+class CommEventLog {
+  std::array<std::atomic<uint8_t>, kSize> events_{};
+  std::atomic<uint32_t> started_{0};  //  Pushes begun
+  std::atomic<uint32_t> count_{0};    //  Pushes completed
+
+ public:
+  static constexpr std::size_t size(void) { return kSize; }
+
+  void Push(const uint8_t event) {
+    const uint32_t count = count_.load(std::memory_order_relaxed);
+    started_.store(count + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    events_[count % kSize].store(event, std::memory_order_relaxed);
+    count_.store(count + 1, std::memory_order_release);
+  }
+
+  std::size_t GetCount(void) const {
+    const uint32_t count = count_.load(std::memory_order_acquire);
+    return count < kSize ? count : kSize;
+  }
+
+  void Clear(void) {
+    started_.store(0, std::memory_order_relaxed);
+    count_.store(0, std::memory_order_release);
+  }
+
+  /*
+   * Copy up to max_count events, most recent first. Returns the number
+   * copied. A copy overlapped by the writer is taken again.
+   * */
+  std::size_t Copy(uint8_t *events, const std::size_t max_count) const {
+    while (true) {
+      const uint32_t count = count_.load(std::memory_order_acquire);
+      std::size_t copied = count < kSize ? count : kSize;
+      copied = copied < max_count ? copied : max_count;
+      for (std::size_t i = 0; i < copied; i++) {
+        events[i] =
+            events_[(count - 1 - i) % kSize].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      const uint32_t started = started_.load(std::memory_order_relaxed);
+      //  The oldest copied entry survives until kSize - copied more pushes
+      if (started >= count && started - count <= kSize - copied) {
+        return copied;
+      }
+    }
+  }
+};
+
+class CommDiagnostics {
+  std::array<std::atomic<uint32_t>,
+             static_cast<std::size_t>(DiagnosticCounter::kCount)>
+      counters_{};
+  std::atomic<uint32_t> event_counter_{0};
+  std::atomic<uint16_t> diagnostic_register_{0};
+  std::atomic<bool> listen_only_{false};
+  CommEventLog<> event_log_{};
+
+ public:
+  static const constexpr std::size_t kEventLogSize = 64;
+
+  void Count(const DiagnosticCounter counter, const uint32_t count = 1) {
+    counters_[static_cast<std::size_t>(counter)].fetch_add(
+        count, std::memory_order_relaxed);
+  }
+  //  The specification reports the low 16 bits
+  uint16_t Get(const DiagnosticCounter counter) const {
+    return static_cast<uint16_t>(
+        counters_[static_cast<std::size_t>(counter)].load(
+            std::memory_order_relaxed));
+  }
+  void Clear(const DiagnosticCounter counter) {
+    counters_[static_cast<std::size_t>(counter)].store(
+        0, std::memory_order_relaxed);
+  }
+  void ClearCounters(void) {
+    for (auto &counter : counters_) {
+      counter.store(0, std::memory_order_relaxed);
+    }
+    event_counter_.store(0, std::memory_order_relaxed);
+    diagnostic_register_.store(0, std::memory_order_relaxed);
+  }
+
+  //  Successful message completions, the function 11 count
+  void CountEvent(void) {
+    event_counter_.fetch_add(1, std::memory_order_relaxed);
+  }
+  uint16_t GetEventCounter(void) const {
+    return static_cast<uint16_t>(
+        event_counter_.load(std::memory_order_relaxed));
+  }
+
+  uint16_t GetDiagnosticRegister(void) const {
+    return diagnostic_register_.load(std::memory_order_relaxed);
+  }
+  void SetDiagnosticRegister(const uint16_t value) {
+    diagnostic_register_.store(value, std::memory_order_relaxed);
+  }
+
+  bool IsListenOnly(void) const {
+    return listen_only_.load(std::memory_order_relaxed);
+  }
+  void SetListenOnly(const bool listen_only) {
+    listen_only_.store(listen_only, std::memory_order_relaxed);
+  }
+
+  void LogEvent(const uint8_t event) { event_log_.Push(event); }
+  const CommEventLog<> &GetEventLog(void) const { return event_log_; }
+  void ClearEventLog(void) { event_log_.Clear(); }
+};
+
+class DiagnosticCommand : public Command {
+ public:
+  static const constexpr auto kFunction = Function::kDiagnostic;
+  static const constexpr uint16_t kClearEventLog = 0xff00;
+  struct CommandPacket {
+    static const constexpr std::size_t kSubFunction = 0;
+    static const constexpr std::size_t kData =
+        kSubFunction + sizeof(uint16_t);
+    static const constexpr std::size_t kPacketSize = kData + sizeof(uint16_t);
+  };
+  struct ResponsePacket {
+    static const constexpr std::size_t kSubFunction =
+        Command::ResponsePacket::kHeaderEnd + 1;
+    static const constexpr std::size_t kData =
+        kSubFunction + sizeof(uint16_t);
+    static const constexpr std::size_t kPacketSize = kData + sizeof(uint16_t);
+  };
+  static uint16_t ReadSubFunction(const ArrayView<uint8_t> &data_array) {
+    return Utilities::Make_MSB_uint16_tFromU8Array(ArrayView<const uint8_t>{
+        sizeof(uint16_t), &data_array[CommandPacket::kSubFunction]});
+  }
+  static uint16_t ReadData(const ArrayView<uint8_t> &data_array) {
+    return Utilities::Make_MSB_uint16_tFromU8Array(ArrayView<const uint8_t>{
+        sizeof(uint16_t), &data_array[CommandPacket::kData]});
+  }
+  static void FillResponseHeader(const uint8_t slave_address,
+                                 const uint16_t sub_function,
+                                 const uint16_t data, Response *response) {
+    response->operator[](Command::ResponsePacket::kSlaveAddress) =
+        slave_address;
+    response->operator[](Command::ResponsePacket::kFunction) =
+        static_cast<uint8_t>(kFunction);
+    response->operator[](ResponsePacket::kSubFunction) =
+        Utilities::GetByte(sub_function, 1);
+    response->operator[](ResponsePacket::kSubFunction + 1) =
+        Utilities::GetByte(sub_function, 0);
+    response->operator[](ResponsePacket::kData) = Utilities::GetByte(data, 1);
+    response->operator[](ResponsePacket::kData + 1) =
+        Utilities::GetByte(data, 0);
+    response->SetLength(ResponsePacket::kPacketSize);
+  }
+  static int32_t FillFrame(const DiagnosticSubFunction sub_function,
+                           const uint16_t data, Frame *frame) {
+    assert(frame->data_array.size() >= CommandPacket::kPacketSize);
+    const uint16_t code = static_cast<uint16_t>(sub_function);
+    frame->function = kFunction;
+    frame->data_array[CommandPacket::kSubFunction] =
+        Utilities::GetByte(code, 1);
+    frame->data_array[CommandPacket::kSubFunction + 1] =
+        Utilities::GetByte(code, 0);
+    frame->data_array[CommandPacket::kData] = Utilities::GetByte(data, 1);
+    frame->data_array[CommandPacket::kData + 1] = Utilities::GetByte(data, 0);
+    frame->data_length = CommandPacket::kPacketSize;
+    return 0;
+  }
+  static bool IsRestart(const Frame &frame) {
+    return frame.function == kFunction &&
+           ReadSubFunction(frame.data_array) ==
+               static_cast<uint16_t>(
+                   DiagnosticSubFunction::kRestartCommunicationsOption);
+  }
+};
+
+class GetComEventCounterCommand : public Command {
+ public:
+  static const constexpr auto kFunction = Function::kGetComEventCounter;
+  struct ResponsePacket {
+    static const constexpr std::size_t kStatus =
+        Command::ResponsePacket::kHeaderEnd + 1;
+    static const constexpr std::size_t kEventCount = kStatus + sizeof(uint16_t);
+    static const constexpr std::size_t kPacketSize =
+        kEventCount + sizeof(uint16_t);
+  };
+  static int32_t FillFrame(Frame *frame) {
+    frame->function = kFunction;
+    frame->data_length = 0;
+    return 0;
+  }
+};
+
+class GetComEventLogCommand : public Command {
+ public:
+  static const constexpr auto kFunction = Function::kGetComEventLog;
+  struct ResponsePacket {
+    static const constexpr std::size_t kByteCount =
+        Command::ResponsePacket::kHeaderEnd + 1;
+    static const constexpr std::size_t kStatus = kByteCount + 1;
+    static const constexpr std::size_t kEventCount = kStatus + sizeof(uint16_t);
+    static const constexpr std::size_t kMessageCount =
+        kEventCount + sizeof(uint16_t);
+    static const constexpr std::size_t kEvents =
+        kMessageCount + sizeof(uint16_t);
+  };
+  static int32_t FillFrame(Frame *frame) {
+    frame->function = kFunction;
+    frame->data_length = 0;
+    return 0;
+  }
+};
+
+static_assert(GetFunctionDescriptor(Function::kDiagnostic).meta_length +
+                  GetFunctionDescriptor(Function::kDiagnostic).data_length ==
+              DiagnosticCommand::CommandPacket::kPacketSize);
+static_assert(GetFunctionDescriptor(Function::kGetComEventCounter)
+                      .response_meta_length +
+                  Command::kHeaderLength ==
+              GetComEventCounterCommand::ResponsePacket::kPacketSize);
+
+/*
+ * Serves functions 8, 11 and 12 from a CommDiagnostics. Force listen only
+ * returns no response, the slave then only acts on restart communications.
+ * */
+class DiagnosticsController {
+  CommDiagnostics *diagnostics_;
+
+  static void WriteWord(const std::size_t index, const uint16_t value,
+                        Response *response) {
+    response->operator[](index) = Utilities::GetByte(value, 1);
+    response->operator[](index + 1) = Utilities::GetByte(value, 0);
+  }
+
+  static bool IsCounter(const uint16_t sub_function) {
+    return sub_function >= static_cast<uint16_t>(
+                               DiagnosticSubFunction::kReturnBusMessageCount) &&
+           sub_function <=
+               static_cast<uint16_t>(
+                   DiagnosticSubFunction::kReturnBusCharacterOverrunCount);
+  }
+
+  Exception ValidateDiagnostic(const ArrayView<uint8_t> &data_array) const {
+    using Sub = DiagnosticSubFunction;
+    const uint16_t sub_function =
+        DiagnosticCommand::ReadSubFunction(data_array);
+    const uint16_t data = DiagnosticCommand::ReadData(data_array);
+    switch (static_cast<Sub>(sub_function)) {
+      case Sub::kReturnQueryData:
+        return Exception::kAck;
+      case Sub::kRestartCommunicationsOption:
+        return data == 0 || data == DiagnosticCommand::kClearEventLog
+                   ? Exception::kAck
+                   : Exception::kIllegalDataValue;
+      case Sub::kReturnDiagnosticRegister:
+      case Sub::kForceListenOnlyMode:
+      case Sub::kClearCountersAndDiagnosticRegister:
+      case Sub::kClearOverrunCounterAndFlag:
+        return data == 0 ? Exception::kAck : Exception::kIllegalDataValue;
+      default:
+        if (IsCounter(sub_function)) {
+          return data == 0 ? Exception::kAck : Exception::kIllegalDataValue;
+        }
+        return Exception::kIllegalFunction;
+    }
+  }
+
+ public:
+  static const constexpr std::array<Function, 3> kFunctions{
+      Function::kDiagnostic,
+      Function::kGetComEventCounter,
+      Function::kGetComEventLog,
+  };
+
+  explicit DiagnosticsController(CommDiagnostics *diagnostics)
+      : diagnostics_{diagnostics} {}
+  CommDiagnostics *GetDataStore(void) { return diagnostics_; }
+
+  int32_t ReadFrame(const Frame &frame, Response *response) {
+    if (frame.function == Function::kDiagnostic) {
+      return RunDiagnostic(frame, response);
+    } else if (frame.function == Function::kGetComEventCounter) {
+      return RunGetComEventCounter(frame, response);
+    } else if (frame.function == Function::kGetComEventLog) {
+      return RunGetComEventLog(frame, response);
+    } else {
+      assert(0);
+    }
+    return -1;
+  }
+
+  int32_t RunDiagnostic(const Frame &frame, Response *response) {
+    using Sub = DiagnosticSubFunction;
+    const uint16_t sub_function =
+        DiagnosticCommand::ReadSubFunction(frame.data_array);
+    uint16_t data = DiagnosticCommand::ReadData(frame.data_array);
+    switch (static_cast<Sub>(sub_function)) {
+      case Sub::kReturnQueryData:
+        break;
+      case Sub::kRestartCommunicationsOption: {
+        const bool was_listen_only = diagnostics_->IsListenOnly();
+        diagnostics_->ClearCounters();
+        diagnostics_->SetListenOnly(false);
+        if (data == DiagnosticCommand::kClearEventLog) {
+          diagnostics_->ClearEventLog();
+        }
+        diagnostics_->LogEvent(CommEvent::kCommunicationRestart);
+        if (was_listen_only) {
+          return 1;  //  No response leaving listen only mode
+        }
+        break;
+      }
+      case Sub::kReturnDiagnosticRegister:
+        data = diagnostics_->GetDiagnosticRegister();
+        break;
+      case Sub::kForceListenOnlyMode:
+        diagnostics_->SetListenOnly(true);
+        diagnostics_->LogEvent(CommEvent::kEnteredListenOnly);
+        return 1;  //  Never answered
+      case Sub::kClearCountersAndDiagnosticRegister:
+        diagnostics_->ClearCounters();
+        break;
+      case Sub::kClearOverrunCounterAndFlag:
+        diagnostics_->Clear(DiagnosticCounter::kBusCharacterOverrun);
+        break;
+      default:
+        assert(IsCounter(sub_function));
+        data = diagnostics_->Get(static_cast<DiagnosticCounter>(
+            sub_function -
+            static_cast<uint16_t>(Sub::kReturnBusMessageCount)));
+        break;
+    }
+    DiagnosticCommand::FillResponseHeader(frame.address, sub_function, data,
+                                          response);
+    return 0;
+  }
+
+  int32_t RunGetComEventCounter(const Frame &frame, Response *response) {
+    using Counter = GetComEventCounterCommand;
+    response->operator[](Command::ResponsePacket::kSlaveAddress) =
+        frame.address;
+    response->operator[](Command::ResponsePacket::kFunction) =
+        static_cast<uint8_t>(Counter::kFunction);
+    WriteWord(Counter::ResponsePacket::kStatus, 0, response);
+    WriteWord(Counter::ResponsePacket::kEventCount,
+              diagnostics_->GetEventCounter(), response);
+    response->SetLength(Counter::ResponsePacket::kPacketSize);
+    return 0;
+  }
+
+  int32_t RunGetComEventLog(const Frame &frame, Response *response) {
+    using Log = GetComEventLogCommand;
+    response->operator[](Command::ResponsePacket::kSlaveAddress) =
+        frame.address;
+    response->operator[](Command::ResponsePacket::kFunction) =
+        static_cast<uint8_t>(Log::kFunction);
+    WriteWord(Log::ResponsePacket::kStatus, 0, response);
+    WriteWord(Log::ResponsePacket::kEventCount,
+              diagnostics_->GetEventCounter(), response);
+    WriteWord(Log::ResponsePacket::kMessageCount,
+              diagnostics_->Get(DiagnosticCounter::kBusMessage), response);
+    const std::size_t count = diagnostics_->GetEventLog().Copy(
+        &response->data()[Log::ResponsePacket::kEvents],
+        CommDiagnostics::kEventLogSize);
+    response->operator[](Log::ResponsePacket::kByteCount) =
+        static_cast<uint8_t>(Log::ResponsePacket::kEvents -
+                             Log::ResponsePacket::kStatus + count);
+    response->SetLength(Log::ResponsePacket::kEvents + count);
+    return 0;
+  }
+
+  Exception ValidateFrame(const Frame &frame) const {
+    if (frame.function == Function::kDiagnostic) {
+      return ValidateDiagnostic(frame.data_array);
+    } else if (frame.function == Function::kGetComEventCounter ||
+               frame.function == Function::kGetComEventLog) {
+      return Exception::kAck;
+    }
+    return Exception::kIllegalFunction;
+  }
+};
+}  //  namespace Modbus
@@ -0,0 +1,131 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        FifoControl.h
+ * Description:  Data controller for function 24, read fifo queue
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ *
+ * Target Processor: Any, Linux system
+ * ----------------------------------------------------------------------
+ */
+
+#pragma once
+#include <Modbus/DataCommand.h>
+#include <Modbus/Modbus.h>
+
+#include <array>
+#include <cstdint>
+
+namespace Modbus {
+/*
+ * The request is the fifo pointer address. The response is a two byte byte
+ * count, a two byte fifo count then the queued registers, oldest first.
+ * */
+class ReadFifoQueueCommand : public DataCommand {
+ public:
+  static const constexpr auto kFunction = Function::kReadFifoQueue;
+  //  Most registers a single response may carry
+  static const constexpr std::size_t kMaxCount = 31;
+  struct CommandPacket {
+    static const constexpr std::size_t kPacketSize =
+        DataCommand::CommandPacket::kDataAddressEnd + 1;
+  };
+  struct ResponsePacket {
+    static const constexpr std::size_t kByteCount =
+        DataCommand::ResponsePacket::kHeaderEnd + 1;
+    static const constexpr std::size_t kFifoCount =
+        kByteCount + sizeof(uint16_t);
+    static const constexpr std::size_t kValueStart =
+        kFifoCount + sizeof(uint16_t);
+  };
+  static uint16_t ReadFifoCount(const ArrayView<uint8_t> &data_array) {
+    return Utilities::Make_MSB_uint16_tFromU8Array(ArrayView<const uint8_t>{
+        sizeof(uint16_t), &data_array[ResponsePacket::kFifoCount]});
+  }
+  static void FillResponseHeader(const uint8_t slave_address,
+                                 const std::size_t count, Response *response) {
+    assert(count <= kMaxCount);
+    const uint16_t byte_count =
+        static_cast<uint16_t>(sizeof(uint16_t) * (count + 1));
+    response->operator[](DataCommand::ResponsePacket::kSlaveAddress) =
+        slave_address;
+    response->operator[](DataCommand::ResponsePacket::kFunction) =
+        static_cast<uint8_t>(kFunction);
+    response->operator[](ResponsePacket::kByteCount) =
+        Utilities::GetByte(byte_count, 1);
+    response->operator[](ResponsePacket::kByteCount + 1) =
+        Utilities::GetByte(byte_count, 0);
+    response->operator[](ResponsePacket::kFifoCount) =
+        Utilities::GetByte(static_cast<uint16_t>(count), 1);
+    response->operator[](ResponsePacket::kFifoCount + 1) =
+        Utilities::GetByte(static_cast<uint16_t>(count), 0);
+    response->SetLength(ResponsePacket::kValueStart +
+                        sizeof(uint16_t) * count);
+  }
+  static int32_t FillFrame(const uint16_t pointer_address, Frame *frame) {
+    assert(frame->data_array.size() >= CommandPacket::kPacketSize);
+    frame->function = kFunction;
+    frame->data_array[DataCommand::CommandPacket::kDataAddressStart] =
+        Utilities::GetByte(pointer_address, 1);
+    frame->data_array[DataCommand::CommandPacket::kDataAddressStart + 1] =
+        Utilities::GetByte(pointer_address, 0);
+    frame->data_length = CommandPacket::kPacketSize;
+    return 0;
+  }
+};
+
+static_assert(GetFunctionDescriptor(Function::kReadFifoQueue).meta_length ==
+              ReadFifoQueueCommand::CommandPacket::kPacketSize);
+
+/*
+ * Serves one queue at pointer_address. Each request drains up to kMaxCount
+ * registers from the store, anything left stays queued for the next request.
+ * A drained register is gone even if the response is lost on the line.
+ * */
+template <typename T>
+class FifoQueueController {
+  T *fifo_data_;
+  const uint16_t pointer_address_;
+
+ public:
+  static const constexpr std::array<Function, 1> kFunctions{
+      Function::kReadFifoQueue,
+  };
+
+  FifoQueueController(T *fifo_data, const uint16_t pointer_address)
+      : fifo_data_{fifo_data}, pointer_address_{pointer_address} {}
+  T *GetDataStore(void) { return fifo_data_; }
+  uint16_t GetPointerAddress(void) const { return pointer_address_; }
+
+  int32_t ReadFrame(const Frame &frame, Response *response) {
+    if (frame.function != Function::kReadFifoQueue) {
+      return -1;
+    }
+    return RunReadFifoQueue(frame, response);
+  }
+
+  int32_t RunReadFifoQueue(const Frame &frame, Response *response) {
+    std::array<uint16_t, ReadFifoQueueCommand::kMaxCount> values;
+    const std::size_t count = fifo_data_->pop(values.data(), values.size());
+    ReadFifoQueueCommand::FillResponseHeader(frame.address, count, response);
+    std::size_t index = ReadFifoQueueCommand::ResponsePacket::kValueStart;
+    for (std::size_t i = 0; i < count; i++) {
+      response->operator[](index++) = Utilities::GetByte(values[i], 1);
+      response->operator[](index++) = Utilities::GetByte(values[i], 0);
+    }
+    return 0;
+  }
+
+  Exception ValidateFrame(const Frame &frame) const {
+    if (frame.function != Function::kReadFifoQueue) {
+      return Exception::kIllegalFunction;
+    }
+    if (DataCommand::ReadAddressStart(frame.data_array) != pointer_address_) {
+      return Exception::kIllegalDataAddress;
+    }
+    return Exception::kAck;
+  }
+};
+}  //  namespace Modbus
@@ -0,0 +1,352 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        FileRecordControl.h
+ * Description:  Data controller for functions 20 & 21, file record access
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ *
+ * Target Processor: Any, Linux system
+ * ----------------------------------------------------------------------
+ */
+
+#pragma once
+#include <ArrayView/ArrayView.h>
+#include <Modbus/Modbus.h>
+#include <Utilities/TypeConversion.h>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+
+namespace Modbus {
+/*
+ * One sub-request, record_length registers from record_number of file_number
+ * */
+struct FileRecord {
+  uint16_t file_number = 0;
+  uint16_t record_number = 0;
+  uint16_t record_length = 0;
+};
+
+/*
+ * Both requests are a byte count followed by sub-requests of a reference
+ * type, file number, record number and record length. A write sub-request
+ * carries its record data straight after.
+ * */
+class FileRecordCommand : public Command {
+ public:
+  static const constexpr uint8_t kReferenceType = 6;
+  //  Highest record number in a file
+  static const constexpr uint16_t kMaxRecordNumber = 9999;
+  struct CommandPacket {
+    static const constexpr std::size_t kByteCount = 0;
+    static const constexpr std::size_t kSubRequestStart = kByteCount + 1;
+  };
+  struct SubRequest {
+    static const constexpr std::size_t kReferenceType = 0;
+    static const constexpr std::size_t kFileNumber = kReferenceType + 1;
+    static const constexpr std::size_t kRecordNumber =
+        kFileNumber + sizeof(uint16_t);
+    static const constexpr std::size_t kRecordLength =
+        kRecordNumber + sizeof(uint16_t);
+    static const constexpr std::size_t kHeaderSize =
+        kRecordLength + sizeof(uint16_t);
+  };
+  static uint8_t ReadByteCount(const ArrayView<uint8_t> &data_array) {
+    return data_array[CommandPacket::kByteCount];
+  }
+  static uint8_t ReadReferenceType(const uint8_t *sub_request) {
+    return sub_request[SubRequest::kReferenceType];
+  }
+  static FileRecord ReadSubRequest(const uint8_t *sub_request) {
+    FileRecord record;
+    record.file_number = Utilities::Make_MSB_uint16_tFromU8Array(
+        ArrayView<const uint8_t>{sizeof(uint16_t),
+                                 &sub_request[SubRequest::kFileNumber]});
+    record.record_number = Utilities::Make_MSB_uint16_tFromU8Array(
+        ArrayView<const uint8_t>{sizeof(uint16_t),
+                                 &sub_request[SubRequest::kRecordNumber]});
+    record.record_length = Utilities::Make_MSB_uint16_tFromU8Array(
+        ArrayView<const uint8_t>{sizeof(uint16_t),
+                                 &sub_request[SubRequest::kRecordLength]});
+    return record;
+  }
+
+ protected:
+  static void FillSubRequest(const FileRecord &record, uint8_t *sub_request) {
+    sub_request[SubRequest::kReferenceType] = kReferenceType;
+    sub_request[SubRequest::kFileNumber] =
+        Utilities::GetByte(record.file_number, 1);
+    sub_request[SubRequest::kFileNumber + 1] =
+        Utilities::GetByte(record.file_number, 0);
+    sub_request[SubRequest::kRecordNumber] =
+        Utilities::GetByte(record.record_number, 1);
+    sub_request[SubRequest::kRecordNumber + 1] =
+        Utilities::GetByte(record.record_number, 0);
+    sub_request[SubRequest::kRecordLength] =
+        Utilities::GetByte(record.record_length, 1);
+    sub_request[SubRequest::kRecordLength + 1] =
+        Utilities::GetByte(record.record_length, 0);
+  }
+};
+
+/*
+ * The response is a byte count then for each sub-request a length, the
+ * reference type and the record data
+ * */
+class ReadFileRecordCommand : public FileRecordCommand {
+ public:
+  static const constexpr auto kFunction = Function::kReadFileRecord;
+  static const constexpr std::size_t kMinByteCount = SubRequest::kHeaderSize;
+  static const constexpr std::size_t kMaxByteCount = 0xf5;
+  //  Most bytes after the response byte count
+  static const constexpr std::size_t kMaxResponseByteCount = 0xf5;
+  struct ResponsePacket {
+    static const constexpr std::size_t kByteCount =
+        Command::ResponsePacket::kHeaderEnd + 1;
+    static const constexpr std::size_t kSubResponseStart = kByteCount + 1;
+  };
+  struct SubResponse {
+    static const constexpr std::size_t kLength = 0;
+    static const constexpr std::size_t kReferenceType = kLength + 1;
+    static const constexpr std::size_t kRecordData = kReferenceType + 1;
+  };
+  static constexpr std::size_t GetSubResponseSize(
+      const std::size_t record_length) {
+    return SubResponse::kRecordData + record_length * sizeof(uint16_t);
+  }
+  static int32_t FillFrame(const ArrayView<const FileRecord> &records,
+                           Frame *frame) {
+    const std::size_t byte_count = records.size() * SubRequest::kHeaderSize;
+    assert(byte_count <= kMaxByteCount);
+    assert(frame->data_array.size() >=
+           CommandPacket::kSubRequestStart + byte_count);
+    frame->function = kFunction;
+    frame->data_array[CommandPacket::kByteCount] =
+        static_cast<uint8_t>(byte_count);
+    uint8_t *sub_request = &frame->data_array[CommandPacket::kSubRequestStart];
+    for (const auto &record : records) {
+      FillSubRequest(record, sub_request);
+      sub_request += SubRequest::kHeaderSize;
+    }
+    frame->data_length = CommandPacket::kSubRequestStart + byte_count;
+    return 0;
+  }
+};
+
+/*
+ * The response is an echo of the request
+ * */
+class WriteFileRecordCommand : public FileRecordCommand {
+ public:
+  static const constexpr auto kFunction = Function::kWriteFileRecord;
+  static const constexpr std::size_t kMinByteCount =
+      SubRequest::kHeaderSize + sizeof(uint16_t);
+  static const constexpr std::size_t kMaxByteCount = 0xfb;
+  static constexpr std::size_t GetSubRequestSize(
+      const std::size_t record_length) {
+    return SubRequest::kHeaderSize + record_length * sizeof(uint16_t);
+  }
+  /*
+   * values holds the record data of each sub-request in turn
+   * */
+  static int32_t FillFrame(const ArrayView<const FileRecord> &records,
+                           const ArrayView<const uint16_t> &values,
+                           Frame *frame) {
+    std::size_t byte_count = 0;
+    for (const auto &record : records) {
+      byte_count += GetSubRequestSize(record.record_length);
+    }
+    assert(byte_count <= kMaxByteCount);
+    assert(frame->data_array.size() >=
+           CommandPacket::kSubRequestStart + byte_count);
+    frame->function = kFunction;
+    frame->data_array[CommandPacket::kByteCount] =
+        static_cast<uint8_t>(byte_count);
+    uint8_t *sub_request = &frame->data_array[CommandPacket::kSubRequestStart];
+    std::size_t value_index = 0;
+    for (const auto &record : records) {
+      FillSubRequest(record, sub_request);
+      uint8_t *data = &sub_request[SubRequest::kHeaderSize];
+      for (std::size_t i = 0; i < record.record_length; i++) {
+        assert(value_index < values.size());
+        *data++ = Utilities::GetByte(values[value_index], 1);
+        *data++ = Utilities::GetByte(values[value_index], 0);
+        value_index++;
+      }
+      sub_request = data;
+    }
+    frame->data_length = CommandPacket::kSubRequestStart + byte_count;
+    return 0;
+  }
+};
+
+static_assert(GetFunctionDescriptor(Function::kReadFileRecord).meta_length ==
+              FileRecordCommand::CommandPacket::kSubRequestStart);
+static_assert(GetFunctionDescriptor(Function::kWriteFileRecord).meta_length ==
+              FileRecordCommand::CommandPacket::kSubRequestStart);
+
+/*
+ * Serves functions 20 and 21 from a file store such as MmapFileStore. Record
+ * data is copied once, between the frame and the store, in Modbus byte
+ * order. Every sub-request of a write is applied before the store is synced
+ * once for the whole frame.
+ * */
+template <typename T>
+class FileRecordController {
+  T *file_data_;
+
+  bool SubRequestValid(const FileRecord &record) const {
+    return record.record_number <= FileRecordCommand::kMaxRecordNumber &&
+           file_data_->RecordsValid(record.file_number, record.record_number,
+                                    record.record_length);
+  }
+
+  Exception ValidateReadFileRecord(const ArrayView<uint8_t> &data_array) const {
+    using Read = ReadFileRecordCommand;
+    const std::size_t byte_count = Read::ReadByteCount(data_array);
+    if (byte_count < Read::kMinByteCount || byte_count > Read::kMaxByteCount ||
+        byte_count % Read::SubRequest::kHeaderSize != 0) {
+      return Exception::kIllegalDataValue;
+    }
+    std::size_t response_byte_count = 0;
+    for (std::size_t offset = Read::CommandPacket::kSubRequestStart;
+         offset < Read::CommandPacket::kSubRequestStart + byte_count;
+         offset += Read::SubRequest::kHeaderSize) {
+      const uint8_t *const sub_request = &data_array[offset];
+      const FileRecord record = Read::ReadSubRequest(sub_request);
+      response_byte_count += Read::GetSubResponseSize(record.record_length);
+      if (Read::ReadReferenceType(sub_request) != Read::kReferenceType ||
+          record.record_length == 0 ||
+          response_byte_count > Read::kMaxResponseByteCount) {
+        return Exception::kIllegalDataValue;
+      } else if (!SubRequestValid(record)) {
+        return Exception::kIllegalDataAddress;
+      }
+    }
+    return Exception::kAck;
+  }
+
+  Exception ValidateWriteFileRecord(
+      const ArrayView<uint8_t> &data_array) const {
+    using Write = WriteFileRecordCommand;
+    const std::size_t byte_count = Write::ReadByteCount(data_array);
+    if (byte_count < Write::kMinByteCount ||
+        byte_count > Write::kMaxByteCount) {
+      return Exception::kIllegalDataValue;
+    }
+    const std::size_t end = Write::CommandPacket::kSubRequestStart + byte_count;
+    std::size_t offset = Write::CommandPacket::kSubRequestStart;
+    while (offset < end) {
+      if (offset + Write::SubRequest::kHeaderSize > end) {
+        return Exception::kIllegalDataValue;
+      }
+      const uint8_t *const sub_request = &data_array[offset];
+      const FileRecord record = Write::ReadSubRequest(sub_request);
+      offset += Write::GetSubRequestSize(record.record_length);
+      if (Write::ReadReferenceType(sub_request) != Write::kReferenceType ||
+          record.record_length == 0 || offset > end) {
+        return Exception::kIllegalDataValue;
+      } else if (!SubRequestValid(record)) {
+        return Exception::kIllegalDataAddress;
+      }
+    }
+    return Exception::kAck;
+  }
+
+ public:
+  static const constexpr std::array<Function, 2> kFunctions{
+      Function::kReadFileRecord,
+      Function::kWriteFileRecord,
+  };
+
+  explicit FileRecordController(T *file_data) : file_data_{file_data} {}
+  T *GetDataStore(void) { return file_data_; }
+
+  int32_t ReadFrame(const Frame &frame, Response *response) {
+    if (frame.function == Function::kReadFileRecord) {
+      return RunReadFileRecord(frame, response);
+    } else if (frame.function == Function::kWriteFileRecord) {
+      return RunWriteFileRecord(frame, response);
+    } else {
+      assert(0);
+    }
+    return -1;
+  }
+
+  int32_t RunReadFileRecord(const Frame &frame, Response *response) {
+    using Read = ReadFileRecordCommand;
+    const std::size_t byte_count = Read::ReadByteCount(frame.data_array);
+    uint8_t *sub_response =
+        &response->data()[Read::ResponsePacket::kSubResponseStart];
+    for (std::size_t offset = Read::CommandPacket::kSubRequestStart;
+         offset < Read::CommandPacket::kSubRequestStart + byte_count;
+         offset += Read::SubRequest::kHeaderSize) {
+      const FileRecord record = Read::ReadSubRequest(&frame.data_array[offset]);
+      const std::size_t size = Read::GetSubResponseSize(record.record_length);
+      sub_response[Read::SubResponse::kLength] = static_cast<uint8_t>(size - 1);
+      sub_response[Read::SubResponse::kReferenceType] = Read::kReferenceType;
+      file_data_->ReadRecords(record.file_number, record.record_number,
+                              record.record_length,
+                              &sub_response[Read::SubResponse::kRecordData]);
+      sub_response += size;
+    }
+    const std::size_t length =
+        static_cast<std::size_t>(sub_response - response->data());
+    response->operator[](Command::ResponsePacket::kSlaveAddress) =
+        frame.address;
+    response->operator[](Command::ResponsePacket::kFunction) =
+        static_cast<uint8_t>(Read::kFunction);
+    response->operator[](Read::ResponsePacket::kByteCount) =
+        static_cast<uint8_t>(length - Read::ResponsePacket::kSubResponseStart);
+    response->SetLength(length);
+    return 0;
+  }
+
+  int32_t RunWriteFileRecord(const Frame &frame, Response *response) {
+    using Write = WriteFileRecordCommand;
+    const std::size_t byte_count = Write::ReadByteCount(frame.data_array);
+    const std::size_t end = Write::CommandPacket::kSubRequestStart + byte_count;
+    for (std::size_t offset = Write::CommandPacket::kSubRequestStart;
+         offset < end;) {
+      const uint8_t *const sub_request = &frame.data_array[offset];
+      const FileRecord record = Write::ReadSubRequest(sub_request);
+      file_data_->WriteRecords(record.file_number, record.record_number,
+                               record.record_length,
+                               &sub_request[Write::SubRequest::kHeaderSize]);
+      file_data_->set_records_callback(
+          record.file_number, record.record_number, record.record_length);
+      offset += Write::GetSubRequestSize(record.record_length);
+    }
+    //  Only queues the dirty span for writeback, waiting for the disk is
+    //  left to the owner. A failed sync is kept by the store, the records are
+    //  already in the shared mapping so the write is still acknowledged.
+    file_data_->Sync();
+
+    response->operator[](Command::ResponsePacket::kSlaveAddress) =
+        frame.address;
+    response->operator[](Command::ResponsePacket::kFunction) =
+        static_cast<uint8_t>(Write::kFunction);
+    std::copy(&frame.data_array[Write::CommandPacket::kByteCount],
+              &frame.data_array[Write::CommandPacket::kByteCount] + end,
+              &response->data()[Command::ResponsePacket::kHeaderEnd + 1]);
+    response->SetLength(Command::kHeaderLength + end);
+    return 0;
+  }
+
+  Exception ValidateFrame(const Frame &frame) const {
+    Exception exception = Exception::kIllegalFunction;
+    if (frame.function == Function::kReadFileRecord) {
+      exception = ValidateReadFileRecord(frame.data_array);
+    } else if (frame.function == Function::kWriteFileRecord) {
+      exception = ValidateWriteFileRecord(frame.data_array);
+    } else {
+      assert(0);
+    }
+    return exception;
+  }
+};
+}  //  namespace Modbus
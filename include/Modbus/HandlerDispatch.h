@@ -0,0 +1,149 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        HandlerDispatch.h
+ * Description:  Compile time function code to handler jump table used by
+ *               the slave protocols
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ *
+ * A handler is any class with
+ *   static const constexpr std::array<Function, N> kFunctions;
+ *   Exception ValidateFrame(const Frame&) const;
+ *   int32_t ReadFrame(const Frame&, Response*);
+ * and optionally
+ *   void ResponseSent(void);
+ * which the slave's ResponseSent calls once the response to a frame is on
+ * its way, for work that must not hold up the response.
+ * The table has an entry for every function byte, codes no handler serves
+ * are left empty and answered with an illegal function exception.
+ */
+
+#pragma once
+#ifndef MODBUS_HANDLERDISPATCH_H_
+#define MODBUS_HANDLERDISPATCH_H_
+#include <Modbus/Modbus.h>
+#include <Modbus/ModbusRtu/ModbusRtuProtocol.h>
+
+#include <array>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace Modbus {
+template <typename... THandlers>
+class HandlerDispatch {
+ public:
+  using Handlers = std::tuple<THandlers &...>;
+  using ValidateFunction = Exception (*)(const Handlers &, const Frame &);
+  using RunFunction = int32_t (*)(const Handlers &, const Frame &,
+                                  Response *);
+  struct Entry {
+    ValidateFunction validate = nullptr;
+    RunFunction run = nullptr;
+  };
+  using Table = std::array<Entry, 256>;
+
+  static const constexpr std::size_t kFunctionCount =
+      (THandlers::kFunctions.size() + ... + 0);
+
+  static constexpr Table MakeTable(void) {
+    return MakeTable(std::index_sequence_for<THandlers...>{});
+  }
+
+  static constexpr std::size_t CountEntries(const Table &table) {
+    std::size_t count = 0;
+    for (const auto &entry : table) {
+      count += entry.validate != nullptr ? 1 : 0;
+    }
+    return count;
+  }
+
+  //  The function codes with an entry in table, in code order
+  static constexpr std::array<Function, kFunctionCount> GetFunctions(
+      const Table &table) {
+    std::array<Function, kFunctionCount> functions{};
+    std::size_t index = 0;
+    for (std::size_t code = 0; code < table.size(); code++) {
+      if (table[code].validate != nullptr && index < functions.size()) {
+        functions[index++] = static_cast<Function>(code);
+      }
+    }
+    return functions;
+  }
+
+  static constexpr bool FunctionsAreValid(void) {
+    return (HandlerFunctionsAreValid<THandlers>() && ... && true);
+  }
+
+  //  Calls ResponseSent on each handler that has it
+  static void ResponseSent(const Handlers &handlers) {
+    ResponseSent(handlers, std::index_sequence_for<THandlers...>{});
+  }
+
+ private:
+  template <typename THandler, typename = void>
+  struct HasResponseSent : std::false_type {};
+  template <typename THandler>
+  using ResponseSentType =
+      decltype(std::declval<THandler &>().ResponseSent());
+  template <typename THandler>
+  struct HasResponseSent<THandler, std::void_t<ResponseSentType<THandler>>>
+      : std::true_type {};
+
+  template <std::size_t I>
+  static void HandlerResponseSent(const Handlers &handlers) {
+    using THandler = std::tuple_element_t<I, std::tuple<THandlers...>>;
+    if constexpr (HasResponseSent<THandler>::value) {
+      std::get<I>(handlers).ResponseSent();
+    }
+  }
+
+  template <std::size_t... I>
+  static void ResponseSent(const Handlers &handlers,
+                           std::index_sequence<I...>) {
+    (HandlerResponseSent<I>(handlers), ...);
+  }
+
+  template <typename THandler>
+  static constexpr bool HandlerFunctionsAreValid(void) {
+    for (auto function : THandler::kFunctions) {
+      if (!FunctionCodeIsValid(static_cast<uint8_t>(function))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  template <std::size_t I>
+  static Exception Validate(const Handlers &handlers, const Frame &frame) {
+    return std::get<I>(handlers).ValidateFrame(frame);
+  }
+
+  template <std::size_t I>
+  static int32_t Run(const Handlers &handlers, const Frame &frame,
+                     Response *response) {
+    return std::get<I>(handlers).ReadFrame(frame, response);
+  }
+
+  template <std::size_t I>
+  static constexpr void AddHandler(Table *table) {
+    using THandler = std::tuple_element_t<I, std::tuple<THandlers...>>;
+    for (auto function : THandler::kFunctions) {
+      (*table)[static_cast<uint8_t>(function)] = Entry{&Validate<I>, &Run<I>};
+    }
+  }
+
+  template <std::size_t... I>
+  static constexpr Table MakeTable(std::index_sequence<I...>) {
+    Table table{};
+    (AddHandler<I>(&table), ...);
+    return table;
+  }
+};
+}  //  namespace Modbus
+
+#endif  //  MODBUS_HANDLERDISPATCH_H_
@@ -170,12 +170,35 @@ class MappedRegisterDataStore : public DataStore {
     return value;
   }
 
+  /*
+   * A range can cover several fields as long as it starts on the first
+   * register of one and ends on the last register of another, so a master
+   * can read neighbouring fields in one request. Registers between fields
+   * that belong to no field read as zero and are ignored on writes.
+   * */
   void GetRegisters(std::size_t address, std::size_t register_count,
                     ArrayView<uint8_t> *data_view) const {
     assert(ReadLocationValid(address, register_count));
-    GetFieldFromAddress(address, data_view);
+    const std::size_t end = address + register_count;
+    std::fill(data_view->data(),
+              data_view->data() + register_count * sizeof(uint16_t), 0);
+    for (std::size_t i = 0; i < memory_controller_->offsets_.size(); i++) {
+      const std::size_t offset = memory_controller_->offsets_[i];
+      const std::size_t end_point = memory_controller_->end_points_[i];
+      if (offset < address || end_point >= end) {
+        continue;
+      }
+      ArrayView<uint8_t> field_view{
+          (end_point - offset + 1) * sizeof(uint16_t),
+          &data_view->data()[(offset - address) * sizeof(uint16_t)]};
+      GetField(i, &field_view);
+    }
   }
 
+  void set_register_callback(std::size_t, uint16_t) {}
+  void set_registers_callback(std::size_t, std::size_t,
+                              const ArrayView<const uint8_t> &) {}
+
   void SetRegister(std::size_t address, uint16_t value) {
     std::array<uint8_t, sizeof(uint16_t)> data{Utilities::GetByte(value, 1),
                                                Utilities::GetByte(value, 0)};
@@ -183,11 +206,37 @@ class MappedRegisterDataStore : public DataStore {
     SetRegisters(address, 1, uint16_data_view);
   }
 
+  /*
+   * Function 22 on a single register field. Fields are copied in and out
+   * through the memory controller so this is a read then a write. The slave
+   * runs requests one at a time so no other master's write lands in
+   * between. A write the application makes to the field from another thread
+   * meanwhile can be lost, use RegisterDataStore for registers the
+   * application also writes.
+   * */
+  uint16_t MaskWriteRegister(std::size_t address, uint16_t and_mask,
+                             uint16_t or_mask) {
+    const uint16_t result = static_cast<uint16_t>(
+        (GetRegister(address) & and_mask) | (or_mask & ~and_mask));
+    SetRegister(address, result);
+    return result;
+  }
+
   //  Validation has made each one of the a complete entry to one of our values
   void SetRegisters(std::size_t address, std::size_t register_count,
                     const ArrayView<const uint8_t> &data_view) {
     assert(WriteLocationValid(address, register_count));
-    SetFieldFromAddress(address, data_view);
+    const std::size_t end = address + register_count;
+    for (std::size_t i = 0; i < memory_controller_->offsets_.size(); i++) {
+      const std::size_t offset = memory_controller_->offsets_[i];
+      const std::size_t end_point = memory_controller_->end_points_[i];
+      if (offset < address || end_point >= end) {
+        continue;
+      }
+      SetField(i, ArrayView<const uint8_t>{
+                      (end_point - offset + 1) * sizeof(uint16_t),
+                      &data_view[(offset - address) * sizeof(uint16_t)]});
+    }
   }
 };  //  class MappedRegisterDataStore
 
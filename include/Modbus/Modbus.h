@@ -14,6 +14,7 @@
 
 #include <ArrayView/ArrayView.h>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cstdint>
@@ -64,6 +65,7 @@ enum class AddressSpace : uint32_t {
   kDiscreteInput = 0x100000,
   kInputRegister = 0x300000,
   kHoldingRegister = 0x400000,
+  kFileRecord = 0x600000,
   kSystemStatus,
   kDeviceIdentifier,
   kUnmapped,
@@ -135,15 +137,6 @@ enum class Function : uint8_t {
   kNone = 0xff
 };
 
-inline constexpr Modbus::Function GetErrorFunction(Modbus::Function function) {
-  if (static_cast<uint8_t>(function) >= kStatusResponseAddValue) {
-    return function;
-  } else {
-    return static_cast<Modbus::Function>(static_cast<uint8_t>(function) +
-                                         kStatusResponseAddValue);
-  }
-}
-
 enum class PacketState { kAddress, kFunction, kMeta, kData, kDone };
 
 enum class CoilState : uint16_t {
@@ -178,110 +171,272 @@ GetValidFunctions() {
   };
 }
 
-inline const constexpr std::array<const Modbus::Function, 4>
+/*
+ * Every function code served by a handler in this library. What a slave
+ * answers depends on the handlers it is built with, see
+ * ProtocolRtuSlave::GetSupportedFunctions.
+ * */
+inline const constexpr std::array<const Modbus::Function, 17>
 GetSupportedFunctions() {
   return {
-      // Modbus::Function::kReadCoils,
-      // Modbus::Function::kReadDiscreteInputs,
+      Modbus::Function::kReadCoils,
+      Modbus::Function::kReadDiscreteInputs,
       Modbus::Function::kReadMultipleHoldingRegisters,
       Modbus::Function::kReadInputRegisters,
-      // Modbus::Function::kWriteSingleCoil,
+      Modbus::Function::kWriteSingleCoil,
       Modbus::Function::kWriteSingleHoldingRegister,
       // Modbus::Function::kReadExceptionStatus,
-      // Modbus::Function::kDiagnostic,
-      // Modbus::Function::kGetComEventCounter,
-      // Modbus::Function::kGetComEventLog,
-      // Modbus::Function::kWriteMultipleCoils,
+      Modbus::Function::kDiagnostic,
+      Modbus::Function::kGetComEventCounter,
+      Modbus::Function::kGetComEventLog,
+      Modbus::Function::kWriteMultipleCoils,
       Modbus::Function::kWriteMultipleHoldingRegisters,
       // Modbus::Function::kReportSlaveId,
-      // Modbus::Function::kReadFileRecord,
-      // Modbus::Function::kWriteFileRecord,
-      // Modbus::Function::kMaskWriteRegister,
-      // Modbus::Function::kReadWriteMultipleRegisters,
-      // Modbus::Function::kReadFifoQueue,
-      // Modbus::Function::kReadDeviceIdentification,
+      Modbus::Function::kReadFileRecord,
+      Modbus::Function::kWriteFileRecord,
+      Modbus::Function::kMaskWriteRegister,
+      Modbus::Function::kReadWriteMultipleRegisters,
+      Modbus::Function::kReadFifoQueue,
+      Modbus::Function::kReadDeviceIdentification,
   };
 }
 
-inline constexpr Modbus::AddressSpace GetAddressSpaceFromFunction(
-    Modbus::Function function) {
-  switch (function) {
-    case (Modbus::Function::kReadCoils):
-      return Modbus::AddressSpace::kCoil;
-    case (Modbus::Function::kWriteSingleCoil):
-      return Modbus::AddressSpace::kCoil;
-    case (Modbus::Function::kWriteMultipleCoils):
-      return Modbus::AddressSpace::kCoil;
-    case (Modbus::Function::kReadDiscreteInputs):
-      return Modbus::AddressSpace::kDiscreteInput;
-    case (Modbus::Function::kReadInputRegisters):
-      return Modbus::AddressSpace::kInputRegister;
-    case (Modbus::Function::kReadMultipleHoldingRegisters):
-      return Modbus::AddressSpace::kHoldingRegister;
-    case (Modbus::Function::kWriteSingleHoldingRegister):
-      return Modbus::AddressSpace::kHoldingRegister;
-    case (Modbus::Function::kWriteMultipleHoldingRegisters):
-      return Modbus::AddressSpace::kHoldingRegister;
-    case (Modbus::Function::kReadWriteMultipleRegisters):
-      return Modbus::AddressSpace::kHoldingRegister;
-    case (Modbus::Function::kMaskWriteRegister):
-      return Modbus::AddressSpace::kHoldingRegister;
-    case (Modbus::Function::kReadExceptionStatus):
-      return Modbus::AddressSpace::kSystemStatus;
-    case (Modbus::Function::kDiagnostic):
-      return Modbus::AddressSpace::kSystemStatus;
-    case (Modbus::Function::kGetComEventCounter):
-      return Modbus::AddressSpace::kSystemStatus;
-    case (Modbus::Function::kGetComEventLog):
-      return Modbus::AddressSpace::kSystemStatus;
-    case (Modbus::Function::kReportSlaveId):
-      return Modbus::AddressSpace::kDeviceIdentifier;
-    case (Modbus::Function::kReadFileRecord):
-      return Modbus::AddressSpace::kUnmapped;
-    case (Modbus::Function::kWriteFileRecord):
-      return Modbus::AddressSpace::kUnmapped;
-    case (Modbus::Function::kReadFifoQueue):
-      return Modbus::AddressSpace::kUnmapped;
-    case (Modbus::Function::kReadDeviceIdentification):
-      return Modbus::AddressSpace::kDeviceIdentifier;
-    case (Modbus::Function::kNone):
-      return Modbus::AddressSpace::kUnmapped;
+/*
+ * How the length of the data section of a command is found once its meta
+ * section has been read
+ * */
+enum class DataLengthType : uint8_t {
+  kNone,       //  No data section
+  kFixed,      //  data_length bytes
+  kByteCount,  //  The meta byte at index data_length holds the byte count
+};
+
+/*
+ * Everything the framing and dispatch code needs to know about a function
+ * code. kFunctionTable holds one for every possible function byte.
+ * */
+struct FunctionDescriptor {
+  Function function = Function::kNone;
+  bool valid = false;
+  bool supported = false;
+  AddressSpace address_space = AddressSpace::kUnmapped;
+  uint8_t meta_length = 0;
+  DataLengthType data_length_type = DataLengthType::kNone;
+  uint8_t data_length = 0;
+  //  Same layout for the normal response to the command
+  uint8_t response_meta_length = 0;
+  DataLengthType response_data_length_type = DataLengthType::kNone;
+  uint8_t response_data_length = 0;
+  Function error_function = Function::kNone;
+};
+
+inline constexpr FunctionDescriptor MakeFunctionDescriptor(const uint8_t code) {
+  FunctionDescriptor descriptor{};
+  descriptor.error_function =
+      static_cast<Function>(code >= kStatusResponseAddValue
+                                ? code
+                                : code + kStatusResponseAddValue);
+  for (auto pt : GetValidFunctions()) {
+    if (static_cast<uint8_t>(pt) == code) {
+      descriptor.function = pt;
+      descriptor.valid = true;
+    }
+  }
+  if (!descriptor.valid) {
+    return descriptor;
+  }
+  for (auto pt : GetSupportedFunctions()) {
+    if (pt == descriptor.function) {
+      descriptor.supported = true;
+    }
+  }
+
+  //  Command framing, the meta section is what comes before any variable data
+  switch (descriptor.function) {
+    case Function::kReadCoils:
+    case Function::kReadDiscreteInputs:
+    case Function::kReadMultipleHoldingRegisters:
+    case Function::kReadInputRegisters:
+      descriptor.meta_length = 4;  //  address, count
+      break;
+    case Function::kWriteSingleCoil:
+    case Function::kWriteSingleHoldingRegister:
+      descriptor.meta_length = 2;  //  address
+      descriptor.data_length_type = DataLengthType::kFixed;
+      descriptor.data_length = 2;  //  value
+      break;
+    case Function::kDiagnostic:
+      descriptor.meta_length = 2;  //  sub-function
+      descriptor.data_length_type = DataLengthType::kFixed;
+      descriptor.data_length = 2;
+      break;
+    case Function::kWriteMultipleCoils:
+    case Function::kWriteMultipleHoldingRegisters:
+      descriptor.meta_length = 5;  //  address, count, byte count
+      descriptor.data_length_type = DataLengthType::kByteCount;
+      descriptor.data_length = 4;
+      break;
+    case Function::kReadFileRecord:
+    case Function::kWriteFileRecord:
+      descriptor.meta_length = 1;  //  byte count
+      descriptor.data_length_type = DataLengthType::kByteCount;
+      descriptor.data_length = 0;
+      break;
+    case Function::kMaskWriteRegister:
+      descriptor.meta_length = 2;  //  address
+      descriptor.data_length_type = DataLengthType::kFixed;
+      descriptor.data_length = 4;  //  and mask, or mask
+      break;
+    case Function::kReadWriteMultipleRegisters:
+      //  read address, read count, write address, write count, byte count
+      descriptor.meta_length = 9;
+      descriptor.data_length_type = DataLengthType::kByteCount;
+      descriptor.data_length = 8;
+      break;
+    case Function::kReadFifoQueue:
+      descriptor.meta_length = 2;  //  pointer address
+      break;
+    case Function::kReadDeviceIdentification:
+      descriptor.meta_length = 1;  //  MEI type
+      descriptor.data_length_type = DataLengthType::kFixed;
+      descriptor.data_length = 2;  //  read device id code, object id
+      break;
+    case Function::kReadExceptionStatus:
+    case Function::kGetComEventCounter:
+    case Function::kGetComEventLog:
+    case Function::kReportSlaveId:
     default:
-      assert(0);
-      return Modbus::AddressSpace::kUnmapped;
+      break;
   }
+
+  //  Response framing. Device identification responses are a list of
+  //  objects with no overall byte count so they cannot be framed this way.
+  switch (descriptor.function) {
+    case Function::kReadCoils:
+    case Function::kReadDiscreteInputs:
+    case Function::kReadMultipleHoldingRegisters:
+    case Function::kReadInputRegisters:
+    case Function::kGetComEventLog:
+    case Function::kReportSlaveId:
+    case Function::kReadFileRecord:
+    case Function::kWriteFileRecord:
+    case Function::kReadWriteMultipleRegisters:
+      descriptor.response_meta_length = 1;  //  byte count
+      descriptor.response_data_length_type = DataLengthType::kByteCount;
+      descriptor.response_data_length = 0;
+      break;
+    case Function::kWriteSingleCoil:
+    case Function::kWriteSingleHoldingRegister:
+    case Function::kDiagnostic:
+    case Function::kMaskWriteRegister:
+      //  Echo of the command
+      descriptor.response_meta_length = descriptor.meta_length;
+      descriptor.response_data_length_type = descriptor.data_length_type;
+      descriptor.response_data_length = descriptor.data_length;
+      break;
+    case Function::kReadExceptionStatus:
+      descriptor.response_meta_length = 1;  //  status
+      break;
+    case Function::kGetComEventCounter:
+      descriptor.response_meta_length = 4;  //  status, event count
+      break;
+    case Function::kWriteMultipleCoils:
+    case Function::kWriteMultipleHoldingRegisters:
+      descriptor.response_meta_length = 4;  //  address, count
+      break;
+    case Function::kReadFifoQueue:
+      //  Two byte byte count, the fifo never holds more than 31 registers so
+      //  the low byte is enough
+      descriptor.response_meta_length = 2;
+      descriptor.response_data_length_type = DataLengthType::kByteCount;
+      descriptor.response_data_length = 1;
+      break;
+    case Function::kReadDeviceIdentification:
+    default:
+      break;
+  }
+
+  switch (descriptor.function) {
+    case Function::kReadCoils:
+    case Function::kWriteSingleCoil:
+    case Function::kWriteMultipleCoils:
+      descriptor.address_space = AddressSpace::kCoil;
+      break;
+    case Function::kReadDiscreteInputs:
+      descriptor.address_space = AddressSpace::kDiscreteInput;
+      break;
+    case Function::kReadInputRegisters:
+      descriptor.address_space = AddressSpace::kInputRegister;
+      break;
+    case Function::kReadMultipleHoldingRegisters:
+    case Function::kWriteSingleHoldingRegister:
+    case Function::kWriteMultipleHoldingRegisters:
+    case Function::kReadWriteMultipleRegisters:
+    case Function::kMaskWriteRegister:
+    case Function::kReadFifoQueue:  //  the pointer is a holding register
+      descriptor.address_space = AddressSpace::kHoldingRegister;
+      break;
+    case Function::kReadExceptionStatus:
+    case Function::kDiagnostic:
+    case Function::kGetComEventCounter:
+    case Function::kGetComEventLog:
+      descriptor.address_space = AddressSpace::kSystemStatus;
+      break;
+    case Function::kReportSlaveId:
+    case Function::kReadDeviceIdentification:
+      descriptor.address_space = AddressSpace::kDeviceIdentifier;
+      break;
+    case Function::kReadFileRecord:
+    case Function::kWriteFileRecord:
+      descriptor.address_space = AddressSpace::kFileRecord;
+      break;
+    default:
+      descriptor.address_space = AddressSpace::kUnmapped;
+      break;
+  }
+  return descriptor;
 }
 
-inline constexpr Modbus::Function GetFunction(uint8_t code) {
-  for (auto i : Modbus::GetValidFunctions()) {
-    if (code == static_cast<uint8_t>(i)) {
-      return i;
-    }
+using FunctionTable = std::array<FunctionDescriptor, 256>;
+inline constexpr FunctionTable MakeFunctionTable(void) {
+  FunctionTable table{};
+  for (std::size_t code = 0; code < table.size(); code++) {
+    table[code] = MakeFunctionDescriptor(static_cast<uint8_t>(code));
   }
-  return Modbus::Function::kNone;
+  return table;
+}
+
+inline constexpr FunctionTable kFunctionTable = MakeFunctionTable();
+
+inline constexpr const FunctionDescriptor &GetFunctionDescriptor(
+    const uint8_t code) {
+  return kFunctionTable[code];
+}
+
+inline constexpr const FunctionDescriptor &GetFunctionDescriptor(
+    const Function function) {
+  return kFunctionTable[static_cast<uint8_t>(function)];
+}
+
+inline constexpr Modbus::Function GetErrorFunction(Modbus::Function function) {
+  return GetFunctionDescriptor(function).error_function;
+}
+
+inline constexpr Modbus::AddressSpace GetAddressSpaceFromFunction(
+    Modbus::Function function) {
+  return GetFunctionDescriptor(function).address_space;
+}
+
+inline constexpr Modbus::Function GetFunction(uint8_t code) {
+  return GetFunctionDescriptor(code).function;
 }
 
 inline constexpr bool FunctionIsSupported(const Function function) {
-  for (auto i : Modbus::GetSupportedFunctions()) {
-    bool valid = false;
-    if (function == i) {
-      valid = true;
-      break;
-    }
-    return valid;
-  }
+  return GetFunctionDescriptor(function).supported;
 }
 
 inline constexpr bool FunctionCodeIsValid(uint8_t code) {
-  if (code > static_cast<uint8_t>(Function::kReadDeviceIdentification)) {
-    return false;
-  }
-  for (auto pt : Modbus::GetValidFunctions()) {
-    if (static_cast<uint8_t>(pt) == code) {
-      return true;
-    }
-  }
-  return false;
+  return GetFunctionDescriptor(code).valid;
 }
 
 enum class PacketType { kCommand, kResponse, kError, kUnknown };
@@ -315,9 +470,6 @@ struct Frame {
     address = 0;
     function = Modbus::Function::kNone;
     data_length = 0;
-    for (auto &pt : data_array) {
-      pt = 0;
-    }
   }
   Frame(uint8_t addr, Modbus::Function func, std::size_t length,
         ArrayView<uint8_t> arrayview)
@@ -332,20 +484,35 @@ struct Frame {
   Frame(void) {}
 };
 
+/*
+ * Response being built for transmission. By default it is written into its
+ * own storage, SetBuffer points it at a caller owned transmit region so the
+ * controllers encode straight into it. Copies always land in the storage of
+ * the destination.
+ * */
 class Response {
   static const std::size_t kMaxFrameLength = 256;
   std::size_t length_ = 0;
-  std::array<uint8_t, kMaxFrameLength> data_{};
+  std::array<uint8_t, kMaxFrameLength> storage_{};
+  uint8_t *data_ = storage_.data();
+  std::size_t capacity_ = kMaxFrameLength;
   bool ready_ = false;
+  bool crc_written_ = false;
 
  public:
   std::size_t GetLength(void) const { return length_; }
   void SetLength(size_t length) { length_ = length; }
   bool IsReady(void) const { return ready_; }
   void SetReady(bool ready) { ready_ = ready; }
-  uint8_t *data(void) { return data_.data(); }
-  const uint8_t *data(void) const { return data_.data(); }
-  constexpr std::size_t size(void) const { return data_.size(); }
+  /*
+   * Set by a controller that copied a prebuilt frame with its crc already
+   * after the GetLength() bytes, the rtu framing then keeps that crc
+   * */
+  bool IsCrcWritten(void) const { return crc_written_; }
+  void SetCrcWritten(bool written) { crc_written_ = written; }
+  uint8_t *data(void) { return data_; }
+  const uint8_t *data(void) const { return data_; }
+  std::size_t size(void) const { return capacity_; }
   const uint8_t &at(std::size_t index) const {
     assert(index <= size());
     return data_[index < size() ? index : 0];
@@ -362,19 +529,42 @@ class Response {
     return ArrayView<const uint8_t>{GetLength(), data()};
   }
 
-  const uint8_t *begin(void) const { return data_.begin(); }
+  const uint8_t *begin(void) const { return data_; }
   const uint8_t *end(void) const { return begin() + GetLength(); }
-  uint8_t *begin(void) { return data_.begin(); }
-  uint8_t *end(void) { return data_.begin() + GetLength(); }
+  uint8_t *begin(void) { return data_; }
+  uint8_t *end(void) { return data_ + GetLength(); }
+
+  //  Only the length is cleared, every response writes the bytes it sends
   void Reset(void) {
-    for (uint8_t &pt : data_) {
-      pt = 0;
-    }
     SetLength(0);
     SetReady(false);
+    SetCrcWritten(false);
   }
 
-  constexpr Response(void) {}
+  void SetBuffer(uint8_t *buffer, const std::size_t capacity) {
+    assert(buffer != nullptr);
+    data_ = buffer;
+    capacity_ = capacity;
+    Reset();
+  }
+  void UseInternalBuffer(void) { SetBuffer(storage_.data(), storage_.size()); }
+  bool UsesInternalBuffer(void) const { return data_ == storage_.data(); }
+
+  Response &operator=(const Response &other) {
+    if (this != &other) {
+      length_ = std::min(other.GetLength(), size());
+      ready_ = other.IsReady();
+      crc_written_ = other.IsCrcWritten();
+      const std::size_t crc_length =
+          crc_written_ ? std::min(sizeof(uint16_t), size() - length_) : 0;
+      std::copy(other.begin(), other.begin() + length_ + crc_length, data_);
+    }
+    return *this;
+  }
+  Response(const Response &other) { *this = other; }
+  Response(uint8_t *buffer, const std::size_t capacity)
+      : data_{buffer}, capacity_{capacity} {}
+  Response(void) {}
 };
 
 struct Command {
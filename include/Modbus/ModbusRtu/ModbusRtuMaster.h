@@ -0,0 +1,414 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        ModbusRtu/ModbusRtuMaster.h
+ * Description:  Controller for a rtu master, one outstanding request at a
+ *               time with response matching and timeouts
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ *
+ * ----------------------------------------------------------------------
+ *
+ * Nothing here reads a clock, every call that depends on time is passed the
+ * current time in microseconds by the caller. Differences are taken with
+ * unsigned arithmetic so the counter is free to wrap.
+ *
+ * A request is built with one of the request functions, the caller writes
+ * GetTxData to the line and calls RequestSent once the last byte has gone
+ * out. Received bytes go to ProcessBytes. Poll times the request out, after
+ * which GetStatus tells how it ended. Read responses are decoded straight
+ * into the data store given with the request, any store with
+ * WriteLocationValid and SetRegisters will do (RegisterDataStore,
+ * MappedRegisterDataStore).
+ */
+
+#pragma once
+#ifndef MODBUS_MODBUSRTUMASTER_H_
+#define MODBUS_MODBUSRTUMASTER_H_
+#include <ArrayView/ArrayView.h>
+#include <Modbus/Modbus.h>
+#include <Modbus/ModbusRtu/ModbusRtuProtocol.h>
+#include <Modbus/RegisterControl.h>
+#include <Utilities/TypeConversion.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace Modbus {
+enum class MasterStatus {
+  kIdle,         //  No request has been made
+  kReady,        //  Request framed, waiting for RequestSent
+  kWaiting,      //  Waiting on the response
+  kComplete,     //  Response received and decoded
+  kException,    //  Slave answered with an exception, see GetException
+  kTimeout,      //  No complete response in time
+  kBadResponse,  //  CRC error or a response that does not match the request
+};
+
+struct MasterTiming {
+  uint32_t frame_delay_us = 1750;          //  t3.5, silence before a request
+  uint32_t response_timeout_us = 100000;   //  Request sent to response done
+  uint32_t broadcast_delay_us = 100000;    //  Turnaround after a broadcast
+};
+
+class ProtocolRtuMaster : public ProtocolRtu {
+ public:
+  static const constexpr uint8_t kBroadcastAddress = 0;
+
+ private:
+  /*
+   * Where a read response is decoded to, the store type is erased so the
+   * master does not have to be a template over every store it fills
+   * */
+  using DecodeFunction = void (*)(void *, uint16_t, uint16_t,
+                                  const ArrayView<const uint8_t> &);
+  struct Target {
+    void *store = nullptr;
+    DecodeFunction decode = nullptr;
+  };
+
+  template <typename TStore>
+  static void Decode(void *store, const uint16_t address,
+                     const uint16_t register_count,
+                     const ArrayView<const uint8_t> &data) {
+    static_cast<TStore *>(store)->SetRegisters(address, register_count, data);
+  }
+
+  template <typename TStore>
+  static Target MakeTarget(TStore *store) {
+    return Target{store, &Decode<TStore>};
+  }
+
+  //  Response offsets relative to the frame data, which starts after the
+  //  function byte
+  static const constexpr std::size_t kByteCountIndex =
+      ReadMultipleRegistersCommandBase::ResponsePacket::kNumberOfBytes -
+      Command::kHeaderLength;
+  static const constexpr std::size_t kEchoAddressIndex =
+      WriteSingleHoldingRegisterCommand::ResponsePacket::kDataAddress -
+      Command::kHeaderLength;
+  static const constexpr std::size_t kEchoValueIndex =
+      WriteSingleHoldingRegisterCommand::ResponsePacket::kValueStart -
+      Command::kHeaderLength;
+  static_assert(WriteMultipleHoldingRegistersCommand::ResponsePacket::
+                        kRegisterCount -
+                    Command::kHeaderLength ==
+                kEchoValueIndex);
+
+  MasterTiming timing_;
+  MasterStatus status_ = MasterStatus::kIdle;
+  Exception exception_ = Exception::kNoException;
+
+  std::array<uint8_t, 256> request_data_{};
+  Modbus::Frame request_{
+      ArrayView<uint8_t>{request_data_.size(), request_data_.data()}};
+  std::array<uint8_t, 256> tx_data_{};
+  std::size_t tx_length_ = 0;
+
+  std::array<uint8_t, 256> response_data_{};
+  Modbus::Frame response_{
+      ArrayView<uint8_t>{response_data_.size(), response_data_.data()}};
+  ReadContext ctx_{PacketType::kResponse};
+
+  Target target_{};
+  uint16_t address_ = 0;
+  uint16_t count_ = 0;  //  Register count or written value
+
+  uint32_t sent_at_us_ = 0;
+  uint32_t last_activity_us_ = 0;
+  uint32_t quiet_us_ = 0;  //  Silence needed after last_activity_us_
+
+  static bool Elapsed(const uint32_t now_us, const uint32_t since_us,
+                      const uint32_t period_us) {
+    return static_cast<uint32_t>(now_us - since_us) >= period_us;
+  }
+
+  //  Function 3 and 4 ask for 1 to 125 registers
+  static bool ReadCountValid(const uint16_t register_count) {
+    return register_count > 0 &&
+           register_count <=
+               ReadMultipleRegistersCommandBase::kMaxRegisterCount;
+  }
+
+  uint16_t ReadResponseWord(const std::size_t index) const {
+    return Utilities::Make_MSB_uint16_tFromU8Array(ArrayView<const uint8_t>{
+        sizeof(uint16_t), &response_.data_array[index]});
+  }
+
+  bool PrepareRequest(const uint8_t slave_address) {
+    if (status_ == MasterStatus::kWaiting) {
+      return false;
+    }
+    request_.Reset();
+    request_.address = slave_address;
+    target_ = Target{};
+    exception_ = Exception::kNoException;
+    return true;
+  }
+
+  void FinishRequest(void) {
+    tx_length_ = GetRequiredPacketSize(request_);
+    ArrayView<uint8_t> frame{tx_length_, tx_data_.data()};
+    Frame(request_, &frame);
+    status_ = MasterStatus::kReady;
+  }
+
+  void Finish(const MasterStatus status, const uint32_t now_us) {
+    status_ = status;
+    last_activity_us_ = now_us;
+    quiet_us_ = timing_.frame_delay_us;
+  }
+
+  /*
+   * Check a complete response against the outstanding request and decode it
+   * */
+  MasterStatus HandleResponse(void) {
+    if (!ctx_.CrcIsValid() || response_.address != request_.address) {
+      return MasterStatus::kBadResponse;
+    }
+    if (response_.function == GetErrorFunction(request_.function)) {
+      exception_ = static_cast<Exception>(response_.data_array[0]);
+      return MasterStatus::kException;
+    }
+    if (response_.function != request_.function) {
+      return MasterStatus::kBadResponse;
+    }
+    switch (request_.function) {
+      case Function::kReadMultipleHoldingRegisters:
+      case Function::kReadInputRegisters:
+      case Function::kReadWriteMultipleRegisters: {
+        const std::size_t byte_count = response_.data_array[kByteCountIndex];
+        if (byte_count != count_ * sizeof(uint16_t)) {
+          return MasterStatus::kBadResponse;
+        }
+        if (target_.decode != nullptr) {
+          target_.decode(target_.store, address_, count_,
+                         ArrayView<const uint8_t>{
+                             byte_count,
+                             &response_.data_array[kByteCountIndex + 1]});
+        }
+        break;
+      }
+      case Function::kWriteSingleHoldingRegister:
+      case Function::kWriteMultipleHoldingRegisters:
+        if (ReadResponseWord(kEchoAddressIndex) != address_ ||
+            ReadResponseWord(kEchoValueIndex) != count_) {
+          return MasterStatus::kBadResponse;
+        }
+        break;
+      case Function::kMaskWriteRegister:
+        if (!std::equal(request_.data_array.begin(),
+                        request_.data_array.begin() + request_.data_length,
+                        response_.data_array.begin())) {
+          return MasterStatus::kBadResponse;
+        }
+        break;
+      default:
+        return MasterStatus::kBadResponse;
+    }
+    return MasterStatus::kComplete;
+  }
+
+ public:
+  MasterStatus GetStatus(void) const { return status_; }
+  Exception GetException(void) const { return exception_; }
+  bool IsBusy(void) const { return status_ == MasterStatus::kWaiting; }
+  const MasterTiming &GetTiming(void) const { return timing_; }
+  void SetTiming(const MasterTiming &timing) { timing_ = timing; }
+
+  /*
+   * True once the line has been quiet long enough for the next request
+   * */
+  bool ReadyToSend(const uint32_t now_us) const {
+    return !IsBusy() && Elapsed(now_us, last_activity_us_, quiet_us_);
+  }
+
+  /*
+   * The framed request, CRC included
+   * */
+  ArrayView<const uint8_t> GetTxData(void) const {
+    return ArrayView<const uint8_t>{tx_length_, tx_data_.data()};
+  }
+  const Modbus::Frame &GetRequest(void) const { return request_; }
+  const Modbus::Frame &GetResponse(void) const { return response_; }
+
+  template <typename TStore>
+  bool ReadHoldingRegisters(const uint8_t slave_address,
+                            const uint16_t address,
+                            const uint16_t register_count, TStore *store) {
+    if (slave_address == kBroadcastAddress ||
+        !ReadCountValid(register_count) ||
+        !store->WriteLocationValid(address, register_count) ||
+        !PrepareRequest(slave_address)) {
+      return false;
+    }
+    ReadMultipleHoldingRegistersCommand::FillFrame(address, register_count,
+                                                   &request_);
+    address_ = address;
+    count_ = register_count;
+    target_ = MakeTarget(store);
+    FinishRequest();
+    return true;
+  }
+
+  template <typename TStore>
+  bool ReadInputRegisters(const uint8_t slave_address, const uint16_t address,
+                          const uint16_t register_count, TStore *store) {
+    if (slave_address == kBroadcastAddress ||
+        !ReadCountValid(register_count) ||
+        !store->WriteLocationValid(address, register_count) ||
+        !PrepareRequest(slave_address)) {
+      return false;
+    }
+    ReadInputRegistersCommand::FillFrame(address, register_count, &request_);
+    address_ = address;
+    count_ = register_count;
+    target_ = MakeTarget(store);
+    FinishRequest();
+    return true;
+  }
+
+  bool WriteSingleRegister(const uint8_t slave_address, const uint16_t address,
+                           const uint16_t value) {
+    if (!PrepareRequest(slave_address)) {
+      return false;
+    }
+    WriteSingleHoldingRegisterCommand::FillFrame(address, value, &request_);
+    address_ = address;
+    count_ = value;
+    FinishRequest();
+    return true;
+  }
+
+  bool WriteMultipleRegisters(const uint8_t slave_address,
+                              const uint16_t address,
+                              const ArrayView<const uint16_t> &values) {
+    if (values.size() == 0 ||
+        values.size() >
+            WriteMultipleHoldingRegistersCommand::kMaxRegisterCount ||
+        !PrepareRequest(slave_address)) {
+      return false;
+    }
+    const uint16_t register_count = static_cast<uint16_t>(values.size());
+    WriteMultipleHoldingRegistersCommand::FillFrame(address, register_count,
+                                                    values, &request_);
+    address_ = address;
+    count_ = register_count;
+    FinishRequest();
+    return true;
+  }
+
+  /*
+   * Function 22, the bits set in and_mask are kept and the rest are taken
+   * from or_mask. The slave changes the register in one step.
+   * */
+  bool MaskWriteRegister(const uint8_t slave_address, const uint16_t address,
+                         const uint16_t and_mask, const uint16_t or_mask) {
+    if (!PrepareRequest(slave_address)) {
+      return false;
+    }
+    MaskWriteRegisterCommand::FillFrame(address, and_mask, or_mask, &request_);
+    address_ = address;
+    count_ = 0;
+    FinishRequest();
+    return true;
+  }
+
+  /*
+   * Function 23, values are written from write_address and then read_count
+   * registers from read_address are read back into store, all in one
+   * transaction
+   * */
+  template <typename TStore>
+  bool ReadWriteMultipleRegisters(const uint8_t slave_address,
+                                  const uint16_t write_address,
+                                  const ArrayView<const uint16_t> &values,
+                                  const uint16_t read_address,
+                                  const uint16_t read_count, TStore *store) {
+    using Limits = ReadWriteMultipleRegistersCommand;
+    if (slave_address == kBroadcastAddress || read_count == 0 ||
+        read_count > Limits::kMaxReadCount || values.size() == 0 ||
+        values.size() > Limits::kMaxWriteCount ||
+        !store->WriteLocationValid(read_address, read_count) ||
+        !PrepareRequest(slave_address)) {
+      return false;
+    }
+    ReadWriteMultipleRegistersCommand::FillFrame(read_address, read_count,
+                                                 write_address, values,
+                                                 &request_);
+    address_ = read_address;
+    count_ = read_count;
+    target_ = MakeTarget(store);
+    FinishRequest();
+    return true;
+  }
+
+  /*
+   * Call when the last byte of the request has left the transmitter. A
+   * broadcast gets no response, the line is held for the broadcast delay.
+   * */
+  void RequestSent(const uint32_t now_us) {
+    assert(status_ == MasterStatus::kReady);
+    sent_at_us_ = now_us;
+    last_activity_us_ = now_us;
+    if (request_.address == kBroadcastAddress) {
+      status_ = MasterStatus::kComplete;
+      quiet_us_ = timing_.broadcast_delay_us;
+      return;
+    }
+    status_ = MasterStatus::kWaiting;
+    quiet_us_ = timing_.frame_delay_us;
+    ctx_.Reset();
+    response_.Reset();
+  }
+
+  /*
+   * Pass received bytes in. Returns the number used, bytes after a complete
+   * response or received when no response is expected are dropped.
+   * */
+  std::size_t ProcessBytes(const ArrayView<const uint8_t> &data,
+                           const uint32_t now_us) {
+    last_activity_us_ = now_us;
+    if (status_ != MasterStatus::kWaiting) {
+      return data.size();
+    }
+    const ReadResult result = ctx_.ProcessBytes(&response_, data);
+    if (result.packet_received) {
+      Finish(HandleResponse(), now_us);
+    }
+    return result.bytes_used;
+  }
+
+  /*
+   * Times out the outstanding request, returns true while still waiting
+   * */
+  bool Poll(const uint32_t now_us) {
+    if (status_ != MasterStatus::kWaiting) {
+      return false;
+    }
+    if (Elapsed(now_us, sent_at_us_, timing_.response_timeout_us)) {
+      Finish(MasterStatus::kTimeout, now_us);
+      return false;
+    }
+    return true;
+  }
+
+  /*
+   * Drop any request in progress
+   * */
+  void Reset(void) {
+    status_ = MasterStatus::kIdle;
+    ctx_.Reset();
+    response_.Reset();
+    tx_length_ = 0;
+  }
+
+  explicit ProtocolRtuMaster(Crc16 crc16,
+                             const MasterTiming &timing = MasterTiming{})
+      : ProtocolRtu{crc16}, timing_{timing} {}
+};
+}  //  namespace Modbus
+
+#endif  //  MODBUS_MODBUSRTUMASTER_H_
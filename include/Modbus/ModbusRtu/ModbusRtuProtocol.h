@@ -10,10 +10,12 @@
  */
 
 #pragma once
+#include <Modbus/Crc.h>
 #include <Modbus/Modbus.h>
 #include <Modbus/RegisterControl.h>
 #include <Utilities/TypeConversion.h>
 
+#include <algorithm>
 #include <cstdint>
 
 #define INTEGER_SIZE sizeof(uint16_t)
@@ -26,99 +28,229 @@ inline constexpr std::size_t GetRequiredPacketSize(
   return Command::kHeaderLength + packet.data_length + Command::kFooterLength;
 }
 
-inline int32_t CalculateMetaDataBytesRemaining(const Function function) {
-  if (function == Function::kReadMultipleHoldingRegisters) {
-    return ReadMultipleRegistersCommandBase::CommandPacket::kPacketSize;
-  } else if (function == Function::kReadInputRegisters) {
-    return ReadMultipleRegistersCommandBase::CommandPacket::kPacketSize;
-  } else if (function == Function::kWriteSingleHoldingRegister) {
-    return WriteSingleHoldingRegisterCommand::CommandPacket::kValueStart;
-  } else if (function == Function::kWriteMultipleHoldingRegisters) {
-    return WriteMultipleHoldingRegistersCommand::CommandPacket::kValueStart;
+static_assert(GetFunctionDescriptor(Function::kReadMultipleHoldingRegisters)
+                  .meta_length ==
+              ReadMultipleRegistersCommandBase::CommandPacket::kPacketSize);
+static_assert(GetFunctionDescriptor(Function::kWriteSingleHoldingRegister)
+                      .meta_length +
+                  GetFunctionDescriptor(Function::kWriteSingleHoldingRegister)
+                      .data_length ==
+              WriteSingleHoldingRegisterCommand::CommandPacket::kPacketSize);
+static_assert(GetFunctionDescriptor(Function::kWriteMultipleHoldingRegisters)
+                  .meta_length ==
+              WriteMultipleHoldingRegistersCommand::CommandPacket::kValueStart);
+static_assert(
+    GetFunctionDescriptor(Function::kWriteMultipleHoldingRegisters)
+        .data_length ==
+    WriteMultipleHoldingRegistersCommand::CommandPacket::kNumberOfDataBytes);
+
+/*
+ * An exception response carries the function code with the top bit set
+ * followed by the exception code
+ * */
+inline constexpr bool IsErrorResponseCode(const uint8_t code) {
+  return code >= kStatusResponseAddValue &&
+         FunctionCodeIsValid(
+             static_cast<uint8_t>(code - kStatusResponseAddValue));
+}
+
+static_assert(GetFunctionDescriptor(Function::kMaskWriteRegister).meta_length +
+                  GetFunctionDescriptor(Function::kMaskWriteRegister)
+                      .data_length ==
+              MaskWriteRegisterCommand::CommandPacket::kPacketSize);
+static_assert(GetFunctionDescriptor(Function::kReadWriteMultipleRegisters)
+                  .meta_length ==
+              ReadWriteMultipleRegistersCommand::CommandPacket::kValueStart);
+static_assert(
+    GetFunctionDescriptor(Function::kReadWriteMultipleRegisters).data_length ==
+    ReadWriteMultipleRegistersCommand::CommandPacket::kNumberOfDataBytes);
+
+inline int32_t CalculateMetaDataBytesRemaining(
+    const Function function, const PacketType type = PacketType::kCommand) {
+  const uint8_t code = static_cast<uint8_t>(function);
+  if (type == PacketType::kResponse && IsErrorResponseCode(code)) {
+    return sizeof(Exception);
   }
-  return 0;
-  //  Function::kReadExceptionStatus,
-  //  Function::kDiagnostic,
-  //  Function::kGetComEventCounter,
-  //  Function::kGetComEventLog,
-  //  Function::kReportSlaveId,
-  //  Function::kReadFileRecord,
-  //  Function::kWriteFileRecord,
-  //  Function::kMaskWriteRegister,
-  //  Function::kReadWriteMultipleRegisters,
-  //  Function::kReadFifoQueue,
-  //  Function::kReadDeviceIdentification,
+  const auto &descriptor = GetFunctionDescriptor(function);
+  return type == PacketType::kResponse ? descriptor.response_meta_length
+                                       : descriptor.meta_length;
 }
 
-inline int32_t CalculateBytesRemaining(const Frame &frame) {
-  const auto function = frame.function;
-  std::size_t bytes = 0;
-  if (function == Function::kReadMultipleHoldingRegisters) {
-    bytes = 0;
-  } else if (function == Function::kReadInputRegisters) {
-    bytes = 0;
-  } else if (function == Function::kWriteSingleHoldingRegister) {
-    bytes = sizeof(uint16_t);
-  } else if (function == Function::kWriteMultipleHoldingRegisters) {
-    bytes =
-        frame.data_array
-            [WriteMultipleHoldingRegistersCommand::CommandPacket::
-                 kNumberOfDataBytes];  // << 8 |
-                                       // frame.data_array[WriteMultipleHoldingRegistersCommand::CommandPacket::kNumberOfDataBytes];
-  }
-  return bytes;
+inline int32_t CalculateBytesRemaining(
+    const Frame &frame, const PacketType type = PacketType::kCommand) {
+  if (type == PacketType::kResponse &&
+      IsErrorResponseCode(static_cast<uint8_t>(frame.function))) {
+    return 0;
+  }
+  const auto &descriptor = GetFunctionDescriptor(frame.function);
+  const bool response = type == PacketType::kResponse;
+  const DataLengthType length_type = response
+                                         ? descriptor.response_data_length_type
+                                         : descriptor.data_length_type;
+  const uint8_t data_length =
+      response ? descriptor.response_data_length : descriptor.data_length;
+  switch (length_type) {
+    case DataLengthType::kFixed:
+      return data_length;
+    case DataLengthType::kByteCount:
+      return frame.data_array[data_length];
+    case DataLengthType::kNone:
+    default:
+      break;
+  }
+  return 0;
 }
 
+/*
+ * Result of passing a block of bytes to ReadContext::ProcessBytes.
+ * bytes_used is the number of bytes taken from the block, bytes past that
+ * belong to the next frame and should be passed in after the current one has
+ * been handled.
+ * */
+struct ReadResult {
+  std::size_t bytes_used = 0;
+  bool packet_received = false;
+};
+
+/*
+ * Slaves read commands, a master reads responses with the same context
+ * constructed with PacketType::kResponse. Response frames may be exception
+ * responses, frame.function then holds the error function code.
+ * */
 class ReadContext {
   PacketState state_ = PacketState::kAddress;
   int32_t bytes_to_read_ = Command::kHeaderLength + 1;
+  RunningCrc16 crc_{};
+  PacketType packet_type_ = PacketType::kCommand;
+  uint32_t overruns_ = 0;  //  Frames dropped since TakeOverrunCount
+
+  bool FunctionByteIsValid(const uint8_t code) const {
+    return FunctionCodeIsValid(code) ||
+           (packet_type_ == PacketType::kResponse && IsErrorResponseCode(code));
+  }
+
+  /*
+   * Called when the byte count of the meta or data section reaches zero
+   * */
+  void FinishSection(const Frame &frame) {
+    if (state_ == PacketState::kMeta) {
+      bytes_to_read_ =
+          CalculateBytesRemaining(frame, packet_type_) + Command::kFooterLength;
+      state_ = PacketState::kData;
+      if (bytes_to_read_ == 0) {
+        state_ = PacketState::kDone;
+      }
+    } else {
+      state_ = PacketState::kDone;
+    }
+  }
+
+  //  Frame overruns the buffer, drop it and resync on the next frame
+  void Overrun(Frame *p_frame) {
+    p_frame->data_length = 0;
+    overruns_++;
+    Reset();
+  }
+
+  //  Store a meta or data byte
+  void ReadByte(Frame *p_frame, const uint8_t pt) {
+    if (p_frame->data_length >= p_frame->data_array.size()) {
+      Overrun(p_frame);
+      return;
+    }
+    p_frame->data_array[p_frame->data_length++] = pt;
+    if (bytes_to_read_ <= 0) {
+      FinishSection(*p_frame);
+    }
+  }
+
+  /*
+   * Copy as much of the meta or data section as is available in one go.
+   * Returns the number of bytes consumed.
+   * */
+  std::size_t ReadSection(Frame *p_frame, const uint8_t *data,
+                          const std::size_t length) {
+    const std::size_t requested =
+        bytes_to_read_ > 0 ? static_cast<std::size_t>(bytes_to_read_) : 1;
+    const std::size_t count = std::min(requested, length);
+    if (p_frame->data_length + count > p_frame->data_array.size()) {
+      Overrun(p_frame);
+      return count;
+    }
+    std::copy(data, data + count, &p_frame->data_array[p_frame->data_length]);
+    crc_.Update(data, count);
+    p_frame->data_length += count;
+    bytes_to_read_ -= static_cast<int32_t>(count);
+    if (bytes_to_read_ <= 0) {
+      FinishSection(*p_frame);
+    }
+    return count;
+  }
 
  public:
+  explicit ReadContext(const PacketType packet_type = PacketType::kCommand)
+      : packet_type_{packet_type} {}
+
   PacketState GetState(void) const { return state_; }
+  PacketType GetPacketType(void) const { return packet_type_; }
   void Reset(void) {
     bytes_to_read_ = Command::kHeaderLength + 1;
     state_ = PacketState::kAddress;
+    crc_.Reset();
   }
 
   bool PacketReceived(void) const { return state_ == PacketState::kDone; }
 
+  /*
+   * Frames dropped for overrunning the frame buffer since the last call,
+   * collected by the slave for the character overrun diagnostic
+   * */
+  uint32_t TakeOverrunCount(void) {
+    const uint32_t overruns = overruns_;
+    overruns_ = 0;
+    return overruns;
+  }
+
+  /*
+   * The CRC is run over every byte as it is accepted, a received frame is
+   * valid when the CRC over the whole frame including its own CRC is zero.
+   * */
+  bool CrcIsValid(void) const {
+    return PacketReceived() && crc_.ResidueIsValid();
+  }
+
   void ProcessCharacter(Frame *p_frame, const uint8_t pt) {
     bytes_to_read_--;
+    crc_.Update(pt);
     switch (state_) {
       case PacketState::kAddress:
         p_frame->address = pt;
         state_ = PacketState::kFunction;
         break;
       case PacketState::kFunction:
-        if (FunctionCodeIsValid(pt)) {
-          p_frame->function = GetFunction(pt);
+        if (FunctionByteIsValid(pt)) {
+          p_frame->function = static_cast<Function>(pt);
           state_ = PacketState::kMeta;
-          bytes_to_read_ = CalculateMetaDataBytesRemaining(p_frame->function);
+          bytes_to_read_ =
+              CalculateMetaDataBytesRemaining(p_frame->function, packet_type_);
+          if (bytes_to_read_ <= 0) {
+            //  No meta section, only the CRC is left
+            FinishSection(*p_frame);
+          }
         } else {
           Reset();
         }
         break;
       case PacketState::kMeta:
         //  This contains information on the length or not depending on function
-        p_frame->data_array[p_frame->data_length++] = pt;
-        if (bytes_to_read_ <= 0) {
-          bytes_to_read_ =
-              CalculateBytesRemaining(*p_frame) + Command::kFooterLength;
-          state_ = PacketState::kData;
-          if (bytes_to_read_ == 0) {
-            state_ = PacketState::kDone;
-          }
-        }
+        ReadByte(p_frame, pt);
         break;
 
       case PacketState::kData:
         //  Send the data to the function controller, keep reading until it says
         //  its done, character space timeout occurs, or an illegal value is
         //  entered
-        p_frame->data_array[p_frame->data_length++] = pt;
-        if (bytes_to_read_ <= 0) {
-          state_ = PacketState::kDone;
-        }
+        ReadByte(p_frame, pt);
         break;
       case PacketState::kDone:
         assert(0);
@@ -129,6 +261,37 @@ class ReadContext {
         Reset();
     }
   }
+
+  /*
+   * Run the state machine over a block of received bytes, such as a DMA
+   * transfer or the result of a read(2). The header is handled a byte at a
+   * time, the meta and data sections are copied as blocks. Stops at the end
+   * of a frame so the frame can be handled before the rest of the block is
+   * passed in.
+   * */
+  ReadResult ProcessBytes(Frame *p_frame,
+                          const ArrayView<const uint8_t> &data) {
+    const uint8_t *const bytes = data.data();
+    const std::size_t length = data.size();
+    std::size_t index = 0;
+    while (index < length && !PacketReceived()) {
+      switch (state_) {
+        case PacketState::kAddress:
+        case PacketState::kFunction:
+          ProcessCharacter(p_frame, bytes[index++]);
+          break;
+        case PacketState::kMeta:
+        case PacketState::kData:
+          index += ReadSection(p_frame, &bytes[index], length - index);
+          break;
+        default:
+          assert(0);
+          Reset();
+          break;
+      }
+    }
+    return ReadResult{index, PacketReceived()};
+  }
 };
 
 class ProtocolRtu : public Protocol {
@@ -144,14 +307,18 @@ class ProtocolRtu : public Protocol {
 
  public:
   explicit ProtocolRtu(Crc16 crc16) : crc16_{crc16} {}
+  /*
+   * Frames filled by a ReadContext hold the received CRC at the end of the
+   * data, the CRC over the frame is zero when it is intact.
+   * */
   bool FrameCrcIsValid(const Modbus::Frame &frame) const {
-    std::array<uint8_t, 256> data{};
-    data[kAddressLocation] = frame.address;
-    data[kFunctionLocation] = static_cast<uint16_t>(frame.function);
-    for (std::size_t i = 0; i < std::min(frame.data_length, data.size()); i++) {
-      data[i + kHeaderLength] = frame.data_array[i];
+    RunningCrc16 crc{};
+    crc.Update(frame.address);
+    crc.Update(static_cast<uint8_t>(frame.function));
+    if (frame.data_length > 0) {
+      crc.Update(&frame.data_array[0], frame.data_length);
     }
-    return FrameCrcIsValid(ArrayView{frame.data_length + 2, data.data()});
+    return crc.ResidueIsValid();
   }
   bool FrameCrcIsValid(const ArrayView<uint8_t> &frame_buffer) const {
     const uint16_t frame_crc =
@@ -197,13 +364,20 @@ class ProtocolRtu : public Protocol {
         static_cast<uint8_t>(packet.function);
     assert(response->operator[](Command::ResponsePacket::kFunction) ==
            static_cast<uint8_t>(packet.function));
-    const uint16_t crc =
-        crc16_(response->GetArrayView(), response->GetLength());
+    if (response->IsCrcWritten()) {
+      response->SetLength(response->GetLength() + sizeof(uint16_t));
+      return 0;
+    }
+    //  The controllers write the response body in place so its CRC is one
+    //  pass over the finished bytes, only received frames are checked as
+    //  they arrive
+    RunningCrc16 crc{};
+    crc.Update(response->data(), response->GetLength());
+    const std::size_t crc_start = response->GetLength();
     response->SetLength(response->GetLength() + sizeof(uint16_t));
-    const std::size_t crc_start = response->GetLength() - sizeof(uint16_t);
 
-    response->operator[](crc_start) = Utilities::GetByte(crc, 1);      //  LSB
-    response->operator[](crc_start + 1) = Utilities::GetByte(crc, 0);  //  MSB
+    response->operator[](crc_start) = crc.GetLowByte();
+    response->operator[](crc_start + 1) = crc.GetHighByte();
     return 0;
   }
 
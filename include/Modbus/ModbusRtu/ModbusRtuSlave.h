@@ -18,11 +18,14 @@
 #pragma once
 #ifndef MODBUS_MODBUSRTUSLAVE_H_
 #define MODBUS_MODBUSRTUSLAVE_H_
+#include <Modbus/Diagnostics.h>
+#include <Modbus/HandlerDispatch.h>
 #include <Modbus/Modbus.h>
 #include <Modbus/ModbusRtu/ModbusRtuProtocol.h>
 #include <Modbus/Utilities.h>
 #include <Utilities/TypeConversion.h>
 
+#include <array>
 #include <cstdint>
 namespace Modbus {
 
@@ -42,10 +45,19 @@ class SlaveProtocolBase : public ProtocolRtu {
   void ProcessCharacter(const uint8_t pt) {
     ctx_.ProcessCharacter(&framein_, pt);
   }
-  void SetResponse(const Response& response) {
-    response_.Reset();
-    response_ = response;
+  ReadResult ProcessBytes(const ArrayView<const uint8_t>& data) {
+    return ctx_.ProcessBytes(&framein_, data);
+  }
+  void SetResponse(const Response& response) { response_ = response; }
+
+  /*
+   * Responses are encoded straight into buffer, which has to outlive the
+   * slave or be replaced before the next message
+   * */
+  void SetTxBuffer(ArrayView<uint8_t> buffer) {
+    response_.SetBuffer(buffer.data(), buffer.size());
   }
+  Response* GetResponseBuffer(void) { return &response_; }
 
   void SendErrorResponse(const Modbus::Frame& frame, Exception exception) {
     Modbus::Frame error_frame;
@@ -64,7 +76,6 @@ class SlaveProtocolBase : public ProtocolRtu {
   void ResetRead(void) {
     ctx_.Reset();
     ResetResponse();
-    response_.Reset();
     framein_.Reset();
   }
 
@@ -80,76 +91,134 @@ class SlaveProtocolBase : public ProtocolRtu {
   explicit SlaveProtocolBase(Crc16 crc16) : ProtocolRtu{crc16} {}
 };
 
-template <typename THoldingRegisterController,
-          typename TInputRegisterController>
+/*
+ * Each handler declares the function codes it serves in kFunctions, see
+ * HandlerDispatch.h. The function code to handler table is built at compile
+ * time so dispatch is a single indexed call.
+ * */
+template <typename... THandlers>
 class ProtocolRtuSlave {
+ public:
+  static const constexpr uint8_t kBroadcastAddress = 0;
+
  protected:
-  static const constexpr Function implimented_functions_[]{
-      //  Function::kReadCoils,
-      //  Function::kReadDiscreteInputs,
-      Function::kReadMultipleHoldingRegisters, Function::kReadInputRegisters,
-      //  Function::kWriteSingleCoil,
-      Function::kWriteSingleHoldingRegister,
-      Function::kWriteMultipleHoldingRegisters,
-      //  Function::kWriteMultipleCoils,
-      //  Function::kReadDeviceIdentification,
-  };
+  using Dispatch = HandlerDispatch<THandlers...>;
+  static constexpr typename Dispatch::Table kDispatch = Dispatch::MakeTable();
+  static_assert(Dispatch::CountEntries(kDispatch) == Dispatch::kFunctionCount,
+                "More than one handler serves the same function code");
+  static_assert(Dispatch::FunctionsAreValid(),
+                "Handler serves an invalid function code");
 
   SlaveProtocolBase slave_{};
   uint8_t slave_address_;
-  THoldingRegisterController& holding_register_controller_;
-  TInputRegisterController& input_register_controller_;
+  typename Dispatch::Handlers handlers_;
+  CommDiagnostics* diagnostics_ = nullptr;
+
+  /*
+   * Counts the frame and logs its receive event. Returns true when the frame
+   * is to be handled.
+   * */
+  bool RecordReceive(const Modbus::Frame& frame, const bool addressed) {
+    const uint32_t overruns = slave_.ctx_.TakeOverrunCount();
+    diagnostics_->Count(DiagnosticCounter::kBusMessage);
+    uint8_t event = CommEvent::kReceive;
+    if (overruns) {
+      diagnostics_->Count(DiagnosticCounter::kBusCharacterOverrun, overruns);
+      event |= CommEvent::kReceiveCharacterOverrun;
+    }
+    if (diagnostics_->IsListenOnly()) {
+      event |= CommEvent::kReceiveListenOnly;
+    }
+    if (!slave_.ctx_.CrcIsValid()) {
+      diagnostics_->Count(DiagnosticCounter::kBusCommunicationError);
+      diagnostics_->LogEvent(event | CommEvent::kReceiveCommunicationError);
+      return false;
+    }
+    const bool broadcast = frame.address == kBroadcastAddress;
+    if (!addressed && !broadcast) {
+      return false;
+    }
+    diagnostics_->Count(DiagnosticCounter::kSlaveMessage);
+    diagnostics_->LogEvent(broadcast && !addressed
+                               ? event | CommEvent::kReceiveBroadcast
+                               : event);
+    //  Broadcasts are not handled, in listen only mode only restart is
+    const bool listen_only =
+        diagnostics_->IsListenOnly() && !DiagnosticCommand::IsRestart(frame);
+    if ((broadcast && !addressed) || listen_only) {
+      diagnostics_->Count(DiagnosticCounter::kSlaveNoResponse);
+      return false;
+    }
+    return true;
+  }
+
+  void RecordSend(const Modbus::Frame& frame, const Exception exception) {
+    if (exception != Exception::kAck) {
+      diagnostics_->Count(DiagnosticCounter::kSlaveExceptionError);
+      diagnostics_->LogEvent(CommEvent::MakeSendEvent(exception));
+    } else if (!slave_.GetResponseValid()) {
+      diagnostics_->Count(DiagnosticCounter::kSlaveNoResponse);
+    } else {
+      diagnostics_->LogEvent(CommEvent::kSend);
+      if (frame.function != Function::kGetComEventCounter &&
+          frame.function != Function::kGetComEventLog) {
+        diagnostics_->CountEvent();
+      }
+    }
+  }
 
  public:
   /*
-   * Check the command for basic errors in function, data address, or data valid
+   * The function codes this slave answers, taken from the dispatch table
+   * built from its handlers
    * */
+  static constexpr std::array<Function, Dispatch::kFunctionCount>
+  GetSupportedFunctions(void) {
+    return Dispatch::GetFunctions(kDispatch);
+  }
+
   /*
    * Each command needs to queue a response when it completes
    * Some will have data, some just the same command acked
    * some with error status included
    * all commands have the response of slave address, function, {payload
    * specific response}, crc lsb, crc msb
+   * A handler returns a positive code for a request that is not answered
+   * and a negative one when it could not run a validated request, which is
+   * answered with a slave device failure
    * */
   int32_t RunCommand(const Modbus::Frame& frame) {
-    int32_t response_code = 0;
-    Response response{};
-    switch (GetAddressSpaceFromFunction(frame.function)) {
-      case (AddressSpace::kCoil):
-        response_code = -1;
-        break;
-      case (AddressSpace::kDiscreteInput):
-        response_code = -1;
-        break;
-      case (AddressSpace::kInputRegister):
-        response_code = input_register_controller_.ReadFrame(frame, &response);
-        break;
-      case (AddressSpace::kHoldingRegister):
-        response_code =
-            holding_register_controller_.ReadFrame(frame, &response);
-        break;
-      case (AddressSpace::kDeviceIdentifier):
-        response_code = -1;
-        break;
-      case (AddressSpace::kUnmapped):
-        response_code = -1;
-        break;
-      default:
-        response_code = -1;
-        break;
+    Response* response = slave_.GetResponseBuffer();
+    response->Reset();
+    const auto& entry = kDispatch[static_cast<uint8_t>(frame.function)];
+    if (entry.run == nullptr) {
+      return -1;
     }
+    const int32_t response_code = entry.run(handlers_, frame, response);
     if (response_code == 0) {
-      slave_.FrameResponse(frame, &response);
+      slave_.FrameResponse(frame, response);
       slave_.SetResponseValid(true);
+    } else if (response_code < 0) {
+      slave_.SendErrorResponse(frame, Exception::kSlaveDeviceFailure);
+    } else {
+      response->Reset();
     }
-    slave_.SetResponse(response);
     return response_code;
   }
 
   const Modbus::Frame& GetFrameIn(void) { return slave_.GetFrameIn(); }
   const Response& GetResponse(void) { return slave_.GetResponse(); }
+  void SetTxBuffer(ArrayView<uint8_t> buffer) {
+    slave_.SetTxBuffer(buffer);
+  }
   bool GetResponseValid(void) { return slave_.GetResponseValid(); }
 
+  /*
+   * Call once the response to a frame has been handed to the port, or the
+   * frame has been handled without one. Runs the handlers' deferred work.
+   * */
+  void ResponseSent(void) { Dispatch::ResponseSent(handlers_); }
+
   void Reset(void) {
     slave_.ResetResponse();
     slave_.ResetRead();
@@ -159,30 +228,11 @@ class ProtocolRtuSlave {
    * Check the command for basic errors in function, data address, or data valid
    * */
   Exception ValidateMessage(const Modbus::Frame& frame) const {
-    if (!InList(frame.function, implimented_functions_,
-                sizeof(implimented_functions_) /
-                    sizeof(implimented_functions_[0]))) {
+    const auto& entry = kDispatch[static_cast<uint8_t>(frame.function)];
+    if (entry.validate == nullptr) {
       return Exception::kIllegalFunction;
     }
-    switch (GetAddressSpaceFromFunction(frame.function)) {
-      case (AddressSpace::kCoil):
-        return Exception::kIllegalFunction;
-      case (AddressSpace::kDiscreteInput):
-        return Exception::kIllegalFunction;
-      case (AddressSpace::kInputRegister):
-        return input_register_controller_.ValidateFrame(frame);
-      case (AddressSpace::kHoldingRegister):
-        return holding_register_controller_.ValidateFrame(frame);
-      case (AddressSpace::kDeviceIdentifier):
-        return Exception::kIllegalFunction;
-      case (AddressSpace::kSystemStatus):
-        return Exception::kIllegalFunction;
-      case (AddressSpace::kUnmapped):
-        return Exception::kIllegalFunction;
-      default:
-        break;
-    }
-    return Exception::kIllegalFunction;
+    return entry.validate(handlers_, frame);
   }
 
   uint8_t GetAddress(void) const { return slave_address_; }
@@ -194,28 +244,41 @@ class ProtocolRtuSlave {
 
   const ReadContext& GetContext(void) const { return slave_.ctx_; }
 
+  /*
+   * Counters and event log for functions 8, 11 and 12, see Diagnostics.h.
+   * Nothing is recorded while this is null.
+   * */
+  void SetDiagnostics(CommDiagnostics* diagnostics) {
+    diagnostics_ = diagnostics;
+  }
+  CommDiagnostics* GetDiagnostics(void) { return diagnostics_; }
+
   void ProcessMessage(const bool filter_address = true) {
     const auto& frame = GetFrameIn();
+    const bool addressed = GetAddress() == frame.address || !filter_address;
+    if (diagnostics_ != nullptr) {
+      if (!RecordReceive(frame, addressed)) {
+        return;
+      }
+    } else if (!addressed || !slave_.ctx_.CrcIsValid()) {
+      return;
+    }
     Exception exception = ValidateMessage(frame);
-    if (GetAddress() == frame.address || !filter_address) {
-      if (slave_.FrameCrcIsValid(frame)) {
-        if (exception == Exception::kAck) {
-          RunCommand(frame);
-        } else {
-          slave_.SendErrorResponse(frame, exception);
-        }
+    if (exception == Exception::kAck) {
+      if (RunCommand(frame) < 0) {
+        exception = Exception::kSlaveDeviceFailure;
       }
+    } else {
+      slave_.SendErrorResponse(frame, exception);
+    }
+    if (diagnostics_ != nullptr) {
+      RecordSend(frame, exception);
     }
   }
 
-  explicit ProtocolRtuSlave(
-      Crc16 crc16, uint8_t slave_address,
-      THoldingRegisterController& holding_register_controller,
-      TInputRegisterController& input_register_controller)
-      : slave_{crc16},
-        slave_address_{slave_address},
-        holding_register_controller_{holding_register_controller},
-        input_register_controller_{input_register_controller} {}
+  explicit ProtocolRtuSlave(Crc16 crc16, uint8_t slave_address,
+                            THandlers&... handlers)
+      : slave_{crc16}, slave_address_{slave_address}, handlers_{handlers...} {}
 };
 }  //  namespace Modbus
 
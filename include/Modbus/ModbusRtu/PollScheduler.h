@@ -0,0 +1,267 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        ModbusRtu/PollScheduler.h
+ * Description:  Periodic register polling for a rtu master, nearby ranges
+ *               are read together
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ *
+ * ----------------------------------------------------------------------
+ *
+ * Every request pays for the header, CRC and two t3.5 gaps whatever its
+ * size, a 2 register read at 19200 baud is mostly overhead. The scheduler
+ * keeps the ranges sorted by slave, address space and address and when one
+ * is due reads it together with the due ranges that follow it, as long as
+ * the registers between them number no more than the gap threshold and the
+ * whole read stays within 125 registers. Ranges that are not due but fall
+ * inside the read are refreshed for free.
+ *
+ * Ranges should start and end on whole fields when the store is a
+ * MappedRegisterDataStore so that the merged reads are valid locations.
+ */
+
+#pragma once
+#ifndef MODBUS_POLLSCHEDULER_H_
+#define MODBUS_POLLSCHEDULER_H_
+#include <Modbus/Modbus.h>
+#include <Modbus/ModbusRtu/ModbusRtuMaster.h>
+#include <Modbus/RegisterControl.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace Modbus {
+struct PollRange {
+  uint8_t slave_address = 0;
+  AddressSpace address_space = AddressSpace::kHoldingRegister;
+  uint16_t address = 0;
+  uint16_t count = 0;
+  uint32_t period_us = 0;
+};
+
+struct PollStatistics {
+  std::size_t requests = 0;
+  std::size_t registers = 0;  //  Registers requested, gaps included
+  std::size_t completed = 0;
+  std::size_t failed = 0;
+};
+
+template <typename TStore, std::size_t kMaxRanges>
+class PollScheduler {
+ public:
+  /*
+   * max_registers is held to 1 to 125, the most the master reads in one
+   * request, and gap_threshold to max_registers
+   * */
+  struct Settings {
+    uint16_t gap_threshold = 8;  //  Unwanted registers allowed between ranges
+    uint16_t max_registers =
+        ReadMultipleRegistersCommandBase::kMaxRegisterCount;
+  };
+
+ private:
+  struct Entry {
+    PollRange range{};
+    TStore *store = nullptr;
+    uint32_t due_us = 0;
+    bool polled = false;
+    MasterStatus status = MasterStatus::kIdle;
+  };
+
+  //  A read covers the entries from first to last that lie within the
+  //  registers [start, end)
+  struct Block {
+    std::size_t first = 0;
+    std::size_t last = 0;
+    uint32_t start = 0;
+    uint32_t end = 0;
+  };
+
+  Settings settings_;
+  std::array<Entry, kMaxRanges> entries_{};
+  std::size_t count_ = 0;
+  Block block_{};
+  bool pending_ = false;
+  PollStatistics statistics_{};
+
+  static Settings Limit(Settings settings) {
+    settings.max_registers = std::clamp<uint16_t>(
+        settings.max_registers, 1,
+        ReadMultipleRegistersCommandBase::kMaxRegisterCount);
+    settings.gap_threshold =
+        std::min(settings.gap_threshold, settings.max_registers);
+    return settings;
+  }
+
+  static bool Before(const PollRange &lhs, const PollRange &rhs) {
+    if (lhs.slave_address != rhs.slave_address) {
+      return lhs.slave_address < rhs.slave_address;
+    }
+    if (lhs.address_space != rhs.address_space) {
+      return lhs.address_space < rhs.address_space;
+    }
+    return lhs.address < rhs.address;
+  }
+
+  static bool SameBlock(const Entry &lhs, const Entry &rhs) {
+    return lhs.range.slave_address == rhs.range.slave_address &&
+           lhs.range.address_space == rhs.range.address_space &&
+           lhs.store == rhs.store;
+  }
+
+  static bool IsDue(const Entry &entry, const uint32_t now_us) {
+    return !entry.polled ||
+           static_cast<int32_t>(now_us - entry.due_us) >= 0;
+  }
+
+  static uint32_t GetEnd(const Entry &entry) {
+    return static_cast<uint32_t>(entry.range.address) + entry.range.count;
+  }
+
+  bool InBlock(const std::size_t index) const {
+    const Entry &entry = entries_[index];
+    return SameBlock(entry, entries_[block_.first]) &&
+           entry.range.address >= block_.start && GetEnd(entry) <= block_.end;
+  }
+
+  /*
+   * Extend a read starting at the due entry first over the due entries after
+   * it
+   * */
+  Block MakeBlock(const std::size_t first, const uint32_t now_us) const {
+    const Entry &head = entries_[first];
+    Block block{first, first, head.range.address, GetEnd(head)};
+    for (std::size_t i = first + 1; i < count_; i++) {
+      const Entry &entry = entries_[i];
+      if (entry.range.slave_address != head.range.slave_address ||
+          entry.range.address_space != head.range.address_space ||
+          entry.range.address > block.end + settings_.gap_threshold) {
+        break;
+      }
+      const uint32_t end = std::max(block.end, GetEnd(entry));
+      if (!SameBlock(entry, head) ||
+          end - block.start > settings_.max_registers ||
+          !head.store->WriteLocationValid(block.start, end - block.start)) {
+        continue;
+      }
+      if (IsDue(entry, now_us) || end == block.end) {
+        block.end = end;
+        block.last = i;
+      }
+    }
+    return block;
+  }
+
+  bool Request(ProtocolRtuMaster *master, const Block &block) {
+    const Entry &head = entries_[block.first];
+    const uint16_t address = static_cast<uint16_t>(block.start);
+    const uint16_t count = static_cast<uint16_t>(block.end - block.start);
+    if (head.range.address_space == AddressSpace::kInputRegister) {
+      return master->ReadInputRegisters(head.range.slave_address, address,
+                                        count, head.store);
+    }
+    return master->ReadHoldingRegisters(head.range.slave_address, address,
+                                        count, head.store);
+  }
+
+  void Collect(const MasterStatus status) {
+    pending_ = false;
+    if (status == MasterStatus::kComplete) {
+      statistics_.completed++;
+    } else {
+      statistics_.failed++;
+    }
+    for (std::size_t i = block_.first; i <= block_.last; i++) {
+      if (InBlock(i)) {
+        entries_[i].status = status;
+      }
+    }
+  }
+
+ public:
+  /*
+   * Ranges are kept in address order. Returns false when full, while a read
+   * is in flight or when the range cannot be read in one request.
+   * */
+  bool AddRange(const PollRange &range, TStore *store) {
+    if (pending_ || count_ == entries_.size() || range.count == 0 ||
+        range.count > settings_.max_registers ||
+        range.slave_address == ProtocolRtuMaster::kBroadcastAddress ||
+        (range.address_space != AddressSpace::kHoldingRegister &&
+         range.address_space != AddressSpace::kInputRegister) ||
+        !store->ReadLocationValid(range.address, range.count) ||
+        !store->WriteLocationValid(range.address, range.count)) {
+      return false;
+    }
+    std::size_t index = count_;
+    while (index > 0 && Before(range, entries_[index - 1].range)) {
+      entries_[index] = entries_[index - 1];
+      index--;
+    }
+    entries_[index] = Entry{range, store};
+    count_++;
+    return true;
+  }
+
+  /*
+   * Collects the result of the last request and frames the next read on the
+   * master when one is due and the line is free. Returns true when a request
+   * has been framed, the caller sends GetTxData and calls RequestSent.
+   * */
+  bool Run(ProtocolRtuMaster *master, const uint32_t now_us) {
+    master->Poll(now_us);
+    if (master->IsBusy() || master->GetStatus() == MasterStatus::kReady) {
+      return false;
+    }
+    if (pending_) {
+      Collect(master->GetStatus());
+    }
+    if (!master->ReadyToSend(now_us)) {
+      return false;
+    }
+    std::size_t first = 0;
+    while (first < count_ && !IsDue(entries_[first], now_us)) {
+      first++;
+    }
+    if (first == count_) {
+      return false;
+    }
+    block_ = MakeBlock(first, now_us);
+    if (!Request(master, block_)) {
+      //  Still due, tried again on the next run
+      statistics_.failed++;
+      return false;
+    }
+    for (std::size_t i = block_.first; i <= block_.last; i++) {
+      if (InBlock(i)) {
+        entries_[i].polled = true;
+        entries_[i].due_us = now_us + entries_[i].range.period_us;
+      }
+    }
+    pending_ = true;
+    statistics_.requests++;
+    statistics_.registers += block_.end - block_.start;
+    return true;
+  }
+
+  std::size_t GetRangeCount(void) const { return count_; }
+  const PollRange &GetRange(const std::size_t index) const {
+    return entries_[index].range;
+  }
+  //  How the last read of the range ended
+  MasterStatus GetRangeStatus(const std::size_t index) const {
+    return entries_[index].status;
+  }
+  const PollStatistics &GetStatistics(void) const { return statistics_; }
+  void ResetStatistics(void) { statistics_ = PollStatistics{}; }
+  const Settings &GetSettings(void) const { return settings_; }
+
+  explicit PollScheduler(const Settings &settings = Settings{})
+      : settings_{Limit(settings)} {}
+};
+}  //  namespace Modbus
+
+#endif  //  MODBUS_POLLSCHEDULER_H_
@@ -0,0 +1,244 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        ModbusTcp/ModbusTcpProtocol.h
+ * Description:  Modbus/TCP framing, MBAP header parsing
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ *
+ * A Modbus/TCP ADU is the 7 byte MBAP header followed by the PDU:
+ *   transaction id (2), protocol id (2, always 0), length (2), unit id (1),
+ *   function (1), data
+ * The length counts the unit id and the PDU. There is no CRC, TCP takes care
+ * of integrity. The unit id sits where the RTU slave address does, so the
+ * RTU response layout is used unchanged starting at the unit id.
+ */
+
+#pragma once
+#ifndef MODBUS_MODBUSTCPPROTOCOL_H_
+#define MODBUS_MODBUSTCPPROTOCOL_H_
+#include <ArrayView/ArrayView.h>
+#include <Modbus/Modbus.h>
+#include <Modbus/ModbusRtu/ModbusRtuProtocol.h>
+#include <Utilities/TypeConversion.h>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdint>
+
+namespace Modbus {
+struct MbapHeader {
+  static const constexpr std::size_t kTransactionId = 0;
+  static const constexpr std::size_t kProtocolId = 2;
+  static const constexpr std::size_t kLength = 4;
+  static const constexpr std::size_t kUnitId = 6;
+  static const constexpr std::size_t kHeaderLength = kUnitId + 1;
+  static const constexpr uint16_t kModbusProtocolId = 0;
+  //  Unit id, function and the largest PDU data section
+  static const constexpr uint16_t kMinLength = 2;
+  static const constexpr uint16_t kMaxLength = 254;
+  static const constexpr std::size_t kMaxAduLength = kUnitId + kMaxLength;
+
+  uint16_t transaction_id = 0;
+  uint16_t protocol_id = kModbusProtocolId;
+  uint16_t length = 0;
+  uint8_t unit_id = 0;
+
+  static MbapHeader Read(const uint8_t *data) {
+    MbapHeader header{};
+    header.transaction_id =
+        static_cast<uint16_t>((data[kTransactionId] << 8) |
+                              data[kTransactionId + 1]);
+    header.protocol_id =
+        static_cast<uint16_t>((data[kProtocolId] << 8) | data[kProtocolId + 1]);
+    header.length =
+        static_cast<uint16_t>((data[kLength] << 8) | data[kLength + 1]);
+    header.unit_id = data[kUnitId];
+    return header;
+  }
+
+  void Write(uint8_t *data) const {
+    data[kTransactionId] = Utilities::GetByte(transaction_id, 1);
+    data[kTransactionId + 1] = Utilities::GetByte(transaction_id, 0);
+    data[kProtocolId] = Utilities::GetByte(protocol_id, 1);
+    data[kProtocolId + 1] = Utilities::GetByte(protocol_id, 0);
+    data[kLength] = Utilities::GetByte(length, 1);
+    data[kLength + 1] = Utilities::GetByte(length, 0);
+    data[kUnitId] = unit_id;
+  }
+
+  bool IsValid(void) const {
+    return protocol_id == kModbusProtocolId && length >= kMinLength &&
+           length <= kMaxLength;
+  }
+};
+
+inline std::size_t GetRequiredTcpPacketSize(const Frame &packet) {
+  return MbapHeader::kHeaderLength + 1 + packet.data_length;
+}
+
+/*
+ * The MBAP length, not the function, sets how much data a TCP request has
+ * so it may be shorter or longer than the function needs. True when the
+ * data is exactly the meta section plus the fixed data or the byte count.
+ * */
+inline bool PduLengthIsValid(const Frame &frame) {
+  const std::size_t meta_length =
+      static_cast<std::size_t>(CalculateMetaDataBytesRemaining(frame.function));
+  if (frame.data_length < meta_length) {
+    return false;
+  }
+  return frame.data_length ==
+         meta_length + static_cast<std::size_t>(CalculateBytesRemaining(frame));
+}
+
+/*
+ * Per connection parse state. The MBAP length tells how long the PDU is so
+ * unlike the RTU ReadContext this needs no knowledge of the function codes,
+ * unknown functions are read whole and answered with an exception.
+ * A header that is not Modbus or has an impossible length leaves the stream
+ * out of sync, HasError is set and the connection should be dropped.
+ * */
+class TcpReadContext {
+  enum class State { kHeader, kFunction, kData, kDone, kError };
+  State state_ = State::kHeader;
+  std::array<uint8_t, MbapHeader::kHeaderLength> header_data_{};
+  std::size_t header_bytes_ = 0;
+  MbapHeader header_{};
+  uint8_t function_code_ = 0;
+  std::size_t data_remaining_ = 0;
+
+  std::size_t ReadHeader(Frame *p_frame, const uint8_t *data,
+                         const std::size_t length) {
+    const std::size_t count =
+        std::min(header_data_.size() - header_bytes_, length);
+    std::copy(data, data + count, &header_data_[header_bytes_]);
+    header_bytes_ += count;
+    if (header_bytes_ == header_data_.size()) {
+      header_ = MbapHeader::Read(header_data_.data());
+      //  Length counts unit id and function, the rest is frame data
+      const std::size_t data_length =
+          header_.length >= MbapHeader::kMinLength
+              ? header_.length - MbapHeader::kMinLength
+              : 0;
+      if (!header_.IsValid() || data_length > p_frame->data_array.size()) {
+        state_ = State::kError;
+      } else {
+        p_frame->address = header_.unit_id;
+        p_frame->data_length = 0;
+        data_remaining_ = data_length;
+        state_ = State::kFunction;
+      }
+    }
+    return count;
+  }
+
+  std::size_t ReadData(Frame *p_frame, const uint8_t *data,
+                       const std::size_t length) {
+    const std::size_t count = std::min(data_remaining_, length);
+    std::copy(data, data + count, &p_frame->data_array[p_frame->data_length]);
+    p_frame->data_length += count;
+    data_remaining_ -= count;
+    if (data_remaining_ == 0) {
+      state_ = State::kDone;
+    }
+    return count;
+  }
+
+ public:
+  void Reset(void) {
+    state_ = State::kHeader;
+    header_bytes_ = 0;
+    data_remaining_ = 0;
+    function_code_ = 0;
+  }
+  bool PacketReceived(void) const { return state_ == State::kDone; }
+  bool HasError(void) const { return state_ == State::kError; }
+  const MbapHeader &GetHeader(void) const { return header_; }
+
+  /*
+   * The function byte as received, kept because an unsupported code still
+   * needs to be echoed back in the exception response
+   * */
+  uint8_t GetFunctionCode(void) const { return function_code_; }
+
+  /*
+   * Same contract as ReadContext::ProcessBytes, stops at the end of an ADU
+   * and reports how many bytes were taken. Nothing is taken once HasError is
+   * set.
+   * */
+  ReadResult ProcessBytes(Frame *p_frame,
+                          const ArrayView<const uint8_t> &data) {
+    const uint8_t *const bytes = data.data();
+    const std::size_t length = data.size();
+    std::size_t index = 0;
+    while (index < length && state_ != State::kDone &&
+           state_ != State::kError) {
+      switch (state_) {
+        case State::kHeader:
+          index += ReadHeader(p_frame, &bytes[index], length - index);
+          break;
+        case State::kFunction:
+          function_code_ = bytes[index++];
+          p_frame->function = GetFunction(function_code_);
+          state_ = data_remaining_ == 0 ? State::kDone : State::kData;
+          break;
+        case State::kData:
+          index += ReadData(p_frame, &bytes[index], length - index);
+          break;
+        default:
+          assert(0);
+          break;
+      }
+    }
+    return ReadResult{index, PacketReceived()};
+  }
+};
+
+class ProtocolTcp : public Protocol {
+ public:
+  /*
+   * Write a request ADU for packet into frame_buffer, returns the number of
+   * bytes used
+   * */
+  static std::size_t Frame(const Modbus::Frame &packet,
+                           const uint16_t transaction_id,
+                           ArrayView<uint8_t> *frame_buffer) {
+    const std::size_t size = GetRequiredTcpPacketSize(packet);
+    assert(frame_buffer->size() >= size);
+    MbapHeader header{};
+    header.transaction_id = transaction_id;
+    header.length =
+        static_cast<uint16_t>(MbapHeader::kMinLength + packet.data_length);
+    header.unit_id = packet.address;
+    header.Write(frame_buffer->data());
+    frame_buffer->operator[](MbapHeader::kHeaderLength) =
+        static_cast<uint8_t>(packet.function);
+    std::copy(packet.data_array.begin(),
+              packet.data_array.begin() + packet.data_length,
+              &frame_buffer->operator[](MbapHeader::kHeaderLength + 1));
+    return size;
+  }
+
+  /*
+   * A response built at buffer + MbapHeader::kUnitId, laid out as an RTU
+   * response without the CRC, gets its MBAP header filled in front of it.
+   * Returns the ADU length.
+   * */
+  static std::size_t FrameResponse(const MbapHeader &request,
+                                   const Response &response,
+                                   uint8_t *buffer) {
+    MbapHeader header{};
+    header.transaction_id = request.transaction_id;
+    header.length = static_cast<uint16_t>(response.GetLength());
+    header.unit_id = request.unit_id;
+    header.Write(buffer);
+    return MbapHeader::kUnitId + response.GetLength();
+  }
+};
+}  //  namespace Modbus
+
+#endif  //  MODBUS_MODBUSTCPPROTOCOL_H_
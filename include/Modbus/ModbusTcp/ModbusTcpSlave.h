@@ -0,0 +1,185 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        ModbusTcp/ModbusTcpSlave.h
+ * Description:  Modbus/TCP slave (server) using the same handlers as the
+ *               rtu slave
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ *
+ * A server has many connections talking to the same data. The per
+ * connection state (parse context, received frame and transmit buffer) is a
+ * TcpSlaveSession, the handlers and dispatch table live once in
+ * ProtocolTcpSlave which works on whichever session has a message ready.
+ */
+
+#pragma once
+#ifndef MODBUS_MODBUSTCPSLAVE_H_
+#define MODBUS_MODBUSTCPSLAVE_H_
+#include <ArrayView/ArrayView.h>
+#include <Modbus/HandlerDispatch.h>
+#include <Modbus/Modbus.h>
+#include <Modbus/ModbusTcp/ModbusTcpProtocol.h>
+
+#include <array>
+#include <cstdint>
+
+namespace Modbus {
+class TcpSlaveSession {
+  std::array<uint8_t, 256> frame_data_{};
+  Modbus::Frame framein_{ArrayView<uint8_t>{frame_data_.size(),
+                                            frame_data_.data()}};
+  std::array<uint8_t, MbapHeader::kMaxAduLength> tx_data_{};
+  //  Handlers write the RTU layout from the unit id on, the MBAP header is
+  //  put in front of it once the length is known
+  Response response_{&tx_data_[MbapHeader::kUnitId],
+                     tx_data_.size() - MbapHeader::kUnitId};
+  std::size_t tx_length_ = 0;
+
+ public:
+  TcpReadContext ctx_{};
+
+  ReadResult ProcessBytes(const ArrayView<const uint8_t> &data) {
+    return ctx_.ProcessBytes(&framein_, data);
+  }
+  bool PacketReceived(void) const { return ctx_.PacketReceived(); }
+  bool HasError(void) const { return ctx_.HasError(); }
+  const Modbus::Frame &GetFrameIn(void) const { return framein_; }
+  Response *GetResponseBuffer(void) { return &response_; }
+
+  void FinishResponse(void) {
+    tx_length_ = ProtocolTcp::FrameResponse(ctx_.GetHeader(), response_,
+                                            tx_data_.data());
+  }
+
+  void SendErrorResponse(const Exception exception) {
+    const uint8_t function = ctx_.GetFunctionCode();
+    response_[Command::ResponsePacket::kSlaveAddress] = framein_.address;
+    response_[Command::ResponsePacket::kFunction] =
+        static_cast<uint8_t>(function >= kStatusResponseAddValue
+                                 ? function
+                                 : function + kStatusResponseAddValue);
+    response_[Command::ResponsePacket::kHeaderEnd + 1] =
+        static_cast<uint8_t>(exception);
+    response_.SetLength(Command::ResponsePacket::kHeaderEnd + 2);
+    FinishResponse();
+  }
+
+  bool GetResponseValid(void) const { return tx_length_ > 0; }
+
+  /*
+   * The whole response ADU, MBAP header included, ready to be written to the
+   * socket
+   * */
+  ArrayView<const uint8_t> GetTxData(void) const {
+    return ArrayView<const uint8_t>{tx_length_, tx_data_.data()};
+  }
+
+  void Reset(void) {
+    ctx_.Reset();
+    framein_.Reset();
+    response_.Reset();
+    tx_length_ = 0;
+  }
+
+  TcpSlaveSession(void) {}
+  TcpSlaveSession(const TcpSlaveSession &) = delete;
+  TcpSlaveSession &operator=(const TcpSlaveSession &) = delete;
+};
+
+/*
+ * Handlers are the same as for ProtocolRtuSlave, see HandlerDispatch.h
+ * */
+template <typename... THandlers>
+class ProtocolTcpSlave {
+ protected:
+  using Dispatch = HandlerDispatch<THandlers...>;
+  static constexpr typename Dispatch::Table kDispatch = Dispatch::MakeTable();
+  static_assert(Dispatch::CountEntries(kDispatch) == Dispatch::kFunctionCount,
+                "More than one handler serves the same function code");
+  static_assert(Dispatch::FunctionsAreValid(),
+                "Handler serves an invalid function code");
+
+  uint8_t unit_id_;
+  typename Dispatch::Handlers handlers_;
+
+ public:
+  /*
+   * The function codes this slave answers, taken from the dispatch table
+   * built from its handlers
+   * */
+  static constexpr std::array<Function, Dispatch::kFunctionCount>
+  GetSupportedFunctions(void) {
+    return Dispatch::GetFunctions(kDispatch);
+  }
+
+  Exception ValidateMessage(const Modbus::Frame &frame) const {
+    const auto &entry = kDispatch[static_cast<uint8_t>(frame.function)];
+    if (entry.validate == nullptr) {
+      return Exception::kIllegalFunction;
+    }
+    if (!PduLengthIsValid(frame)) {
+      return Exception::kIllegalDataValue;
+    }
+    return entry.validate(handlers_, frame);
+  }
+
+  /*
+   * As in ProtocolRtuSlave a handler returns a positive code for a request
+   * that is not answered and a negative one when it could not run a
+   * validated request, which is answered with a slave device failure
+   * */
+  int32_t RunCommand(TcpSlaveSession *session) {
+    const auto &frame = session->GetFrameIn();
+    Response *response = session->GetResponseBuffer();
+    response->Reset();
+    const auto &entry = kDispatch[static_cast<uint8_t>(frame.function)];
+    if (entry.run == nullptr) {
+      return -1;
+    }
+    const int32_t response_code = entry.run(handlers_, frame, response);
+    if (response_code == 0) {
+      session->FinishResponse();
+    } else if (response_code < 0) {
+      session->SendErrorResponse(Exception::kSlaveDeviceFailure);
+    } else {
+      response->Reset();
+    }
+    return response_code;
+  }
+
+  /*
+   * Call once a session's response has been handed to the socket. Runs the
+   * handlers' deferred work, see HandlerDispatch.h.
+   * */
+  void ResponseSent(void) { Dispatch::ResponseSent(handlers_); }
+
+  uint8_t GetUnitId(void) const { return unit_id_; }
+  void SetUnitId(const uint8_t unit_id) { unit_id_ = unit_id; }
+
+  /*
+   * Gateways use the unit id to pick a device, a plain server usually
+   * answers whatever it is sent so filtering is off by default
+   * */
+  void ProcessMessage(TcpSlaveSession *session,
+                      const bool filter_unit_id = false) {
+    const auto &frame = session->GetFrameIn();
+    if (filter_unit_id && frame.address != GetUnitId()) {
+      return;
+    }
+    const Exception exception = ValidateMessage(frame);
+    if (exception == Exception::kAck) {
+      RunCommand(session);
+    } else {
+      session->SendErrorResponse(exception);
+    }
+  }
+
+  explicit ProtocolTcpSlave(uint8_t unit_id, THandlers &... handlers)
+      : unit_id_{unit_id}, handlers_{handlers...} {}
+};
+}  //  namespace Modbus
+
+#endif  //  MODBUS_MODBUSTCPSLAVE_H_
@@ -14,9 +14,11 @@
 
 #pragma once
 #include <Modbus/DataCommand.h>
+#include <Modbus/DataStores/DataStore.h>
 #include <Modbus/Modbus.h>
 
 #include <algorithm>
+#include <array>
 
 namespace Modbus {
 class RegisterCommand : public DataCommand {};
@@ -89,6 +91,8 @@ class WriteSingleHoldingRegisterCommand : public RegisterCommand {
 };
 class ReadMultipleRegistersCommandBase : public RegisterCommand {
  public:
+  //  Most registers a single read may ask for, 250 data bytes
+  static const constexpr uint16_t kMaxRegisterCount = 125;
   struct CommandPacket {
     static const constexpr std::size_t kRegisterCount =
         DataCommand::CommandPacket::kDataAddressEnd + 1;
@@ -176,6 +180,8 @@ class WriteMultipleHoldingRegistersCommand : public RegisterCommand {
  public:
   static const constexpr auto kFunction =
       Function::kWriteMultipleHoldingRegisters;
+  //  Most registers a single write may carry, 246 data bytes
+  static const constexpr uint16_t kMaxRegisterCount = 123;
   struct CommandPacket {
     static const constexpr std::size_t kRegisterCount =
         DataCommand::CommandPacket::kDataAddressEnd + 1;
@@ -259,10 +265,162 @@ class WriteMultipleHoldingRegistersCommand : public RegisterCommand {
   }
 };
 
+/*
+ * Function 22, the register becomes
+ *   (current & and_mask) | (or_mask & ~and_mask)
+ * The response is an echo of the command.
+ * */
+class MaskWriteRegisterCommand : public RegisterCommand {
+ public:
+  static const constexpr auto kFunction = Function::kMaskWriteRegister;
+  struct CommandPacket {
+    static const constexpr std::size_t kAndMask =
+        DataCommand::CommandPacket::kDataAddressEnd + 1;
+    static const constexpr std::size_t kOrMask = kAndMask + sizeof(uint16_t);
+    static const constexpr std::size_t kPacketSize =
+        kOrMask + sizeof(uint16_t);
+  };
+  struct ResponsePacket {
+    static const constexpr std::size_t kDataAddress =
+        DataCommand::ResponsePacket::kHeaderEnd + 1;
+    static const constexpr std::size_t kAndMask =
+        kDataAddress + sizeof(uint16_t);
+    static const constexpr std::size_t kOrMask = kAndMask + sizeof(uint16_t);
+    static const constexpr std::size_t kPacketSize =
+        kOrMask + sizeof(uint16_t);
+  };
+  static uint16_t ReadAndMask(const ArrayView<uint8_t> &data_array) {
+    return Utilities::Make_MSB_uint16_tFromU8Array(ArrayView<const uint8_t>{
+        sizeof(uint16_t), &data_array[CommandPacket::kAndMask]});
+  }
+  static uint16_t ReadOrMask(const ArrayView<uint8_t> &data_array) {
+    return Utilities::Make_MSB_uint16_tFromU8Array(ArrayView<const uint8_t>{
+        sizeof(uint16_t), &data_array[CommandPacket::kOrMask]});
+  }
+  static void FillResponseHeader(const uint8_t slave_address,
+                                 const uint16_t address,
+                                 const uint16_t and_mask,
+                                 const uint16_t or_mask, Response *response) {
+    response->operator[](DataCommand::ResponsePacket::kSlaveAddress) =
+        slave_address;
+    response->operator[](DataCommand::ResponsePacket::kFunction) =
+        static_cast<uint8_t>(kFunction);
+    const std::array<uint16_t, 3> words{address, and_mask, or_mask};
+    std::size_t index = ResponsePacket::kDataAddress;
+    for (uint16_t pt : words) {
+      response->operator[](index++) = Utilities::GetByte(pt, 1);
+      response->operator[](index++) = Utilities::GetByte(pt, 0);
+    }
+    response->SetLength(ResponsePacket::kPacketSize);
+  }
+  static int32_t FillFrame(const uint16_t address, const uint16_t and_mask,
+                           const uint16_t or_mask, Frame *frame) {
+    const std::size_t frame_size = CommandPacket::kPacketSize;
+    assert(frame->data_array.size() >= frame_size);
+
+    frame->function = kFunction;
+    const std::array<uint16_t, 3> words{address, and_mask, or_mask};
+    std::size_t index = DataCommand::CommandPacket::kDataAddressStart;
+    for (uint16_t pt : words) {
+      frame->data_array[index++] = Utilities::GetByte(pt, 1);
+      frame->data_array[index++] = Utilities::GetByte(pt, 0);
+    }
+    frame->data_length = frame_size;
+    return 0;
+  }
+};
+
+/*
+ * Function 23, writes registers then reads registers in one transaction. The
+ * response is laid out as a read multiple registers response.
+ * */
+class ReadWriteMultipleRegistersCommand
+    : public ReadMultipleRegistersCommandBase {
+ public:
+  static const constexpr auto kFunction = Function::kReadWriteMultipleRegisters;
+  static const constexpr uint16_t kMaxReadCount = kMaxRegisterCount;
+  static const constexpr uint16_t kMaxWriteCount = 121;
+  struct CommandPacket {
+    static const constexpr std::size_t kReadAddress =
+        DataCommand::CommandPacket::kDataAddressStart;
+    static const constexpr std::size_t kReadCount =
+        kReadAddress + sizeof(uint16_t);
+    static const constexpr std::size_t kWriteAddress =
+        kReadCount + sizeof(uint16_t);
+    static const constexpr std::size_t kWriteCount =
+        kWriteAddress + sizeof(uint16_t);
+    static const constexpr std::size_t kNumberOfDataBytes =
+        kWriteCount + sizeof(uint16_t);
+    static const constexpr std::size_t kValueStart = kNumberOfDataBytes + 1;
+    static const constexpr std::size_t kHeaderSize = kValueStart;
+  };
+
+  static uint16_t ReadReadCount(const ArrayView<uint8_t> &data_array) {
+    return Utilities::Make_MSB_uint16_tFromU8Array(ArrayView<const uint8_t>{
+        sizeof(uint16_t), &data_array[CommandPacket::kReadCount]});
+  }
+  static uint16_t ReadWriteAddress(const ArrayView<uint8_t> &data_array) {
+    return Utilities::Make_MSB_uint16_tFromU8Array(ArrayView<const uint8_t>{
+        sizeof(uint16_t), &data_array[CommandPacket::kWriteAddress]});
+  }
+  static uint16_t ReadWriteCount(const ArrayView<uint8_t> &data_array) {
+    return Utilities::Make_MSB_uint16_tFromU8Array(ArrayView<const uint8_t>{
+        sizeof(uint16_t), &data_array[CommandPacket::kWriteCount]});
+  }
+  static std::size_t ReadDataByteCount(const ArrayView<uint8_t> &data_array) {
+    return data_array[CommandPacket::kNumberOfDataBytes];
+  }
+
+  static void FillResponseHeader(const uint8_t slave_address,
+                                 const std::size_t register_count,
+                                 Response *response) {
+    FillResponseHeaderBase(slave_address, register_count, response, kFunction);
+  }
+  static int32_t FillFrame(const uint16_t read_address,
+                           const uint16_t read_count,
+                           const uint16_t write_address,
+                           const ArrayView<const uint16_t> &data,
+                           Frame *frame) {
+    const std::size_t number_of_data_bytes = data.size() * sizeof(data[0]);
+    const std::size_t frame_size =
+        CommandPacket::kHeaderSize + number_of_data_bytes;
+    assert(frame->data_array.size() >= frame_size);
+
+    frame->function = kFunction;
+    const std::array<uint16_t, 4> header{
+        read_address, read_count, write_address,
+        static_cast<uint16_t>(data.size())};
+    std::size_t index = CommandPacket::kReadAddress;
+    for (uint16_t pt : header) {
+      frame->data_array[index++] = Utilities::GetByte(pt, 1);
+      frame->data_array[index++] = Utilities::GetByte(pt, 0);
+    }
+    frame->data_array[CommandPacket::kNumberOfDataBytes] =
+        static_cast<uint8_t>(number_of_data_bytes);
+    index = CommandPacket::kValueStart;
+    for (uint16_t pt : data) {
+      frame->data_array[index++] = Utilities::GetByte(pt, 1);
+      frame->data_array[index++] = Utilities::GetByte(pt, 0);
+    }
+    frame->data_length = frame_size;
+    return 0;
+  }
+};
+
 template <typename T>
 class HoldingRegisterController {
   T *register_data_;
 
+ public:
+  static const constexpr std::array<Function, 5> kFunctions{
+      Function::kReadMultipleHoldingRegisters,
+      Function::kWriteSingleHoldingRegister,
+      Function::kWriteMultipleHoldingRegisters,
+      Function::kMaskWriteRegister,
+      Function::kReadWriteMultipleRegisters,
+  };
+
+ private:
   Exception ValidateWriteSingleHoldingRegister(
       const ArrayView<uint8_t> &data_array) const {
     const std::size_t address =
@@ -298,11 +456,44 @@ class HoldingRegisterController {
     }
     return Exception::kAck;
   }
+  Exception ValidateMaskWriteRegister(
+      const ArrayView<uint8_t> &data_array) const {
+    const std::size_t address = DataCommand::ReadAddressStart(data_array);
+    if (!WriteLocationValid(address, 1)) {
+      return Exception::kIllegalDataAddress;
+    }
+    return Exception::kAck;
+  }
+  Exception ValidateReadWriteMultipleRegisters(
+      const ArrayView<uint8_t> &data_array) const {
+    using ReadWrite = ReadWriteMultipleRegistersCommand;
+    const std::size_t read_address = ReadWrite::ReadAddressStart(data_array);
+    const std::size_t read_count = ReadWrite::ReadReadCount(data_array);
+    const std::size_t write_address = ReadWrite::ReadWriteAddress(data_array);
+    const std::size_t write_count = ReadWrite::ReadWriteCount(data_array);
+    if (read_count == 0 || read_count > ReadWrite::kMaxReadCount ||
+        write_count == 0 || write_count > ReadWrite::kMaxWriteCount ||
+        write_count * sizeof(uint16_t) !=
+            ReadWrite::ReadDataByteCount(data_array)) {
+      return Exception::kIllegalDataValue;
+    } else if (!ReadLocationValid(read_address, read_count) ||
+               !WriteLocationValid(write_address, write_count)) {
+      return Exception::kIllegalDataAddress;
+    }
+    return Exception::kAck;
+  }
 
  public:
   explicit HoldingRegisterController(T *register_data)
       : register_data_{register_data} {}
   T *GetDataStore(void) { return register_data_; }
+
+  //  See HandlerDispatch.h, lets the store publish the writes it took
+  void ResponseSent(void) {
+    if constexpr (HasPublish<T>::value) {
+      register_data_->Publish();
+    }
+  }
   bool WriteLocationValid(std::size_t address, std::size_t count) const {
     return register_data_->WriteLocationValid(address, count);
   }
@@ -322,6 +513,10 @@ class HoldingRegisterController {
       return RunReadMultipleHoldingRegisters(frame, response);
     } else if (frame.function == Function::kWriteMultipleHoldingRegisters) {
       return RunWriteMultipleHoldingRegisters(frame, response);
+    } else if (frame.function == Function::kMaskWriteRegister) {
+      return RunMaskWriteRegister(frame, response);
+    } else if (frame.function == Function::kReadWriteMultipleRegisters) {
+      return RunReadWriteMultipleRegisters(frame, response);
     } else {
       assert(0);
     }
@@ -385,6 +580,59 @@ class HoldingRegisterController {
     return 0;
   }
 
+  /*
+   * The data store applies the masks in one step so no other write to the
+   * register can land between reading and writing it
+   * */
+  int32_t RunMaskWriteRegister(const Frame &frame, Response *response) {
+    const uint16_t address = DataCommand::ReadAddressStart(frame.data_array);
+    const uint16_t and_mask =
+        MaskWriteRegisterCommand::ReadAndMask(frame.data_array);
+    const uint16_t or_mask =
+        MaskWriteRegisterCommand::ReadOrMask(frame.data_array);
+    const uint16_t value =
+        register_data_->MaskWriteRegister(address, and_mask, or_mask);
+    register_data_->set_register_callback(address, value);
+    MaskWriteRegisterCommand::FillResponseHeader(frame.address, address,
+                                                 and_mask, or_mask, response);
+    return 0;
+  }
+
+  /*
+   * The write is done before the read so a read of the written registers
+   * returns the new values. A response buffer too short for the read is
+   * refused before anything is written.
+   * */
+  int32_t RunReadWriteMultipleRegisters(const Frame &frame,
+                                        Response *response) {
+    using ReadWrite = ReadWriteMultipleRegistersCommand;
+    const uint16_t read_address = ReadWrite::ReadAddressStart(frame.data_array);
+    const uint16_t read_count = ReadWrite::ReadReadCount(frame.data_array);
+    const uint16_t write_address =
+        ReadWrite::ReadWriteAddress(frame.data_array);
+    const uint16_t write_count = ReadWrite::ReadWriteCount(frame.data_array);
+    const std::size_t kPacketSize = ReadWrite::ResponsePacket::kHeaderSize +
+                                    read_count * sizeof(uint16_t) +
+                                    Command::kFooterLength;
+    if (response->size() < kPacketSize) {
+      return -1;
+    }
+
+    const ArrayView<const uint8_t> data_view{
+        write_count * sizeof(uint16_t),
+        &frame.data_array[ReadWrite::CommandPacket::kValueStart]};
+    register_data_->SetRegisters(write_address, write_count, data_view);
+    register_data_->set_registers_callback(write_address, write_count,
+                                           data_view);
+
+    ReadWrite::FillResponseHeader(frame.address, read_count, response);
+    auto response_data = ArrayView<uint8_t>{
+        read_count * sizeof(uint16_t),
+        &response->data()[ReadWrite::ResponsePacket::kHeaderSize]};
+    ReadRegisters(read_address, read_count, &response_data);
+    return 0;
+  }
+
   void ReadRegisters(const uint16_t starting_address,
                      const uint16_t register_count,
                      ArrayView<uint8_t> *response_data) {
@@ -404,6 +652,10 @@ class HoldingRegisterController {
       exception = ValidateWriteSingleHoldingRegister(frame.data_array);
     } else if (frame.function == Function::kWriteMultipleHoldingRegisters) {
       exception = ValidateWriteMultipleHoldingRegisters(frame.data_array);
+    } else if (frame.function == Function::kMaskWriteRegister) {
+      exception = ValidateMaskWriteRegister(frame.data_array);
+    } else if (frame.function == Function::kReadWriteMultipleRegisters) {
+      exception = ValidateReadWriteMultipleRegisters(frame.data_array);
     } else {
       assert(0);
     }
@@ -415,6 +667,12 @@ template <typename T>
 class InputRegisterController {
   T *register_data_;
 
+ public:
+  static const constexpr std::array<Function, 1> kFunctions{
+      Function::kReadInputRegisters,
+  };
+
+ private:
   Exception ValidateReadRegisters(const ArrayView<uint8_t> &data_array) const {
     const std::size_t address =
         ReadInputRegistersCommand::ReadAddressStart(data_array);
@@ -1,11 +1,15 @@
 #pragma once
+#include <Modbus/ByteSwap.h>
+
+#include <cassert>
 namespace Modbus {
+/*
+ * T is a contiguous container of uint16_t such as std::array or ArrayView
+ * */
 template <typename T>
 void MakeRegistersToBytes(const T& data_view, ArrayView<uint8_t> data_out) {
-  for (std::size_t i = 0; i < data_view.size(); i++) {
-    data_out[i * sizeof(uint16_t)] = Utilities::GetByte(data_view.at(i), 1);
-    data_out[i * sizeof(uint16_t) + 1] = Utilities::GetByte(data_view.at(i), 0);
-  }
+  assert(data_out.size() >= data_view.size() * sizeof(uint16_t));
+  RegistersToBytes(data_view.data(), data_out.data(), data_view.size());
 }
 
 template <typename T>
@@ -0,0 +1,88 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        TestSlave.h
+ * Description:  Rtu slave with a frame buffer for the handler and store
+ *               tests
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#pragma once
+#ifndef MODBUS_TESTSLAVE_H_
+#define MODBUS_TESTSLAVE_H_
+#include <ArrayView/ArrayView.h>
+#include <Modbus/Modbus.h>
+#include <Modbus/ModbusRtu/ModbusRtuSlave.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "Crc.h"
+
+namespace ModbusTests {
+/*
+ * Fill frame with a request and Run it, or use the register helpers, the
+ * response is read back from GetResponse as from the slave
+ * */
+template <typename... THandlers>
+class TestSlave : public Modbus::ProtocolRtuSlave<THandlers...> {
+  using Slave = Modbus::ProtocolRtuSlave<THandlers...>;
+  std::array<uint8_t, 256> frame_data_{};
+
+ public:
+  static const constexpr uint8_t kSlaveAddress = 0x11;
+  Modbus::Frame frame{kSlaveAddress, Modbus::Function::kNone, 0,
+                      ArrayView<uint8_t>{frame_data_.size(),
+                                         frame_data_.data()}};
+
+  explicit TestSlave(THandlers &... handlers)
+      : Slave{&crc16, kSlaveAddress, handlers...} {}
+
+  //  Runs frame if it is valid, returns the exception it was refused with
+  Modbus::Exception Run(void) {
+    const Modbus::Exception exception = Slave::ValidateMessage(frame);
+    if (exception == Modbus::Exception::kAck) {
+      EXPECT_EQ(Slave::RunCommand(frame), 0);
+    }
+    return exception;
+  }
+
+  //  Function 16
+  Modbus::Exception WriteRegisters(const uint16_t address,
+                                   const std::vector<uint16_t> &values) {
+    const ArrayView<const uint16_t> view{values.size(), values.data()};
+    Modbus::WriteMultipleHoldingRegistersCommand::FillFrame(
+        address, static_cast<uint16_t>(values.size()), view, &frame);
+    return Run();
+  }
+
+  //  Registers of a function 3, or with TCommand 4, response, empty on an
+  //  exception
+  template <typename TCommand = Modbus::ReadMultipleHoldingRegistersCommand>
+  std::vector<uint16_t> ReadRegisters(const uint16_t address,
+                                      const uint16_t count) {
+    TCommand::FillFrame(address, count, &frame);
+    if (Run() != Modbus::Exception::kAck) {
+      return {};
+    }
+    std::vector<uint16_t> values(count);
+    for (std::size_t i = 0; i < count; i++) {
+      values[i] = GetResponseWord(Modbus::Command::kHeaderLength + 1 + 2 * i);
+    }
+    return values;
+  }
+
+  uint16_t GetResponseWord(const std::size_t offset) {
+    const auto &response = Slave::GetResponse();
+    return static_cast<uint16_t>((response[offset] << 8) |
+                                 response[offset + 1]);
+  }
+};
+}  //  namespace ModbusTests
+
+#endif  //  MODBUS_TESTSLAVE_H_
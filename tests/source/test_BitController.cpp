@@ -0,0 +1,187 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        test_BitController.cpp
+ * Description:
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <ArrayView/ArrayView.h>
+#include <Modbus/BitControl.h>
+#include <Modbus/DataStores/BitFieldDataStore.h>
+#include <Modbus/Modbus.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "TestSlave.h"
+
+namespace ModbusTests {
+static const constexpr std::size_t kBitCount = 300;
+using BitStore = Modbus::BitFieldDataStore<kBitCount>;
+
+/*
+ * Packing by the word functions matches packing one bit at a time for every
+ * alignment of the start and end inside the 64 bit words
+ */
+TEST(BitFieldDataStore, GetBitsMatchesBitLoop) {
+  BitStore store;
+  for (std::size_t i = 0; i < kBitCount; i++) {
+    store.SetBit(i, ((i * 7) % 5) < 2);
+  }
+  for (std::size_t address = 0; address < 130; address += 3) {
+    for (std::size_t count = 1; address + count <= kBitCount; count += 11) {
+      std::array<uint8_t, 64> packed{};
+      packed.fill(0xa5);
+      ArrayView<uint8_t> view{packed.size(), packed.data()};
+      store.GetBits(address, count, &view);
+      std::array<uint8_t, 64> expected{};
+      for (std::size_t bit = 0; bit < count; bit++) {
+        if (store.GetBit(address + bit)) {
+          expected[bit / 8] |= static_cast<uint8_t>(1u << (bit % 8));
+        }
+      }
+      const std::size_t bytes = (count + 7) / 8;
+      for (std::size_t byte = 0; byte < bytes; byte++) {
+        ASSERT_EQ(packed[byte], expected[byte])
+            << "address " << address << " count " << count;
+      }
+      EXPECT_EQ(packed[bytes], 0xa5);
+    }
+  }
+}
+
+TEST(BitFieldDataStore, SetBitsOnlyTouchesRange) {
+  for (std::size_t address = 0; address < 130; address += 5) {
+    for (std::size_t count = 1; address + count <= kBitCount; count += 13) {
+      BitStore store;
+      for (std::size_t i = 0; i < kBitCount; i++) {
+        store.SetBit(i, true);
+      }
+      std::array<uint8_t, 64> packed{};
+      for (std::size_t byte = 0; byte < packed.size(); byte++) {
+        packed[byte] = static_cast<uint8_t>(0x5a ^ byte);
+      }
+      store.SetBits(address, count,
+                    ArrayView<const uint8_t>{packed.size(), packed.data()});
+      for (std::size_t i = 0; i < kBitCount; i++) {
+        bool expected = true;
+        if (i >= address && i < address + count) {
+          const std::size_t bit = i - address;
+          expected = (packed[bit / 8] >> (bit % 8)) & 1u;
+        }
+        ASSERT_EQ(store.GetBit(i), expected)
+            << "address " << address << " count " << count << " bit " << i;
+      }
+    }
+  }
+}
+
+TEST(BitFieldDataStore, LocationValid) {
+  BitStore store;
+  EXPECT_TRUE(store.ReadLocationValid(0, kBitCount));
+  EXPECT_TRUE(store.ReadLocationValid(kBitCount - 1, 1));
+  EXPECT_FALSE(store.ReadLocationValid(kBitCount - 1, 2));
+  EXPECT_FALSE(store.ReadLocationValid(0, 0));
+}
+
+struct BitControllerFixture : public ::testing::Test {
+  using CoilController = Modbus::CoilController<BitStore>;
+  using DiscreteInputController = Modbus::DiscreteInputController<BitStore>;
+
+  BitStore coil_store;
+  CoilController coils{&coil_store};
+  BitStore input_store;
+  DiscreteInputController inputs{&input_store};
+  TestSlave<CoilController, DiscreteInputController> slave{coils, inputs};
+  Modbus::Frame &frame = slave.frame;
+
+  void ExpectResponseData(const std::size_t offset,
+                          const std::vector<uint8_t> &expected) {
+    const auto &response = slave.GetResponse();
+    ASSERT_EQ(response.GetLength(),
+              offset + expected.size() + Modbus::Command::kFooterLength);
+    for (std::size_t i = 0; i < expected.size(); i++) {
+      EXPECT_EQ(response[offset + i], expected[i]) << "byte " << i;
+    }
+  }
+};
+
+TEST_F(BitControllerFixture, ReadCoils) {
+  //  Example from the specification, coils 20 to 38
+  const std::array<uint8_t, 3> states{0xcd, 0x6b, 0x05};
+  coil_store.SetBits(20, 19,
+                     ArrayView<const uint8_t>{states.size(), states.data()});
+  Modbus::ReadCoilsCommand::FillFrame(20, 19, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kAck);
+  EXPECT_EQ(slave.RunCommand(frame), 0);
+  ExpectResponseData(Modbus::Command::kHeaderLength, {3, 0xcd, 0x6b, 0x05});
+}
+
+TEST_F(BitControllerFixture, ReadDiscreteInputs) {
+  input_store.SetBit(197, true);
+  input_store.SetBit(199, true);
+  Modbus::ReadDiscreteInputsCommand::FillFrame(197, 3, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kAck);
+  EXPECT_EQ(slave.RunCommand(frame), 0);
+  ExpectResponseData(Modbus::Command::kHeaderLength, {1, 0x05});
+}
+
+TEST_F(BitControllerFixture, WriteSingleCoil) {
+  Modbus::WriteSingleCoilCommand::FillFrame(172, true, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kAck);
+  EXPECT_EQ(slave.RunCommand(frame), 0);
+  EXPECT_TRUE(coils.ReadBit(172));
+  ExpectResponseData(Modbus::Command::kHeaderLength, {0, 172, 0xff, 0x00});
+
+  Modbus::WriteSingleCoilCommand::FillFrame(172, false, &frame);
+  EXPECT_EQ(slave.RunCommand(frame), 0);
+  EXPECT_FALSE(coils.ReadBit(172));
+
+  frame.data_array[Modbus::WriteSingleCoilCommand::CommandPacket::kValueStart] =
+      0x12;
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kIllegalDataValue);
+}
+
+TEST_F(BitControllerFixture, WriteMultipleCoils) {
+  //  Example from the specification, coils 20 to 29
+  const std::array<uint8_t, 2> states{0xcd, 0x01};
+  Modbus::WriteMultipleCoilsCommand::FillFrame(
+      20, 10, ArrayView<const uint8_t>{states.size(), states.data()}, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kAck);
+  EXPECT_EQ(slave.RunCommand(frame), 0);
+  ExpectResponseData(Modbus::Command::kHeaderLength, {0, 20, 0, 10});
+  const std::array<bool, 10> expected{true,  false, true, true, false,
+                                      false, true,  true, true, false};
+  for (std::size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(coils.ReadBit(static_cast<uint16_t>(20 + i)), expected[i]);
+  }
+  EXPECT_FALSE(coils.ReadBit(19));
+  EXPECT_FALSE(coils.ReadBit(30));
+}
+
+TEST_F(BitControllerFixture, InvalidRequests) {
+  Modbus::ReadCoilsCommand::FillFrame(0, 0, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kIllegalDataValue);
+  Modbus::ReadCoilsCommand::FillFrame(0, 2001, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kIllegalDataValue);
+  Modbus::ReadCoilsCommand::FillFrame(kBitCount - 1, 2, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame),
+            Modbus::Exception::kIllegalDataAddress);
+  Modbus::ReadDiscreteInputsCommand::FillFrame(kBitCount, 1, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame),
+            Modbus::Exception::kIllegalDataAddress);
+
+  const std::array<uint8_t, 2> states{};
+  Modbus::WriteMultipleCoilsCommand::FillFrame(
+      0, 9, ArrayView<const uint8_t>{states.size(), states.data()}, &frame);
+  frame.data_array[Modbus::WriteMultipleCoilsCommand::CommandPacket::
+                       kNumberOfDataBytes] = 1;
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kIllegalDataValue);
+}
+}  //  namespace ModbusTests
@@ -0,0 +1,83 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        test_ByteSwap.cpp
+ * Description:
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <ArrayView/ArrayView.h>
+#include <Modbus/ByteSwap.h>
+#include <Modbus/DataStores/RegisterDataStore.h>
+#include <Modbus/Utilities.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+
+namespace ModbusTests {
+using Backend = Modbus::ByteSwapBackend;
+static const constexpr std::array<Backend, 4> kBackends{
+    Backend::kScalar, Backend::kSsse3, Backend::kAvx2, Backend::kNeon};
+
+//  Every length around the vector widths, from odd byte offsets
+TEST(ByteSwap, BackendsMatchScalar) {
+  std::array<uint16_t, 160> registers{};
+  for (std::size_t i = 0; i < registers.size(); i++) {
+    registers[i] = static_cast<uint16_t>(i * 0x0101 + 0x1234);
+  }
+  for (auto backend : kBackends) {
+    if (!Modbus::ByteSwapBackendAvailable(backend)) {
+      continue;
+    }
+    const auto to_bytes = Modbus::GetRegistersToBytesFunction(backend);
+    const auto to_registers = Modbus::GetBytesToRegistersFunction(backend);
+    for (std::size_t offset = 0; offset < 2; offset++) {
+      for (std::size_t count = 0; count <= 130; count++) {
+        std::array<uint8_t, 2 * 160 + 2> bytes{};
+        uint8_t *const out = &bytes[offset];
+        to_bytes(&registers[1], out, count);
+        for (std::size_t i = 0; i < count; i++) {
+          ASSERT_EQ(out[2 * i], registers[i + 1] >> 8);
+          ASSERT_EQ(out[2 * i + 1], registers[i + 1] & 0xff);
+        }
+        EXPECT_EQ(out[2 * count], 0) << "wrote past the end";
+
+        std::array<uint16_t, 160> read_back{};
+        to_registers(out, &read_back[1], count);
+        for (std::size_t i = 0; i < count; i++) {
+          ASSERT_EQ(read_back[i + 1], registers[i + 1]);
+        }
+        EXPECT_EQ(read_back[count + 1], 0) << "wrote past the end";
+      }
+    }
+  }
+}
+
+TEST(ByteSwap, RegisterDataStoreBulkCopy) {
+  std::array<uint16_t, 125> registers{};
+  Modbus::RegisterDataStore store{registers.data(), registers.size()};
+  std::array<uint8_t, 2 * 125> bytes{};
+  for (std::size_t i = 0; i < bytes.size(); i++) {
+    bytes[i] = static_cast<uint8_t>(i);
+  }
+  store.SetRegisters(
+      0, registers.size(),
+      ArrayView<const uint8_t>{bytes.size(), bytes.data()});
+  EXPECT_EQ(store.GetRegister(0), 0x0001);
+  EXPECT_EQ(store.GetRegister(124), 0xf8f9);
+
+  std::array<uint8_t, 2 * 125> out{};
+  ArrayView<uint8_t> view{out.size(), out.data()};
+  store.GetRegisters(0, registers.size(), &view);
+  EXPECT_EQ(out, bytes);
+
+  std::array<uint8_t, 2 * 125> converted{};
+  Modbus::MakeRegistersToBytes(
+      registers, ArrayView<uint8_t>{converted.size(), converted.data()});
+  EXPECT_EQ(converted, bytes);
+}
+}  //  namespace ModbusTests
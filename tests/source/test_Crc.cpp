@@ -1,6 +1,7 @@
 /*
  * Copyright 2020 Electrooptical Innovations
  * */
+#include <Modbus/Crc.h>
 #include <Utilities/Crc.h>
 #include <gtest/gtest.h>
 
@@ -9,6 +10,123 @@
 #include <iostream>
 #include <vector>
 
+#include "Crc.h"
+
+/*
+ * RunningCrc16, the incremental CRC used while receiving a frame
+ * */
+
+/*
+ * Read holding registers example from the Modbus over serial line guide,
+ * the CRC is sent low byte first: 0xc5 0xcd
+ * */
+TEST(RunningCrc16, KnownFrame) {
+  const std::array<uint8_t, 6> frame{0x01, 0x03, 0x00, 0x00, 0x00, 0x0a};
+  Modbus::RunningCrc16 crc{};
+  crc.Update(frame.data(), frame.size());
+  EXPECT_EQ(crc.GetLowByte(), 0xc5);
+  EXPECT_EQ(crc.GetHighByte(), 0xcd);
+}
+
+TEST(RunningCrc16, BytewiseMatchesBlock) {
+  std::array<uint8_t, 64> data{};
+  for (std::size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<uint8_t>(i * 37 + 11);
+  }
+  Modbus::RunningCrc16 block{};
+  Modbus::RunningCrc16 bytewise{};
+  block.Update(data.data(), data.size());
+  for (auto pt : data) {
+    bytewise.Update(pt);
+  }
+  EXPECT_EQ(block.GetValue(), bytewise.GetValue());
+}
+
+TEST(RunningCrc16, ResidueOfFrameWithCrcIsZero) {
+  std::array<uint8_t, 8> frame{0x11, 0x06, 0x00, 0x01, 0x00, 0x03};
+  Modbus::RunningCrc16 crc{};
+  crc.Update(frame.data(), 6);
+  frame[6] = crc.GetLowByte();
+  frame[7] = crc.GetHighByte();
+
+  Modbus::RunningCrc16 check{};
+  check.Update(frame.data(), frame.size());
+  EXPECT_TRUE(check.ResidueIsValid());
+
+  frame[3] ^= 0x10;
+  check.Reset();
+  check.Update(frame.data(), frame.size());
+  EXPECT_FALSE(check.ResidueIsValid());
+}
+
+TEST(RunningCrc16, MatchesFrameCrcHook) {
+  std::array<uint8_t, 32> data{};
+  for (std::size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<uint8_t>(0xa5 ^ i);
+  }
+  Modbus::RunningCrc16 crc{};
+  crc.Update(data.data(), data.size());
+  //  The Crc16 hook returns the CRC in transmit order, low byte in the MSB
+  const uint16_t hook = crc16(data, data.size());
+  EXPECT_EQ(crc.GetLowByte(), static_cast<uint8_t>(hook >> 8));
+  EXPECT_EQ(crc.GetHighByte(), static_cast<uint8_t>(hook & 0xff));
+}
+
+/*
+ * CRC16 backends, each must give the bitwise result for any length and
+ * initial value
+ * */
+class Crc16BackendFixture
+    : public ::testing::TestWithParam<Modbus::Crc16Backend> {
+ public:
+  std::array<uint8_t, 300> data{};
+  void SetUp(void) {
+    uint32_t seed = 0x12345678;
+    for (auto &pt : data) {
+      seed = seed * 1103515245 + 12345;
+      pt = static_cast<uint8_t>(seed >> 16);
+    }
+  }
+};
+
+TEST_P(Crc16BackendFixture, MatchesBitwise) {
+  if (!Modbus::Crc16BackendAvailable(GetParam())) {
+    GTEST_SKIP();
+  }
+  const auto update = Modbus::GetCrc16Function(GetParam());
+  for (std::size_t length = 0; length <= data.size(); length++) {
+    for (uint16_t initial :
+         {Modbus::kCrc16Initial, uint16_t{0}, uint16_t{0x1234}}) {
+      EXPECT_EQ(update(initial, data.data(), length),
+                Modbus::Crc16UpdateBitwise(initial, data.data(), length))
+          << "length " << length;
+    }
+  }
+}
+
+TEST_P(Crc16BackendFixture, KnownFrame) {
+  const std::array<uint8_t, 6> frame{0x01, 0x03, 0x00, 0x00, 0x00, 0x0a};
+  const auto update = Modbus::GetCrc16Function(GetParam());
+  EXPECT_EQ(update(Modbus::kCrc16Initial, frame.data(), frame.size()), 0xcdc5);
+}
+
+INSTANTIATE_TEST_SUITE_P(Crc16, Crc16BackendFixture,
+                         ::testing::Values(Modbus::Crc16Backend::kBitwise,
+                                           Modbus::Crc16Backend::kTable,
+                                           Modbus::Crc16Backend::kSliceBy8,
+                                           Modbus::Crc16Backend::kClmul));
+
+TEST(Crc16, CalculateCrc16MatchesHook) {
+  std::array<uint8_t, 128> data{};
+  for (std::size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<uint8_t>(i * 7);
+  }
+  const ArrayView<uint8_t> view{data.size(), data.data()};
+  for (std::size_t length = 0; length < data.size(); length += 9) {
+    EXPECT_EQ(Modbus::CalculateCrc16(view, length), crc16(view, length));
+  }
+}
+
 /*
  * Example from MS56XX AN520
  * */
@@ -12,7 +12,6 @@
 #include <Modbus/Modbus.h>
 #include <Modbus/ModbusRtu/ModbusRtuSlave.h>
 
-#include "ConnectedSystem.h"
 #include "Crc.h"
 //#include <Modbus/ModbusRtu/ModbusRtuMaster.h>
 #include <ArrayView/ArrayView.h>
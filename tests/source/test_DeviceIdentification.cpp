@@ -0,0 +1,174 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        test_DeviceIdentification.cpp
+ * Description:
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <Modbus/Crc.h>
+#include <Modbus/DeviceIdentification.h>
+#include <Modbus/Modbus.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "TestSlave.h"
+
+namespace ModbusTests {
+using Identification = Modbus::DeviceIdentification<>;
+using Code = Modbus::ReadDeviceIdCode;
+using ObjectId = Modbus::DeviceObjectId;
+
+struct DeviceIdentificationFixture : public ::testing::Test {
+  using Controller = Modbus::DeviceIdentificationController<Identification>;
+  using Command = Modbus::ReadDeviceIdentificationCommand;
+  static const constexpr uint8_t kSlaveAddress =
+      TestSlave<Controller>::kSlaveAddress;
+
+  Identification identification;
+  Controller controller{&identification};
+  TestSlave<Controller> slave{controller};
+  Modbus::Frame &frame = slave.frame;
+
+  void AddBasicObjects(void) {
+    ASSERT_TRUE(identification.AddObject(ObjectId::kMajorMinorRevision, "1.2"));
+    ASSERT_TRUE(identification.AddObject(ObjectId::kVendorName, "EOI"));
+    ASSERT_TRUE(identification.AddObject(ObjectId::kProductCode, "MB-1"));
+  }
+
+  void AddLongObject(const uint8_t id, const char fill) {
+    const std::string value(100, fill);
+    ASSERT_TRUE(identification.AddObject(
+        id, reinterpret_cast<const uint8_t *>(value.data()), value.size()));
+  }
+
+  //  Runs the request and checks the whole frame, crc included
+  void Request(const Code code, const uint8_t object_id) {
+    Command::FillFrame(code, object_id, &frame);
+    ASSERT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kAck);
+    ASSERT_EQ(slave.RunCommand(frame), 0);
+    const auto &response = slave.GetResponse();
+    Modbus::RunningCrc16 crc{};
+    crc.Update(response.data(), response.GetLength());
+    EXPECT_TRUE(crc.ResidueIsValid());
+    EXPECT_EQ(response[Modbus::Command::ResponsePacket::kSlaveAddress],
+              frame.address);
+  }
+
+  uint8_t ResponseByte(const std::size_t index) {
+    return slave.GetResponse()[index];
+  }
+
+  //  Ids of the objects in the response
+  std::vector<uint8_t> ResponseObjects(void) {
+    std::vector<uint8_t> ids;
+    std::size_t index = Command::ResponsePacket::kObjectStart;
+    const uint8_t count =
+        ResponseByte(Command::ResponsePacket::kNumberOfObjects);
+    for (uint8_t i = 0; i < count; i++) {
+      ids.push_back(ResponseByte(index));
+      index += 2u + ResponseByte(index + 1);
+    }
+    EXPECT_EQ(index + Modbus::Command::kFooterLength,
+              slave.GetResponse().GetLength());
+    return ids;
+  }
+};
+
+TEST_F(DeviceIdentificationFixture, BuildNeedsBasicObjects) {
+  ASSERT_TRUE(identification.AddObject(ObjectId::kVendorName, "EOI"));
+  ASSERT_TRUE(identification.AddObject(ObjectId::kProductCode, "MB-1"));
+  EXPECT_FALSE(identification.AddObject(ObjectId::kVendorName, "Other"));
+  EXPECT_FALSE(identification.Build(kSlaveAddress));
+  Command::FillFrame(Code::kBasic, 0, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kIllegalFunction);
+}
+
+TEST_F(DeviceIdentificationFixture, ReadBasic) {
+  AddBasicObjects();
+  ASSERT_TRUE(identification.Build(kSlaveAddress));
+  Request(Code::kBasic, 0);
+  const std::vector<uint8_t> expected{
+      0x0e, 0x01, 0x81, 0x00, 0x00, 0x03, 0x00, 3,   'E', 'O',
+      'I',  0x01, 4,    'M',  'B',  '-',  '1',  0x02, 3,   '1',
+      '.',  '2'};
+  const auto &response = slave.GetResponse();
+  ASSERT_EQ(response.GetLength(), Modbus::Command::kHeaderLength +
+                                      expected.size() +
+                                      Modbus::Command::kFooterLength);
+  for (std::size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(response[Modbus::Command::kHeaderLength + i], expected[i])
+        << "byte " << i;
+  }
+  //  The prebuilt frame carries its own crc
+  EXPECT_TRUE(response.IsCrcWritten());
+
+  //  An object outside the basic range restarts at the first object
+  Request(Code::kBasic, 0x05);
+  EXPECT_EQ(ResponseObjects(), (std::vector<uint8_t>{0, 1, 2}));
+}
+
+TEST_F(DeviceIdentificationFixture, ReadRegularAndSpecific) {
+  AddBasicObjects();
+  ASSERT_TRUE(identification.AddObject(ObjectId::kProductName, "Slave"));
+  ASSERT_TRUE(identification.Build(kSlaveAddress));
+  EXPECT_EQ(identification.GetConformityLevel(), 0x82);
+
+  Request(Code::kRegular, 0);
+  EXPECT_EQ(ResponseObjects(), (std::vector<uint8_t>{0, 1, 2, 4}));
+  Request(Code::kExtended, 0);
+  EXPECT_EQ(ResponseObjects(), (std::vector<uint8_t>{0, 1, 2, 4}));
+
+  Request(Code::kSpecific, 4);
+  EXPECT_EQ(ResponseObjects(), (std::vector<uint8_t>{4}));
+  EXPECT_EQ(ResponseByte(Command::ResponsePacket::kMoreFollows), 0);
+
+  Command::FillFrame(Code::kSpecific, 3, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame),
+            Modbus::Exception::kIllegalDataAddress);
+  frame.data_array[Command::CommandPacket::kReadDeviceIdCode] = 5;
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kIllegalDataValue);
+  Command::FillFrame(Code::kBasic, 0, &frame);
+  frame.data_array[Command::CommandPacket::kMeiType] = 0x0d;
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kIllegalFunction);
+}
+
+TEST_F(DeviceIdentificationFixture, ExtendedMoreFollows) {
+  AddBasicObjects();
+  AddLongObject(0x80, 'a');
+  AddLongObject(0x81, 'b');
+  AddLongObject(0x82, 'c');
+  ASSERT_TRUE(identification.Build(kSlaveAddress));
+  EXPECT_EQ(identification.GetConformityLevel(), 0x83);
+
+  Request(Code::kExtended, 0);
+  EXPECT_EQ(ResponseObjects(), (std::vector<uint8_t>{0, 1, 2, 0x80, 0x81}));
+  EXPECT_EQ(ResponseByte(Command::ResponsePacket::kMoreFollows), 0xff);
+  EXPECT_EQ(ResponseByte(Command::ResponsePacket::kNextObjectId), 0x82);
+
+  Request(Code::kExtended, 0x82);
+  EXPECT_EQ(ResponseObjects(), (std::vector<uint8_t>{0x82}));
+  EXPECT_EQ(ResponseByte(Command::ResponsePacket::kMoreFollows), 0);
+  EXPECT_TRUE(slave.GetResponse().IsCrcWritten());
+
+  //  A start that is not prebuilt is encoded for the request
+  Request(Code::kExtended, 0x81);
+  EXPECT_EQ(ResponseObjects(), (std::vector<uint8_t>{0x81, 0x82}));
+  EXPECT_FALSE(slave.GetResponse().IsCrcWritten());
+}
+
+TEST_F(DeviceIdentificationFixture, OtherAddressGetsItsOwnCrc) {
+  AddBasicObjects();
+  ASSERT_TRUE(identification.Build(kSlaveAddress));
+  frame.address = kSlaveAddress + 1;
+  Request(Code::kBasic, 0);
+  EXPECT_FALSE(slave.GetResponse().IsCrcWritten());
+}
+}  //  namespace ModbusTests
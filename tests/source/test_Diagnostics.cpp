@@ -0,0 +1,231 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        test_Diagnostics.cpp
+ * Description:
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <ArrayView/ArrayView.h>
+#include <Modbus/DataStores/RegisterDataStore.h>
+#include <Modbus/Diagnostics.h>
+#include <Modbus/Modbus.h>
+#include <Modbus/ModbusRtu/ModbusRtuSlave.h>
+#include <Modbus/RegisterControl.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "Crc.h"
+
+namespace ModbusTests {
+using Counter = Modbus::DiagnosticCounter;
+using Sub = Modbus::DiagnosticSubFunction;
+using Event = Modbus::CommEvent;
+
+template <typename... THandlers>
+class DiagnosticSlave : public Modbus::ProtocolRtuSlave<THandlers...> {
+ public:
+  using Modbus::ProtocolRtuSlave<THandlers...>::ProtocolRtuSlave;
+  Modbus::ReadResult ProcessBytes(const ArrayView<const uint8_t> &data) {
+    return this->slave_.ProcessBytes(data);
+  }
+};
+
+struct DiagnosticsFixture : public ::testing::Test {
+  static const constexpr uint8_t kSlaveAddress = 0x11;
+  using HoldingController =
+      Modbus::HoldingRegisterController<Modbus::RegisterDataStore>;
+
+  std::array<uint16_t, 16> registers{};
+  Modbus::RegisterDataStore store{registers.data(), registers.size()};
+  HoldingController holding_controller{&store};
+  Modbus::CommDiagnostics diagnostics;
+  Modbus::DiagnosticsController diagnostics_controller{&diagnostics};
+  DiagnosticSlave<HoldingController, Modbus::DiagnosticsController> slave{
+      &crc16, kSlaveAddress, holding_controller, diagnostics_controller};
+
+  void SetUp(void) override { slave.SetDiagnostics(&diagnostics); }
+
+  //  Frames the bytes with their crc, feeds them in and returns the response
+  std::vector<uint8_t> Send(std::vector<uint8_t> bytes,
+                            const bool corrupt = false) {
+    Modbus::RunningCrc16 crc{};
+    crc.Update(bytes.data(), bytes.size());
+    bytes.push_back(crc.GetLowByte());
+    bytes.push_back(crc.GetHighByte() ^ (corrupt ? 0x01 : 0x00));
+    slave.Reset();
+    const auto result = slave.ProcessBytes(
+        ArrayView<const uint8_t>{bytes.size(), bytes.data()});
+    EXPECT_TRUE(result.packet_received);
+    slave.ProcessMessage();
+    if (!slave.GetResponseValid()) {
+      return {};
+    }
+    const auto &response = slave.GetResponse();
+    //  Drop the crc
+    return std::vector<uint8_t>(
+        response.begin(), response.end() - Modbus::Command::kFooterLength);
+  }
+
+  std::vector<uint8_t> Diagnostic(const Sub sub_function,
+                                  const uint16_t data = 0) {
+    const uint16_t code = static_cast<uint16_t>(sub_function);
+    return Send({kSlaveAddress, 8, Utilities::GetByte(code, 1),
+                 Utilities::GetByte(code, 0), Utilities::GetByte(data, 1),
+                 Utilities::GetByte(data, 0)});
+  }
+
+  uint16_t DiagnosticValue(const Sub sub_function) {
+    const auto response = Diagnostic(sub_function);
+    EXPECT_EQ(response.size(), 6u);
+    if (response.size() != 6) {
+      return 0xffff;
+    }
+    return static_cast<uint16_t>((response[4] << 8) | response[5]);
+  }
+
+  std::vector<uint8_t> ReadHolding(const uint8_t address = kSlaveAddress) {
+    return Send({address, 3, 0x00, 0x00, 0x00, 0x01});
+  }
+};
+
+TEST_F(DiagnosticsFixture, ReturnQueryData) {
+  const auto response = Diagnostic(Sub::kReturnQueryData, 0xa537);
+  EXPECT_EQ(response,
+            (std::vector<uint8_t>{kSlaveAddress, 8, 0x00, 0x00, 0xa5, 0x37}));
+  EXPECT_EQ(Diagnostic(static_cast<Sub>(0x03)),
+            (std::vector<uint8_t>{kSlaveAddress, 0x88, 0x01}));
+  EXPECT_EQ(Diagnostic(Sub::kReturnBusMessageCount, 1),
+            (std::vector<uint8_t>{kSlaveAddress, 0x88, 0x03}));
+}
+
+TEST_F(DiagnosticsFixture, CountersFollowTheLine) {
+  ReadHolding();
+  ReadHolding(kSlaveAddress + 1);
+  ReadHolding(0);
+  Send({kSlaveAddress, 3, 0x00, 0x00, 0x00, 0x01}, true);
+  Send({kSlaveAddress, 3, 0x00, 0x20, 0x00, 0x01});  //  Illegal address
+
+  EXPECT_EQ(diagnostics.Get(Counter::kBusMessage), 5);
+  EXPECT_EQ(diagnostics.Get(Counter::kBusCommunicationError), 1);
+  EXPECT_EQ(diagnostics.Get(Counter::kSlaveMessage), 3);
+  EXPECT_EQ(diagnostics.Get(Counter::kSlaveNoResponse), 1);
+  EXPECT_EQ(diagnostics.Get(Counter::kSlaveExceptionError), 1);
+  EXPECT_EQ(diagnostics.GetEventCounter(), 1);
+
+  //  The request is counted before the reply is made
+  EXPECT_EQ(DiagnosticValue(Sub::kReturnBusMessageCount), 6);
+  EXPECT_EQ(DiagnosticValue(Sub::kReturnBusCommunicationErrorCount), 1);
+  EXPECT_EQ(DiagnosticValue(Sub::kReturnBusExceptionErrorCount), 1);
+  EXPECT_EQ(DiagnosticValue(Sub::kReturnSlaveMessageCount), 7);
+  EXPECT_EQ(DiagnosticValue(Sub::kReturnSlaveNoResponseCount), 1);
+  EXPECT_EQ(DiagnosticValue(Sub::kReturnSlaveNakCount), 0);
+
+  Diagnostic(Sub::kClearCountersAndDiagnosticRegister);
+  EXPECT_EQ(diagnostics.Get(Counter::kBusMessage), 0);
+  EXPECT_EQ(diagnostics.GetEventCounter(), 1);  //  The clear itself
+}
+
+TEST_F(DiagnosticsFixture, CharacterOverrun) {
+  //  A write far larger than the frame buffer is dropped
+  std::vector<uint8_t> bytes{kSlaveAddress, 16, 0x00, 0x00, 0x00, 0x7b, 0xff};
+  bytes.resize(bytes.size() + 0xff + 2);
+  slave.ProcessBytes(ArrayView<const uint8_t>{bytes.size(), bytes.data()});
+  EXPECT_EQ(diagnostics.Get(Counter::kBusCharacterOverrun), 0);
+
+  //  and collected with the next frame
+  EXPECT_EQ(DiagnosticValue(Sub::kReturnBusCharacterOverrunCount), 1);
+  const auto &log = diagnostics.GetEventLog();
+  std::array<uint8_t, 4> events{};
+  ASSERT_EQ(log.Copy(events.data(), events.size()), 2u);
+  EXPECT_EQ(events[0], Event::kSend);
+  EXPECT_EQ(events[1], Event::kReceive | Event::kReceiveCharacterOverrun);
+
+  Diagnostic(Sub::kClearOverrunCounterAndFlag);
+  EXPECT_EQ(diagnostics.Get(Counter::kBusCharacterOverrun), 0);
+}
+
+TEST_F(DiagnosticsFixture, ListenOnlyAndRestart) {
+  EXPECT_TRUE(Diagnostic(Sub::kForceListenOnlyMode).empty());
+  EXPECT_TRUE(diagnostics.IsListenOnly());
+  EXPECT_TRUE(ReadHolding().empty());
+  EXPECT_EQ(diagnostics.Get(Counter::kSlaveNoResponse), 2);
+
+  //  No response leaving listen only mode, answered after
+  EXPECT_TRUE(Diagnostic(Sub::kRestartCommunicationsOption).empty());
+  EXPECT_FALSE(diagnostics.IsListenOnly());
+  EXPECT_EQ(ReadHolding().size(), 5u);
+  EXPECT_EQ(Diagnostic(Sub::kRestartCommunicationsOption, 0xff00),
+            (std::vector<uint8_t>{kSlaveAddress, 8, 0x00, 0x01, 0xff, 0x00}));
+  std::array<uint8_t, 8> events{};
+  EXPECT_EQ(diagnostics.GetEventLog().Copy(events.data(), events.size()), 2u);
+  EXPECT_EQ(events[0], Event::kSend);
+  EXPECT_EQ(events[1], Event::kCommunicationRestart);
+
+  EXPECT_EQ(Diagnostic(Sub::kRestartCommunicationsOption, 0x1234),
+            (std::vector<uint8_t>{kSlaveAddress, 0x88, 0x03}));
+}
+
+TEST_F(DiagnosticsFixture, EventCounterAndLog) {
+  diagnostics.SetDiagnosticRegister(0x1234);
+  EXPECT_EQ(DiagnosticValue(Sub::kReturnDiagnosticRegister), 0x1234);
+  ReadHolding();
+  Send({kSlaveAddress, 3, 0x00, 0x20, 0x00, 0x01});
+
+  EXPECT_EQ(Send({kSlaveAddress, 11}),
+            (std::vector<uint8_t>{kSlaveAddress, 11, 0, 0, 0, 2}));
+  //  Fetching the counter does not count
+  const auto response = Send({kSlaveAddress, 12});
+  const std::vector<uint8_t> expected{
+      kSlaveAddress, 12, 15, 0, 0, 0, 2, 0, 5,
+      Event::kReceive,  //  function 12
+      Event::kSend,  //  function 11
+      Event::kReceive,
+      Event::kSend | Event::kSendReadException,
+      Event::kReceive,
+      Event::kSend,
+      Event::kReceive,
+      Event::kSend,
+      Event::kReceive};
+  EXPECT_EQ(response, expected);
+}
+
+TEST_F(DiagnosticsFixture, EventLogWraps) {
+  Modbus::CommEventLog<8> log;
+  for (uint8_t i = 0; i < 20; i++) {
+    log.Push(i);
+  }
+  EXPECT_EQ(log.GetCount(), 8u);
+  std::array<uint8_t, 8> events{};
+  ASSERT_EQ(log.Copy(events.data(), 3), 3u);
+  EXPECT_EQ(events[0], 19);
+  EXPECT_EQ(events[2], 17);
+  ASSERT_EQ(log.Copy(events.data(), events.size()), 8u);
+  EXPECT_EQ(events[7], 12);
+
+  //  Counters and log are read while the protocol thread writes
+  std::thread writer([this] {
+    for (int i = 0; i < 2000; i++) {
+      diagnostics.Count(Counter::kBusMessage);
+      diagnostics.LogEvent(static_cast<uint8_t>(i));
+    }
+  });
+  std::array<uint8_t, Modbus::CommDiagnostics::kEventLogSize> copy{};
+  for (int i = 0; i < 200; i++) {
+    const std::size_t count =
+        diagnostics.GetEventLog().Copy(copy.data(), copy.size());
+    for (std::size_t j = 1; j < count; j++) {
+      EXPECT_EQ(static_cast<uint8_t>(copy[j] + 1), copy[j - 1]);
+    }
+  }
+  writer.join();
+  EXPECT_EQ(diagnostics.Get(Counter::kBusMessage), 2000);
+}
+}  //  namespace ModbusTests
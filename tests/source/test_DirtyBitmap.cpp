@@ -0,0 +1,118 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        test_DirtyBitmap.cpp
+ * Description:
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <Modbus/DataStores/DirtyBitmap.h>
+#include <Modbus/DataStores/RegisterDataStore.h>
+#include <Modbus/RegisterControl.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "TestSlave.h"
+
+namespace ModbusTests {
+using Range = std::pair<std::size_t, std::size_t>;
+
+template <typename T>
+std::vector<Range> TakeRanges(T* bitmap) {
+  std::vector<Range> ranges;
+  bitmap->Take([&](std::size_t first, std::size_t count) {
+    ranges.emplace_back(first, count);
+  });
+  return ranges;
+}
+
+TEST(DirtyBitmap, RangesAreCoalesced) {
+  Modbus::DirtyBitmap<65536> bitmap;
+  EXPECT_FALSE(bitmap.Any());
+  bitmap.Mark(3);
+  bitmap.Mark(60, 10);  //  Across a word
+  bitmap.Mark(70, 58);  //  Joins the last and fills the next word
+  bitmap.Mark(4096, 1);
+  bitmap.Mark(65535);
+  EXPECT_TRUE(bitmap.Any());
+  EXPECT_TRUE(bitmap.IsMarked(127));
+  EXPECT_FALSE(bitmap.IsMarked(128));
+
+  EXPECT_EQ(TakeRanges(&bitmap),
+            (std::vector<Range>{{3, 1}, {60, 68}, {4096, 1}, {65535, 1}}));
+  EXPECT_FALSE(bitmap.Any());
+  EXPECT_FALSE(bitmap.IsMarked(3));
+  EXPECT_TRUE(TakeRanges(&bitmap).empty());
+
+  bitmap.Mark(0, 65536);
+  EXPECT_EQ(TakeRanges(&bitmap), (std::vector<Range>{{0, 65536}}));
+}
+
+TEST(DirtyBitmap, NoMarkIsLostWhileTaking) {
+  Modbus::DirtyBitmap<4096> bitmap;
+  static const constexpr std::size_t kMarks = 200000;
+  std::atomic<bool> finished{false};
+  std::thread writer([&] {
+    for (std::size_t i = 0; i < kMarks; i++) {
+      bitmap.Mark((i * 67) % bitmap.size());
+    }
+    finished.store(true);
+  });
+  std::vector<uint32_t> seen(bitmap.size());
+  const auto tally = [&](std::size_t first, std::size_t count) {
+    for (std::size_t i = first; i < first + count; i++) {
+      seen[i]++;
+    }
+  };
+  while (!finished.load()) {
+    bitmap.Take(tally);
+  }
+  writer.join();
+  bitmap.Take(tally);
+  //  Every bit was marked, each is taken at least once
+  for (std::size_t i = 0; i < seen.size(); i++) {
+    EXPECT_NE(seen[i], 0u) << i;
+  }
+  EXPECT_FALSE(bitmap.Any());
+}
+
+TEST(UpdatingRegisterDataStore, WritesAreFlagged) {
+  using Store = Modbus::UpdatingRegisterDataStore<256>;
+  using Controller = Modbus::HoldingRegisterController<Store>;
+  std::array<uint16_t, 256> registers{};
+  Store store{registers.data(), registers.size()};
+  Controller controller{&store};
+  TestSlave<Controller> slave{controller};
+
+  //  The last register is flagged and seen
+  Modbus::WriteSingleHoldingRegisterCommand::FillFrame(255, 7, &slave.frame);
+  ASSERT_EQ(slave.Run(), Modbus::Exception::kAck);
+  EXPECT_TRUE(store.flag_set(255));
+  EXPECT_TRUE(store.new_data_available());
+  store.clear_new_data_flags();
+  EXPECT_FALSE(store.new_data_available());
+  EXPECT_FALSE(store.flag_set(255));
+
+  ASSERT_EQ(slave.WriteRegisters(10, {1, 2, 3, 4}), Modbus::Exception::kAck);
+  Modbus::WriteSingleHoldingRegisterCommand::FillFrame(14, 5, &slave.frame);
+  ASSERT_EQ(slave.Run(), Modbus::Exception::kAck);
+
+  std::vector<Range> ranges;
+  EXPECT_EQ(store.take_new_data([&](std::size_t address, std::size_t count) {
+    ranges.emplace_back(address, count);
+  }),
+            5u);
+  EXPECT_EQ(ranges, (std::vector<Range>{{10, 5}}));
+  EXPECT_EQ(registers[14], 5);
+  EXPECT_FALSE(store.new_data_available());
+}
+}  //  namespace ModbusTests
@@ -0,0 +1,165 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        test_FifoQueue.cpp
+ * Description:
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <Modbus/DataStores/FifoDataStore.h>
+#include <Modbus/FifoControl.h>
+#include <Modbus/Modbus.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <thread>
+
+#include "TestSlave.h"
+
+namespace ModbusTests {
+using Fifo = Modbus::FifoDataStore<64>;
+
+TEST(FifoDataStore, PopsInOrderAcrossWrap) {
+  Fifo fifo;
+  std::array<uint16_t, 40> values{};
+  uint16_t next = 0;
+  uint16_t expected = 0;
+  for (int round = 0; round < 10; round++) {
+    for (std::size_t i = 0; i < values.size(); i++) {
+      EXPECT_TRUE(fifo.insert(next++));
+    }
+    EXPECT_EQ(fifo.GetCount(), values.size());
+    EXPECT_EQ(fifo.pop(values.data(), values.size()), values.size());
+    for (auto value : values) {
+      EXPECT_EQ(value, expected++);
+    }
+  }
+  EXPECT_TRUE(fifo.isEmpty());
+  EXPECT_EQ(fifo.pop(values.data(), values.size()), 0);
+  EXPECT_EQ(fifo.GetOverflowCount(), 0);
+}
+
+TEST(FifoDataStore, CountsOverflows) {
+  Fifo fifo;
+  for (uint16_t i = 0; i < Fifo::size(); i++) {
+    EXPECT_TRUE(fifo.insert(i));
+  }
+  EXPECT_FALSE(fifo.insert(0xffff));
+  const std::array<uint16_t, 5> block{1, 2, 3, 4, 5};
+  EXPECT_EQ(fifo.insert(block.data(), block.size()), 0);
+  EXPECT_EQ(fifo.GetOverflowCount(), 6);
+
+  //  The oldest values are kept
+  uint16_t value = 0;
+  EXPECT_EQ(fifo.pop(&value, 1), 1);
+  EXPECT_EQ(value, 0);
+  EXPECT_EQ(fifo.insert(block.data(), block.size()), 1);
+  EXPECT_EQ(fifo.GetOverflowCount(), 10);
+  fifo.ResetOverflowCount();
+  EXPECT_EQ(fifo.GetOverflowCount(), 0);
+}
+
+/*
+ * Every value pushed by the producer thread is either popped in order by the
+ * consumer or counted as an overflow
+ * */
+TEST(FifoDataStore, SingleProducerSingleConsumer) {
+  Fifo fifo;
+  static const constexpr uint32_t kPushes = 200000;
+  std::thread producer{[&fifo]() {
+    for (uint32_t i = 0; i < kPushes; i++) {
+      fifo.insert(static_cast<uint16_t>(i));
+    }
+  }};
+  std::array<uint16_t, 31> values{};
+  uint32_t popped = 0;
+  uint16_t last = 0;
+  bool first = true;
+  bool in_order = true;
+  auto drain = [&]() {
+    const std::size_t count = fifo.pop(values.data(), values.size());
+    for (std::size_t i = 0; i < count; i++) {
+      //  Dropped values leave gaps but the sequence never goes backwards
+      const uint16_t step = static_cast<uint16_t>(values[i] - last);
+      if (!first && (step == 0 || step > 0x8000)) {
+        in_order = false;
+      }
+      first = false;
+      last = values[i];
+    }
+    popped += static_cast<uint32_t>(count);
+  };
+  while (popped + fifo.GetOverflowCount() < kPushes) {
+    drain();
+  }
+  producer.join();
+  drain();
+  EXPECT_TRUE(in_order);
+  EXPECT_TRUE(fifo.isEmpty());
+  EXPECT_EQ(popped + fifo.GetOverflowCount(), kPushes);
+}
+
+struct FifoQueueFixture : public ::testing::Test {
+  static const constexpr uint16_t kPointerAddress = 0x04de;
+  using Controller = Modbus::FifoQueueController<Fifo>;
+  using Command = Modbus::ReadFifoQueueCommand;
+
+  Fifo fifo;
+  Controller controller{&fifo, kPointerAddress};
+  TestSlave<Controller> slave{controller};
+  Modbus::Frame &frame = slave.frame;
+};
+
+TEST_F(FifoQueueFixture, ReadFifoQueue) {
+  //  Example from the specification
+  fifo.insert(0x01b8);
+  fifo.insert(0x1284);
+  Command::FillFrame(kPointerAddress, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kAck);
+  EXPECT_EQ(slave.RunCommand(frame), 0);
+  const auto &response = slave.GetResponse();
+  const std::array<uint8_t, 8> expected{0, 6, 0, 2, 0x01, 0xb8, 0x12, 0x84};
+  ASSERT_EQ(response.GetLength(), Modbus::Command::kHeaderLength +
+                                      expected.size() +
+                                      Modbus::Command::kFooterLength);
+  for (std::size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(response[Modbus::Command::kHeaderLength + i], expected[i]);
+  }
+  EXPECT_TRUE(fifo.isEmpty());
+}
+
+TEST_F(FifoQueueFixture, DrainsAtMostOneFramePerRequest) {
+  for (uint16_t i = 0; i < 40; i++) {
+    fifo.insert(i);
+  }
+  Command::FillFrame(kPointerAddress, &frame);
+  EXPECT_EQ(slave.RunCommand(frame), 0);
+  EXPECT_EQ(slave.GetResponseWord(Command::ResponsePacket::kByteCount), 64);
+  EXPECT_EQ(slave.GetResponseWord(Command::ResponsePacket::kFifoCount),
+            Command::kMaxCount);
+  EXPECT_EQ(
+      slave.GetResponseWord(Command::ResponsePacket::kValueStart + 2 * 30), 30);
+  EXPECT_EQ(fifo.GetCount(), 9);
+
+  EXPECT_EQ(slave.RunCommand(frame), 0);
+  EXPECT_EQ(slave.GetResponseWord(Command::ResponsePacket::kFifoCount), 9);
+  EXPECT_EQ(slave.GetResponseWord(Command::ResponsePacket::kValueStart), 31);
+
+  //  An empty queue answers with a count of zero
+  EXPECT_EQ(slave.RunCommand(frame), 0);
+  EXPECT_EQ(slave.GetResponseWord(Command::ResponsePacket::kByteCount), 2);
+  EXPECT_EQ(slave.GetResponseWord(Command::ResponsePacket::kFifoCount), 0);
+}
+
+TEST_F(FifoQueueFixture, WrongPointerAddress) {
+  fifo.insert(1);
+  Command::FillFrame(kPointerAddress + 1, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame),
+            Modbus::Exception::kIllegalDataAddress);
+  EXPECT_EQ(fifo.GetCount(), 1);
+}
+}  //  namespace ModbusTests
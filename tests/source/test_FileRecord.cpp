@@ -0,0 +1,196 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        test_FileRecord.cpp
+ * Description:
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <ArrayView/ArrayView.h>
+#include <Modbus/DataStores/MmapFileStore.h>
+#include <Modbus/FileRecordControl.h>
+#include <Modbus/Modbus.h>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "TestSlave.h"
+
+namespace ModbusTests {
+using FileStore = Modbus::MmapFileStore<4>;
+
+struct FileRecordFixture : public ::testing::Test {
+  using Controller = Modbus::FileRecordController<FileStore>;
+
+  std::string path_a =
+      ::testing::TempDir() + "modbus_file_a_" + std::to_string(getpid());
+  std::string path_b =
+      ::testing::TempDir() + "modbus_file_b_" + std::to_string(getpid());
+  FileStore store;
+  Controller controller{&store};
+  TestSlave<Controller> slave{controller};
+  Modbus::Frame &frame = slave.frame;
+
+  void SetUp(void) override {
+    unlink(path_a.c_str());
+    unlink(path_b.c_str());
+  }
+  void TearDown(void) override {
+    store.Close(3);
+    store.Close(4);
+    unlink(path_a.c_str());
+    unlink(path_b.c_str());
+  }
+
+  void WriteRegister(uint16_t file, uint16_t record, uint16_t value) {
+    const std::array<uint8_t, 2> data{Utilities::GetByte(value, 1),
+                                      Utilities::GetByte(value, 0)};
+    store.WriteRecords(file, record, 1, data.data());
+  }
+
+  void ExpectResponseData(const std::vector<uint8_t> &expected) {
+    const auto &response = slave.GetResponse();
+    ASSERT_EQ(response.GetLength(), Modbus::Command::kHeaderLength +
+                                        expected.size() +
+                                        Modbus::Command::kFooterLength);
+    for (std::size_t i = 0; i < expected.size(); i++) {
+      EXPECT_EQ(response[Modbus::Command::kHeaderLength + i], expected[i])
+          << "byte " << i;
+    }
+  }
+};
+
+TEST_F(FileRecordFixture, FilesSpanRecordLimit) {
+  //  25000 records are served as files 3, 4 and 5
+  ASSERT_EQ(store.Open(3, path_a.c_str(), 25000), 0);
+  EXPECT_TRUE(store.RecordsValid(3, 0, 10000));
+  EXPECT_TRUE(store.RecordsValid(5, 4999, 1));
+  EXPECT_FALSE(store.RecordsValid(5, 5000, 1));
+  EXPECT_FALSE(store.RecordsValid(4, 9999, 2));
+  EXPECT_FALSE(store.RecordsValid(6, 0, 1));
+  EXPECT_FALSE(store.RecordsValid(2, 0, 1));
+  EXPECT_FALSE(store.RecordsValid(3, 0, 0));
+  EXPECT_EQ(store.Open(5, path_b.c_str(), 10), -EEXIST);
+
+  WriteRegister(4, 0, 0x1234);
+  EXPECT_EQ(store.GetRecords(3, 0)[20000], 0x12);
+  EXPECT_EQ(store.GetRecords(3, 0)[20001], 0x34);
+}
+
+TEST_F(FileRecordFixture, WritesReachTheFile) {
+  ASSERT_EQ(store.Open(4, path_a.c_str(), 100), 0);
+  WriteRegister(4, 7, 0x06af);
+  WriteRegister(4, 90, 0x04be);
+  EXPECT_FALSE(store.IsFlushed());
+  EXPECT_EQ(store.Sync(), 0);
+  EXPECT_FALSE(store.IsFlushed());
+  EXPECT_EQ(store.Flush(), 0);
+  EXPECT_TRUE(store.IsFlushed());
+  EXPECT_EQ(store.GetSyncError(), 0);
+
+  const int fd = open(path_a.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  std::array<uint8_t, 2> data{};
+  EXPECT_EQ(pread(fd, data.data(), data.size(), 14), 2);
+  EXPECT_EQ(data[0], 0x06);
+  EXPECT_EQ(data[1], 0xaf);
+  EXPECT_EQ(pread(fd, data.data(), data.size(), 180), 2);
+  EXPECT_EQ(data[0], 0x04);
+  EXPECT_EQ(data[1], 0xbe);
+  close(fd);
+
+  //  The contents are kept when the file is opened again
+  store.Close(4);
+  ASSERT_EQ(store.Open(4, path_a.c_str(), 200), 0);
+  EXPECT_EQ(store.GetRecords(4, 90)[0], 0x04);
+  EXPECT_EQ(store.GetRecords(4, 150)[0], 0);
+}
+
+TEST_F(FileRecordFixture, ReadFileRecord) {
+  //  Example from the specification
+  ASSERT_EQ(store.Open(3, path_a.c_str(), 20), 0);
+  ASSERT_EQ(store.Open(4, path_b.c_str(), 20), 0);
+  WriteRegister(4, 1, 0x0dfe);
+  WriteRegister(4, 2, 0x0020);
+  WriteRegister(3, 9, 0x33cd);
+  WriteRegister(3, 10, 0x0040);
+  const std::array<Modbus::FileRecord, 2> records{
+      Modbus::FileRecord{4, 1, 2}, Modbus::FileRecord{3, 9, 2}};
+  Modbus::ReadFileRecordCommand::FillFrame(
+      ArrayView<const Modbus::FileRecord>{records.size(), records.data()},
+      &frame);
+  EXPECT_EQ(frame.data_array[0], 14);
+  EXPECT_EQ(slave.Run(), Modbus::Exception::kAck);
+  ExpectResponseData({0x0c, 0x05, 0x06, 0x0d, 0xfe, 0x00, 0x20, 0x05, 0x06,
+                      0x33, 0xcd, 0x00, 0x40});
+}
+
+TEST_F(FileRecordFixture, WriteFileRecord) {
+  //  Example from the specification plus a second sub-request
+  ASSERT_EQ(store.Open(3, path_a.c_str(), 20), 0);
+  ASSERT_EQ(store.Open(4, path_b.c_str(), 20), 0);
+  const std::array<Modbus::FileRecord, 2> records{
+      Modbus::FileRecord{4, 7, 3}, Modbus::FileRecord{3, 0, 1}};
+  const std::array<uint16_t, 4> values{0x06af, 0x04be, 0x100d, 0xbeef};
+  Modbus::WriteFileRecordCommand::FillFrame(
+      ArrayView<const Modbus::FileRecord>{records.size(), records.data()},
+      ArrayView<const uint16_t>{values.size(), values.data()}, &frame);
+  EXPECT_EQ(slave.Run(), Modbus::Exception::kAck);
+  ExpectResponseData({0x16, 0x06, 0x00, 0x04, 0x00, 0x07, 0x00, 0x03,
+                      0x06, 0xaf, 0x04, 0xbe, 0x10, 0x0d, 0x06, 0x00,
+                      0x03, 0x00, 0x00, 0x00, 0x01, 0xbe, 0xef});
+  const std::array<uint8_t, 6> expected{0x06, 0xaf, 0x04, 0xbe, 0x10, 0x0d};
+  for (std::size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(store.GetRecords(4, 7)[i], expected[i]);
+  }
+  EXPECT_EQ(store.GetRecords(3, 0)[0], 0xbe);
+  EXPECT_EQ(store.GetSyncError(), 0);
+  //  The response does not wait for the disk, the owner flushes later
+  EXPECT_FALSE(store.IsFlushed());
+  EXPECT_EQ(store.Flush(), 0);
+  EXPECT_TRUE(store.IsFlushed());
+}
+
+TEST_F(FileRecordFixture, InvalidRequests) {
+  ASSERT_EQ(store.Open(4, path_a.c_str(), 20), 0);
+  std::array<Modbus::FileRecord, 1> records{Modbus::FileRecord{4, 18, 3}};
+  const ArrayView<const Modbus::FileRecord> view{records.size(),
+                                                 records.data()};
+  Modbus::ReadFileRecordCommand::FillFrame(view, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame),
+            Modbus::Exception::kIllegalDataAddress);
+
+  records[0] = Modbus::FileRecord{5, 0, 1};
+  Modbus::ReadFileRecordCommand::FillFrame(view, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame),
+            Modbus::Exception::kIllegalDataAddress);
+
+  records[0] = Modbus::FileRecord{4, 0, 1};
+  Modbus::ReadFileRecordCommand::FillFrame(view, &frame);
+  frame.data_array[Modbus::FileRecordCommand::CommandPacket::kSubRequestStart] =
+      7;
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kIllegalDataValue);
+
+  Modbus::ReadFileRecordCommand::FillFrame(view, &frame);
+  frame.data_array[Modbus::FileRecordCommand::CommandPacket::kByteCount] = 8;
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kIllegalDataValue);
+
+  //  Record data shorter than the record length
+  const std::array<uint16_t, 1> values{1};
+  Modbus::WriteFileRecordCommand::FillFrame(
+      view, ArrayView<const uint16_t>{values.size(), values.data()}, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kAck);
+  frame.data_array[Modbus::FileRecordCommand::CommandPacket::kSubRequestStart +
+                   Modbus::FileRecordCommand::SubRequest::kRecordLength + 1] =
+      2;
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kIllegalDataValue);
+}
+}  //  namespace ModbusTests
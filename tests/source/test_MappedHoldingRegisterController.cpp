@@ -13,6 +13,7 @@
 #include <Modbus/RegisterControl.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <array>
 #include <cstdio>
 #include <iostream>
@@ -54,6 +55,21 @@ TEST_F(MappedHoldingRegisterControllerFixture,
   }
 }
 
+TEST_F(MappedHoldingRegisterControllerFixture, MaskWriteRegisterSingleField) {
+  const auto &functions = HoldingRegisterController::kFunctions;
+  EXPECT_NE(std::find(functions.begin(), functions.end(),
+                      Modbus::Function::kMaskWriteRegister),
+            functions.end());
+
+  //  Every field of this map is wider than one register
+  std::array<uint8_t, 64> frame_data{};
+  Modbus::Frame frame{1, Modbus::Function::kNone, 0,
+                      ArrayView<uint8_t>{frame_data.size(), frame_data.data()}};
+  Modbus::MaskWriteRegisterCommand::FillFrame(map.offsets_[2], 0xff, 0, &frame);
+  EXPECT_EQ(controller.ValidateFrame(frame),
+            Modbus::Exception::kIllegalDataAddress);
+}
+
 #if 0
   bool WriteLocationValid(std::size_t address, std::size_t count) {
   bool ReadLocationValid(std::size_t address, std::size_t count) {
@@ -106,4 +106,43 @@ TEST(DataMapTest, Serialize) {
   //  EXPECT_EQ(map.get_int645(), setting);
 }
 
+/*
+ * A read covering several fields matches the fields read one at a time
+ */
+TEST(MappedRegisterDataStore, MultipleFieldsReadAndWrite) {
+  HoldingRegisters data_store;
+  HoldingRegistersWrapper map{&data_store};
+  Modbus::MappedRegisterDataStore<HoldingRegistersWrapper> store{&map};
+  map.set_int32(0x01020304);
+  map.set_int641(0x1122334455667788);
+
+  const std::size_t address = HoldingRegistersWrapper::offsets_[3];  //  int32
+  const std::size_t count =
+      HoldingRegistersWrapper::end_points_[4] - address + 1;
+  ASSERT_TRUE(store.ReadLocationValid(address, count));
+  std::array<uint8_t, 64> data{};
+  ArrayView<uint8_t> data_view{count * sizeof(uint16_t), data.data()};
+  store.GetRegisters(address, count, &data_view);
+
+  std::array<uint8_t, 8> field{};
+  ArrayView<uint8_t> field_view{4, field.data()};
+  store.GetRegisters(address, 2, &field_view);
+  for (std::size_t i = 0; i < 4; i++) {
+    EXPECT_EQ(data[i], field[i]);
+  }
+  ArrayView<uint8_t> wide_field_view{8, field.data()};
+  store.GetRegisters(address + 2, 4, &wide_field_view);
+  for (std::size_t i = 0; i < 8; i++) {
+    EXPECT_EQ(data[4 + i], field[i]);
+  }
+
+  map.set_int32(0);
+  map.set_int641(0);
+  store.SetRegisters(address, count,
+                     ArrayView<const uint8_t>{count * sizeof(uint16_t),
+                                              data.data()});
+  EXPECT_EQ(map.get_int32(), 0x01020304u);
+  EXPECT_EQ(map.get_int641(), 0x1122334455667788u);
+}
+
 }  // namespace TestsMappedRegisterDataStore
@@ -35,3 +35,40 @@ TEST(Modbus,
     EXPECT_NE(address, AddressSpace::kUnmapped);
   }
 }
+
+TEST(Modbus, FunctionTable_ValidFunctionsMatchList) {
+  for (std::size_t code = 0; code < kFunctionTable.size(); code++) {
+    bool listed = false;
+    for (auto pt : GetValidFunctions()) {
+      listed |= static_cast<uint8_t>(pt) == code;
+    }
+    EXPECT_EQ(FunctionCodeIsValid(static_cast<uint8_t>(code)), listed);
+  }
+}
+
+TEST(Modbus, FunctionIsSupported_MatchesSupportedList) {
+  for (auto pt : GetValidFunctions()) {
+    bool listed = false;
+    for (auto supported : GetSupportedFunctions()) {
+      listed |= supported == pt;
+    }
+    EXPECT_EQ(FunctionIsSupported(pt), listed);
+  }
+  EXPECT_FALSE(FunctionIsSupported(Modbus::Function::kNone));
+}
+
+TEST(Modbus, GetErrorFunction_AddsErrorBit) {
+  EXPECT_EQ(GetErrorFunction(Modbus::Function::kReadMultipleHoldingRegisters),
+            Modbus::Function::kErrorReadMultipleHoldingRegisters);
+  EXPECT_EQ(GetErrorFunction(Modbus::Function::kReadDeviceIdentification),
+            Modbus::Function::kErrorReadDeviceIdentification);
+}
+
+TEST(Modbus, FunctionTable_IsConstexpr) {
+  static_assert(GetFunction(0x03) ==
+                Modbus::Function::kReadMultipleHoldingRegisters);
+  static_assert(GetFunctionDescriptor(Modbus::Function::kReadCoils)
+                    .meta_length == 4);
+  static_assert(GetFunctionDescriptor(Modbus::Function::kReportSlaveId)
+                    .meta_length == 0);
+}
@@ -0,0 +1,162 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        test_NotifyingRegisterDataStore.cpp
+ * Description:
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <ArrayView/ArrayView.h>
+#include <Modbus/DataStores/NotifyingRegisterDataStore.h>
+#include <Modbus/ModbusTcp/ModbusTcpSlave.h>
+#include <Modbus/RegisterControl.h>
+#include <gtest/gtest.h>
+#include <poll.h>
+
+#include <array>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "TestSlave.h"
+
+namespace ModbusTests {
+using Range = std::pair<std::size_t, std::size_t>;
+
+struct NotifyingFixture : public ::testing::Test {
+  using Store = Modbus::NotifyingRegisterDataStore<4, 4>;
+  using Controller = Modbus::HoldingRegisterController<Store>;
+  using Slave = TestSlave<Controller>;
+
+  std::array<uint16_t, 1024> registers{};
+  Store store{registers.data(), registers.size()};
+  Controller controller{&store};
+  Slave slave{controller};
+
+  void Write(const uint16_t address, const std::size_t count) {
+    ASSERT_EQ(slave.WriteRegisters(address,
+                                   std::vector<uint16_t>(count, 0x1234)),
+              Modbus::Exception::kAck);
+  }
+
+  bool Readable(const int id, const int timeout_ms = 0) {
+    pollfd fd{store.GetFileDescriptor(id), POLLIN, 0};
+    return poll(&fd, 1, timeout_ms) == 1;
+  }
+
+  std::vector<Range> Take(const int id) {
+    std::vector<Range> ranges;
+    store.TakeWrites(id, [&](std::size_t address, std::size_t count) {
+      ranges.emplace_back(address, count);
+    });
+    return ranges;
+  }
+};
+
+TEST_F(NotifyingFixture, WritesWakeOverlappingSubscribers) {
+  const int low = store.Subscribe(0, 100);
+  const int high = store.Subscribe(500, 10);
+  ASSERT_GE(low, 0);
+  ASSERT_GE(high, 0);
+  EXPECT_EQ(store.Subscribe(1020, 10), -EINVAL);
+
+  Write(90, 20);
+  Modbus::WriteSingleHoldingRegisterCommand::FillFrame(3, 7, &slave.frame);
+  ASSERT_EQ(slave.Run(), Modbus::Exception::kAck);
+  //  Nothing is signalled until the response is out
+  EXPECT_FALSE(Readable(low));
+  store.Publish();
+  EXPECT_TRUE(Readable(low));
+  EXPECT_FALSE(Readable(high));
+
+  EXPECT_EQ(Take(low), (std::vector<Range>{{90, 10}, {3, 1}}));
+  EXPECT_FALSE(Readable(low));
+  EXPECT_TRUE(Take(low).empty());
+
+  Write(505, 1);
+  store.Publish();
+  EXPECT_TRUE(Readable(high));
+  EXPECT_EQ(Take(high), (std::vector<Range>{{505, 1}}));
+}
+
+TEST_F(NotifyingFixture, SlavePublishesOnceResponseSent) {
+  const int id = store.Subscribe(0, 100);
+  ASSERT_GE(id, 0);
+  Write(10, 2);
+  EXPECT_FALSE(Readable(id));
+  slave.ResponseSent();
+  EXPECT_TRUE(Readable(id));
+  EXPECT_EQ(Take(id), (std::vector<Range>{{10, 2}}));
+
+  //  The same through a TCP slave, function 6 to register 5
+  Modbus::ProtocolTcpSlave<Controller> tcp_slave{Slave::kSlaveAddress,
+                                                 controller};
+  Modbus::TcpSlaveSession session;
+  const std::array<uint8_t, 12> request{
+      0, 1, 0, 0, 0, 6, Slave::kSlaveAddress, 6, 0, 5, 0, 7};
+  session.ProcessBytes(
+      ArrayView<const uint8_t>{request.size(), request.data()});
+  ASSERT_TRUE(session.PacketReceived());
+  tcp_slave.ProcessMessage(&session);
+  ASSERT_TRUE(session.GetResponseValid());
+  EXPECT_FALSE(Readable(id));
+  tcp_slave.ResponseSent();
+  EXPECT_TRUE(Readable(id));
+  EXPECT_EQ(Take(id), (std::vector<Range>{{5, 1}}));
+}
+
+TEST_F(NotifyingFixture, OneWakePerBatchAndOverflow) {
+  const int id = store.Subscribe(0, 64);
+  ASSERT_GE(id, 0);
+  Write(0, 1);
+  store.Publish();
+  Write(1, 1);
+  store.Publish();  //  Not drained yet, no second wake
+  uint64_t wakes = 0;
+  ASSERT_EQ(read(store.GetFileDescriptor(id), &wakes, sizeof(wakes)),
+            static_cast<ssize_t>(sizeof(wakes)));
+  EXPECT_EQ(wakes, 1u);
+  EXPECT_EQ(Take(id), (std::vector<Range>{{0, 1}, {1, 1}}));
+
+  for (uint16_t i = 0; i < 6; i++) {
+    Write(i, 1);
+  }
+  store.Publish();
+  EXPECT_EQ(Take(id), (std::vector<Range>{{0, 64}}));
+  EXPECT_TRUE(Take(id).empty());
+}
+
+//  The queue never fills so every write is delivered, a lost wake would
+//  leave the consumer waiting
+TEST(NotifyingRegisterDataStore, ConsumerThreadSeesEveryWrite) {
+  static const constexpr std::size_t kWrites = 2000;
+  std::array<uint16_t, 256> registers{};
+  Modbus::NotifyingRegisterDataStore<1, 2048> store{registers.data(),
+                                                    registers.size()};
+  const int id = store.Subscribe(100, 50);
+  ASSERT_GE(id, 0);
+  std::size_t total = 0;
+  std::thread consumer([&] {
+    pollfd fd{store.GetFileDescriptor(id), POLLIN, 0};
+    while (total < kWrites && poll(&fd, 1, 1000) == 1) {
+      store.TakeWrites(id, [&](std::size_t address, std::size_t count) {
+        EXPECT_EQ(address, 100 + total % 50);
+        EXPECT_EQ(count, 1u);
+        total++;
+      });
+    }
+  });
+  const std::array<uint8_t, 2> data{};
+  for (std::size_t i = 0; i < kWrites; i++) {
+    store.set_registers_callback(
+        100 + i % 50, 1, ArrayView<const uint8_t>{data.size(), data.data()});
+    store.Publish();
+  }
+  consumer.join();
+  EXPECT_EQ(total, kWrites);
+}
+}  //  namespace ModbusTests
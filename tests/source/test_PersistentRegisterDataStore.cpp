@@ -0,0 +1,158 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        test_PersistentRegisterDataStore.cpp
+ * Description:
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <Modbus/DataStores/PersistentRegisterDataStore.h>
+#include <Modbus/RegisterControl.h>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TestSlave.h"
+
+namespace ModbusTests {
+using Modbus::PersistentRegisterDataStore;
+
+struct PersistentFixture : public ::testing::Test {
+  static const constexpr std::size_t kRegisterCount = 100;
+  using Controller =
+      Modbus::HoldingRegisterController<PersistentRegisterDataStore>;
+
+  std::string path =
+      ::testing::TempDir() + "modbus_persistent_" + std::to_string(getpid());
+
+  void SetUp(void) override { unlink(path.c_str()); }
+  void TearDown(void) override { unlink(path.c_str()); }
+
+  //  Function 16 through a slave serving the store
+  void Write(PersistentRegisterDataStore *store, const uint16_t address,
+             const std::vector<uint16_t> &values) {
+    Controller controller{store};
+    TestSlave<Controller> slave{controller};
+    ASSERT_EQ(slave.WriteRegisters(address, values), Modbus::Exception::kAck);
+  }
+
+  //  Flips a byte of the registers saved in slot, 0 or 1
+  void Corrupt(const std::size_t slot) {
+    const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    const int fd = open(path.c_str(), O_RDWR);
+    ASSERT_GE(fd, 0);
+    const off_t offset = static_cast<off_t>(page + slot * page + 64 + 3);
+    uint8_t byte = 0;
+    ASSERT_EQ(pread(fd, &byte, 1, offset), 1);
+    byte ^= 0x40;
+    ASSERT_EQ(pwrite(fd, &byte, 1, offset), 1);
+    close(fd);
+  }
+};
+
+TEST_F(PersistentFixture, WarmRestart) {
+  {
+    std::array<uint16_t, kRegisterCount> registers{};
+    registers[7] = 77;  //  Default
+    PersistentRegisterDataStore store{registers.data(), registers.size()};
+    ASSERT_EQ(store.Open(path.c_str()), 0);
+    EXPECT_FALSE(store.IsRecovered());
+    EXPECT_EQ(store.Flush(), 0);  //  The defaults
+    EXPECT_EQ(store.GetSequence(), 1u);
+    Write(&store, 0, {1, 2, 3});
+    Write(&store, 98, {0xbeef, 0xcafe});
+    EXPECT_TRUE(store.IsDirty());
+    //  Two writes, one flush
+    EXPECT_EQ(store.Flush(), 0);
+    EXPECT_EQ(store.GetSequence(), 2u);
+    EXPECT_EQ(store.Flush(), 0);
+    EXPECT_EQ(store.GetSequence(), 2u);
+    Write(&store, 3, {4});
+  }  //  Saved on close
+
+  std::array<uint16_t, kRegisterCount> registers{};
+  PersistentRegisterDataStore store{registers.data(), registers.size()};
+  ASSERT_EQ(store.Open(path.c_str()), 0);
+  EXPECT_TRUE(store.IsRecovered());
+  EXPECT_EQ(store.GetSequence(), 3u);
+  EXPECT_EQ(registers[0], 1);
+  EXPECT_EQ(registers[3], 4);
+  EXPECT_EQ(registers[7], 77);
+  EXPECT_EQ(registers[99], 0xcafe);
+}
+
+TEST_F(PersistentFixture, TornSlotFallsBack) {
+  {
+    std::array<uint16_t, kRegisterCount> registers{};
+    PersistentRegisterDataStore store{registers.data(), registers.size()};
+    ASSERT_EQ(store.Open(path.c_str()), 0);
+    Write(&store, 0, {1});
+    ASSERT_EQ(store.Flush(), 0);  //  Slot 0
+    Write(&store, 0, {2});
+    ASSERT_EQ(store.Flush(), 0);  //  Slot 1
+  }
+  Corrupt(1);
+  {
+    std::array<uint16_t, kRegisterCount> registers{};
+    PersistentRegisterDataStore store{registers.data(), registers.size()};
+    ASSERT_EQ(store.Open(path.c_str()), 0);
+    EXPECT_TRUE(store.IsRecovered());
+    EXPECT_EQ(registers[0], 1);
+    //  The next flush overwrites the bad slot, not the good one
+    Write(&store, 0, {3});
+    ASSERT_EQ(store.Flush(), 0);
+  }
+  Corrupt(0);
+  std::array<uint16_t, kRegisterCount> registers{};
+  PersistentRegisterDataStore store{registers.data(), registers.size()};
+  ASSERT_EQ(store.Open(path.c_str()), 0);
+  EXPECT_EQ(registers[0], 3);
+}
+
+TEST_F(PersistentFixture, LayoutChangeStartsAfresh) {
+  {
+    std::array<uint16_t, kRegisterCount> registers{};
+    PersistentRegisterDataStore store{registers.data(), registers.size()};
+    ASSERT_EQ(store.Open(path.c_str()), 0);
+    Write(&store, 0, {5});
+  }
+  std::array<uint16_t, kRegisterCount + 1> registers{};
+  registers[0] = 9;
+  PersistentRegisterDataStore store{registers.data(), registers.size()};
+  ASSERT_EQ(store.Open(path.c_str()), 0);
+  EXPECT_FALSE(store.IsRecovered());
+  EXPECT_EQ(registers[0], 9);
+}
+
+TEST_F(PersistentFixture, BackgroundFlusher) {
+  std::array<uint16_t, kRegisterCount> registers{};
+  PersistentRegisterDataStore store{registers.data(), registers.size()};
+  ASSERT_EQ(store.Open(path.c_str()), 0);
+  store.StartFlusher(std::chrono::milliseconds{1});
+  for (uint16_t i = 1; i <= 200; i++) {
+    Write(&store, i % kRegisterCount, {i});
+  }
+  for (int i = 0; i < 1000 && store.IsDirty(); i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+  }
+  EXPECT_FALSE(store.IsDirty());
+  //  Batched, far fewer flushes than writes
+  EXPECT_LT(store.GetSequence(), 200u);
+  store.Close();
+
+  std::array<uint16_t, kRegisterCount> reloaded{};
+  PersistentRegisterDataStore reopened{reloaded.data(), reloaded.size()};
+  ASSERT_EQ(reopened.Open(path.c_str()), 0);
+  EXPECT_EQ(reloaded, registers);
+}
+}  //  namespace ModbusTests
@@ -0,0 +1,270 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        test_PollScheduler.cpp
+ * Description:
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <ArrayView/ArrayView.h>
+#include <Modbus/DataStores/RegisterDataStore.h>
+#include <Modbus/Modbus.h>
+#include <Modbus/ModbusRtu/ModbusRtuMaster.h>
+#include <Modbus/ModbusRtu/ModbusRtuSlave.h>
+#include <Modbus/ModbusRtu/PollScheduler.h>
+#include <Modbus/RegisterControl.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Crc.h"
+
+namespace ModbusTests {
+struct PollSchedulerFixture : public ::testing::Test {
+  static const constexpr uint8_t kSlaveAddress = 0x21;
+  static const constexpr std::size_t kRegisterCount = 512;
+  static const constexpr uint32_t kPeriod_us = 100000;
+
+  using HoldingController =
+      Modbus::HoldingRegisterController<Modbus::RegisterDataStore>;
+  using InputController =
+      Modbus::InputRegisterController<Modbus::RegisterDataStore>;
+  using Slave = Modbus::ProtocolRtuSlave<HoldingController, InputController>;
+  struct TestSlave : public Slave {
+    using Slave::Slave;
+    void ProcessBytes(const ArrayView<const uint8_t> &data) {
+      slave_.ProcessBytes(data);
+    }
+  };
+  using Scheduler = Modbus::PollScheduler<Modbus::RegisterDataStore, 32>;
+
+  std::array<uint16_t, kRegisterCount> slave_holding{};
+  Modbus::RegisterDataStore slave_holding_store{slave_holding.data(),
+                                                slave_holding.size()};
+  HoldingController holding_controller{&slave_holding_store};
+  std::array<uint16_t, kRegisterCount> slave_input{};
+  Modbus::RegisterDataStore slave_input_store{slave_input.data(),
+                                              slave_input.size()};
+  InputController input_controller{&slave_input_store};
+  TestSlave slave{&crc16, kSlaveAddress, holding_controller, input_controller};
+
+  std::array<uint16_t, kRegisterCount> local_holding{};
+  Modbus::RegisterDataStore local_holding_store{local_holding.data(),
+                                                local_holding.size()};
+  std::array<uint16_t, kRegisterCount> local_input{};
+  Modbus::RegisterDataStore local_input_store{local_input.data(),
+                                              local_input.size()};
+
+  Modbus::ProtocolRtuMaster master{&crc16,
+                                   Modbus::MasterTiming{0, 10000, 0}};
+  uint32_t now_us = 0;
+
+  static Modbus::PollRange Holding(const uint16_t address,
+                                   const uint16_t count,
+                                   const uint32_t period_us = kPeriod_us) {
+    return Modbus::PollRange{kSlaveAddress,
+                             Modbus::AddressSpace::kHoldingRegister, address,
+                             count, period_us};
+  }
+
+  /*
+   * Run the scheduler until nothing more is due, answering every request
+   * from the slave. Returns the address and count of each read.
+   * */
+  std::vector<std::pair<uint16_t, uint16_t>> Cycle(Scheduler *scheduler) {
+    std::vector<std::pair<uint16_t, uint16_t>> reads;
+    while (scheduler->Run(&master, now_us)) {
+      const auto &request = master.GetRequest();
+      reads.emplace_back(
+          Modbus::DataCommand::ReadAddressStart(request.data_array),
+          Modbus::ReadMultipleRegistersCommandBase::ReadRegisterCount(
+              request.data_array));
+      const auto tx = master.GetTxData();
+      master.RequestSent(now_us);
+      slave.Reset();
+      slave.ProcessBytes(tx);
+      slave.ProcessMessage();
+      const auto &response = slave.GetResponse();
+      master.ProcessBytes(
+          ArrayView<const uint8_t>{response.GetLength(), response.data()},
+          now_us);
+    }
+    return reads;
+  }
+};
+
+TEST_F(PollSchedulerFixture, AdjacentRangesAreMerged) {
+  Scheduler scheduler{};
+  for (uint16_t address = 0; address < 40; address += 4) {
+    ASSERT_TRUE(scheduler.AddRange(Holding(address, 4), &local_holding_store));
+  }
+  const auto reads = Cycle(&scheduler);
+  ASSERT_EQ(reads.size(), 1u);
+  EXPECT_EQ(reads[0].first, 0);
+  EXPECT_EQ(reads[0].second, 40);
+  EXPECT_EQ(scheduler.GetStatistics().requests, 1u);
+  EXPECT_EQ(scheduler.GetStatistics().completed, 1u);
+}
+
+TEST_F(PollSchedulerFixture, RangesAddedOutOfOrderAreSorted) {
+  Scheduler scheduler{};
+  ASSERT_TRUE(scheduler.AddRange(Holding(20, 2), &local_holding_store));
+  ASSERT_TRUE(scheduler.AddRange(Holding(10, 2), &local_holding_store));
+  ASSERT_TRUE(scheduler.AddRange(Holding(14, 2), &local_holding_store));
+  const auto reads = Cycle(&scheduler);
+  ASSERT_EQ(reads.size(), 1u);
+  EXPECT_EQ(reads[0].first, 10);
+  EXPECT_EQ(reads[0].second, 12);
+}
+
+TEST_F(PollSchedulerFixture, GapThresholdSplits) {
+  Scheduler scheduler{Scheduler::Settings{4, 125}};
+  ASSERT_TRUE(scheduler.AddRange(Holding(0, 2), &local_holding_store));
+  ASSERT_TRUE(scheduler.AddRange(Holding(6, 2), &local_holding_store));
+  ASSERT_TRUE(scheduler.AddRange(Holding(13, 2), &local_holding_store));
+  const auto reads = Cycle(&scheduler);
+  ASSERT_EQ(reads.size(), 2u);
+  EXPECT_EQ(reads[0], std::make_pair(uint16_t{0}, uint16_t{8}));
+  EXPECT_EQ(reads[1], std::make_pair(uint16_t{13}, uint16_t{2}));
+}
+
+TEST_F(PollSchedulerFixture, ReadsStayWithinRegisterLimit) {
+  Scheduler scheduler{};
+  for (uint16_t address = 0; address < 300; address += 10) {
+    ASSERT_TRUE(
+        scheduler.AddRange(Holding(address, 10), &local_holding_store));
+  }
+  const auto reads = Cycle(&scheduler);
+  ASSERT_EQ(reads.size(), 3u);
+  std::size_t total = 0;
+  for (const auto &read : reads) {
+    EXPECT_LE(read.second,
+              Modbus::ReadMultipleRegistersCommandBase::kMaxRegisterCount);
+    total += read.second;
+  }
+  EXPECT_EQ(total, 300u);
+}
+
+TEST_F(PollSchedulerFixture, SettingsAreHeldToRegisterLimit) {
+  Scheduler scheduler{Scheduler::Settings{300, 200}};
+  EXPECT_EQ(scheduler.GetSettings().max_registers,
+            Modbus::ReadMultipleRegistersCommandBase::kMaxRegisterCount);
+  EXPECT_EQ(scheduler.GetSettings().gap_threshold,
+            Modbus::ReadMultipleRegistersCommandBase::kMaxRegisterCount);
+  //  A range the master would refuse is not taken
+  EXPECT_FALSE(scheduler.AddRange(Holding(0, 126), &local_holding_store));
+  ASSERT_TRUE(scheduler.AddRange(Holding(0, 100), &local_holding_store));
+  ASSERT_TRUE(scheduler.AddRange(Holding(100, 100), &local_holding_store));
+  const auto reads = Cycle(&scheduler);
+  ASSERT_EQ(reads.size(), 2u);
+  EXPECT_EQ(scheduler.GetStatistics().completed, 2u);
+  EXPECT_EQ(scheduler.GetStatistics().failed, 0u);
+}
+
+TEST_F(PollSchedulerFixture, SpacesAreNotMerged) {
+  Scheduler scheduler{};
+  ASSERT_TRUE(scheduler.AddRange(Holding(0, 2), &local_holding_store));
+  ASSERT_TRUE(scheduler.AddRange(
+      Modbus::PollRange{kSlaveAddress, Modbus::AddressSpace::kInputRegister, 2,
+                        2, kPeriod_us},
+      &local_input_store));
+  slave_holding[1] = 0x1111;
+  slave_input[3] = 0x3333;
+  const auto reads = Cycle(&scheduler);
+  EXPECT_EQ(reads.size(), 2u);
+  EXPECT_EQ(local_holding[1], 0x1111);
+  EXPECT_EQ(local_input[3], 0x3333);
+}
+
+TEST_F(PollSchedulerFixture, OnlyDueRangesExtendTheRead) {
+  Scheduler scheduler{};
+  ASSERT_TRUE(scheduler.AddRange(Holding(0, 2, 1000), &local_holding_store));
+  ASSERT_TRUE(scheduler.AddRange(Holding(2, 2, kPeriod_us),
+                                 &local_holding_store));
+  ASSERT_TRUE(scheduler.AddRange(Holding(6, 2, 1000), &local_holding_store));
+  EXPECT_EQ(Cycle(&scheduler).size(), 1u);
+
+  now_us += 1000;
+  //  The slow range sits inside the read and rides along
+  auto reads = Cycle(&scheduler);
+  ASSERT_EQ(reads.size(), 1u);
+  EXPECT_EQ(reads[0], std::make_pair(uint16_t{0}, uint16_t{8}));
+
+  Scheduler tail{};
+  ASSERT_TRUE(tail.AddRange(Holding(0, 2, 1000), &local_holding_store));
+  ASSERT_TRUE(tail.AddRange(Holding(4, 2, kPeriod_us), &local_holding_store));
+  now_us = 0;
+  EXPECT_EQ(Cycle(&tail).size(), 1u);
+  now_us += 1000;
+  //  The slow range would only lengthen the read, it waits for its period
+  reads = Cycle(&tail);
+  ASSERT_EQ(reads.size(), 1u);
+  EXPECT_EQ(reads[0], std::make_pair(uint16_t{0}, uint16_t{2}));
+}
+
+TEST_F(PollSchedulerFixture, DataLandsInStore) {
+  Scheduler scheduler{};
+  ASSERT_TRUE(scheduler.AddRange(Holding(100, 3), &local_holding_store));
+  ASSERT_TRUE(scheduler.AddRange(Holding(104, 1), &local_holding_store));
+  for (std::size_t i = 100; i < 105; i++) {
+    slave_holding[i] = static_cast<uint16_t>(i * 3);
+  }
+  Cycle(&scheduler);
+  for (std::size_t i = 100; i < 105; i++) {
+    EXPECT_EQ(local_holding[i], i * 3);
+  }
+  EXPECT_EQ(scheduler.GetRangeStatus(0), Modbus::MasterStatus::kComplete);
+  EXPECT_EQ(scheduler.GetRangeStatus(1), Modbus::MasterStatus::kComplete);
+}
+
+TEST_F(PollSchedulerFixture, InvalidRangesAreRefused) {
+  Scheduler scheduler{};
+  EXPECT_FALSE(scheduler.AddRange(Holding(0, 0), &local_holding_store));
+  EXPECT_FALSE(scheduler.AddRange(Holding(0, 126), &local_holding_store));
+  EXPECT_FALSE(scheduler.AddRange(Holding(kRegisterCount - 1, 2),
+                                  &local_holding_store));
+  EXPECT_FALSE(scheduler.AddRange(
+      Modbus::PollRange{kSlaveAddress, Modbus::AddressSpace::kCoil, 0, 1,
+                        kPeriod_us},
+      &local_holding_store));
+  EXPECT_FALSE(scheduler.AddRange(
+      Modbus::PollRange{Modbus::ProtocolRtuMaster::kBroadcastAddress,
+                        Modbus::AddressSpace::kHoldingRegister, 0, 1,
+                        kPeriod_us},
+      &local_holding_store));
+  EXPECT_EQ(scheduler.GetRangeCount(), 0u);
+}
+
+//  Store that can refuse writes, so the master refuses to frame a read
+struct GatedStore : public Modbus::RegisterDataStore {
+  using Modbus::RegisterDataStore::RegisterDataStore;
+  bool writable = true;
+  bool WriteLocationValid(const std::size_t address,
+                          const std::size_t count) const {
+    return writable &&
+           Modbus::RegisterDataStore::WriteLocationValid(address, count);
+  }
+};
+
+TEST_F(PollSchedulerFixture, FailedRequestStaysDue) {
+  std::array<uint16_t, kRegisterCount> registers{};
+  GatedStore store{registers.data(), registers.size()};
+  Modbus::PollScheduler<GatedStore, 4> scheduler{};
+  ASSERT_TRUE(scheduler.AddRange(Holding(10, 2), &store));
+
+  store.writable = false;
+  EXPECT_FALSE(scheduler.Run(&master, now_us));
+  EXPECT_EQ(scheduler.GetStatistics().failed, 1u);
+  //  Not pushed back a period, the next run reads it
+  store.writable = true;
+  now_us += 1;
+  EXPECT_TRUE(scheduler.Run(&master, now_us));
+  EXPECT_EQ(scheduler.GetStatistics().requests, 1u);
+}
+}  //  namespace ModbusTests
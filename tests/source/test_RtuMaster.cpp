@@ -0,0 +1,303 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        test_RtuMaster.cpp
+ * Description:
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <ArrayView/ArrayView.h>
+#include <Modbus/DataStores/RegisterDataStore.h>
+#include <Modbus/MappedRegisterDataStore.h>
+#include <Modbus/Modbus.h>
+#include <Modbus/ModbusRtu/ModbusRtuMaster.h>
+#include <Modbus/ModbusRtu/ModbusRtuSlave.h>
+#include <Modbus/RegisterControl.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "Crc.h"
+#include "TestHoldingRegisterMappedDataStore.h"
+
+namespace ModbusTests {
+template <typename... THandlers>
+class TestSlave : public Modbus::ProtocolRtuSlave<THandlers...> {
+ public:
+  using Modbus::ProtocolRtuSlave<THandlers...>::ProtocolRtuSlave;
+  Modbus::ReadResult ProcessBytes(const ArrayView<const uint8_t> &data) {
+    return this->slave_.ProcessBytes(data);
+  }
+};
+
+struct RtuMasterFixture : public ::testing::Test {
+  static const constexpr uint8_t kSlaveAddress = 0x11;
+  static const constexpr std::size_t kRegisterCount = 64;
+  static const constexpr uint32_t kFrameDelay_us = 1750;
+  static const constexpr uint32_t kTimeout_us = 50000;
+  static const constexpr uint32_t kBroadcastDelay_us = 20000;
+
+  using HoldingController =
+      Modbus::HoldingRegisterController<Modbus::RegisterDataStore>;
+  using InputController =
+      Modbus::InputRegisterController<Modbus::RegisterDataStore>;
+
+  std::array<uint16_t, kRegisterCount> slave_holding{};
+  Modbus::RegisterDataStore slave_holding_store{slave_holding.data(),
+                                                slave_holding.size()};
+  HoldingController holding_controller{&slave_holding_store};
+  std::array<uint16_t, kRegisterCount> slave_input{};
+  Modbus::RegisterDataStore slave_input_store{slave_input.data(),
+                                              slave_input.size()};
+  InputController input_controller{&slave_input_store};
+  TestSlave<HoldingController, InputController> slave{
+      &crc16, kSlaveAddress, holding_controller, input_controller};
+
+  std::array<uint16_t, kRegisterCount> local{};
+  Modbus::RegisterDataStore local_store{local.data(), local.size()};
+
+  Modbus::ProtocolRtuMaster master{
+      &crc16,
+      Modbus::MasterTiming{kFrameDelay_us, kTimeout_us, kBroadcastDelay_us}};
+  uint32_t now_us = 1000;
+
+  /*
+   * Hand the request to the slave and return its response bytes
+   * */
+  std::vector<uint8_t> RunSlave(void) {
+    const auto tx = master.GetTxData();
+    master.RequestSent(now_us);
+    slave.Reset();
+    const auto result = slave.ProcessBytes(tx);
+    EXPECT_TRUE(result.packet_received);
+    slave.ProcessMessage();
+    const auto &response = slave.GetResponse();
+    return std::vector<uint8_t>(response.begin(), response.end());
+  }
+
+  void Receive(const std::vector<uint8_t> &bytes) {
+    now_us += 500;
+    master.ProcessBytes(
+        ArrayView<const uint8_t>{bytes.size(), bytes.data()}, now_us);
+  }
+};
+
+TEST_F(RtuMasterFixture, ReadHoldingRequestIsFramed) {
+  ASSERT_TRUE(master.ReadHoldingRegisters(kSlaveAddress, 0x0012, 3,
+                                          &local_store));
+  EXPECT_EQ(master.GetStatus(), Modbus::MasterStatus::kReady);
+  const auto tx = master.GetTxData();
+  const std::array<uint8_t, 6> expected{kSlaveAddress, 3, 0x00, 0x12, 0, 3};
+  ASSERT_EQ(tx.size(), expected.size() + Modbus::Command::kFooterLength);
+  for (std::size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(tx[i], expected[i]);
+  }
+  Modbus::RunningCrc16 crc{};
+  crc.Update(tx.data(), tx.size());
+  EXPECT_TRUE(crc.ResidueIsValid());
+}
+
+TEST_F(RtuMasterFixture, ReadHoldingDecodesIntoStore) {
+  for (std::size_t i = 0; i < kRegisterCount; i++) {
+    slave_holding[i] = static_cast<uint16_t>(0x1000 + i);
+  }
+  ASSERT_TRUE(master.ReadHoldingRegisters(kSlaveAddress, 4, 8, &local_store));
+  Receive(RunSlave());
+  EXPECT_EQ(master.GetStatus(), Modbus::MasterStatus::kComplete);
+  for (std::size_t i = 0; i < kRegisterCount; i++) {
+    EXPECT_EQ(local[i], (i >= 4 && i < 12) ? slave_holding[i] : 0);
+  }
+}
+
+TEST_F(RtuMasterFixture, ReadInputDecodesIntoStore) {
+  slave_input[0] = 0xbeef;
+  slave_input[1] = 0xfeed;
+  ASSERT_TRUE(master.ReadInputRegisters(kSlaveAddress, 0, 2, &local_store));
+  Receive(RunSlave());
+  EXPECT_EQ(master.GetStatus(), Modbus::MasterStatus::kComplete);
+  EXPECT_EQ(local[0], 0xbeef);
+  EXPECT_EQ(local[1], 0xfeed);
+}
+
+TEST_F(RtuMasterFixture, ResponseSplitAcrossReads) {
+  slave_holding[2] = 0x1234;
+  ASSERT_TRUE(master.ReadHoldingRegisters(kSlaveAddress, 2, 1, &local_store));
+  const auto response = RunSlave();
+  Receive(std::vector<uint8_t>(response.begin(), response.begin() + 3));
+  EXPECT_TRUE(master.IsBusy());
+  Receive(std::vector<uint8_t>(response.begin() + 3, response.end()));
+  EXPECT_EQ(master.GetStatus(), Modbus::MasterStatus::kComplete);
+  EXPECT_EQ(local[2], 0x1234);
+}
+
+TEST_F(RtuMasterFixture, WriteSingleRegisterChecksEcho) {
+  ASSERT_TRUE(master.WriteSingleRegister(kSlaveAddress, 7, 0xabcd));
+  Receive(RunSlave());
+  EXPECT_EQ(master.GetStatus(), Modbus::MasterStatus::kComplete);
+  EXPECT_EQ(slave_holding[7], 0xabcd);
+}
+
+TEST_F(RtuMasterFixture, WriteMultipleRegistersChecksEcho) {
+  const std::array<uint16_t, 3> values{1, 2, 3};
+  ASSERT_TRUE(master.WriteMultipleRegisters(
+      kSlaveAddress, 10, ArrayView<const uint16_t>{values.size(),
+                                                   values.data()}));
+  Receive(RunSlave());
+  EXPECT_EQ(master.GetStatus(), Modbus::MasterStatus::kComplete);
+  EXPECT_EQ(slave_holding[10], 1);
+  EXPECT_EQ(slave_holding[11], 2);
+  EXPECT_EQ(slave_holding[12], 3);
+}
+
+TEST_F(RtuMasterFixture, MaskWriteRegisterChecksEcho) {
+  slave_holding[9] = 0x00ff;
+  ASSERT_TRUE(master.MaskWriteRegister(kSlaveAddress, 9, 0x00f0, 0x0a05));
+  Receive(RunSlave());
+  EXPECT_EQ(master.GetStatus(), Modbus::MasterStatus::kComplete);
+  EXPECT_EQ(slave_holding[9], 0x0af5);
+}
+
+TEST_F(RtuMasterFixture, ReadWriteMultipleRegisters) {
+  slave_holding[30] = 0x3030;
+  const std::array<uint16_t, 2> values{0x3131, 0x3232};
+  ASSERT_TRUE(master.ReadWriteMultipleRegisters(
+      kSlaveAddress, 31,
+      ArrayView<const uint16_t>{values.size(), values.data()}, 30, 3,
+      &local_store));
+  Receive(RunSlave());
+  EXPECT_EQ(master.GetStatus(), Modbus::MasterStatus::kComplete);
+  EXPECT_EQ(slave_holding[31], 0x3131);
+  EXPECT_EQ(slave_holding[32], 0x3232);
+  EXPECT_EQ(local[30], 0x3030);
+  EXPECT_EQ(local[31], 0x3131);
+  EXPECT_EQ(local[32], 0x3232);
+}
+
+TEST_F(RtuMasterFixture, ExceptionResponseIsReported) {
+  std::array<uint16_t, 256> big{};
+  Modbus::RegisterDataStore big_store{big.data(), big.size()};
+  ASSERT_TRUE(master.ReadHoldingRegisters(kSlaveAddress, 100, 1, &big_store));
+  Receive(RunSlave());
+  EXPECT_EQ(master.GetStatus(), Modbus::MasterStatus::kException);
+  EXPECT_EQ(master.GetException(), Modbus::Exception::kIllegalDataAddress);
+}
+
+TEST_F(RtuMasterFixture, CorruptResponseIsRejected) {
+  ASSERT_TRUE(master.ReadHoldingRegisters(kSlaveAddress, 0, 2, &local_store));
+  auto response = RunSlave();
+  response[3] ^= 0x01;
+  Receive(response);
+  EXPECT_EQ(master.GetStatus(), Modbus::MasterStatus::kBadResponse);
+  EXPECT_EQ(local[0], 0);
+}
+
+TEST_F(RtuMasterFixture, ResponseFromOtherSlaveIsRejected) {
+  ASSERT_TRUE(master.ReadHoldingRegisters(kSlaveAddress, 0, 1, &local_store));
+  RunSlave();
+  std::array<uint8_t, 5> other{kSlaveAddress + 1, 3, 2, 0, 1};
+  std::vector<uint8_t> response(other.begin(), other.end());
+  Modbus::RunningCrc16 crc{};
+  crc.Update(other.data(), other.size());
+  response.push_back(crc.GetLowByte());
+  response.push_back(crc.GetHighByte());
+  Receive(response);
+  EXPECT_EQ(master.GetStatus(), Modbus::MasterStatus::kBadResponse);
+}
+
+TEST_F(RtuMasterFixture, TimeoutThenFrameDelay) {
+  ASSERT_TRUE(master.ReadHoldingRegisters(kSlaveAddress, 0, 1, &local_store));
+  master.RequestSent(now_us);
+  EXPECT_FALSE(master.ReadyToSend(now_us));
+  EXPECT_FALSE(
+      master.ReadHoldingRegisters(kSlaveAddress, 0, 1, &local_store));
+  EXPECT_TRUE(master.Poll(now_us + kTimeout_us - 1));
+  EXPECT_FALSE(master.Poll(now_us + kTimeout_us));
+  EXPECT_EQ(master.GetStatus(), Modbus::MasterStatus::kTimeout);
+  EXPECT_FALSE(master.ReadyToSend(now_us + kTimeout_us + kFrameDelay_us - 1));
+  EXPECT_TRUE(master.ReadyToSend(now_us + kTimeout_us + kFrameDelay_us));
+}
+
+TEST_F(RtuMasterFixture, TimeoutAcrossClockWrap) {
+  now_us = UINT32_MAX - 10;
+  ASSERT_TRUE(master.ReadHoldingRegisters(kSlaveAddress, 0, 1, &local_store));
+  master.RequestSent(now_us);
+  EXPECT_TRUE(master.Poll(100));
+  EXPECT_FALSE(master.Poll(kTimeout_us));
+  EXPECT_EQ(master.GetStatus(), Modbus::MasterStatus::kTimeout);
+}
+
+TEST_F(RtuMasterFixture, BroadcastWaitsTurnaround) {
+  ASSERT_TRUE(master.WriteSingleRegister(
+      Modbus::ProtocolRtuMaster::kBroadcastAddress, 0, 1));
+  master.RequestSent(now_us);
+  EXPECT_EQ(master.GetStatus(), Modbus::MasterStatus::kComplete);
+  EXPECT_FALSE(master.ReadyToSend(now_us + kBroadcastDelay_us - 1));
+  EXPECT_TRUE(master.ReadyToSend(now_us + kBroadcastDelay_us));
+  EXPECT_FALSE(master.ReadHoldingRegisters(
+      Modbus::ProtocolRtuMaster::kBroadcastAddress, 0, 1, &local_store));
+}
+
+TEST_F(RtuMasterFixture, ReadOutsideTargetIsRefused) {
+  EXPECT_FALSE(master.ReadHoldingRegisters(kSlaveAddress, kRegisterCount - 1,
+                                           2, &local_store));
+  EXPECT_EQ(master.GetStatus(), Modbus::MasterStatus::kIdle);
+}
+
+TEST_F(RtuMasterFixture, CountsOutsideFunctionLimitsAreRefused) {
+  std::array<uint16_t, 256> large{};
+  Modbus::RegisterDataStore large_store{large.data(), large.size()};
+  EXPECT_FALSE(master.ReadHoldingRegisters(kSlaveAddress, 0, 0, &large_store));
+  EXPECT_FALSE(
+      master.ReadHoldingRegisters(kSlaveAddress, 0, 126, &large_store));
+  EXPECT_FALSE(master.ReadInputRegisters(kSlaveAddress, 0, 126, &large_store));
+
+  const ArrayView<const uint16_t> write_124{124, large.data()};
+  EXPECT_FALSE(master.WriteMultipleRegisters(kSlaveAddress, 0, write_124));
+  EXPECT_FALSE(master.WriteMultipleRegisters(
+      kSlaveAddress, 0, ArrayView<const uint16_t>{0, large.data()}));
+
+  const ArrayView<const uint16_t> write_122{122, large.data()};
+  const ArrayView<const uint16_t> write_121{121, large.data()};
+  EXPECT_FALSE(master.ReadWriteMultipleRegisters(kSlaveAddress, 0, write_122,
+                                                 0, 1, &large_store));
+  EXPECT_FALSE(master.ReadWriteMultipleRegisters(kSlaveAddress, 0, write_121,
+                                                 0, 126, &large_store));
+  EXPECT_EQ(master.GetStatus(), Modbus::MasterStatus::kIdle);
+
+  //  The largest of each are framed
+  EXPECT_TRUE(
+      master.ReadHoldingRegisters(kSlaveAddress, 0, 125, &large_store));
+  EXPECT_TRUE(master.WriteMultipleRegisters(
+      kSlaveAddress, 0, ArrayView<const uint16_t>{123, large.data()}));
+  EXPECT_TRUE(master.ReadWriteMultipleRegisters(kSlaveAddress, 0, write_121,
+                                                0, 125, &large_store));
+}
+
+TEST_F(RtuMasterFixture, ReadDecodesIntoMappedStore) {
+  using Wrapper = ModbusBasic_holding_register::Wrapper;
+  ModbusBasic_holding_register::holding_register data{};
+  Wrapper map{&data};
+  Modbus::MappedRegisterDataStore<Wrapper> mapped{&map};
+  ModbusBasic_holding_register::holding_register expected_data{};
+  Wrapper expected_map{&expected_data};
+  Modbus::MappedRegisterDataStore<Wrapper> expected{&expected_map};
+
+  const std::size_t address = Wrapper::offsets_[3];  //  int32
+  slave_holding[address] = 0x0102;
+  slave_holding[address + 1] = 0x0304;
+  const std::array<uint8_t, 4> bytes{1, 2, 3, 4};
+  expected.SetRegisters(address, 2,
+                        ArrayView<const uint8_t>{bytes.size(), bytes.data()});
+
+  ASSERT_TRUE(master.ReadHoldingRegisters(
+      kSlaveAddress, static_cast<uint16_t>(address), 2, &mapped));
+  Receive(RunSlave());
+  EXPECT_EQ(master.GetStatus(), Modbus::MasterStatus::kComplete);
+  EXPECT_EQ(map.get_int32(), expected_map.get_int32());
+}
+}  //  namespace ModbusTests
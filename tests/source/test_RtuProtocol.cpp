@@ -58,6 +58,29 @@ TEST(Response, copy) {
   }
 }
 
+TEST(Response, CopyLandsInDestinationBuffer) {
+  Modbus::Response ra{};
+  ra.SetLength(8);
+  for (uint8_t pt = 0; pt < ra.GetLength(); pt++) {
+    ra[pt] = static_cast<uint8_t>(pt + 1);
+  }
+
+  std::array<uint8_t, 16> tx_data{};
+  Modbus::Response rb{tx_data.data(), tx_data.size()};
+  rb = ra;
+  EXPECT_EQ(rb.data(), tx_data.data());
+  EXPECT_EQ(rb.GetLength(), ra.GetLength());
+  EXPECT_EQ(tx_data[7], 8);
+
+  const Modbus::Response rc{rb};
+  EXPECT_TRUE(rc.UsesInternalBuffer());
+  EXPECT_EQ(rc.at(7), 8);
+
+  rb.Reset();
+  EXPECT_EQ(rb.GetLength(), 0u);
+  EXPECT_EQ(tx_data[7], 8);  //  Reset does not clear the buffer
+}
+
 struct RtuProtocolFixture : public ::testing::Test {
   Modbus::ProtocolRtu prot{&crc16};
   std::array<uint8_t, 9> data{1, 2, 3, 4, 5, 6, 7, 8, 0};
@@ -108,4 +131,150 @@ TEST_F(RtuProtocolFixture, ReadFrame) {
   EXPECT_EQ(packet.address, packet_read.address);
   EXPECT_TRUE(packet.function == packet_read.function);
 }
+
+struct ReadContextFixture : public ::testing::Test {
+  static const constexpr uint16_t kRegisterCount = 16;
+  Modbus::ProtocolRtu prot{&crc16};
+  std::array<uint8_t, 256> command_data{};
+  std::array<uint8_t, 256> frame_data{};
+  std::size_t frame_length = 0;
+
+  void SetUp(void) {
+    std::array<uint16_t, kRegisterCount> registers{};
+    for (uint16_t i = 0; i < registers.size(); i++) {
+      registers[i] = static_cast<uint16_t>(0x1111 * i);
+    }
+    Modbus::Frame packet{
+        ArrayView<uint8_t>{command_data.size(), command_data.data()}};
+    packet.address = 0x0f;
+    Modbus::WriteMultipleHoldingRegistersCommand::FillFrame(
+        0x20, kRegisterCount,
+        ArrayView<const uint16_t>{registers.size(), registers.data()}, &packet);
+    frame_length = GetRequiredPacketSize(packet);
+    ArrayView<uint8_t> frame{frame_length, frame_data.data()};
+    prot.Frame(packet, &frame);
+  }
+};
+
+TEST_F(ReadContextFixture, ProcessBytesMatchesProcessCharacter) {
+  std::array<uint8_t, 256> bytewise_data{};
+  std::array<uint8_t, 256> block_data{};
+  Modbus::Frame bytewise{
+      ArrayView<uint8_t>{bytewise_data.size(), bytewise_data.data()}};
+  Modbus::Frame block{ArrayView<uint8_t>{block_data.size(), block_data.data()}};
+  Modbus::ReadContext bytewise_ctx;
+  Modbus::ReadContext block_ctx;
+
+  for (std::size_t i = 0; i < frame_length; i++) {
+    bytewise_ctx.ProcessCharacter(&bytewise, frame_data[i]);
+  }
+  const auto result = block_ctx.ProcessBytes(
+      &block, ArrayView<const uint8_t>{frame_length, frame_data.data()});
+
+  EXPECT_TRUE(bytewise_ctx.PacketReceived());
+  EXPECT_TRUE(result.packet_received);
+  EXPECT_EQ(result.bytes_used, frame_length);
+  EXPECT_EQ(bytewise.address, block.address);
+  EXPECT_TRUE(bytewise.function == block.function);
+  EXPECT_EQ(bytewise.data_length, block.data_length);
+  for (std::size_t i = 0; i < block.data_length; i++) {
+    EXPECT_EQ(bytewise.data_array[i], block.data_array[i]);
+  }
+  EXPECT_TRUE(prot.FrameCrcIsValid(block));
+  EXPECT_TRUE(bytewise_ctx.CrcIsValid());
+  EXPECT_TRUE(block_ctx.CrcIsValid());
+}
+
+TEST_F(ReadContextFixture, CrcIsValid_CorruptByteFails) {
+  for (std::size_t corrupt = 2; corrupt < frame_length; corrupt++) {
+    std::array<uint8_t, 256> corrupted = frame_data;
+    corrupted[corrupt] ^= 0x01;
+    std::array<uint8_t, 256> block_data{};
+    Modbus::Frame block{
+        ArrayView<uint8_t>{block_data.size(), block_data.data()}};
+    Modbus::ReadContext ctx;
+    const auto result = ctx.ProcessBytes(
+        &block, ArrayView<const uint8_t>{frame_length, corrupted.data()});
+    if (result.packet_received) {
+      EXPECT_FALSE(ctx.CrcIsValid());
+      EXPECT_FALSE(prot.FrameCrcIsValid(block));
+    }
+  }
+}
+
+TEST_F(ReadContextFixture, FrameResponseCrcIsValid) {
+  Modbus::Response response{};
+  Modbus::Frame frame{};
+  frame.address = 0x0f;
+  frame.function = Modbus::Function::kWriteSingleHoldingRegister;
+  Modbus::WriteSingleHoldingRegisterCommand::FillResponseHeader(
+      frame.address, 0x10, 0xbeef, &response);
+  prot.FrameResponse(frame, &response);
+  EXPECT_TRUE(prot.FrameCrcIsValid(response.GetArrayView()));
+
+  Modbus::RunningCrc16 crc{};
+  crc.Update(response.data(), response.GetLength());
+  EXPECT_TRUE(crc.ResidueIsValid());
+}
+
+TEST_F(ReadContextFixture, ProcessBytesStopsAtEndOfFrame) {
+  std::array<uint8_t, 512> stream{};
+  std::copy(frame_data.begin(), frame_data.begin() + frame_length,
+            stream.begin());
+  std::copy(frame_data.begin(), frame_data.begin() + frame_length,
+            stream.begin() + frame_length);
+
+  std::array<uint8_t, 256> block_data{};
+  Modbus::Frame block{ArrayView<uint8_t>{block_data.size(), block_data.data()}};
+  Modbus::ReadContext ctx;
+  const auto first = ctx.ProcessBytes(
+      &block, ArrayView<const uint8_t>{2 * frame_length, stream.data()});
+  EXPECT_TRUE(first.packet_received);
+  EXPECT_EQ(first.bytes_used, frame_length);
+
+  ctx.Reset();
+  block.Reset();
+  const auto second = ctx.ProcessBytes(
+      &block, ArrayView<const uint8_t>{frame_length, &stream[frame_length]});
+  EXPECT_TRUE(second.packet_received);
+  EXPECT_EQ(second.bytes_used, frame_length);
+}
+
+TEST_F(ReadContextFixture, ProcessBytesAcrossChunks) {
+  std::array<uint8_t, 256> block_data{};
+  Modbus::Frame block{ArrayView<uint8_t>{block_data.size(), block_data.data()}};
+  Modbus::ReadContext ctx;
+  const std::size_t kChunkSize = 5;
+  std::size_t index = 0;
+  Modbus::ReadResult result{};
+  while (index < frame_length) {
+    const std::size_t length = std::min(kChunkSize, frame_length - index);
+    result = ctx.ProcessBytes(
+        &block, ArrayView<const uint8_t>{length, &frame_data[index]});
+    index += result.bytes_used;
+  }
+  EXPECT_TRUE(result.packet_received);
+  EXPECT_EQ(index, frame_length);
+  EXPECT_TRUE(prot.FrameCrcIsValid(block));
+}
+
+TEST(ReadContext, FunctionWithoutMetaReadsOnlyCrc) {
+  //  Get com event counter has no request data, address function crc
+  std::array<uint8_t, 4> request{
+      0x11, static_cast<uint8_t>(Modbus::Function::kGetComEventCounter)};
+  Modbus::RunningCrc16 crc;
+  crc.Update(request.data(), 2);
+  request[2] = crc.GetLowByte();
+  request[3] = crc.GetHighByte();
+
+  std::array<uint8_t, 256> block_data{};
+  Modbus::Frame block{ArrayView<uint8_t>{block_data.size(), block_data.data()}};
+  Modbus::ReadContext ctx;
+  const auto result = ctx.ProcessBytes(
+      &block, ArrayView<const uint8_t>{request.size(), request.data()});
+  EXPECT_TRUE(result.packet_received);
+  EXPECT_EQ(result.bytes_used, request.size());
+  EXPECT_EQ(block.data_length, Modbus::Command::kFooterLength);
+  EXPECT_TRUE(ctx.CrcIsValid());
+}
 }  //  namespace ModbusTests
@@ -20,6 +20,7 @@
 #include <cassert>
 #include <cstdint>
 #include <iostream>
+#include <thread>
 #include <vector>
 
 #include "Crc.h"
@@ -203,4 +204,223 @@ TEST_F(RtuSlaveFixture, ReadHoldingValueCheck) {
   EXPECT_EQ(resp.at(offset++), 0xef);
 }
 
+TEST_F(RtuSlaveFixture, ReadWriteMultipleRegistersWritesFirst) {
+  registers[20] = 0x1111;
+  const std::array<uint16_t, 2> values{0xaaaa, 0xbbbb};
+  std::array<uint8_t, 64> frame_data{};
+  Modbus::Frame frame{kSlaveAddress, Modbus::Function::kNone, 0,
+                      ArrayView<uint8_t>{frame_data.size(), frame_data.data()}};
+  Modbus::ReadWriteMultipleRegistersCommand::FillFrame(
+      20, 3, 21, ArrayView<const uint16_t>{values.size(), values.data()},
+      &frame);
+  CheckFrame(frame);
+  EXPECT_EQ(slave.RunCommand(frame), 0);
+  EXPECT_EQ(registers[21], 0xaaaa);
+  EXPECT_EQ(registers[22], 0xbbbb);
+
+  const auto &response = slave.GetResponse();
+  const std::size_t offset =
+      Modbus::ReadMultipleRegistersCommandBase::ResponsePacket::kHeaderSize;
+  ASSERT_EQ(response.GetLength(), offset + 6 + Modbus::Command::kFooterLength);
+  EXPECT_EQ(
+      response[Modbus::Command::ResponsePacket::kFunction],
+      static_cast<uint8_t>(Modbus::Function::kReadWriteMultipleRegisters));
+  EXPECT_EQ(response[offset - 1], 6);
+  const std::array<uint8_t, 6> expected{0x11, 0x11, 0xaa, 0xaa, 0xbb, 0xbb};
+  for (std::size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(response[offset + i], expected[i]);
+  }
+}
+
+TEST_F(RtuSlaveFixture, ReadWriteMultipleRegistersChecksRequest) {
+  const std::array<uint16_t, 2> values{1, 2};
+  std::array<uint8_t, 64> frame_data{};
+  Modbus::Frame frame{kSlaveAddress, Modbus::Function::kNone, 0,
+                      ArrayView<uint8_t>{frame_data.size(), frame_data.data()}};
+  const ArrayView<const uint16_t> view{values.size(), values.data()};
+  using Command = Modbus::ReadWriteMultipleRegistersCommand;
+
+  Command::FillFrame(0, 1, 0, view, &frame);
+  frame_data[Command::CommandPacket::kNumberOfDataBytes] = 3;
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kIllegalDataValue);
+
+  Command::FillFrame(0, 0, 0, view, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kIllegalDataValue);
+
+  Command::FillFrame(0, 1, holding_register_count - 1, view, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame),
+            Modbus::Exception::kIllegalDataAddress);
+
+  Command::FillFrame(holding_register_count, 1, 0, view, &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame),
+            Modbus::Exception::kIllegalDataAddress);
+}
+
+TEST_F(RtuSlaveFixture, MaskWriteRegisterEchoesCommand) {
+  registers[4] = 0x12;
+  std::array<uint8_t, 64> frame_data{};
+  Modbus::Frame frame{kSlaveAddress, Modbus::Function::kNone, 0,
+                      ArrayView<uint8_t>{frame_data.size(), frame_data.data()}};
+  //  Example from the specification
+  Modbus::MaskWriteRegisterCommand::FillFrame(4, 0xf2, 0x25, &frame);
+  CheckFrame(frame);
+  EXPECT_EQ(slave.RunCommand(frame), 0);
+  EXPECT_EQ(registers[4], 0x17);
+
+  const auto &response = slave.GetResponse();
+  ASSERT_EQ(response.GetLength(),
+            Modbus::MaskWriteRegisterCommand::ResponsePacket::kPacketSize +
+                Modbus::Command::kFooterLength);
+  for (std::size_t i = 0; i < frame.data_length; i++) {
+    EXPECT_EQ(response[Modbus::Command::kHeaderLength + i], frame_data[i]);
+  }
+
+  Modbus::MaskWriteRegisterCommand::FillFrame(holding_register_count, 0, 0,
+                                              &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame),
+            Modbus::Exception::kIllegalDataAddress);
+}
+
+/*
+ * Each thread sets its own bits of one register through mask writes, a read
+ * then write would lose bits set by the other thread in between
+ */
+TEST_F(RtuSlaveFixture, MaskWriteRegisterIsAtomic) {
+  const std::size_t kAddress = 3;
+  const int kRounds = 20000;
+  auto set_bits = [this](const uint16_t bits) {
+    const uint16_t keep = static_cast<uint16_t>(~bits);
+    for (int round = 0; round < kRounds; round++) {
+      holding_map.MaskWriteRegister(kAddress, keep, 0);
+      holding_map.MaskWriteRegister(kAddress, keep, bits);
+    }
+  };
+  std::thread low{set_bits, 0x00ff};
+  std::thread high{set_bits, 0xff00};
+  low.join();
+  high.join();
+  EXPECT_EQ(registers[kAddress], 0xffff);
+}
+
+TEST_F(RtuSlaveFixture, UnservedFunctionIsIllegal) {
+  std::array<uint8_t, 64> frame_data{};
+  Modbus::Frame frame{kSlaveAddress, Modbus::Function::kReadCoils, 4,
+                      ArrayView<uint8_t>{frame_data.size(), frame_data.data()}};
+  EXPECT_EQ(slave.ValidateMessage(frame),
+            Modbus::Exception::kIllegalFunction);
+  EXPECT_EQ(slave.RunCommand(frame), -1);
+}
+
+//  Minimal handler to check that one can be added without touching the slave
+struct ReportSlaveIdHandler {
+  static const constexpr std::array<Modbus::Function, 1> kFunctions{
+      Modbus::Function::kReportSlaveId};
+  std::size_t calls = 0;
+  Modbus::Exception ValidateFrame(const Modbus::Frame &) const {
+    return Modbus::Exception::kAck;
+  }
+  int32_t ReadFrame(const Modbus::Frame &frame, Modbus::Response *response) {
+    calls++;
+    response->operator[](Modbus::Command::ResponsePacket::kSlaveAddress) =
+        frame.address;
+    response->operator[](Modbus::Command::ResponsePacket::kFunction) =
+        static_cast<uint8_t>(frame.function);
+    response->SetLength(Modbus::Command::ResponsePacket::kHeaderEnd + 1);
+    return 0;
+  }
+};
+
+TEST_F(RtuSlaveFixture, AddedHandlerIsDispatched) {
+  ReportSlaveIdHandler report_slave_id;
+  Modbus::ProtocolRtuSlave<HoldingController, ReportSlaveIdHandler,
+                           InputController>
+      extended_slave{&crc16, kSlaveAddress, holding_register_controller,
+                     report_slave_id, input_register_controller};
+
+  std::array<uint8_t, 64> frame_data{};
+  Modbus::Frame frame{kSlaveAddress, Modbus::Function::kReportSlaveId, 0,
+                      ArrayView<uint8_t>{frame_data.size(), frame_data.data()}};
+  EXPECT_EQ(extended_slave.ValidateMessage(frame), Modbus::Exception::kAck);
+  EXPECT_EQ(extended_slave.RunCommand(frame), 0);
+  EXPECT_EQ(report_slave_id.calls, 1u);
+  EXPECT_TRUE(extended_slave.GetResponseValid());
+
+  Modbus::ReadMultipleHoldingRegistersCommand::FillFrame(0, 4, &frame);
+  frame.function = Modbus::Function::kReadMultipleHoldingRegisters;
+  EXPECT_EQ(extended_slave.ValidateMessage(frame), Modbus::Exception::kAck);
+}
+
+TEST_F(RtuSlaveFixture, SupportedFunctionsFromHandlers) {
+  using Function = Modbus::Function;
+  EXPECT_EQ(slave.GetSupportedFunctions(),
+            (std::array<Function, 6>{
+                Function::kReadMultipleHoldingRegisters,
+                Function::kReadInputRegisters,
+                Function::kWriteSingleHoldingRegister,
+                Function::kWriteMultipleHoldingRegisters,
+                Function::kMaskWriteRegister,
+                Function::kReadWriteMultipleRegisters}));
+
+  //  A handler outside the library adds its code
+  using ExtendedSlave =
+      Modbus::ProtocolRtuSlave<HoldingController, ReportSlaveIdHandler>;
+  static_assert(ExtendedSlave::GetSupportedFunctions()[3] ==
+                    Function::kReportSlaveId,
+                "Codes are in order");
+  for (const auto function : slave.GetSupportedFunctions()) {
+    EXPECT_TRUE(Modbus::FunctionIsSupported(function));
+  }
+}
+
+TEST_F(RtuSlaveFixture, ResponseWrittenIntoTxBuffer) {
+  holding_register_controller.WriteRegister(0, 0xbeef);
+  std::array<uint8_t, 64> tx_data{};
+  slave.SetTxBuffer(ArrayView<uint8_t>{tx_data.size(), tx_data.data()});
+
+  std::array<uint8_t, 64> frame_data{};
+  Modbus::Frame frame{kSlaveAddress,
+                      Modbus::Function::kReadMultipleHoldingRegisters, 0,
+                      ArrayView<uint8_t>{frame_data.size(), frame_data.data()}};
+  Modbus::ReadMultipleHoldingRegistersCommand::FillFrame(0, 1, &frame);
+  EXPECT_EQ(slave.RunCommand(frame), 0);
+
+  const auto &response = slave.GetResponse();
+  EXPECT_EQ(response.data(), tx_data.data());
+  const std::size_t offset =
+      Modbus::ReadMultipleRegistersCommandBase::ResponsePacket::kHeaderSize;
+  EXPECT_EQ(tx_data[offset], 0xbe);
+  EXPECT_EQ(tx_data[offset + 1], 0xef);
+  EXPECT_EQ(response.GetLength(), offset + 2 + Modbus::Command::kFooterLength);
+
+  Modbus::RunningCrc16 crc;
+  crc.Update(tx_data.data(), response.GetLength());
+  EXPECT_TRUE(crc.ResidueIsValid());
+}
+
+TEST_F(RtuSlaveFixture, ReadWriteMultipleRegistersChecksTxBuffer) {
+  //  Room for the header, crc and fewer than the ten registers read
+  std::array<uint8_t, 16> tx_data{};
+  slave.SetTxBuffer(ArrayView<uint8_t>{tx_data.size(), tx_data.data()});
+
+  const std::array<uint16_t, 1> values{0xaaaa};
+  std::array<uint8_t, 64> frame_data{};
+  Modbus::Frame frame{kSlaveAddress, Modbus::Function::kNone, 0,
+                      ArrayView<uint8_t>{frame_data.size(), frame_data.data()}};
+  Modbus::ReadWriteMultipleRegistersCommand::FillFrame(
+      0, 10, 30, ArrayView<const uint16_t>{values.size(), values.data()},
+      &frame);
+  EXPECT_EQ(slave.ValidateMessage(frame), Modbus::Exception::kAck);
+  EXPECT_LT(slave.RunCommand(frame), 0);
+  EXPECT_EQ(registers[30], 0);
+
+  const auto &response = slave.GetResponse();
+  EXPECT_TRUE(slave.GetResponseValid());
+  EXPECT_EQ(response.data(), tx_data.data());
+  EXPECT_EQ(response[Modbus::Command::ResponsePacket::kFunction],
+            static_cast<uint8_t>(Modbus::GetErrorFunction(
+                Modbus::Function::kReadWriteMultipleRegisters)));
+  EXPECT_EQ(response[Modbus::Command::ResponsePacket::kHeaderEnd + 1],
+            static_cast<uint8_t>(Modbus::Exception::kSlaveDeviceFailure));
+}
+
 }  //  namespace ModbusTests
@@ -0,0 +1,156 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        test_SeqlockRegisterDataStore.cpp
+ * Description:
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <Modbus/DataStores/SeqlockRegisterDataStore.h>
+#include <Modbus/RegisterControl.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "TestSlave.h"
+
+namespace ModbusTests {
+static const constexpr std::size_t kRegisterCount = 64;
+static const constexpr std::size_t kRegionSize = 8;
+
+//  Opens the write and read sections to the tests
+class SeqlockStore
+    : public Modbus::SeqlockRegisterDataStore<kRegisterCount, kRegionSize> {
+ public:
+  using SeqlockRegisterDataStore::BeginWrite;
+  using SeqlockRegisterDataStore::EndWrite;
+  using SeqlockRegisterDataStore::ReadConsistent;
+  using SeqlockRegisterDataStore::SeqlockRegisterDataStore;
+};
+
+struct SeqlockFixture : public ::testing::Test {
+  using Store = SeqlockStore;
+  using HoldingController = Modbus::HoldingRegisterController<Store>;
+  using InputController = Modbus::InputRegisterController<Store>;
+  using ReadInputs = Modbus::ReadInputRegistersCommand;
+
+  std::array<uint16_t, kRegisterCount> registers{};
+  Store store{registers.data(), registers.size()};
+  HoldingController holding_controller{&store};
+  InputController input_controller{&store};
+  TestSlave<HoldingController, InputController> slave{holding_controller,
+                                                      input_controller};
+};
+
+TEST_F(SeqlockFixture, WritesAndReads) {
+  const std::array<uint16_t, 4> values{1, 2, 3, 4};
+  store.Write(6, values.size(), values.data());
+  EXPECT_EQ(slave.ReadRegisters<ReadInputs>(5, 6),
+            (std::vector<uint16_t>{0, 1, 2, 3, 4, 0}));
+
+  ASSERT_EQ(slave.WriteRegisters(20, {0xbeef, 0xcafe}),
+            Modbus::Exception::kAck);
+  store.SetRegister(30, 0x1234);
+  EXPECT_EQ(store.MaskWriteRegister(30, 0x00ff, 0x5600), 0x5634);
+  std::array<uint16_t, 3> read{};
+  store.Read(20, 2, read.data());
+  EXPECT_EQ(read[0], 0xbeef);
+  EXPECT_EQ(read[1], 0xcafe);
+  EXPECT_EQ(store.GetRegister(30), 0x5634);
+  EXPECT_EQ(slave.WriteRegisters(kRegisterCount, {1}),
+            Modbus::Exception::kIllegalDataAddress);
+}
+
+TEST_F(SeqlockFixture, ReadWaitsForWriteInProgress) {
+  //  A read of a range with a write part done waits for the write to end
+  store.BeginWrite(kRegionSize - 1, 2);
+  registers[kRegionSize - 1] = 1;
+  std::atomic<bool> read_done{false};
+  std::vector<uint16_t> values;
+  std::thread reader([&] {
+    values = slave.ReadRegisters<ReadInputs>(kRegionSize - 2, 3);
+    read_done.store(true, std::memory_order_release);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds{20});
+  EXPECT_FALSE(read_done.load(std::memory_order_acquire));
+  registers[kRegionSize] = 2;
+  store.EndWrite(kRegionSize - 1, 2);
+  reader.join();
+  EXPECT_EQ(values, (std::vector<uint16_t>{0, 1, 2}));
+
+  //  Other regions are not held up
+  store.BeginWrite(0, 1);
+  EXPECT_EQ(slave.ReadRegisters<ReadInputs>(kRegionSize, 1),
+            (std::vector<uint16_t>{2}));
+  store.EndWrite(0, 1);
+}
+
+TEST_F(SeqlockFixture, ReadOverlappedByWriteIsRepeated) {
+  //  A write landing in the second region while the copy runs
+  std::size_t copies = 0;
+  const std::array<uint16_t, 1> value{7};
+  store.ReadConsistent(0, kRegionSize * 2, [&] {
+    if (copies++ == 0) {
+      store.Write(kRegionSize + 1, value.size(), value.data());
+    }
+  });
+  EXPECT_EQ(copies, 2u);
+  //  Outside the range read it is not
+  copies = 0;
+  store.ReadConsistent(0, kRegionSize, [&] {
+    if (copies++ == 0) {
+      store.Write(kRegionSize + 1, value.size(), value.data());
+    }
+  });
+  EXPECT_EQ(copies, 1u);
+}
+
+TEST_F(SeqlockFixture, ReadsAreNeverTorn) {
+  //  Three writers publish 64 bit values in four registers that straddle a
+  //  region boundary. Each value has all four 16 bit words equal, a read
+  //  mixing two updates has words that differ.
+  static const constexpr uint16_t kAddress = kRegionSize - 2;
+  std::atomic<bool> done{false};
+  std::atomic<std::size_t> updates{0};
+  std::vector<std::thread> writers;
+  for (uint16_t writer = 0; writer < 3; writer++) {
+    writers.emplace_back([&, writer] {
+      uint16_t word = writer;
+      while (!done.load(std::memory_order_acquire)) {
+        word = static_cast<uint16_t>(word + 3);
+        const uint64_t value = word * uint64_t{0x0001000100010001};
+        const std::array<uint16_t, 4> values{
+            static_cast<uint16_t>(value >> 48),
+            static_cast<uint16_t>(value >> 32),
+            static_cast<uint16_t>(value >> 16), static_cast<uint16_t>(value)};
+        store.Write(kAddress, values.size(), values.data());
+        updates.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+  while (updates.load(std::memory_order_relaxed) < 100000) {
+    const std::vector<uint16_t> served =
+        slave.ReadRegisters<ReadInputs>(kAddress, 4);
+    for (std::size_t j = 1; j < served.size(); j++) {
+      ASSERT_EQ(served[j], served[0]);
+    }
+    std::array<uint16_t, 4> read{};
+    store.Read(kAddress, read.size(), read.data());
+    for (std::size_t j = 1; j < read.size(); j++) {
+      ASSERT_EQ(read[j], read[0]);
+    }
+  }
+  done.store(true, std::memory_order_release);
+  for (auto &writer : writers) {
+    writer.join();
+  }
+}
+}  //  namespace ModbusTests
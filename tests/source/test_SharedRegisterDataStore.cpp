@@ -0,0 +1,139 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        test_SharedRegisterDataStore.cpp
+ * Description:
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <ArrayView/ArrayView.h>
+#include <Modbus/DataStores/SharedRegisterDataStore.h>
+#include <Modbus/RegisterControl.h>
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TestSlave.h"
+
+namespace ModbusTests {
+struct SharedFixture : public ::testing::Test {
+  static const constexpr std::size_t kRegisterCount = 256;
+  static const constexpr std::size_t kRegionSize = 16;
+  using Store = Modbus::SharedRegisterDataStore<kRegisterCount, kRegionSize>;
+  using Reader = Modbus::SharedRegisterReader<kRegisterCount, kRegionSize>;
+  using Controller = Modbus::HoldingRegisterController<Store>;
+
+  std::string name = "/modbus_shared_" + std::to_string(getpid());
+  Store store;
+  Controller controller{&store};
+  TestSlave<Controller> slave{controller};
+
+  void SetUp(void) override {
+    Store::Unlink(name.c_str());
+    ASSERT_EQ(store.Create(name.c_str()), 0);
+  }
+  void TearDown(void) override {
+    store.Close();
+    Store::Unlink(name.c_str());
+  }
+};
+
+TEST_F(SharedFixture, ReaderSeesWrites) {
+  Reader reader;
+  ASSERT_EQ(reader.Open(name.c_str()), 0);
+  EXPECT_EQ(reader.GetGeneration(), 0u);
+
+  ASSERT_EQ(slave.WriteRegisters(10, {1, 2, 3}), Modbus::Exception::kAck);
+  store.SetRegister(200, 0xbeef);
+  EXPECT_EQ(store.MaskWriteRegister(200, 0x00ff, 0x1200), 0x12ef);
+  EXPECT_EQ(reader.GetGeneration(), 3u);
+  EXPECT_EQ(store.GetGeneration(), 3u);
+
+  std::array<uint16_t, 4> values{};
+  ASSERT_TRUE(reader.Read(9, values.size(), values.data()));
+  EXPECT_EQ(values, (std::array<uint16_t, 4>{0, 1, 2, 3}));
+  ASSERT_TRUE(reader.Read(200, 1, values.data()));
+  EXPECT_EQ(values[0], 0x12ef);
+  EXPECT_EQ(slave.WriteRegisters(kRegisterCount, {1}),
+            Modbus::Exception::kIllegalDataAddress);
+}
+
+TEST_F(SharedFixture, RestartKeepsRegisters) {
+  store.SetRegister(5, 55);
+  store.Close();
+  Store restarted;
+  ASSERT_EQ(restarted.Create(name.c_str()), 0);
+  EXPECT_EQ(restarted.GetRegister(5), 55);
+
+  //  A reader built for another layout is refused
+  Modbus::SharedRegisterReader<kRegisterCount, 32> other;
+  EXPECT_EQ(other.Open(name.c_str()), -EPROTO);
+  Modbus::SharedRegisterReader<kRegisterCount + 1, kRegionSize> larger;
+  EXPECT_EQ(larger.Open(name.c_str()), -EPROTO);
+}
+
+TEST_F(SharedFixture, SecondWriterIsRefused) {
+  Store second;
+  EXPECT_EQ(second.Create(name.c_str()), -EWOULDBLOCK);
+  store.Close();
+  EXPECT_EQ(second.Create(name.c_str()), 0);
+}
+
+TEST_F(SharedFixture, SlaveReadsAreNeverTorn) {
+  //  Function 3 copies through GetRegisters while the application publishes
+  //  across two regions
+  std::atomic<bool> done{false};
+  std::thread writer_thread([&] {
+    std::array<uint16_t, kRegionSize * 2> values{};
+    for (uint16_t i = 1; !done.load(std::memory_order_acquire); i++) {
+      values.fill(i);
+      store.Write(kRegionSize / 2, values.size(), values.data());
+    }
+  });
+  std::array<uint8_t, kRegionSize * 4> bytes{};
+  for (std::size_t read = 0; read < 5000; read++) {
+    ArrayView<uint8_t> view{bytes.size(), bytes.data()};
+    store.GetRegisters(kRegionSize / 2, kRegionSize * 2, &view);
+    for (std::size_t i = 2; i < bytes.size(); i++) {
+      ASSERT_EQ(bytes[i], bytes[i % 2]);
+    }
+  }
+  done.store(true, std::memory_order_release);
+  writer_thread.join();
+}
+
+TEST_F(SharedFixture, RegionsAreNeverTorn) {
+  //  Every write sets a whole region to one value, a reader must always see
+  //  a region with all registers equal
+  std::atomic<bool> done{false};
+  std::thread reader_thread([&] {
+    Reader reader;
+    ASSERT_EQ(reader.Open(name.c_str()), 0);
+    std::array<uint16_t, kRegionSize * 2> values{};
+    while (!done.load(std::memory_order_acquire)) {
+      ASSERT_TRUE(reader.Read(kRegionSize, values.size(), values.data()));
+      for (std::size_t i = 1; i < kRegionSize; i++) {
+        ASSERT_EQ(values[i], values[0]);
+        ASSERT_EQ(values[kRegionSize + i], values[kRegionSize]);
+      }
+    }
+  });
+  for (uint16_t i = 1; i <= 5000; i++) {
+    const std::vector<uint16_t> values(kRegionSize * 2, i);
+    ASSERT_EQ(slave.WriteRegisters(kRegionSize, values),
+              Modbus::Exception::kAck);
+  }
+  done.store(true, std::memory_order_release);
+  reader_thread.join();
+  EXPECT_EQ(store.GetGeneration(), 5000u);
+}
+}  //  namespace ModbusTests
@@ -0,0 +1,126 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        test_SparseRegisterDataStore.cpp
+ * Description:
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <ArrayView/ArrayView.h>
+#include <Modbus/DataStores/SparseRegisterDataStore.h>
+#include <Modbus/RegisterControl.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "TestSlave.h"
+
+namespace ModbusTests {
+using Modbus::SparseRegisterDataStore;
+using Modbus::UnallocatedRead;
+
+struct SparseFixture : public ::testing::Test {
+  using Controller = Modbus::HoldingRegisterController<SparseRegisterDataStore>;
+
+  SparseRegisterDataStore store{};
+  SparseRegisterDataStore strict{UnallocatedRead::kIllegalAddress};
+  Controller controller{&store};
+  Controller strict_controller{&strict};
+  TestSlave<Controller> slave{controller};
+  TestSlave<Controller> strict_slave{strict_controller};
+};
+
+TEST_F(SparseFixture, PagesAllocatedOnWrite) {
+  EXPECT_EQ(store.GetAllocatedPageCount(), 0u);
+  EXPECT_EQ(slave.ReadRegisters(40000, 3), (std::vector<uint16_t>{0, 0, 0}));
+  EXPECT_EQ(store.GetAllocatedPageCount(), 0u);
+
+  const std::array<uint16_t, 4> addresses{0, 1000, 30000, 40000};
+  for (const uint16_t address : addresses) {
+    ASSERT_EQ(slave.WriteRegisters(address, {address, 0xa5a5}),
+              Modbus::Exception::kAck);
+  }
+  EXPECT_EQ(store.GetAllocatedPageCount(), 4u);
+  EXPECT_EQ(store.GetRegister(30000), 30000);
+  EXPECT_EQ(slave.ReadRegisters(39999, 4),
+            (std::vector<uint16_t>{0, 40000, 0xa5a5, 0}));
+  EXPECT_FALSE(store.IsAllocated(2000));
+
+  //  The last register of the address space
+  store.SetRegister(0xffff, 7);
+  EXPECT_EQ(store.GetRegister(0xffff), 7);
+  EXPECT_EQ(store.MaskWriteRegister(0xff00, 0x00f0, 0x0005), 0x0005);
+  EXPECT_EQ(store.GetAllocatedPageCount(), 5u);
+}
+
+TEST_F(SparseFixture, WritesAcrossPages) {
+  std::vector<uint16_t> values(SparseRegisterDataStore::kPageSize + 20);
+  for (std::size_t i = 0; i < values.size(); i++) {
+    values[i] = static_cast<uint16_t>(i + 1);
+  }
+  std::vector<uint8_t> bytes;
+  for (const uint16_t value : values) {
+    bytes.push_back(static_cast<uint8_t>(value >> 8));
+    bytes.push_back(static_cast<uint8_t>(value & 0xff));
+  }
+  //  Starts 10 registers before the end of the second page
+  const std::size_t address = 2 * SparseRegisterDataStore::kPageSize - 10;
+  store.SetRegisters(address, values.size(),
+                     ArrayView<const uint8_t>{bytes.size(), bytes.data()});
+  EXPECT_EQ(store.GetAllocatedPageCount(), 3u);
+  for (std::size_t i = 0; i < values.size(); i++) {
+    EXPECT_EQ(store.GetRegister(address + i), values[i]);
+  }
+
+  std::vector<uint8_t> read(bytes.size() + 4);
+  ArrayView<uint8_t> view{read.size(), read.data()};
+  store.GetRegisters(address - 2, values.size() + 2, &view);
+  EXPECT_EQ(read[0], 0);
+  EXPECT_EQ(read[3], 0);
+  EXPECT_TRUE(std::equal(bytes.begin(), bytes.end(), read.begin() + 4));
+}
+
+TEST_F(SparseFixture, UnallocatedReadsAreIllegal) {
+  strict.Allocate(1000, 10);
+  EXPECT_EQ(strict.GetAllocatedPageCount(), 1u);
+  EXPECT_EQ(strict_slave.ReadRegisters(1000, 2), (std::vector<uint16_t>{0, 0}));
+  //  The rest of the page reads as zero, the next page is not there
+  EXPECT_EQ(strict_slave.ReadRegisters(768, 1), (std::vector<uint16_t>{0}));
+  Modbus::ReadMultipleHoldingRegistersCommand::FillFrame(1023, 2,
+                                                         &strict_slave.frame);
+  EXPECT_EQ(strict_slave.Run(), Modbus::Exception::kIllegalDataAddress);
+
+  //  Writes are always accepted and allocate
+  EXPECT_EQ(strict_slave.WriteRegisters(1024, {5}), Modbus::Exception::kAck);
+  EXPECT_EQ(strict_slave.ReadRegisters(1023, 2), (std::vector<uint16_t>{0, 5}));
+}
+
+TEST_F(SparseFixture, ConcurrentFirstWrites) {
+  //  Threads racing to allocate the same pages end with one page each
+  std::vector<std::thread> threads;
+  for (uint16_t t = 0; t < 4; t++) {
+    threads.emplace_back([this, t] {
+      for (std::size_t page = 0; page < 64; page++) {
+        store.SetRegister(page * SparseRegisterDataStore::kPageSize + t, t);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(store.GetAllocatedPageCount(), 64u);
+  for (std::size_t page = 0; page < 64; page++) {
+    for (uint16_t t = 0; t < 4; t++) {
+      const std::size_t address = page * SparseRegisterDataStore::kPageSize;
+      EXPECT_EQ(store.GetRegister(address + t), t);
+    }
+  }
+}
+}  //  namespace ModbusTests
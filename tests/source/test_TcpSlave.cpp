@@ -0,0 +1,315 @@
+/* Copyright (C) 2020 Electrooptical Innovations
+ * ----------------------------------------------------------------------
+ * Project:      Modbus
+ * Title:        test_TcpSlave.cpp
+ * Description:
+ *
+ * $Date:        13. May 2020
+ * $Revision:    V.1.0.1
+ * ----------------------------------------------------------------------
+ */
+
+#include <ArrayView/ArrayView.h>
+#include <Modbus/DataStores/RegisterDataStore.h>
+#include <Modbus/DeviceIdentification.h>
+#include <Modbus/Modbus.h>
+#include <Modbus/ModbusTcp/ModbusTcpProtocol.h>
+#include <Modbus/ModbusTcp/ModbusTcpSlave.h>
+#include <Modbus/RegisterControl.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+namespace ModbusTests {
+
+struct TcpSlaveFixture : public ::testing::Test {
+  static const constexpr uint8_t kUnitId = 0x11;
+  static const constexpr std::size_t kRegisterCount = 64;
+
+  using HoldingController =
+      Modbus::HoldingRegisterController<Modbus::RegisterDataStore>;
+  std::array<uint16_t, kRegisterCount> registers{};
+  Modbus::RegisterDataStore holding_map{registers.data(), registers.size()};
+  HoldingController holding_register_controller{&holding_map};
+
+  using InputController =
+      Modbus::InputRegisterController<Modbus::RegisterDataStore>;
+  std::array<uint16_t, kRegisterCount> input_registers{};
+  Modbus::RegisterDataStore input_map{input_registers.data(),
+                                      input_registers.size()};
+  InputController input_register_controller{&input_map};
+
+  Modbus::ProtocolTcpSlave<HoldingController, InputController> slave{
+      kUnitId, holding_register_controller, input_register_controller};
+  Modbus::TcpSlaveSession session;
+
+  std::array<uint8_t, 256> adu{};
+  std::size_t adu_length = 0;
+
+  void MakeReadRequest(const uint16_t transaction_id, const uint16_t address,
+                       const uint16_t count) {
+    std::array<uint8_t, 64> command_data{};
+    Modbus::Frame packet{
+        ArrayView<uint8_t>{command_data.size(), command_data.data()}};
+    packet.address = kUnitId;
+    Modbus::ReadMultipleHoldingRegistersCommand::FillFrame(address, count,
+                                                           &packet);
+    ArrayView<uint8_t> buffer{adu.size(), adu.data()};
+    adu_length = Modbus::ProtocolTcp::Frame(packet, transaction_id, &buffer);
+  }
+
+  void Feed(void) {
+    const auto result =
+        session.ProcessBytes(ArrayView<const uint8_t>{adu_length, adu.data()});
+    EXPECT_EQ(result.bytes_used, adu_length);
+    EXPECT_TRUE(result.packet_received);
+  }
+};
+
+TEST_F(TcpSlaveFixture, MbapHeaderRoundTrip) {
+  Modbus::MbapHeader header{};
+  header.transaction_id = 0x1234;
+  header.length = 6;
+  header.unit_id = 0xff;
+  std::array<uint8_t, Modbus::MbapHeader::kHeaderLength> data{};
+  header.Write(data.data());
+  EXPECT_EQ(data[0], 0x12);
+  EXPECT_EQ(data[1], 0x34);
+  const auto read = Modbus::MbapHeader::Read(data.data());
+  EXPECT_EQ(read.transaction_id, header.transaction_id);
+  EXPECT_EQ(read.length, header.length);
+  EXPECT_EQ(read.unit_id, header.unit_id);
+  EXPECT_TRUE(read.IsValid());
+}
+
+TEST_F(TcpSlaveFixture, ReadHoldingRegisters) {
+  registers[2] = 0xdead;
+  registers[3] = 0xbeef;
+  MakeReadRequest(0x0102, 2, 2);
+  Feed();
+  EXPECT_EQ(session.GetFrameIn().function,
+            Modbus::Function::kReadMultipleHoldingRegisters);
+  slave.ProcessMessage(&session);
+  ASSERT_TRUE(session.GetResponseValid());
+
+  const std::array<uint8_t, 13> expected{
+      0x01, 0x02, 0x00, 0x00, 0x00, 0x07, kUnitId,
+      0x03, 0x04, 0xde, 0xad, 0xbe, 0xef};
+  const auto tx = session.GetTxData();
+  ASSERT_EQ(tx.size(), expected.size());
+  for (std::size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(tx[i], expected[i]);
+  }
+}
+
+TEST_F(TcpSlaveFixture, RequestSplitAcrossReads) {
+  MakeReadRequest(7, 0, 1);
+  std::size_t index = 0;
+  Modbus::ReadResult result{};
+  while (index < adu_length) {
+    result = session.ProcessBytes(ArrayView<const uint8_t>{1, &adu[index]});
+    index += result.bytes_used;
+  }
+  EXPECT_TRUE(result.packet_received);
+  EXPECT_EQ(session.ctx_.GetHeader().transaction_id, 7);
+}
+
+TEST_F(TcpSlaveFixture, PipelinedRequestsStopAtEachAdu) {
+  MakeReadRequest(1, 0, 1);
+  std::array<uint8_t, 512> stream{};
+  std::copy(adu.begin(), adu.begin() + adu_length, stream.begin());
+  MakeReadRequest(2, 1, 1);
+  std::copy(adu.begin(), adu.begin() + adu_length, &stream[adu_length]);
+
+  auto result = session.ProcessBytes(
+      ArrayView<const uint8_t>{2 * adu_length, stream.data()});
+  EXPECT_EQ(result.bytes_used, adu_length);
+  EXPECT_EQ(session.ctx_.GetHeader().transaction_id, 1);
+  session.Reset();
+  result = session.ProcessBytes(
+      ArrayView<const uint8_t>{adu_length, &stream[adu_length]});
+  EXPECT_TRUE(result.packet_received);
+  EXPECT_EQ(session.ctx_.GetHeader().transaction_id, 2);
+}
+
+TEST_F(TcpSlaveFixture, UnknownFunctionGetsException) {
+  //  Function 0x41 is not a Modbus function, read with no data
+  const std::array<uint8_t, 8> request{0, 9, 0, 0, 0, 2, kUnitId, 0x41};
+  session.ProcessBytes(
+      ArrayView<const uint8_t>{request.size(), request.data()});
+  ASSERT_TRUE(session.PacketReceived());
+  slave.ProcessMessage(&session);
+  const auto tx = session.GetTxData();
+  ASSERT_EQ(tx.size(), 9u);
+  EXPECT_EQ(tx[1], 9);
+  EXPECT_EQ(tx[5], 3);
+  EXPECT_EQ(tx[7], 0xc1);
+  EXPECT_EQ(tx[8], static_cast<uint8_t>(Modbus::Exception::kIllegalFunction));
+}
+
+TEST_F(TcpSlaveFixture, IllegalAddressGetsException) {
+  MakeReadRequest(3, kRegisterCount, 1);
+  Feed();
+  slave.ProcessMessage(&session);
+  const auto tx = session.GetTxData();
+  ASSERT_EQ(tx.size(), 9u);
+  EXPECT_EQ(tx[7], 0x83);
+  EXPECT_EQ(tx[8],
+            static_cast<uint8_t>(Modbus::Exception::kIllegalDataAddress));
+}
+
+TEST_F(TcpSlaveFixture, TruncatedRequestGetsException) {
+  //  Write register 5 = 7, then the same function with no address or value
+  //  must not run on the bytes left in the frame
+  const std::array<uint8_t, 12> write{0, 1,       0, 0, 0,    6,
+                                      kUnitId, 6, 0, 5, 0x00, 0x07};
+  session.ProcessBytes(ArrayView<const uint8_t>{write.size(), write.data()});
+  slave.ProcessMessage(&session);
+  EXPECT_EQ(registers[5], 7);
+  session.Reset();
+  registers[5] = 0;
+
+  const std::array<uint8_t, 8> truncated{0, 2, 0, 0, 0, 2, kUnitId, 6};
+  session.ProcessBytes(
+      ArrayView<const uint8_t>{truncated.size(), truncated.data()});
+  ASSERT_TRUE(session.PacketReceived());
+  slave.ProcessMessage(&session);
+  EXPECT_EQ(registers[5], 0);
+  const auto tx = session.GetTxData();
+  ASSERT_EQ(tx.size(), 9u);
+  EXPECT_EQ(tx[7], 0x86);
+  EXPECT_EQ(tx[8], static_cast<uint8_t>(Modbus::Exception::kIllegalDataValue));
+}
+
+TEST_F(TcpSlaveFixture, ByteCountPastDataGetsException) {
+  //  Write 2 registers from 0, byte count 4 with only 2 data bytes sent
+  const std::array<uint8_t, 15> request{
+      0, 3, 0, 0, 0, 9, kUnitId, 0x10, 0, 0, 0, 2, 4, 0x12, 0x34};
+  session.ProcessBytes(
+      ArrayView<const uint8_t>{request.size(), request.data()});
+  ASSERT_TRUE(session.PacketReceived());
+  slave.ProcessMessage(&session);
+  EXPECT_EQ(registers[0], 0);
+  const auto tx = session.GetTxData();
+  ASSERT_EQ(tx.size(), 9u);
+  EXPECT_EQ(tx[7], 0x90);
+  EXPECT_EQ(tx[8], static_cast<uint8_t>(Modbus::Exception::kIllegalDataValue));
+}
+
+TEST_F(TcpSlaveFixture, BadProtocolIdIsError) {
+  const std::array<uint8_t, 12> request{0, 1,       0, 1, 0, 6,
+                                        kUnitId, 3, 0, 0, 0, 1};
+  const auto result = session.ProcessBytes(
+      ArrayView<const uint8_t>{request.size(), request.data()});
+  EXPECT_TRUE(session.HasError());
+  EXPECT_FALSE(result.packet_received);
+  EXPECT_EQ(result.bytes_used, Modbus::MbapHeader::kHeaderLength);
+}
+
+TEST_F(TcpSlaveFixture, UnitIdFilter) {
+  MakeReadRequest(4, 0, 1);
+  adu[Modbus::MbapHeader::kUnitId] = kUnitId + 1;
+  Feed();
+  slave.ProcessMessage(&session, true);
+  EXPECT_FALSE(session.GetResponseValid());
+  slave.ProcessMessage(&session);
+  EXPECT_TRUE(session.GetResponseValid());
+}
+
+//  Handler answering function 17 with the code the test sets
+struct ReturnCodeHandler {
+  static const constexpr std::array<Modbus::Function, 1> kFunctions{
+      Modbus::Function::kReportSlaveId};
+  int32_t code = 0;
+  Modbus::Exception ValidateFrame(const Modbus::Frame &) const {
+    return Modbus::Exception::kAck;
+  }
+  int32_t ReadFrame(const Modbus::Frame &frame, Modbus::Response *response) {
+    response->operator[](Modbus::Command::ResponsePacket::kSlaveAddress) =
+        frame.address;
+    response->operator[](Modbus::Command::ResponsePacket::kFunction) =
+        static_cast<uint8_t>(frame.function);
+    response->SetLength(Modbus::Command::ResponsePacket::kHeaderEnd + 1);
+    return code;
+  }
+};
+
+TEST(TcpSlaveReturnCode, MatchesRtuSlave) {
+  static const constexpr uint8_t kUnitId = 0x11;
+  ReturnCodeHandler handler;
+  Modbus::ProtocolTcpSlave<ReturnCodeHandler> slave{kUnitId, handler};
+  Modbus::TcpSlaveSession session;
+
+  std::array<uint8_t, 16> command_data{};
+  Modbus::Frame packet{kUnitId, Modbus::Function::kReportSlaveId, 0,
+                       ArrayView<uint8_t>{command_data.size(),
+                                          command_data.data()}};
+  std::array<uint8_t, 64> adu{};
+  ArrayView<uint8_t> buffer{adu.size(), adu.data()};
+  const std::size_t adu_length = Modbus::ProtocolTcp::Frame(packet, 1, &buffer);
+  auto run = [&](const int32_t code) {
+    handler.code = code;
+    session.Reset();
+    session.ProcessBytes(ArrayView<const uint8_t>{adu_length, adu.data()});
+    EXPECT_TRUE(session.PacketReceived());
+    slave.ProcessMessage(&session);
+  };
+
+  run(0);
+  ASSERT_TRUE(session.GetResponseValid());
+  EXPECT_EQ(session.GetTxData()[Modbus::MbapHeader::kHeaderLength],
+            static_cast<uint8_t>(Modbus::Function::kReportSlaveId));
+
+  //  Not answered, as for diagnostics leaving listen only mode
+  run(1);
+  EXPECT_FALSE(session.GetResponseValid());
+
+  run(-1);
+  ASSERT_TRUE(session.GetResponseValid());
+  const auto tx = session.GetTxData();
+  EXPECT_EQ(tx[Modbus::MbapHeader::kHeaderLength],
+            static_cast<uint8_t>(Modbus::Function::kReportSlaveId) +
+                Modbus::kStatusResponseAddValue);
+  EXPECT_EQ(tx[Modbus::MbapHeader::kHeaderLength + 1],
+            static_cast<uint8_t>(Modbus::Exception::kSlaveDeviceFailure));
+}
+
+TEST(TcpSlaveDeviceIdentification, FullSizeObjectFitsTheAdu) {
+  //  One object of the most bytes a response holds fills the ADU, the crc
+  //  of the prebuilt rtu frame must not be copied after it
+  static const constexpr uint8_t kUnitId = 0x11;
+  using Identification = Modbus::DeviceIdentification<>;
+  using Controller = Modbus::DeviceIdentificationController<Identification>;
+  Identification identification;
+  ASSERT_TRUE(identification.AddObject(
+      Modbus::DeviceObjectId::kMajorMinorRevision, "1.2"));
+  ASSERT_TRUE(
+      identification.AddObject(Modbus::DeviceObjectId::kVendorName, "EOI"));
+  ASSERT_TRUE(
+      identification.AddObject(Modbus::DeviceObjectId::kProductCode, "MB-1"));
+  const std::string value(
+      Modbus::ReadDeviceIdentificationCommand::kMaxObjectBytes - 2, 'x');
+  ASSERT_TRUE(identification.AddObject(
+      0x80, reinterpret_cast<const uint8_t *>(value.data()), value.size()));
+  ASSERT_TRUE(identification.Build(kUnitId));
+  Controller controller{&identification};
+  Modbus::ProtocolTcpSlave<Controller> slave{kUnitId, controller};
+  Modbus::TcpSlaveSession session;
+
+  const std::array<uint8_t, 11> request{0,       5,    0,    0,    0,   5,
+                                        kUnitId, 0x2b, 0x0e, 0x03, 0x80};
+  session.ProcessBytes(
+      ArrayView<const uint8_t>{request.size(), request.data()});
+  ASSERT_TRUE(session.PacketReceived());
+  slave.ProcessMessage(&session);
+  const auto tx = session.GetTxData();
+  ASSERT_EQ(tx.size(), Modbus::MbapHeader::kMaxAduLength);
+  EXPECT_EQ(tx[7], 0x2b);
+  EXPECT_EQ(tx[13], 1);  //  Number of objects
+  EXPECT_EQ(tx[14], 0x80);
+  EXPECT_EQ(tx[15], value.size());
+  EXPECT_EQ(tx[tx.size() - 1], 'x');
+}
+}  //  namespace ModbusTests